@@ -0,0 +1,459 @@
+#include "array.h"
+#include "gc.h"
+#include "memory.h"
+#include "parallel.h"
+#include "vm.h"
+
+// Vectors of ARRAY_LANES doubles; aligned(8) so any element can start one.
+typedef double number_vec_t __attribute__((vector_size(ARRAY_LANES * sizeof(double)), aligned(8)));
+typedef int64_t mask_vec_t __attribute__((vector_size(ARRAY_LANES * sizeof(int64_t)), aligned(8)));
+
+/**
+ * allocate_buffer - Allocates uninitialized element storage.
+ * @capacity: Number of elements.
+ * @packed: Whether the elements are unboxed doubles.
+ *
+ * Return: The buffer.
+ */
+static obj_buffer_t *allocate_buffer(int capacity, bool packed)
+{
+	size_t element = packed ? sizeof(double) : sizeof(value_t);
+	obj_buffer_t *buffer = (obj_buffer_t *)allocate_object(sizeof(obj_buffer_t) + element * capacity,
+							       OBJ_BUFFER);
+	buffer->capacity = capacity;
+	return (buffer);
+}
+
+/**
+ * new_array - Allocates an array of zeros (packed) or nulls.
+ * @count: Number of elements, at most ARRAY_MAX.
+ * @packed: Whether the array starts out packed.
+ *
+ * The array is kept on the VM stack while its storage is allocated, so
+ * callers must re-read any pointer they hold into the stack.
+ *
+ * Return: The array value.
+ */
+value_t new_array(int count, bool packed)
+{
+	obj_array_t *array = (obj_array_t *)allocate_object(sizeof(obj_array_t), OBJ_ARRAY);
+	array->packed = packed;
+	array->count = 0;
+	array->buffer = NULL;
+
+	push(obj_val(&array->obj));
+	obj_buffer_t *buffer = allocate_buffer(count, packed);
+	array = as_array(pop());
+
+	if (packed)
+		memset(buffer->numbers, 0, sizeof(double) * count);
+	else
+		for (int i = 0; i < count; i++)
+			((value_t *)buffer->numbers)[i] = null_val();
+	array->buffer = buffer;
+	array->count = count;
+	write_barrier(&array->obj, obj_val(&buffer->obj));
+	return (obj_val(&array->obj));
+}
+
+bool is_array(value_t value) { return (is_obj_type(value, OBJ_ARRAY)); }
+
+obj_array_t *as_array(value_t value) { return ((obj_array_t *)as_obj(value)); }
+
+/**
+ * array_get - Reads an element.
+ * @array: The array.
+ * @index: A valid index.
+ *
+ * Return: The element, boxed if the array is packed.
+ */
+value_t array_get(const obj_array_t *array, int index)
+{
+	if (array->packed)
+		return (number_val(array_numbers(array)[index]));
+	return (array_values(array)[index]);
+}
+
+/**
+ * move_elements - Moves an array's elements into new storage.
+ * @array: Slot holding the array; it must be a GC root.
+ * @capacity: Capacity of the new storage, at least the array's length.
+ * @packed: Whether the new storage is packed; an array only becomes
+ *          packed if every element is a number.
+ */
+static void move_elements(value_t *array, int capacity, bool packed)
+{
+	obj_buffer_t *buffer = allocate_buffer(capacity, packed);
+	obj_array_t *owner = as_array(*array);
+	int count = owner->count;
+
+	if (packed && owner->packed)
+		memcpy(buffer->numbers, array_numbers(owner), sizeof(double) * count);
+	else if (packed)
+		for (int i = 0; i < count; i++)
+			buffer->numbers[i] = as_number(array_values(owner)[i]);
+	else if (owner->packed)
+		for (int i = 0; i < count; i++)
+			((value_t *)buffer->numbers)[i] = number_val(array_numbers(owner)[i]);
+	else
+		memcpy(buffer->numbers, array_values(owner), sizeof(value_t) * count);
+
+	owner->buffer = buffer;
+	owner->packed = packed;
+	write_barrier(&owner->obj, obj_val(&buffer->obj));
+}
+
+/**
+ * array_set - Writes an element.
+ * @array: Slot holding the array; it must be a GC root.
+ * @index: A valid index.
+ * @value: The value; it must live in a GC root too.
+ *
+ * Storing something other than a number into a packed array converts it
+ * to tagged storage first.
+ */
+void array_set(value_t *array, int index, const value_t *value)
+{
+	obj_array_t *owner = as_array(*array);
+	if (owner->packed && is_number(*value))
+	{
+		array_numbers(owner)[index] = as_number(*value);
+		return;
+	}
+	if (owner->packed)
+	{
+		move_elements(array, owner->buffer->capacity, false);
+		owner = as_array(*array);
+	}
+	array_values(owner)[index] = *value;
+	write_barrier(&owner->obj, *value);
+}
+
+/**
+ * array_push - Appends an element, growing the storage as needed.
+ * @array: Slot holding the array; it must be a GC root.
+ * @value: The value; it must live in a GC root too.
+ */
+void array_push(value_t *array, const value_t *value)
+{
+	obj_array_t *owner = as_array(*array);
+	bool packed = owner->packed && is_number(*value);
+	if (owner->count == owner->buffer->capacity || packed != owner->packed)
+	{
+		int capacity = owner->buffer->capacity;
+		if (owner->count == capacity)
+			capacity = (int)grow_capacity(capacity);
+		move_elements(array, capacity, packed);
+		owner = as_array(*array);
+	}
+	owner->count++;
+	array_set(array, owner->count - 1, value);
+}
+
+/**
+ * array_pack - Switches an array of numbers back to packed storage.
+ * @array: Slot holding the array; it must be a GC root.
+ *
+ * Return: false if some element is not a number.
+ */
+bool array_pack(value_t *array)
+{
+	obj_array_t *owner = as_array(*array);
+	if (owner->packed)
+		return (true);
+	for (int i = 0; i < owner->count; i++)
+		if (!is_number(array_values(owner)[i]))
+			return (false);
+	move_elements(array, owner->buffer->capacity, true);
+	return (true);
+}
+
+/**
+ * print_array - Prints an array as a bracketed list.
+ * @array: The array.
+ *
+ * An array nested in itself is printed as [...].
+ */
+void print_array(const obj_array_t *array)
+{
+	static const obj_array_t *printing[64];
+	static int depth;
+
+	for (int i = 0; i < depth; i++)
+	{
+		if (printing[i] == array)
+		{
+			fputs("[...]", stdout);
+			return;
+		}
+	}
+	if (depth == (int)(sizeof(printing) / sizeof(printing[0])))
+	{
+		fputs("[...]", stdout);
+		return;
+	}
+
+	printing[depth++] = array;
+	putchar('[');
+	for (int i = 0; i < array->count; i++)
+	{
+		if (i > 0)
+			fputs(", ", stdout);
+		print_value(array_get(array, i));
+	}
+	putchar(']');
+	depth--;
+}
+
+// Picks lanes from a where the mask is set and from b elsewhere.
+#define SELECT_LANES(mask, a, b) ((number_vec_t)(((mask) & (mask_vec_t)(a)) | (~(mask) & (mask_vec_t)(b))))
+
+/**
+ * sum_numbers - Adds up a run of doubles.
+ * @numbers: The doubles.
+ * @count: How many.
+ *
+ * Two vector accumulators hide the latency of the additions, so the result
+ * may differ from a left-to-right sum in the last bits.
+ *
+ * Return: The sum.
+ */
+double sum_numbers(const double *numbers, int count)
+{
+	const number_vec_t *vectors = (const number_vec_t *)numbers;
+	number_vec_t even = {0}, odd = {0};
+	int blocks = count / (2 * ARRAY_LANES);
+	for (int i = 0; i < blocks; i++)
+	{
+		even += vectors[2 * i];
+		odd += vectors[2 * i + 1];
+	}
+	even += odd;
+
+	double sum = 0;
+	for (int lane = 0; lane < ARRAY_LANES; lane++)
+		sum += even[lane];
+	for (int i = blocks * 2 * ARRAY_LANES; i < count; i++)
+		sum += numbers[i];
+	return (sum);
+}
+
+/**
+ * extreme_numbers - Finds the smallest or largest of a run of doubles.
+ * @numbers: The doubles; there is at least one.
+ * @count: How many.
+ * @largest: Look for the largest rather than the smallest.
+ *
+ * Which value wins is unspecified when there are NaNs.
+ *
+ * Return: The extreme value.
+ */
+static double extreme_numbers(const double *numbers, int count, bool largest)
+{
+	double best = numbers[0];
+	int i = 0;
+	if (count >= ARRAY_LANES)
+	{
+		const number_vec_t *vectors = (const number_vec_t *)numbers;
+		number_vec_t lanes = vectors[0];
+		for (i = 1; i < count / ARRAY_LANES; i++)
+		{
+			mask_vec_t better = largest ? vectors[i] > lanes : vectors[i] < lanes;
+			lanes = SELECT_LANES(better, vectors[i], lanes);
+		}
+		i *= ARRAY_LANES;
+		best = lanes[0];
+		for (int lane = 1; lane < ARRAY_LANES; lane++)
+			if (largest ? lanes[lane] > best : lanes[lane] < best)
+				best = lanes[lane];
+	}
+	for (; i < count; i++)
+		if (largest ? numbers[i] > best : numbers[i] < best)
+			best = numbers[i];
+	return (best);
+}
+
+double min_numbers(const double *numbers, int count) { return (extreme_numbers(numbers, count, false)); }
+
+double max_numbers(const double *numbers, int count) { return (extreme_numbers(numbers, count, true)); }
+
+/**
+ * dot_numbers - Computes the dot product of two runs of doubles.
+ * @a: The first run.
+ * @b: The second run, as long as the first.
+ * @count: Their length.
+ *
+ * Return: The sum of the pairwise products.
+ */
+double dot_numbers(const double *a, const double *b, int count)
+{
+	const number_vec_t *x = (const number_vec_t *)a, *y = (const number_vec_t *)b;
+	number_vec_t even = {0}, odd = {0};
+	int blocks = count / (2 * ARRAY_LANES);
+	for (int i = 0; i < blocks; i++)
+	{
+		even += x[2 * i] * y[2 * i];
+		odd += x[2 * i + 1] * y[2 * i + 1];
+	}
+	even += odd;
+
+	double sum = 0;
+	for (int lane = 0; lane < ARRAY_LANES; lane++)
+		sum += even[lane];
+	for (int i = blocks * 2 * ARRAY_LANES; i < count; i++)
+		sum += a[i] * b[i];
+	return (sum);
+}
+
+// Applies an element-wise operator a vector at a time, then to the tail.
+#define COMBINE(op, x, y, x_tail, y_tail)                                               \
+	do                                                                               \
+	{                                                                                \
+		int i = 0;                                                               \
+		for (; i + ARRAY_LANES <= count; i += ARRAY_LANES)                       \
+			*(number_vec_t *)(dst + i) = (x) op (y);                         \
+		for (; i < count; i++)                                                   \
+			dst[i] = (x_tail) op (y_tail);                                   \
+	} while (0)
+
+#define COMBINE_ALL(x, y, x_tail, y_tail)                                               \
+	switch (op)                                                                      \
+	{                                                                                \
+	case ARRAY_ADD:                                                                  \
+		COMBINE(+, x, y, x_tail, y_tail);                                        \
+		break;                                                                   \
+	case ARRAY_SUBTRACT:                                                             \
+		COMBINE(-, x, y, x_tail, y_tail);                                        \
+		break;                                                                   \
+	case ARRAY_MULTIPLY:                                                             \
+		COMBINE(*, x, y, x_tail, y_tail);                                        \
+		break;                                                                   \
+	case ARRAY_DIVIDE:                                                               \
+		COMBINE(/, x, y, x_tail, y_tail);                                        \
+		break;                                                                   \
+	}
+
+/**
+ * combine_numbers - Applies an operator to two runs of doubles pairwise.
+ * @op: The operator.
+ * @dst: Where the results go; may be one of the operands.
+ * @a: Left operands.
+ * @b: Right operands.
+ * @count: Number of elements.
+ */
+void combine_numbers(array_op_t op, double *dst, const double *a, const double *b, int count)
+{
+	COMBINE_ALL(*(const number_vec_t *)(a + i), *(const number_vec_t *)(b + i), a[i], b[i]);
+}
+
+/**
+ * combine_scalar - Applies an operator between a run of doubles and one double.
+ * @op: The operator.
+ * @dst: Where the results go; may be @a.
+ * @a: The run.
+ * @b: The single operand.
+ * @reversed: Whether @b is the left operand.
+ * @count: Number of elements.
+ */
+void combine_scalar(array_op_t op, double *dst, const double *a, double b, bool reversed, int count)
+{
+	number_vec_t broadcast = {0};
+	broadcast += b;
+	if (reversed)
+	{
+		COMBINE_ALL(broadcast, *(const number_vec_t *)(a + i), b, a[i]);
+	}
+	else
+	{
+		COMBINE_ALL(*(const number_vec_t *)(a + i), broadcast, a[i], b);
+	}
+}
+
+// Maps a double to an integer with IEEE 754's total order: -0 before 0,
+// and NaNs after infinities (or before, if their sign is set).
+static inline uint64_t order_key(double number)
+{
+	uint64_t bits;
+	memcpy(&bits, &number, sizeof(bits));
+	return (bits >> 63 ? ~bits : bits | (uint64_t)1 << 63);
+}
+
+static int compare_numbers(const void *a, const void *b)
+{
+	uint64_t x = order_key(*(const double *)a), y = order_key(*(const double *)b);
+	return ((x > y) - (x < y));
+}
+
+/**
+ * struct sort_job_s - A sort spread over the pool.
+ * @from: The runs being merged.
+ * @to: Where the merged runs go.
+ * @count: Number of elements.
+ * @width: Length of the runs in @from.
+ */
+typedef struct sort_job_s
+{
+	double *from;
+	double *to;
+	int count;
+	int width;
+} sort_job_t;
+
+// Sorts one block, a run of the first pass.
+static void sort_block(void *context, int block)
+{
+	sort_job_t *job = context;
+	int start = block * job->width;
+	int end = start + job->width < job->count ? start + job->width : job->count;
+	qsort(job->from + start, end - start, sizeof(double), compare_numbers);
+}
+
+// Merges the runs 2 * pair and 2 * pair + 1 into one.
+static void merge_runs(void *context, int pair)
+{
+	sort_job_t *job = context;
+	int start = 2 * pair * job->width;
+	int middle = start + job->width < job->count ? start + job->width : job->count;
+	int end = middle + job->width < job->count ? middle + job->width : job->count;
+	int i = start, j = middle, k = start;
+	while (i < middle && j < end)
+		job->to[k++] = order_key(job->from[j]) < order_key(job->from[i]) ? job->from[j++] : job->from[i++];
+	memcpy(job->to + k, job->from + i, sizeof(double) * (middle - i));
+	k += middle - i;
+	memcpy(job->to + k, job->from + j, sizeof(double) * (end - j));
+}
+
+/**
+ * sort_numbers - Sorts doubles in IEEE 754's total order.
+ * @numbers: The doubles.
+ * @count: Number of doubles.
+ *
+ * Long runs are cut into blocks that the pool sorts, then merges in
+ * pairs. The order is total, so the result is the same however the work
+ * is split.
+ */
+void sort_numbers(double *numbers, int count)
+{
+	if (count < PARALLEL_MIN || parallel_threads() < 2)
+	{
+		qsort(numbers, count, sizeof(double), compare_numbers);
+		return;
+	}
+
+	double *scratch = malloc(sizeof(double) * count);
+	if (scratch == NULL)
+		exit(1);
+	sort_job_t job = {numbers, scratch, count, PARALLEL_BLOCK};
+	run_parallel((count + PARALLEL_BLOCK - 1) / PARALLEL_BLOCK, sort_block, &job);
+	for (; job.width < count; job.width *= 2)
+	{
+		int pairs = (count + 2 * job.width - 1) / (2 * job.width);
+		run_parallel(pairs, merge_runs, &job);
+		double *merged = job.to;
+		job.to = job.from;
+		job.from = merged;
+	}
+	if (job.from != numbers)
+		memcpy(numbers, job.from, sizeof(double) * count);
+	free(scratch);
+}
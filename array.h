@@ -0,0 +1,88 @@
+#pragma once
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "common.h"
+#include "object.h"
+
+#define ARRAY_LANES 4           // Doubles per SIMD vector in the bulk kernels.
+#define ARRAY_MAX (1 << 26)     // Most elements an array may hold.
+
+/**
+ * struct obj_buffer_s - Element storage of an array, map or instance.
+ * @obj: Object header.
+ * @capacity: Number of elements that fit.
+ * @numbers: The elements; packed arrays store doubles here, other arrays
+ *           reinterpret the space as value_t.
+ *
+ * Description: Storage is an object of its own so an array can grow
+ * without moving. A buffer has no references of its own: its elements are
+ * traced through the object that owns it, and maps lay out their
+ * entries and control bytes in the space themselves.
+ */
+typedef struct obj_buffer_s
+{
+	obj_t obj;
+	int capacity;
+	double numbers[];
+} obj_buffer_t;
+
+/**
+ * struct obj_array_s - A growable array.
+ * @obj: Object header.
+ * @packed: Whether every element is a number, stored unboxed.
+ * @count: Number of elements.
+ * @buffer: The elements.
+ *
+ * Description: Arrays whose elements are all numbers are stored as
+ * contiguous doubles, which the bulk builtins and element-wise operators
+ * process a vector at a time. Storing anything else into one converts it
+ * to tagged values for good.
+ */
+typedef struct obj_array_s
+{
+	obj_t obj;
+	bool packed;
+	int count;
+	obj_buffer_t *buffer;
+} obj_array_t;
+
+/**
+ * enum array_op_s - Element-wise arithmetic on packed arrays.
+ * @ARRAY_ADD: a + b.
+ * @ARRAY_SUBTRACT: a - b.
+ * @ARRAY_MULTIPLY: a * b.
+ * @ARRAY_DIVIDE: a / b.
+ */
+typedef enum array_op_s
+{
+	ARRAY_ADD,
+	ARRAY_SUBTRACT,
+	ARRAY_MULTIPLY,
+	ARRAY_DIVIDE
+} array_op_t;
+
+value_t new_array(int count, bool packed);
+bool is_array(value_t value);
+obj_array_t *as_array(value_t value);
+value_t array_get(const obj_array_t *array, int index);
+void array_set(value_t *array, int index, const value_t *value);
+void array_push(value_t *array, const value_t *value);
+bool array_pack(value_t *array);
+void print_array(const obj_array_t *array);
+
+double sum_numbers(const double *numbers, int count);
+double min_numbers(const double *numbers, int count);
+double max_numbers(const double *numbers, int count);
+double dot_numbers(const double *a, const double *b, int count);
+void combine_numbers(array_op_t op, double *dst, const double *a, const double *b, int count);
+void combine_scalar(array_op_t op, double *dst, const double *a, double b, bool reversed, int count);
+void sort_numbers(double *numbers, int count);
+
+// Returns the unboxed elements of a packed array.
+static inline double *array_numbers(const obj_array_t *array) { return (array->buffer->numbers); }
+
+// Returns the elements of an array that is not packed.
+static inline value_t *array_values(const obj_array_t *array) { return ((value_t *)array->buffer->numbers); }
+
+#endif // ARRAY_H
@@ -0,0 +1,654 @@
+#include <math.h>
+#include "batch.h"
+#include "error.h"
+#include "intrinsic.h"
+#include "memory.h"
+
+// Vectors of BATCH_LANES lanes; aligned(8) so input columns need no padding.
+typedef double number_vec_t __attribute__((vector_size(BATCH_LANES * sizeof(double)), aligned(8)));
+typedef int64_t mask_vec_t __attribute__((vector_size(BATCH_LANES * sizeof(int64_t)), aligned(8)));
+
+#define ONE_BITS 0x3ff0000000000000LL // Bit pattern of 1.0
+
+/**
+ * struct plan_value_s - A stack slot seen while lowering a chunk.
+ * @type: The slot's type, identical for every row.
+ * @slot: Where the slot's vector lives.
+ */
+typedef struct plan_value_s
+{
+	value_type_t type;
+	batch_slot_t slot;
+} plan_value_t;
+
+/**
+ * struct planner_s - State used while lowering a chunk into a plan.
+ * @plan: The plan being built.
+ * @inputs: The input columns the plan is built for.
+ * @stack: Abstract value stack.
+ * @depth: Number of values on @stack.
+ * @free_scratch: Scratch vectors no longer referenced by the stack.
+ * @free_count: Number of entries in @free_scratch.
+ * @op_capacity: Capacity of plan->ops.
+ */
+typedef struct planner_s
+{
+	batch_plan_t *plan;
+	const column_t *inputs;
+	plan_value_t *stack;
+	int depth;
+	int *free_scratch;
+	int free_count;
+	int op_capacity;
+} planner_t;
+
+static void kernel_add(void *dst, const void *a, const void *b, size_t n)
+{
+	number_vec_t *d = dst;
+	const number_vec_t *x = a, *y = b;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = x[i] + y[i];
+}
+
+static void kernel_subtract(void *dst, const void *a, const void *b, size_t n)
+{
+	number_vec_t *d = dst;
+	const number_vec_t *x = a, *y = b;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = x[i] - y[i];
+}
+
+static void kernel_multiply(void *dst, const void *a, const void *b, size_t n)
+{
+	number_vec_t *d = dst;
+	const number_vec_t *x = a, *y = b;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = x[i] * y[i];
+}
+
+static void kernel_divide(void *dst, const void *a, const void *b, size_t n)
+{
+	number_vec_t *d = dst;
+	const number_vec_t *x = a, *y = b;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = x[i] / y[i];
+}
+
+static void kernel_negate(void *dst, const void *a, const void *b, size_t n)
+{
+	(void)b;
+	number_vec_t *d = dst;
+	const number_vec_t *x = a;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = -x[i];
+}
+
+static void kernel_equal(void *dst, const void *a, const void *b, size_t n)
+{
+	mask_vec_t *d = dst;
+	const number_vec_t *x = a, *y = b;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = x[i] == y[i];
+}
+
+static void kernel_greater(void *dst, const void *a, const void *b, size_t n)
+{
+	mask_vec_t *d = dst;
+	const number_vec_t *x = a, *y = b;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = x[i] > y[i];
+}
+
+static void kernel_less(void *dst, const void *a, const void *b, size_t n)
+{
+	mask_vec_t *d = dst;
+	const number_vec_t *x = a, *y = b;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = x[i] < y[i];
+}
+
+static void kernel_not(void *dst, const void *a, const void *b, size_t n)
+{
+	(void)b;
+	mask_vec_t *d = dst;
+	const mask_vec_t *x = a;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = ~x[i];
+}
+
+// Booleans compare as numbers (true is 1), as in the scalar VM.
+static void kernel_mask_to_number(void *dst, const void *a, const void *b, size_t n)
+{
+	(void)b;
+	mask_vec_t *d = dst;
+	const mask_vec_t *x = a;
+	for (size_t i = 0; i < n / BATCH_LANES; i++)
+		d[i] = x[i] & ONE_BITS;
+}
+
+// Widens a bool input column into lane masks.
+static void kernel_mask_from_bool(void *dst, const void *a, const void *b, size_t n)
+{
+	(void)b;
+	int64_t *d = dst;
+	const bool *x = a;
+	for (size_t i = 0; i < n; i++)
+		d[i] = -(int64_t)x[i];
+}
+
+// Math intrinsics run lane by lane, through the same code as the VM.
+#define INTRINSIC_KERNEL(opcode)                                                        \
+	static void kernel_##opcode(void *dst, const void *a, const void *b, size_t n)   \
+	{                                                                                \
+		double *d = dst;                                                         \
+		const double *x = a, *y = b;                                             \
+		for (size_t i = 0; i < n; i++)                                           \
+			d[i] = apply_intrinsic(opcode, x[i], intrinsic_arity(opcode) == 2 ? y[i] : 0); \
+	}
+
+INTRINSIC_KERNEL(OP_SQRT)
+INTRINSIC_KERNEL(OP_ABS)
+INTRINSIC_KERNEL(OP_FLOOR)
+INTRINSIC_KERNEL(OP_CEIL)
+INTRINSIC_KERNEL(OP_ROUND)
+INTRINSIC_KERNEL(OP_EXP)
+INTRINSIC_KERNEL(OP_LOG)
+INTRINSIC_KERNEL(OP_SIN)
+INTRINSIC_KERNEL(OP_COS)
+INTRINSIC_KERNEL(OP_TAN)
+INTRINSIC_KERNEL(OP_ASIN)
+INTRINSIC_KERNEL(OP_ACOS)
+INTRINSIC_KERNEL(OP_ATAN)
+INTRINSIC_KERNEL(OP_MIN)
+INTRINSIC_KERNEL(OP_MAX)
+INTRINSIC_KERNEL(OP_POW)
+INTRINSIC_KERNEL(OP_ATAN2)
+
+static const batch_kernel_t intrinsic_kernels[] = {
+	[OP_SQRT] = kernel_OP_SQRT,
+	[OP_ABS] = kernel_OP_ABS,
+	[OP_FLOOR] = kernel_OP_FLOOR,
+	[OP_CEIL] = kernel_OP_CEIL,
+	[OP_ROUND] = kernel_OP_ROUND,
+	[OP_EXP] = kernel_OP_EXP,
+	[OP_LOG] = kernel_OP_LOG,
+	[OP_SIN] = kernel_OP_SIN,
+	[OP_COS] = kernel_OP_COS,
+	[OP_TAN] = kernel_OP_TAN,
+	[OP_ASIN] = kernel_OP_ASIN,
+	[OP_ACOS] = kernel_OP_ACOS,
+	[OP_ATAN] = kernel_OP_ATAN,
+	[OP_MIN] = kernel_OP_MIN,
+	[OP_MAX] = kernel_OP_MAX,
+	[OP_POW] = kernel_OP_POW,
+	[OP_ATAN2] = kernel_OP_ATAN2,
+};
+
+static batch_slot_t no_slot(void)
+{
+	batch_slot_t slot = {SLOT_NONE, 0};
+	return slot;
+}
+
+/**
+ * add_constant_vector - Broadcasts a 64-bit pattern into a constant vector.
+ * @planner: The planner.
+ * @bits: The lane value (a double's bits, or a mask).
+ *
+ * Return: The slot of the new constant.
+ */
+static batch_slot_t add_constant_vector(planner_t *planner, int64_t bits)
+{
+	batch_plan_t *plan = planner->plan;
+	size_t old_size = (size_t)plan->constant_count * BATCH_SIZE;
+	plan->constants = grow_array(plan->constants, old_size, old_size + BATCH_SIZE, sizeof(double));
+
+	double *lanes = plan->constants + old_size;
+	for (int i = 0; i < BATCH_SIZE; i++)
+		memcpy(&lanes[i], &bits, sizeof(bits));
+
+	batch_slot_t slot = {SLOT_CONSTANT, (uint16_t)plan->constant_count++};
+	return slot;
+}
+
+static void push_plan_value(planner_t *planner, value_type_t type, batch_slot_t slot)
+{
+	planner->stack[planner->depth].type = type;
+	planner->stack[planner->depth].slot = slot;
+	planner->depth++;
+}
+
+static plan_value_t pop_plan_value(planner_t *planner)
+{
+	return planner->stack[--planner->depth];
+}
+
+// Returns a scratch vector to the free list once nothing refers to it.
+static void release(planner_t *planner, plan_value_t value)
+{
+	if (value.slot.kind == SLOT_SCRATCH)
+		planner->free_scratch[planner->free_count++] = value.slot.index;
+}
+
+/**
+ * emit_kernel - Appends a kernel writing into a fresh scratch vector.
+ * @planner: The planner.
+ * @kernel: The kernel.
+ * @a: First operand.
+ * @b: Second operand, or no_slot().
+ *
+ * The destination is allocated before the operands are released, so a
+ * kernel never writes the vector it is reading.
+ *
+ * Return: The destination slot.
+ */
+static batch_slot_t emit_kernel(planner_t *planner, batch_kernel_t kernel, batch_slot_t a, batch_slot_t b)
+{
+	batch_plan_t *plan = planner->plan;
+	batch_slot_t dst = {SLOT_SCRATCH, 0};
+
+	if (planner->free_count > 0)
+		dst.index = (uint16_t)planner->free_scratch[--planner->free_count];
+	else
+		dst.index = (uint16_t)plan->scratch_count++;
+
+	if (plan->op_count == planner->op_capacity)
+	{
+		int old_capacity = planner->op_capacity;
+		planner->op_capacity = (int)grow_capacity(old_capacity);
+		plan->ops = grow_array(plan->ops, old_capacity, planner->op_capacity, sizeof(batch_op_t));
+	}
+	batch_op_t *op = &plan->ops[plan->op_count++];
+	op->kernel = kernel;
+	op->dst = dst;
+	op->a = a;
+	op->b = b;
+	return dst;
+}
+
+// Applies a kernel to popped operands and pushes its result.
+static void apply(planner_t *planner, batch_kernel_t kernel, value_type_t type, plan_value_t a, plan_value_t b)
+{
+	batch_slot_t dst = emit_kernel(planner, kernel, a.slot, b.slot);
+	release(planner, a);
+	release(planner, b);
+	push_plan_value(planner, type, dst);
+}
+
+// Converts a boolean operand to a number, as comparisons do.
+static plan_value_t as_number_operand(planner_t *planner, plan_value_t value)
+{
+	if (value.type != VAL_BOOLEAN)
+		return value;
+	plan_value_t number = {VAL_NUMBER, emit_kernel(planner, kernel_mask_to_number, value.slot, no_slot())};
+	release(planner, value);
+	return number;
+}
+
+/**
+ * lower_instruction - Lowers one instruction into kernels.
+ * @planner: The planner.
+ * @chunk: The chunk being lowered.
+ * @offset: Offset of the instruction.
+ *
+ * Return: false if the instruction has no vector form, or would raise a
+ * type error, in which case the scalar VM must run it.
+ */
+static bool lower_instruction(planner_t *planner, chunk_t *chunk, int offset)
+{
+	uint8_t opcode = chunk->code[offset];
+	plan_value_t a, b;
+
+	switch (opcode)
+	{
+	case OP_CONSTANT:
+	{
+		value_t value = chunk->constants.values[chunk->code[offset + 1]];
+		int64_t bits;
+		if (is_number(value))
+		{
+			memcpy(&bits, &value.as.number, sizeof(bits));
+			push_plan_value(planner, VAL_NUMBER, add_constant_vector(planner, bits));
+		}
+		else if (is_bool(value))
+			push_plan_value(planner, VAL_BOOLEAN, add_constant_vector(planner, -(int64_t)as_bool(value)));
+		else if (is_null(value))
+			push_plan_value(planner, VAL_NULL, no_slot());
+		else
+			return false;
+		return true;
+	}
+	case OP_INPUT:
+	{
+		uint8_t index = chunk->code[offset + 1];
+		batch_slot_t input = {SLOT_INPUT, index};
+		if (index >= planner->plan->input_count)
+			return false;
+		if (planner->inputs[index].type == VAL_NUMBER)
+			push_plan_value(planner, VAL_NUMBER, input);
+		else
+			push_plan_value(planner, VAL_BOOLEAN, emit_kernel(planner, kernel_mask_from_bool, input, no_slot()));
+		return true;
+	}
+	case OP_NULL:
+		push_plan_value(planner, VAL_NULL, no_slot());
+		return true;
+	case OP_TRUE:
+	case OP_FALSE:
+		push_plan_value(planner, VAL_BOOLEAN, add_constant_vector(planner, opcode == OP_TRUE ? -1 : 0));
+		return true;
+	case OP_NOT:
+		a = pop_plan_value(planner);
+		if (a.type == VAL_BOOLEAN)
+		{
+			apply(planner, kernel_not, VAL_BOOLEAN, a, (plan_value_t){VAL_NULL, no_slot()});
+			return true;
+		}
+		// Numbers are always truthy and null always falsey.
+		release(planner, a);
+		push_plan_value(planner, VAL_BOOLEAN, add_constant_vector(planner, a.type == VAL_NULL ? -1 : 0));
+		return true;
+	case OP_NEGATE:
+		a = pop_plan_value(planner);
+		if (a.type != VAL_NUMBER)
+			return false;
+		apply(planner, kernel_negate, VAL_NUMBER, a, (plan_value_t){VAL_NULL, no_slot()});
+		return true;
+	case OP_ADD:
+	case OP_SUBTRACT:
+	case OP_MULTIPLY:
+	case OP_DIVIDE:
+	{
+		static const batch_kernel_t kernels[] = {
+			[OP_ADD] = kernel_add,
+			[OP_SUBTRACT] = kernel_subtract,
+			[OP_MULTIPLY] = kernel_multiply,
+			[OP_DIVIDE] = kernel_divide,
+		};
+		b = pop_plan_value(planner);
+		a = pop_plan_value(planner);
+		if (a.type != VAL_NUMBER || b.type != VAL_NUMBER)
+			return false;
+		apply(planner, kernels[opcode], VAL_NUMBER, a, b);
+		return true;
+	}
+	case OP_EQUAL:
+	case OP_GREATER:
+	case OP_LESS:
+	{
+		b = pop_plan_value(planner);
+		a = pop_plan_value(planner);
+		if (a.type == VAL_NULL || b.type == VAL_NULL)
+		{
+			if (opcode != OP_EQUAL)
+				return false;
+			release(planner, a);
+			release(planner, b);
+			bool equal = a.type == b.type;
+			push_plan_value(planner, VAL_BOOLEAN, add_constant_vector(planner, equal ? -1 : 0));
+			return true;
+		}
+		a = as_number_operand(planner, a);
+		b = as_number_operand(planner, b);
+		batch_kernel_t kernel = opcode == OP_EQUAL ? kernel_equal
+				      : opcode == OP_GREATER ? kernel_greater : kernel_less;
+		apply(planner, kernel, VAL_BOOLEAN, a, b);
+		return true;
+	}
+	default:
+		if (!is_intrinsic(opcode))
+			return false;
+		b = intrinsic_arity(opcode) == 2 ? pop_plan_value(planner) : (plan_value_t){VAL_NUMBER, no_slot()};
+		a = pop_plan_value(planner);
+		if (a.type != VAL_NUMBER || b.type != VAL_NUMBER)
+			return false;
+		apply(planner, intrinsic_kernels[opcode], VAL_NUMBER, a, b);
+		return true;
+	}
+}
+
+/**
+ * new_batch_plan - Lowers a chunk for evaluation over columns of a given type.
+ * @chunk: The compiled chunk.
+ * @inputs: The input columns (only their types are used).
+ * @input_count: Number of input columns.
+ *
+ * Return: The plan. If the chunk cannot be vectorized the plan is still
+ * usable and falls back to the scalar VM.
+ */
+batch_plan_t *new_batch_plan(chunk_t *chunk, const column_t *inputs, int input_count)
+{
+	batch_plan_t *plan = calloc(1, sizeof(batch_plan_t));
+	if (plan == NULL)
+		exit(1);
+	plan->input_count = input_count;
+	plan->input_types = malloc(sizeof(value_type_t) * (input_count > 0 ? input_count : 1));
+	if (plan->input_types == NULL)
+		exit(1);
+	for (int i = 0; i < input_count; i++)
+		plan->input_types[i] = inputs[i].type;
+
+	planner_t planner = {0};
+	planner.plan = plan;
+	planner.inputs = inputs;
+	planner.stack = malloc(sizeof(plan_value_t) * (chunk->count + 1));
+	planner.free_scratch = malloc(sizeof(int) * (chunk->count + 1));
+	if (planner.stack == NULL || planner.free_scratch == NULL)
+		exit(1);
+
+	plan->vectorized = false;
+	for (int offset = 0; offset < chunk->count; offset += instruction_length(chunk->code[offset]))
+	{
+		if (chunk->code[offset] == OP_RETURN)
+		{
+			plan_value_t result = pop_plan_value(&planner);
+			plan->result = result.slot;
+			plan->result_type = result.type;
+			plan->vectorized = true;
+			break;
+		}
+		if (!lower_instruction(&planner, chunk, offset))
+			break;
+	}
+
+	free(planner.stack);
+	free(planner.free_scratch);
+	return plan;
+}
+
+/**
+ * free_batch_plan - Releases a plan.
+ * @plan: The plan; may be NULL.
+ */
+void free_batch_plan(batch_plan_t *plan)
+{
+	if (plan == NULL)
+		return;
+	free(plan->input_types);
+	free(plan->ops);
+	free(plan->constants);
+	free(plan);
+}
+
+/**
+ * batch_plan_matches - Checks whether a plan fits the given input columns.
+ * @plan: The plan.
+ * @inputs: The input columns.
+ * @input_count: Number of input columns.
+ *
+ * Return: true if the plan was built for columns of these types.
+ */
+bool batch_plan_matches(const batch_plan_t *plan, const column_t *inputs, int input_count)
+{
+	if (plan->input_count != input_count)
+		return false;
+	for (int i = 0; i < input_count; i++)
+		if (plan->input_types[i] != inputs[i].type)
+			return false;
+	return true;
+}
+
+/**
+ * run_scalar - Evaluates a chunk row by row on the scalar VM.
+ * @chunk: The chunk.
+ * @inputs: The input columns.
+ * @input_count: Number of input columns.
+ * @rows: Number of rows.
+ * @output: The output column.
+ *
+ * Used for chunks that have no vector lowering. The output type is that of
+ * the first non-null result; null results are written as NaN or false.
+ * Results that fit in neither column type are a runtime error.
+ *
+ * Return: The result of the evaluation.
+ */
+static interpret_result_t run_scalar(chunk_t *chunk, const column_t *inputs, int input_count,
+				     size_t rows, column_t *output)
+{
+	value_t *row = malloc(sizeof(value_t) * (input_count > 0 ? input_count : 1));
+	if (row == NULL)
+		exit(1);
+
+	output->type = VAL_NULL;
+	vm.inputs = row;
+	vm.input_count = input_count;
+	interpret_result_t result = INTERPRET_OK;
+	for (size_t i = 0; i < rows; i++)
+	{
+		for (int j = 0; j < input_count; j++)
+			row[j] = inputs[j].type == VAL_NUMBER ? number_val(inputs[j].numbers[i])
+							      : bool_val(inputs[j].booleans[i]);
+
+		result = interpret_chunk(chunk);
+		if (result != INTERPRET_OK)
+			goto done;
+
+		value_t value = vm.result;
+		if (!is_number(value) && !is_bool(value) && !is_null(value))
+		{
+			report_error("Batch results must be numbers or booleans.");
+			result = INTERPRET_RUNTIME_ERROR;
+			goto done;
+		}
+		if (output->type == VAL_NULL && !is_null(value))
+		{
+			output->type = value.type;
+			for (size_t k = 0; k < i; k++)
+				output->type == VAL_NUMBER ? (void)(output->numbers[k] = NAN)
+							   : (void)(output->booleans[k] = false);
+		}
+		if (output->type == VAL_NUMBER)
+			output->numbers[i] = is_number(value) ? as_number(value) : NAN;
+		else if (output->type == VAL_BOOLEAN)
+			output->booleans[i] = is_bool(value) && as_bool(value);
+	}
+
+done:
+	// The row dies here, so the VM must not keep pointing at it.
+	vm.inputs = NULL;
+	vm.input_count = 0;
+	free(row);
+	return (result);
+}
+
+/**
+ * resolve - Finds the vector an operand refers to in the current block.
+ * @slot: The operand.
+ * @plan: The plan.
+ * @scratch: The scratch vectors.
+ * @columns: The input vectors of the current block.
+ *
+ * Return: The vector's address, or NULL for SLOT_NONE.
+ */
+static inline void *resolve(batch_slot_t slot, batch_plan_t *plan, double *scratch, const void **columns)
+{
+	switch (slot.kind)
+	{
+	case SLOT_SCRATCH:
+		return scratch + (size_t)slot.index * BATCH_SIZE;
+	case SLOT_INPUT:
+		return (void *)columns[slot.index];
+	case SLOT_CONSTANT:
+		return plan->constants + (size_t)slot.index * BATCH_SIZE;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * run_batch - Evaluates a chunk over every row of a set of input columns.
+ * @plan: A plan built by new_batch_plan() for these column types.
+ * @chunk: The chunk the plan was built from.
+ * @inputs: The input columns.
+ * @rows: Number of rows.
+ * @output: The output column; both of its arrays must hold @rows values.
+ *
+ * Rows are processed BATCH_SIZE at a time; each kernel of the plan runs
+ * over the whole block before the next one starts. Full blocks read the
+ * input columns in place; the final partial block is copied into padded
+ * buffers so kernels never need a scalar tail loop.
+ *
+ * Return: The result of the evaluation.
+ */
+interpret_result_t run_batch(batch_plan_t *plan, chunk_t *chunk, const column_t *inputs,
+			     size_t rows, column_t *output)
+{
+	if (!plan->vectorized)
+		return run_scalar(chunk, inputs, plan->input_count, rows, output);
+
+	int input_count = plan->input_count;
+	size_t scratch_size = (size_t)(plan->scratch_count > 0 ? plan->scratch_count : 1) * BATCH_SIZE;
+	double *scratch = aligned_alloc(64, scratch_size * sizeof(double));
+	double *tails = aligned_alloc(64, (size_t)(input_count > 0 ? input_count : 1) * BATCH_SIZE * sizeof(double));
+	const void **columns = malloc(sizeof(void *) * (input_count > 0 ? input_count : 1));
+	if (scratch == NULL || tails == NULL || columns == NULL)
+		exit(1);
+
+	output->type = plan->result_type;
+	for (size_t start = 0; start < rows; start += BATCH_SIZE)
+	{
+		size_t n = rows - start < BATCH_SIZE ? rows - start : BATCH_SIZE;
+		size_t padded = (n + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+
+		for (int i = 0; i < input_count; i++)
+		{
+			const column_t *column = &inputs[i];
+			size_t width = column->type == VAL_NUMBER ? sizeof(double) : sizeof(bool);
+			const char *data = column->type == VAL_NUMBER ? (const char *)column->numbers
+								      : (const char *)column->booleans;
+			if (n == BATCH_SIZE)
+			{
+				columns[i] = data + start * width;
+				continue;
+			}
+			char *tail = (char *)(tails + (size_t)i * BATCH_SIZE);
+			memcpy(tail, data + start * width, n * width);
+			memset(tail + n * width, 0, (padded - n) * width);
+			columns[i] = tail;
+		}
+
+		for (int i = 0; i < plan->op_count; i++)
+		{
+			batch_op_t *op = &plan->ops[i];
+			op->kernel(resolve(op->dst, plan, scratch, columns), resolve(op->a, plan, scratch, columns),
+				   resolve(op->b, plan, scratch, columns), padded);
+		}
+
+		const void *result = resolve(plan->result, plan, scratch, columns);
+		if (plan->result_type == VAL_NUMBER)
+		{
+			memcpy(output->numbers + start, result, n * sizeof(double));
+		}
+		else if (plan->result_type == VAL_BOOLEAN)
+		{
+			const int64_t *lanes = result;
+			for (size_t i = 0; i < n; i++)
+				output->booleans[start + i] = lanes[i] != 0;
+		}
+	}
+
+	free(scratch);
+	free(tails);
+	free(columns);
+	return INTERPRET_OK;
+}
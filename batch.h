@@ -0,0 +1,101 @@
+#pragma once
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include "common.h"
+#include "chunk.h"
+#include "vm.h"
+
+#define BATCH_SIZE 1024 // Rows per block; a multiple of BATCH_LANES.
+#define BATCH_LANES 4   // Doubles per SIMD vector.
+
+/**
+ * struct column_s - A column of input or output values.
+ * @type: VAL_NUMBER or VAL_BOOLEAN (VAL_NULL for an all-null output).
+ * @numbers: The values of a number column.
+ * @booleans: The values of a boolean column.
+ *
+ * Description: Inputs only need the array matching their type. An output
+ * column must provide both arrays, sized for every row; the evaluator sets
+ * @type and fills the matching array.
+ */
+typedef struct column_s
+{
+	value_type_t type;
+	double *numbers;
+	bool *booleans;
+} column_t;
+
+typedef void (*batch_kernel_t)(void *dst, const void *a, const void *b, size_t n);
+
+/**
+ * enum batch_slot_kind_s - Where an operand of a batch operation lives.
+ * @SLOT_SCRATCH: A scratch vector owned by the plan.
+ * @SLOT_INPUT: An input column, used in place.
+ * @SLOT_CONSTANT: A constant broadcast to a full vector at plan time.
+ * @SLOT_NONE: No operand (null values, unused operands).
+ */
+typedef enum batch_slot_kind_s
+{
+	SLOT_SCRATCH,
+	SLOT_INPUT,
+	SLOT_CONSTANT,
+	SLOT_NONE
+} batch_slot_kind_t;
+
+typedef struct batch_slot_s
+{
+	uint8_t kind;
+	uint16_t index;
+} batch_slot_t;
+
+typedef struct batch_op_s
+{
+	batch_kernel_t kernel;
+	batch_slot_t dst;
+	batch_slot_t a;
+	batch_slot_t b;
+} batch_op_t;
+
+/**
+ * struct batch_plan_s - A chunk lowered to a straight line of vector kernels.
+ * @vectorized: False when the chunk uses opcodes with no vector kernel, in
+ *              which case the plan evaluates row by row on the scalar VM.
+ * @input_types: Column types the plan was built for.
+ * @input_count: Number of inputs.
+ * @ops: The kernels to run over every block, in order.
+ * @op_count: Number of kernels.
+ * @scratch_count: Number of scratch vectors needed.
+ * @constants: Broadcast constant vectors.
+ * @constant_count: Number of constant vectors.
+ * @result: Where the result lives after the last kernel.
+ * @result_type: The type of the result column.
+ *
+ * Description: Types in a column never vary between rows, so the type of
+ * every stack slot is known once the input column types are; the plan
+ * resolves all type dispatch up front and each opcode becomes one kernel
+ * over a BATCH_SIZE block of rows. Booleans are carried as 64-bit lane
+ * masks (all ones for true) so comparisons feed straight into them.
+ */
+typedef struct batch_plan_s
+{
+	bool vectorized;
+	value_type_t *input_types;
+	int input_count;
+	batch_op_t *ops;
+	int op_count;
+	int scratch_count;
+	double *constants;
+	int constant_count;
+	batch_slot_t result;
+	value_type_t result_type;
+} batch_plan_t;
+
+batch_plan_t *new_batch_plan(chunk_t *chunk, const column_t *inputs, int input_count);
+void free_batch_plan(batch_plan_t *plan);
+bool batch_plan_matches(const batch_plan_t *plan, const column_t *inputs, int input_count);
+interpret_result_t run_batch(batch_plan_t *plan, chunk_t *chunk, const column_t *inputs,
+			     size_t rows, column_t *output);
+
+#endif // BATCH_H
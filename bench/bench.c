@@ -0,0 +1,1191 @@
+/**
+ * bench - microbenchmarks and generated workloads for charis
+ *
+ * Measures the scanner, the compiler and the VM in isolation, plus each
+ * opcode's dispatch cost. Results are printed as a table (ns/op and MB/s)
+ * and, with --json=PATH, written in a machine-readable form for comparing
+ * runs.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "chunk.h"
+#include "compiler.h"
+#include "format.h"
+#include "gc.h"
+#include "map.h"
+#include "object.h"
+#include "parallel.h"
+#include "scanner.h"
+#include "snapshot.h"
+#include "vm.h"
+
+#define MAX_RESULTS 128
+#define DISPATCH_REPEAT 1000
+#define MAP_KEYS 50000
+#define FORMAT_NUMBERS 4096
+
+/**
+ * struct bench_s - State handed to a benchmark body.
+ * @iterations: How many times the body must run its workload.
+ * @source: Source text, for scanner and compiler benchmarks.
+ * @chunk: Compiled chunk, for VM benchmarks.
+ * @path: A snapshot to start from, for startup benchmarks.
+ */
+typedef struct bench_s
+{
+	long iterations;
+	const char *source;
+	chunk_t *chunk;
+	const char *path;
+} bench_t;
+
+typedef void (*bench_fn)(bench_t *bench);
+
+/**
+ * struct result_s - One measured benchmark.
+ * @name: Benchmark name.
+ * @iterations: Number of iterations timed.
+ * @seconds: Total time for those iterations.
+ * @ops: Operations per iteration (tokens, instructions, ...).
+ * @bytes: Input bytes per iteration, or 0 when throughput is meaningless.
+ */
+typedef struct result_s
+{
+	char name[64];
+	long iterations;
+	double seconds;
+	double ops;
+	double bytes;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static int result_count;
+static double min_time = 0.25;
+static const char *filter;
+static FILE *out;
+
+// Returns a monotonic timestamp in seconds.
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * measure - Runs a benchmark body until it has run for at least min_time.
+ * @name: Benchmark name.
+ * @fn: Benchmark body.
+ * @bench: State for the body; its iteration count is chosen here.
+ * @ops: Operations per iteration.
+ * @bytes: Input bytes per iteration.
+ */
+static void measure(const char *name, bench_fn fn, bench_t *bench, double ops, double bytes)
+{
+	if (filter != NULL && strstr(name, filter) == NULL)
+		return;
+	if (result_count == MAX_RESULTS)
+		return;
+
+	double elapsed = 0;
+	bench->iterations = 1;
+	while (true)
+	{
+		double start = now();
+		fn(bench);
+		elapsed = now() - start;
+		if (elapsed >= min_time || bench->iterations > (1L << 40))
+			break;
+		double scale = elapsed > 0 ? 1.5 * min_time / elapsed : 100;
+		bench->iterations = (long)(bench->iterations * (scale > 100 ? 100 : scale)) + 1;
+	}
+
+	result_t *result = &results[result_count++];
+	snprintf(result->name, sizeof(result->name), "%s", name);
+	result->iterations = bench->iterations;
+	result->seconds = elapsed;
+	result->ops = ops;
+	result->bytes = bytes;
+
+	double ns_per_op = elapsed * 1e9 / ((double)bench->iterations * ops);
+	fprintf(out, "%-32s %12.2f ns/op", name, ns_per_op);
+	if (bytes > 0)
+		fprintf(out, " %10.2f MB/s", bytes * (double)bench->iterations / elapsed / 1e6);
+	fprintf(out, "\n");
+	fflush(out);
+}
+
+// Scans the whole source, returning the number of tokens.
+static long scan_all(const char *source)
+{
+	long tokens = 0;
+	init_scanner(source);
+	while (scan_token().type != TOKEN_EOF)
+		tokens++;
+	return tokens;
+}
+
+static void bench_scan(bench_t *bench)
+{
+	for (long i = 0; i < bench->iterations; i++)
+		scan_all(bench->source);
+}
+
+static void bench_compile(bench_t *bench)
+{
+	for (long i = 0; i < bench->iterations; i++)
+	{
+		chunk_t chunk;
+		init_chunk(&chunk);
+		compile(bench->source, &chunk);
+		free_chunk(&chunk);
+	}
+}
+
+static void bench_run(bench_t *bench)
+{
+	for (long i = 0; i < bench->iterations; i++)
+		interpret_chunk(bench->chunk);
+}
+
+// Counts the instructions in a chunk; chunks without jumps run each once.
+static double count_instructions(chunk_t *chunk)
+{
+	double count = 0;
+	for (int offset = 0; offset < chunk->count; offset += instruction_length(chunk->code[offset]))
+		count++;
+	return count;
+}
+
+/**
+ * append - Appends formatted text to a growing string.
+ * @buffer: The string, reallocated as needed.
+ * @length: Its current length.
+ * @capacity: Its current capacity.
+ * @text: The text to append.
+ */
+static void append(char **buffer, size_t *length, size_t *capacity, const char *text)
+{
+	size_t n = strlen(text);
+	if (*length + n + 1 > *capacity)
+	{
+		while (*length + n + 1 > *capacity)
+			*capacity = *capacity < 64 ? 64 : *capacity * 2;
+		*buffer = realloc(*buffer, *capacity);
+		if (*buffer == NULL)
+			exit(1);
+	}
+	memcpy(*buffer + *length, text, n + 1);
+	*length += n;
+}
+
+// A long expression made mostly of literals, 200 of them numeric.
+static char *gen_literals(int count)
+{
+	static const char *const literals[] = {"true", "false", "null"};
+	char *source = NULL;
+	size_t length = 0, capacity = 0;
+	char text[32];
+
+	append(&source, &length, &capacity, "1");
+	for (int i = 1; i < count; i++)
+	{
+		append(&source, &length, &capacity, i % 2 ? " == " : " != ");
+		if (i % (count / 200 + 1) == 0)
+		{
+			snprintf(text, sizeof(text), "%d.%d", i, i % 7);
+			append(&source, &length, &capacity, text);
+		}
+		else
+		{
+			append(&source, &length, &capacity, literals[i % 3]);
+		}
+		if (i % 16 == 0)
+			append(&source, &length, &capacity, "\n");
+	}
+	append(&source, &length, &capacity, "\n");
+	return source;
+}
+
+// An expression nested depth levels deep in parentheses.
+static char *gen_nested(int depth)
+{
+	char *source = NULL;
+	size_t length = 0, capacity = 0;
+
+	for (int i = 0; i < depth; i++)
+		append(&source, &length, &capacity, i % 2 ? "-(" : "(");
+	append(&source, &length, &capacity, "1");
+	for (int i = 0; i < depth; i++)
+		append(&source, &length, &capacity, ")");
+	append(&source, &length, &capacity, "\n");
+	return source;
+}
+
+// A left-to-right chain of terms arithmetic operations.
+static char *gen_arithmetic(int terms)
+{
+	static const char *const operators[] = {" + ", " * ", " - ", " / "};
+	char *source = NULL;
+	size_t length = 0, capacity = 0;
+	char text[32];
+
+	append(&source, &length, &capacity, "1");
+	for (int i = 1; i < terms; i++)
+	{
+		snprintf(text, sizeof(text), "%s%d", operators[i % 4], i % 97 + 1);
+		append(&source, &length, &capacity, text);
+	}
+	append(&source, &length, &capacity, "\n");
+	return source;
+}
+
+// A chain of terms whose right operands nest: 1 + (2 - (3 * (...))).
+static char *gen_right_nested(int terms)
+{
+	static const char *const operators[] = {" + (", " - (", " * (", " / ("};
+	char *source = NULL;
+	size_t length = 0, capacity = 0;
+	char text[32];
+
+	for (int i = 1; i < terms; i++)
+	{
+		snprintf(text, sizeof(text), "%d%s", i % 97 + 1, operators[i % 4]);
+		append(&source, &length, &capacity, text);
+	}
+	append(&source, &length, &capacity, "1");
+	for (int i = 1; i < terms; i++)
+		append(&source, &length, &capacity, ")");
+	append(&source, &length, &capacity, "\n");
+	return source;
+}
+
+// A literal under a chain of count prefix operators.
+static char *gen_unary(int count)
+{
+	char *source = NULL;
+	size_t length = 0, capacity = 0;
+
+	for (int i = 0; i < count; i++)
+		append(&source, &length, &capacity, i % 3 ? "-" : "!");
+	append(&source, &length, &capacity, "1\n");
+	return source;
+}
+
+// A script declaring count functions with long bodies, of which it calls two.
+static char *gen_library(int count)
+{
+	char *source = NULL;
+	size_t length = 0, capacity = 0;
+	char text[512];
+
+	for (int i = 0; i < count; i++)
+	{
+		snprintf(text, sizeof(text),
+			 "fn f%d(a, b) {\n"
+			 "\tlet x = a * %d + b;\n"
+			 "\tlet y = x - a / 2;\n"
+			 "\tif (x > y) { x = x + y; } else { y = y - x; }\n"
+			 "\tlet i = 0;\n"
+			 "\twhile (i < 10) { x = x + i * y; i = i + 1; }\n"
+			 "\treturn [x, y, x * y, x + y][%d];\n"
+			 "}\n",
+			 i, i % 89 + 1, i % 4);
+		append(&source, &length, &capacity, text);
+	}
+	snprintf(text, sizeof(text), "f0(1, 2) + f%d(3, 4)\n", count - 1);
+	append(&source, &length, &capacity, text);
+	return source;
+}
+
+// A chain of string concatenations, every intermediate a heap string.
+static char *gen_strings(int terms)
+{
+	char *source = NULL;
+	size_t length = 0, capacity = 0;
+	char text[32];
+
+	append(&source, &length, &capacity, "\"start\"");
+	for (int i = 1; i < terms; i++)
+	{
+		snprintf(text, sizeof(text), " + \"piece %d\"", i);
+		append(&source, &length, &capacity, text);
+		if (i % 8 == 0)
+			append(&source, &length, &capacity, "\n");
+	}
+	append(&source, &length, &capacity, "\n");
+	return source;
+}
+
+/**
+ * bench_workload - Benchmarks scanning, compiling and running one source.
+ * @name: Workload name.
+ * @source: The generated source; freed here.
+ */
+static void bench_workload(const char *name, char *source)
+{
+	char full_name[64];
+	bench_t bench = {0};
+	double bytes = (double)strlen(source);
+	chunk_t chunk;
+
+	double tokens = (double)scan_all(source);
+
+	bench.source = source;
+	snprintf(full_name, sizeof(full_name), "scan/%s", name);
+	measure(full_name, bench_scan, &bench, tokens, bytes);
+
+	snprintf(full_name, sizeof(full_name), "compile/%s", name);
+	measure(full_name, bench_compile, &bench, tokens, bytes);
+
+	init_chunk(&chunk);
+	if (compile(source, &chunk))
+	{
+		bench.chunk = &chunk;
+		snprintf(full_name, sizeof(full_name), "run/%s", name);
+		measure(full_name, bench_run, &bench, count_instructions(&chunk), 0);
+	}
+	else
+	{
+		fprintf(out, "%-32s failed to compile\n", name);
+	}
+	free_chunk(&chunk);
+	free(source);
+}
+
+/**
+ * bench_parse - Compiles expressions of growing length and depth.
+ *
+ * Each shape is compiled at ten and a hundred times the smallest size; the
+ * time per token stays flat when compiling is linear. The nested shapes
+ * are far deeper than the C stack would allow a recursive parser.
+ */
+static void bench_parse(void)
+{
+	static const struct
+	{
+		const char *name;
+		char *(*generate)(int size);
+	} shapes[] = {
+		{"flat", gen_arithmetic},
+		{"nested", gen_nested},
+		{"right", gen_right_nested},
+		{"unary", gen_unary},
+	};
+	char full_name[64];
+	bench_t bench = {0};
+
+	for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+	{
+		for (int size = 10000; size <= 1000000; size *= 10)
+		{
+			snprintf(full_name, sizeof(full_name), "parse/%s-%d", shapes[i].name, size);
+			if (filter != NULL && strstr(full_name, filter) == NULL)
+				continue;
+			char *source = shapes[i].generate(size);
+			bench.source = source;
+			measure(full_name, bench_compile, &bench, (double)scan_all(source), (double)strlen(source));
+			free(source);
+		}
+	}
+}
+
+// Compiles and runs a script, as starting a program does.
+static void bench_start(bench_t *bench)
+{
+	for (long i = 0; i < bench->iterations; i++)
+	{
+		chunk_t chunk;
+		init_chunk(&chunk);
+		if (compile(bench->source, &chunk))
+			interpret_chunk(&chunk);
+		free_chunk(&chunk);
+	}
+}
+
+/**
+ * bench_startup - Starts a script that calls two of its 200 functions.
+ *
+ * Compares compiling every body up front with compiling each on its first
+ * call. Ops are tokens of the script.
+ */
+static void bench_startup(void)
+{
+	bench_t bench = {0};
+	char *source = gen_library(200);
+	double tokens = (double)scan_all(source);
+
+	bench.source = source;
+	vm.eager = true;
+	measure("startup/library-eager", bench_start, &bench, tokens, (double)strlen(source));
+	vm.eager = false;
+	measure("startup/library-lazy", bench_start, &bench, tokens, (double)strlen(source));
+	free(source);
+}
+
+// Starts a fresh VM, from a snapshot when there is one, and runs the source.
+static void bench_restart(bench_t *bench)
+{
+	for (long i = 0; i < bench->iterations; i++)
+	{
+		free_vm();
+		init_vm();
+		if (bench->path != NULL)
+			load_snapshot(bench->path);
+		chunk_t chunk;
+		init_chunk(&chunk);
+		if (compile(bench->source, &chunk))
+			interpret_chunk(&chunk);
+		free_chunk(&chunk);
+	}
+}
+
+/**
+ * bench_snapshot - Starts the library of bench_startup() in a new VM.
+ *
+ * Compares compiling the script with loading a snapshot of its globals
+ * and compiling only the call. Ops are startups.
+ */
+static void bench_snapshot(void)
+{
+	bench_t bench = {0};
+	char *source = gen_library(200);
+	char path[] = "/tmp/charis-bench-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1)
+	{
+		fprintf(out, "%-32s no temporary file\n", "startup/snapshot");
+		free(source);
+		return;
+	}
+	close(fd);
+
+	free_vm();
+	init_vm();
+	vm.eager = true;
+	chunk_t chunk;
+	init_chunk(&chunk);
+	bool saved = compile(source, &chunk) && interpret_chunk(&chunk) == INTERPRET_OK && save_snapshot(path);
+	free_chunk(&chunk);
+
+	bench.source = source;
+	measure("startup/source", bench_restart, &bench, 1, (double)strlen(source));
+	if (saved)
+	{
+		bench.source = strrchr(source, '}') + 1; // The call after the last function.
+		bench.path = path;
+		measure("startup/snapshot", bench_restart, &bench, 1, 0);
+	}
+	unlink(path);
+	free(source);
+}
+
+/**
+ * bench_program - Benchmarks running one program.
+ * @name: Benchmark name.
+ * @source: The program.
+ * @ops: What one run counts as, e.g. its loop iterations.
+ */
+static void bench_program(const char *name, const char *source, double ops)
+{
+	bench_t bench = {0};
+	chunk_t chunk;
+
+	init_chunk(&chunk);
+	if (compile(source, &chunk))
+	{
+		bench.chunk = &chunk;
+		measure(name, bench_run, &bench, ops, 0);
+	}
+	else
+	{
+		fprintf(out, "%-32s failed to compile\n", name);
+	}
+	free_chunk(&chunk);
+}
+
+// Loops whose tests compile to fused compare-and-branch instructions.
+static void bench_loops(void)
+{
+	bench_program("loop/while", "{ let i = 0; while (i < 100000) i = i + 1; }", 100000);
+	bench_program("loop/for-sum",
+		      "{ let s = 0; for (let i = 0; i < 100000; i = i + 1) s = s + i; }", 100000);
+	bench_program("loop/nested",
+		      "{ let s = 0; for (let i = 0; i < 300; i = i + 1)"
+		      " for (let j = 0; j <= i; j = j + 1) if (j != i) s = s + 1; }",
+		      300.0 * 301 / 2);
+	bench_program("loop/math",
+		      "{ let s = 0; for (let i = 0; i < 100000; i = i + 1)"
+		      " s = s + sqrt(i) * abs(sin(i)) + min(i, 50000); }", 100000);
+}
+
+// Bulk builtins against the same reduction written as an indexed loop; ops are elements.
+static void bench_arrays(void)
+{
+	bench_program("array/index-loop",
+		      "{ let a = range(100000); let s = 0;"
+		      " for (let i = 0; i < 100000; i = i + 1) s = s + a[i]; }", 100000);
+	bench_program("array/sum",
+		      "{ let a = range(100000); let s = 0;"
+		      " for (let k = 0; k < 20; k = k + 1) s = s + sum(a); }", 2000000);
+	bench_program("array/dot",
+		      "{ let a = range(100000); let s = 0;"
+		      " for (let k = 0; k < 20; k = k + 1) s = s + dot(a, a); }", 2000000);
+	bench_program("array/axpy",
+		      "{ let a = range(100000); let b = a;"
+		      " for (let k = 0; k < 20; k = k + 1) b = a * 2 + b; }", 2000000);
+}
+
+/**
+ * bench_mapped - Sums mapped files of doubles and of ints like array/sum.
+ *
+ * Each program maps a file of 100000 elements and sums it 20 times; ops
+ * are elements. The files are fresh, so they are in the page cache.
+ */
+static void bench_mapped(void)
+{
+	static const struct
+	{
+		const char *type;
+		size_t size;
+	} files[] = {{"f64", sizeof(double)}, {"i32", sizeof(int32_t)}};
+	char name[64], source[256];
+
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+	{
+		char path[] = "/tmp/charis-bench-XXXXXX";
+		int fd = mkstemp(path);
+		if (fd == -1)
+			return;
+		bool written = true;
+		for (int k = 0; k < 100000 && written; k++)
+		{
+			double number = k;
+			int32_t integer = k;
+			written = write(fd, files[i].size == sizeof(double) ? (void *)&number : (void *)&integer,
+					files[i].size) == (ssize_t)files[i].size;
+		}
+		close(fd);
+		snprintf(name, sizeof(name), "mapped/sum-%s", files[i].type);
+		snprintf(source, sizeof(source),
+			 "{ let a = mmap(\"%s\", \"%s\"); let s = 0;"
+			 " for (let k = 0; k < 20; k = k + 1) s = s + sum(a); }", path, files[i].type);
+		if (written)
+			bench_program(name, source, 2000000);
+		unlink(path);
+	}
+}
+
+/**
+ * bench_parallel - Runs the parallel builtins on one thread and on the pool.
+ *
+ * Each program builds a million-element array and maps, filters, reduces or
+ * sorts it; ops are elements.
+ */
+static void bench_parallel(void)
+{
+	static const struct
+	{
+		const char *name;
+		const char *source;
+	} programs[] = {
+		{"map", "{ fn f(x) { return sqrt(x) * sin(x) + 1; } map(range(1000000), f); }"},
+		{"filter", "{ fn f(x) { return sin(x) > 0; } filter(range(1000000), f); }"},
+		{"reduce", "{ fn f(a, x) { return a + sqrt(x); } reduce(range(1000000), f, 0); }"},
+		{"sort", "{ fn f(x) { return sin(x); } sort(map(range(1000000), f)); }"},
+	};
+	int threads[] = {1, parallel_threads()};
+	char name[64];
+
+	for (int i = 0; i < (threads[1] > 1 ? 2 : 1); i++)
+	{
+		set_parallel_threads(threads[i]);
+		for (size_t j = 0; j < sizeof(programs) / sizeof(programs[0]); j++)
+		{
+			snprintf(name, sizeof(name), "parallel/%s-t%d", programs[j].name, threads[i]);
+			bench_program(name, programs[j].source, 1000000);
+		}
+	}
+	set_parallel_threads(0);
+}
+
+/**
+ * struct chain_node_s - An entry of the chained hash table maps are compared with.
+ * @key: The key.
+ * @value: The value.
+ * @hash: The key's hash.
+ * @next: Next entry in the same bucket.
+ */
+typedef struct chain_node_s
+{
+	value_t key;
+	value_t value;
+	uint64_t hash;
+	struct chain_node_s *next;
+} chain_node_t;
+
+/**
+ * struct chain_map_s - A textbook chained hash table: a power-of-two array
+ * of buckets, each a list of separately allocated entries.
+ * @capacity: Number of buckets.
+ * @count: Number of entries.
+ * @buckets: The buckets.
+ */
+typedef struct chain_map_s
+{
+	int capacity;
+	int count;
+	chain_node_t **buckets;
+} chain_map_t;
+
+static value_t map_keys[MAP_KEYS];
+static value_t map_probes[MAP_KEYS];
+static chain_map_t chain_map;
+static volatile double map_sink;
+
+// Map keys in these benchmarks are numbers or small strings, equal when their bits are.
+static bool same_key(value_t a, value_t b)
+{
+	return (a.type == b.type && memcmp(&a.as, &b.as, sizeof(a.as)) == 0);
+}
+
+static void chain_set(chain_map_t *map, value_t key, value_t value)
+{
+	uint64_t hash = hash_key(key);
+	for (chain_node_t *node = map->buckets[hash & (map->capacity - 1)]; node != NULL; node = node->next)
+	{
+		if (node->hash == hash && same_key(node->key, key))
+		{
+			node->value = value;
+			return;
+		}
+	}
+
+	if (map->count == map->capacity)
+	{
+		chain_node_t **buckets = calloc(map->capacity * 2, sizeof(chain_node_t *));
+		for (int i = 0; i < map->capacity; i++)
+		{
+			for (chain_node_t *node = map->buckets[i], *next; node != NULL; node = next)
+			{
+				next = node->next;
+				node->next = buckets[node->hash & (map->capacity * 2 - 1)];
+				buckets[node->hash & (map->capacity * 2 - 1)] = node;
+			}
+		}
+		free(map->buckets);
+		map->buckets = buckets;
+		map->capacity *= 2;
+	}
+
+	chain_node_t *node = malloc(sizeof(chain_node_t));
+	node->key = key;
+	node->value = value;
+	node->hash = hash;
+	node->next = map->buckets[hash & (map->capacity - 1)];
+	map->buckets[hash & (map->capacity - 1)] = node;
+	map->count++;
+}
+
+static bool chain_get(const chain_map_t *map, value_t key, value_t *value)
+{
+	uint64_t hash = hash_key(key);
+	for (chain_node_t *node = map->buckets[hash & (map->capacity - 1)]; node != NULL; node = node->next)
+	{
+		if (node->hash == hash && same_key(node->key, key))
+		{
+			*value = node->value;
+			return (true);
+		}
+	}
+	return (false);
+}
+
+static void chain_init(chain_map_t *map)
+{
+	map->capacity = 8;
+	map->count = 0;
+	map->buckets = calloc(map->capacity, sizeof(chain_node_t *));
+}
+
+static void chain_free(chain_map_t *map)
+{
+	for (int i = 0; i < map->capacity; i++)
+		for (chain_node_t *node = map->buckets[i], *next; node != NULL; node = next)
+			next = node->next, free(node);
+	free(map->buckets);
+}
+
+static void bench_chain_insert(bench_t *bench)
+{
+	for (long i = 0; i < bench->iterations; i++)
+	{
+		chain_map_t map;
+		chain_init(&map);
+		for (int k = 0; k < MAP_KEYS; k++)
+			chain_set(&map, map_keys[k], map_keys[k]);
+		chain_free(&map);
+	}
+}
+
+static void bench_chain_get(bench_t *bench)
+{
+	double sum = 0;
+	for (long i = 0; i < bench->iterations; i++)
+	{
+		value_t value;
+		for (int k = 0; k < MAP_KEYS; k++)
+			if (chain_get(&chain_map, map_probes[k], &value))
+				sum += 1;
+	}
+	map_sink = sum;
+}
+
+// The map under test lives on the VM stack, where the collector can see it.
+static void bench_swiss_insert(bench_t *bench)
+{
+	for (long i = 0; i < bench->iterations; i++)
+	{
+		push(new_map());
+		for (int k = 0; k < MAP_KEYS; k++)
+			map_set(vm.stack_top - 1, &map_keys[k], &map_keys[k]);
+		pop();
+	}
+}
+
+static void bench_swiss_get(bench_t *bench)
+{
+	double sum = 0;
+	for (long i = 0; i < bench->iterations; i++)
+	{
+		const obj_map_t *map = as_map(vm.stack_top[-1]);
+		value_t value;
+		for (int k = 0; k < MAP_KEYS; k++)
+			if (map_get(map, map_probes[k], &value))
+				sum += 1;
+	}
+	map_sink = sum;
+}
+
+/**
+ * bench_map_keys - Compares the map type with chained hashing on one key set.
+ * @kind: Name of the key set.
+ *
+ * Both tables use the same hash, so the difference is the layout: probing a
+ * group of control bytes in one cache line against chasing list pointers.
+ * Lookups visit the keys in a shuffled order, so neither table is helped by
+ * having allocated its entries in insertion order. Ops are keys inserted or
+ * looked up.
+ */
+static void bench_map_keys(const char *kind)
+{
+	bench_t bench = {0};
+	char name[64];
+
+	uint32_t seed = 12345;
+	for (int k = 0; k < MAP_KEYS; k++)
+		map_probes[k] = map_keys[k];
+	for (int k = MAP_KEYS - 1; k > 0; k--)
+	{
+		seed = seed * 1664525 + 1013904223;
+		int other = (int)(seed % (uint32_t)(k + 1));
+		value_t key = map_probes[k];
+		map_probes[k] = map_probes[other];
+		map_probes[other] = key;
+	}
+
+	snprintf(name, sizeof(name), "map/swiss-insert-%s", kind);
+	measure(name, bench_swiss_insert, &bench, MAP_KEYS, 0);
+	snprintf(name, sizeof(name), "map/chained-insert-%s", kind);
+	measure(name, bench_chain_insert, &bench, MAP_KEYS, 0);
+
+	push(new_map());
+	for (int k = 0; k < MAP_KEYS; k++)
+		map_set(vm.stack_top - 1, &map_keys[k], &map_keys[k]);
+	snprintf(name, sizeof(name), "map/swiss-get-%s", kind);
+	measure(name, bench_swiss_get, &bench, MAP_KEYS, 0);
+	pop();
+
+	chain_init(&chain_map);
+	for (int k = 0; k < MAP_KEYS; k++)
+		chain_set(&chain_map, map_keys[k], map_keys[k]);
+	snprintf(name, sizeof(name), "map/chained-get-%s", kind);
+	measure(name, bench_chain_get, &bench, MAP_KEYS, 0);
+	chain_free(&chain_map);
+}
+
+// Maps against chained hashing from C, then map access from scripts.
+static void bench_maps(void)
+{
+	for (int k = 0; k < MAP_KEYS; k++)
+		map_keys[k] = number_val((double)k * 7919);
+	bench_map_keys("num");
+	for (int k = 0; k < MAP_KEYS; k++)
+	{
+		char chars[16];
+		int length = snprintf(chars, sizeof(chars), "k%d", k);
+		map_keys[k] = copy_string(chars, length);
+	}
+	bench_map_keys("str");
+
+	bench_program("map/script-get",
+		      "{ let m = {}; for (let i = 0; i < 1000; i = i + 1) m[i] = i; let s = 0;"
+		      " for (let i = 0; i < 100000; i = i + 1) s = s + m[floor(i / 100)]; }", 100000);
+}
+
+// Function calls against the same work done inline; ops are calls.
+static void bench_calls(void)
+{
+	bench_program("call/inline",
+		      "{ let s = 0; for (let i = 0; i < 100000; i = i + 1) s = s + i; }", 100000);
+	bench_program("call/function",
+		      "{ fn add(a, b) { return a + b; } let s = 0;"
+		      " for (let i = 0; i < 100000; i = i + 1) s = add(s, i); }", 100000);
+	bench_program("call/tail-recursion",
+		      "{ fn count(n, s) { return n == 0 ? s : count(n - 1, s + n); } count(100000, 0); }", 100000);
+	bench_program("call/fib", "{ fn fib(n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); } fib(20); }", 21891);
+}
+
+// Property access and method calls against locals and plain calls; ops
+// are loop iterations.
+static void bench_classes(void)
+{
+	bench_program("class/locals",
+		      "{ let x = 1; let y = 2; let s = 0;"
+		      " for (let i = 0; i < 100000; i = i + 1) s = s + x + y; }", 100000);
+	bench_program("class/field-get",
+		      "{ class P { init(x, y) { this.x = x; this.y = y; } } let p = P(1, 2); let s = 0;"
+		      " for (let i = 0; i < 100000; i = i + 1) s = s + p.x + p.y; }", 100000);
+	bench_program("class/field-set",
+		      "{ class C { init() { this.n = 0; } } let c = C();"
+		      " for (let i = 0; i < 100000; i = i + 1) c.n = c.n + 1; }", 100000);
+	bench_program("class/method-call",
+		      "{ class A { add(a, b) { return a + b; } } let o = A(); let s = 0;"
+		      " for (let i = 0; i < 100000; i = i + 1) s = o.add(s, i); }", 100000);
+	bench_program("class/polymorphic",
+		      "{ class S { area() { return 1; } } class Q < S { area() { return 2; } }"
+		      " class R < S { area() { return 3; } } let os = [S(), Q(), R()]; let s = 0;"
+		      " for (let i = 0; i < 100000; i = i + 1) s = s + os[i - floor(i / 3) * 3].area(); }", 100000);
+	bench_program("class/construct",
+		      "{ class P { init(x, y) { this.x = x; this.y = y; } } let s = 0;"
+		      " for (let i = 0; i < 100000; i = i + 1) s = s + P(i, 1).x; }", 100000);
+}
+
+// Bytes a chunk holds, slack and alignment padding included.
+static size_t chunk_bytes(const chunk_t *chunk)
+{
+	size_t lines = sizeof(int) * chunk->lines_capacity;
+	if (chunk->frozen != NULL)
+	{
+		size_t constants = sizeof(value_t) * chunk->constants.count;
+		constants = (constants + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+		return ((constants + chunk->count + 1 + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT + lines);
+	}
+	return ((size_t)chunk->capacity + sizeof(value_t) * chunk->constants.capacity + lines);
+}
+
+// Copies a frozen chunk into growable arrays, as the compiler leaves it.
+static void thaw_chunk(const chunk_t *frozen, chunk_t *copy)
+{
+	init_chunk(copy);
+	gc_add_chunk(copy);
+	for (int i = 0; i < frozen->constants.count; i++)
+		add_constant(copy, frozen->constants.values[i]);
+	for (int offset = 0, run = 0; offset < frozen->count; run += 2)
+		for (int i = 0; i < frozen->lines[run + 1]; i++)
+			write_chunk(copy, frozen->code[offset++], frozen->lines[run]);
+}
+
+/**
+ * bench_freeze - Compares a frozen chunk with the arrays it was packed from.
+ * @name: Workload name.
+ * @source: The generated source; freed here.
+ *
+ * Prints the bytes each layout holds, then times running both. Ops are
+ * instructions.
+ */
+static void bench_freeze(const char *name, char *source)
+{
+	char full_name[64];
+	bench_t bench = {0};
+	chunk_t frozen, growable;
+
+	init_chunk(&frozen);
+	if (!compile(source, &frozen))
+	{
+		fprintf(out, "%-32s failed to compile\n", name);
+		free_chunk(&frozen);
+		free(source);
+		return;
+	}
+	thaw_chunk(&frozen, &growable);
+	double instructions = count_instructions(&frozen);
+
+	snprintf(full_name, sizeof(full_name), "freeze/%s", name);
+	if (filter == NULL || strstr(full_name, filter) != NULL)
+		fprintf(out, "%-32s %12zu bytes growable %12zu bytes frozen\n", full_name, chunk_bytes(&growable),
+			chunk_bytes(&frozen));
+	bench.chunk = &growable;
+	snprintf(full_name, sizeof(full_name), "freeze/%s-growable", name);
+	measure(full_name, bench_run, &bench, instructions, 0);
+	bench.chunk = &frozen;
+	snprintf(full_name, sizeof(full_name), "freeze/%s-frozen", name);
+	measure(full_name, bench_run, &bench, instructions, 0);
+
+	free_chunk(&growable);
+	free_chunk(&frozen);
+	free(source);
+}
+
+static double format_numbers[FORMAT_NUMBERS];
+static volatile int format_sink;
+
+static void bench_format_printf(bench_t *bench)
+{
+	char text[NUMBER_BUFFER_SIZE];
+	int sum = 0;
+	for (long i = 0; i < bench->iterations; i++)
+		for (int k = 0; k < FORMAT_NUMBERS; k++)
+			sum += snprintf(text, sizeof(text), "%g", format_numbers[k]);
+	format_sink = sum;
+}
+
+static void bench_format_g(bench_t *bench)
+{
+	char text[NUMBER_BUFFER_SIZE];
+	int sum = 0;
+	for (long i = 0; i < bench->iterations; i++)
+		for (int k = 0; k < FORMAT_NUMBERS; k++)
+			sum += format_number(format_numbers[k], NUMBER_FORMAT_G, text);
+	format_sink = sum;
+}
+
+static void bench_format_shortest(bench_t *bench)
+{
+	char text[NUMBER_BUFFER_SIZE];
+	int sum = 0;
+	for (long i = 0; i < bench->iterations; i++)
+		for (int k = 0; k < FORMAT_NUMBERS; k++)
+			sum += format_number(format_numbers[k], NUMBER_FORMAT_SHORTEST, text);
+	format_sink = sum;
+}
+
+/**
+ * bench_format - Compares number formatting with printf("%g").
+ *
+ * The numbers mix integers, readings with three decimals and results of
+ * division, which need every digit. Ops are numbers formatted.
+ */
+static void bench_format(void)
+{
+	bench_t bench = {0};
+	uint32_t seed = 12345;
+	for (int k = 0; k < FORMAT_NUMBERS; k++)
+	{
+		seed = seed * 1103515245 + 12345;
+		double reading = (double)(seed >> 8);
+		if (k % 3 == 0)
+			format_numbers[k] = reading;
+		else if (k % 3 == 1)
+			format_numbers[k] = (double)(seed % 1000000) / 1000;
+		else
+			format_numbers[k] = reading / 7;
+	}
+	measure("format/printf-g", bench_format_printf, &bench, FORMAT_NUMBERS, 0);
+	measure("format/g", bench_format_g, &bench, FORMAT_NUMBERS, 0);
+	measure("format/shortest", bench_format_shortest, &bench, FORMAT_NUMBERS, 0);
+}
+
+/**
+ * build_dispatch_chunk - Builds a chunk exercising one opcode repeatedly.
+ * @chunk: The chunk to fill.
+ * @opcode: The opcode to exercise, or OP_RETURN for the baseline.
+ * @operands: Values pushed before the opcodes run (0, 1 or repeat + 1).
+ *
+ * The baseline chunk pushes the same operands without executing the
+ * opcode, so the opcode's own cost is the difference between the two.
+ */
+static void build_dispatch_chunk(chunk_t *chunk, uint8_t opcode, int operands)
+{
+	int constant = add_constant(chunk, number_val(3));
+	for (int i = 0; i < operands; i++)
+		write_chunk(chunk, OP_CONSTANT, 1), write_chunk(chunk, (uint8_t)constant, 1);
+	if (opcode != OP_RETURN)
+		for (int i = 0; i < DISPATCH_REPEAT; i++)
+			write_chunk(chunk, opcode, 1);
+	if (operands == 0 && opcode == OP_RETURN)
+		write_chunk(chunk, OP_NULL, 1);
+	write_chunk(chunk, OP_RETURN, 1);
+}
+
+// Times running a chunk a fixed number of times, returning seconds.
+static double time_chunk(chunk_t *chunk, long iterations)
+{
+	bench_t bench = {0};
+	bench.iterations = iterations;
+	bench.chunk = chunk;
+	double start = now();
+	bench_run(&bench);
+	return now() - start;
+}
+
+/**
+ * bench_dispatch - Measures the dispatch cost of every opcode.
+ *
+ * Each opcode runs DISPATCH_REPEAT times back to back on top of whatever
+ * operands it needs; the cost of pushing those operands, measured on a
+ * baseline chunk, is subtracted.
+ */
+static void bench_dispatch(void)
+{
+	static const struct
+	{
+		uint8_t opcode;
+		const char *name;
+		int operands;
+	} ops[] = {
+		{OP_CONSTANT, "OP_CONSTANT", -1},
+		{OP_NULL, "OP_NULL", 0},
+		{OP_TRUE, "OP_TRUE", 0},
+		{OP_FALSE, "OP_FALSE", 0},
+		{OP_NOT, "OP_NOT", 1},
+		{OP_NEGATE, "OP_NEGATE", 1},
+		{OP_ADD, "OP_ADD", DISPATCH_REPEAT + 1},
+		{OP_SUBTRACT, "OP_SUBTRACT", DISPATCH_REPEAT + 1},
+		{OP_MULTIPLY, "OP_MULTIPLY", DISPATCH_REPEAT + 1},
+		{OP_DIVIDE, "OP_DIVIDE", DISPATCH_REPEAT + 1},
+		{OP_EQUAL, "OP_EQUAL", DISPATCH_REPEAT + 1},
+		{OP_GREATER, "OP_GREATER", DISPATCH_REPEAT + 1},
+		{OP_LESS, "OP_LESS", DISPATCH_REPEAT + 1},
+	};
+
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+	{
+		char name[64];
+		chunk_t chunk, baseline;
+
+		snprintf(name, sizeof(name), "dispatch/%s", ops[i].name);
+		if (filter != NULL && strstr(name, filter) == NULL)
+			continue;
+		if (result_count == MAX_RESULTS)
+			return;
+
+		init_chunk(&chunk);
+		init_chunk(&baseline);
+		if (ops[i].operands < 0)
+		{
+			// OP_CONSTANT is its own operand; the baseline is an empty run.
+			build_dispatch_chunk(&chunk, OP_RETURN, DISPATCH_REPEAT);
+			build_dispatch_chunk(&baseline, OP_RETURN, 0);
+		}
+		else
+		{
+			build_dispatch_chunk(&chunk, ops[i].opcode, ops[i].operands);
+			build_dispatch_chunk(&baseline, OP_RETURN, ops[i].operands);
+		}
+
+		long iterations = 1;
+		double elapsed = 0;
+		while ((elapsed = time_chunk(&chunk, iterations)) < min_time)
+			iterations = iterations * 2;
+		double base = time_chunk(&baseline, iterations);
+		double net = elapsed > base ? elapsed - base : 0;
+
+		result_t *result = &results[result_count++];
+		snprintf(result->name, sizeof(result->name), "%s", name);
+		result->iterations = iterations;
+		result->seconds = net;
+		result->ops = DISPATCH_REPEAT;
+		result->bytes = 0;
+		fprintf(out, "%-32s %12.2f ns/op\n", name, net * 1e9 / ((double)iterations * DISPATCH_REPEAT));
+		fflush(out);
+
+		free_chunk(&chunk);
+		free_chunk(&baseline);
+	}
+}
+
+/**
+ * write_json - Writes every result as JSON.
+ * @path: File to write.
+ */
+static void write_json(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open file '%s'.\n", path);
+		exit(74);
+	}
+
+	fprintf(file, "{\n  \"benchmarks\": [\n");
+	for (int i = 0; i < result_count; i++)
+	{
+		result_t *r = &results[i];
+		double ns_per_op = r->seconds * 1e9 / ((double)r->iterations * r->ops);
+		fprintf(file, "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.4f, ",
+			r->name, r->iterations, ns_per_op);
+		if (r->bytes > 0)
+			fprintf(file, "\"mb_per_s\": %.4f}", r->bytes * (double)r->iterations / r->seconds / 1e6);
+		else
+			fprintf(file, "\"mb_per_s\": null}");
+		fprintf(file, "%s\n", i + 1 < result_count ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+}
+
+/**
+ * main - runs every benchmark
+ * @argc: argument count
+ * @argv: argument vector
+ *
+ * Return: 0 on success
+ */
+int main(int argc, char *argv[])
+{
+	const char *json_path = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "--json=", 7) == 0)
+			json_path = argv[i] + 7;
+		else if (strncmp(argv[i], "--filter=", 9) == 0)
+			filter = argv[i] + 9;
+		else if (strncmp(argv[i], "--min-time=", 11) == 0)
+			min_time = strtod(argv[i] + 11, NULL);
+		else
+		{
+			fprintf(stderr, "Usage: bench [--filter=substring] [--min-time=seconds] [--json=path]\n");
+			return (64);
+		}
+	}
+
+	out = stdout;
+	init_vm();
+	bench_workload("literals", gen_literals(20000));
+	bench_workload("nested", gen_nested(2000));
+	bench_workload("arithmetic", gen_arithmetic(250));
+	bench_workload("strings", gen_strings(250));
+	bench_parse();
+	bench_startup();
+	bench_snapshot();
+	bench_freeze("literals", gen_literals(20000));
+	bench_freeze("arithmetic", gen_arithmetic(20000));
+	bench_loops();
+	bench_arrays();
+	bench_mapped();
+	bench_parallel();
+	bench_maps();
+	bench_calls();
+	bench_classes();
+	bench_format();
+	bench_dispatch();
+	free_vm();
+
+	if (json_path != NULL)
+		write_json(json_path);
+	return (0);
+}
@@ -0,0 +1,156 @@
+#include "charis.h"
+#include "batch.h"
+#include "compiler.h"
+#include "error.h"
+#include "module.h"
+
+/**
+ * struct charis_program_s - A compiled program, ready to be evaluated.
+ * @chunk: The program's bytecode and constants.
+ * @input_count: Number of named inputs the program was compiled against.
+ * @plan: Vector plan for batch evaluation, built on first use.
+ */
+struct charis_program_s
+{
+	chunk_t chunk;
+	int input_count;
+	batch_plan_t *plan;
+};
+
+/**
+ * charis_init - Initializes the runtime for embedding.
+ *
+ * Errors are recorded for charis_error() instead of being printed.
+ */
+void charis_init(void)
+{
+	init_vm();
+	set_error_stream(NULL);
+}
+
+/**
+ * charis_shutdown - Releases the runtime.
+ */
+void charis_shutdown(void)
+{
+	free_vm();
+}
+
+/**
+ * charis_compile - Compiles source code into a reusable program.
+ * @source: The source code; it is not referenced after this returns.
+ *
+ * Return: The program, or NULL on a compile error (see charis_error()).
+ */
+charis_program_t *charis_compile(const char *source)
+{
+	return (charis_compile_inputs(source, NULL, 0));
+}
+
+/**
+ * charis_compile_inputs - Compiles source code that refers to named inputs.
+ * @source: The source code; it is not referenced after this returns.
+ * @names: The input names, in the order their values will be supplied.
+ * @count: Number of names (at most 256).
+ *
+ * Modules the source imports are run first, relative to the working
+ * directory, unless they have run already.
+ *
+ * Return: The program, or NULL on a compile error, or if an imported
+ * module fails (see charis_error()).
+ */
+charis_program_t *charis_compile_inputs(const char *source, const char *const *names, int count)
+{
+	charis_program_t *program = malloc(sizeof(charis_program_t));
+	if (program == NULL)
+		return (NULL);
+
+	init_chunk(&program->chunk);
+	program->input_count = count;
+	program->plan = NULL;
+	if (load_imports(source, NULL) != INTERPRET_OK || !compile_with_inputs(source, &program->chunk, names, count))
+	{
+		charis_free(program);
+		return (NULL);
+	}
+	return (program);
+}
+
+/**
+ * charis_eval - Evaluates a compiled program.
+ * @program: The program to evaluate.
+ * @result: Receives the program's value on success; may be NULL.
+ *
+ * Return: INTERPRET_OK, or INTERPRET_RUNTIME_ERROR (see charis_error()).
+ */
+interpret_result_t charis_eval(charis_program_t *program, value_t *result)
+{
+	return (charis_eval_inputs(program, NULL, result));
+}
+
+/**
+ * charis_eval_inputs - Evaluates a compiled program for one set of inputs.
+ * @program: The program to evaluate.
+ * @inputs: One value per input name given to charis_compile_inputs().
+ * @result: Receives the program's value on success; may be NULL.
+ *
+ * Return: INTERPRET_OK, or INTERPRET_RUNTIME_ERROR (see charis_error()).
+ */
+interpret_result_t charis_eval_inputs(charis_program_t *program, const value_t *inputs, value_t *result)
+{
+	vm.inputs = inputs;
+	vm.input_count = inputs != NULL ? program->input_count : 0;
+	interpret_result_t status = interpret_chunk(&program->chunk);
+	vm.inputs = NULL;
+	vm.input_count = 0;
+	if (status == INTERPRET_OK && result != NULL)
+		*result = vm.result;
+	return (status);
+}
+
+/**
+ * charis_eval_batch - Evaluates a compiled program over columns of inputs.
+ * @program: The program to evaluate.
+ * @columns: One column per input name, each holding @rows values.
+ * @rows: Number of rows to evaluate.
+ * @output: Receives one result per row; see column_t.
+ *
+ * The program runs as a sequence of SIMD kernels over blocks of rows
+ * rather than once per row. Programs the vector engine cannot handle are
+ * evaluated row by row with the same results.
+ *
+ * Return: INTERPRET_OK, or INTERPRET_RUNTIME_ERROR (see charis_error()).
+ */
+interpret_result_t charis_eval_batch(charis_program_t *program, const column_t *columns, size_t rows,
+				     column_t *output)
+{
+	if (program->plan == NULL || !batch_plan_matches(program->plan, columns, program->input_count))
+	{
+		free_batch_plan(program->plan);
+		program->plan = new_batch_plan(&program->chunk, columns, program->input_count);
+	}
+	return (run_batch(program->plan, &program->chunk, columns, rows, output));
+}
+
+/**
+ * charis_free - Releases a compiled program.
+ * @program: The program to free; may be NULL.
+ */
+void charis_free(charis_program_t *program)
+{
+	if (program == NULL)
+		return;
+	free_batch_plan(program->plan);
+	free_chunk(&program->chunk);
+	free(program);
+}
+
+/**
+ * charis_error - Describes the most recent compile or runtime error.
+ *
+ * Return: The error message, or an empty string.
+ */
+const char *charis_error(void)
+{
+	return (last_error());
+}
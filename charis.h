@@ -0,0 +1,55 @@
+#pragma once
+#ifndef CHARIS_H
+#define CHARIS_H
+
+/*
+ * libcharis - embedding API
+ *
+ * Compile a source string once into a program handle, then evaluate it
+ * as many times as needed. Evaluation returns the program's value and a
+ * status; errors are never printed and never terminate the process, their
+ * message is available from charis_error().
+ *
+ *	charis_init();
+ *	charis_program_t *program = charis_compile("1 + 2 * 3");
+ *	value_t result;
+ *	if (program != NULL && charis_eval(program, &result) == INTERPRET_OK)
+ *		use(as_number(result));
+ *	charis_free(program);
+ *	charis_shutdown();
+ *
+ * Programs may refer to named inputs (charis_compile_inputs()). These
+ * are supplied per evaluation with charis_eval_inputs(), or as columns of
+ * many rows at once with charis_eval_batch(), which evaluates the whole
+ * program with SIMD kernels over blocks of rows.
+ *
+ * Strings in a result are owned by the runtime's garbage collector and
+ * stay valid only until the next evaluation; copy out what must be kept.
+ * Inputs must not hold such strings.
+ *
+ * The runtime keeps its state in per-thread globals, so every call must
+ * come from the thread that called charis_init(). map(), filter(),
+ * reduce() and sort() may run parts of a call on a pool of threads of
+ * their own; they return only once those are done. The pool is shared by
+ * the process, so threads that each called charis_init() take turns
+ * using it.
+ */
+
+#include "common.h"
+#include "batch.h"
+#include "vm.h"
+
+typedef struct charis_program_s charis_program_t;
+
+void charis_init(void);
+void charis_shutdown(void);
+charis_program_t *charis_compile(const char *source);
+charis_program_t *charis_compile_inputs(const char *source, const char *const *names, int count);
+interpret_result_t charis_eval(charis_program_t *program, value_t *result);
+interpret_result_t charis_eval_inputs(charis_program_t *program, const value_t *inputs, value_t *result);
+interpret_result_t charis_eval_batch(charis_program_t *program, const column_t *columns, size_t rows,
+				     column_t *output);
+void charis_free(charis_program_t *program);
+const char *charis_error(void);
+
+#endif // CHARIS_H
@@ -1,5 +1,7 @@
 #include <stdlib.h>
+#include <string.h>
 #include "chunk.h"
+#include "gc.h"
 #include "memory.h"
 #include "value.h"
 
@@ -15,11 +17,16 @@ void init_chunk(chunk_t *chunk)
 	chunk->count = 0;
 	chunk->capacity = 0;
 	chunk->code = NULL;
+	chunk->frozen = NULL;
 
 	chunk->lines_count = 0;
 	chunk->lines_capacity = 0;
 	chunk->lines = NULL;
 	init_value_array(&chunk->constants);
+
+	chunk->caches = NULL;
+	chunk->cache_count = 0;
+	chunk->cache_capacity = 0;
 }
 
 /**
@@ -28,13 +35,22 @@ void init_chunk(chunk_t *chunk)
  *
  * This function frees the memory used by the chunk's code array,
  * lines array, and constants array, and resets the chunk to its
- * initial state.
+ * initial state. The constants stop being GC roots.
  */
 void free_chunk(chunk_t *chunk)
 {
-	free_array(chunk->code);
+	gc_remove_chunk(chunk);
+	if (chunk->frozen != NULL)
+	{
+		free(chunk->frozen);
+	}
+	else
+	{
+		free_array(chunk->code);
+		free_value_array(&chunk->constants);
+	}
 	free_array(chunk->lines);
-	free_value_array(&chunk->constants);
+	free_array(chunk->caches);
 	init_chunk(chunk);
 }
 
@@ -81,6 +97,72 @@ void write_chunk(chunk_t *chunk, uint8_t byte, int line)
 	}
 }
 
+// Rounds a size up to a whole number of cache lines.
+static size_t align_size(size_t size) { return ((size + CHUNK_ALIGNMENT - 1) & ~(size_t)(CHUNK_ALIGNMENT - 1)); }
+
+/**
+ * freeze_chunk - Packs a finished chunk into one trimmed block.
+ * @chunk: The chunk; nothing may be written to it afterwards.
+ *
+ * The constants and then the code are copied into a single allocation
+ * aligned to a cache line, so a small chunk's constants and first
+ * instructions share lines and no capacity is wasted on slack. The line
+ * table is trimmed to its size and the inline caches, the only part the
+ * VM writes, stay apart from the code.
+ */
+void freeze_chunk(chunk_t *chunk)
+{
+	if (chunk->frozen != NULL)
+		return;
+
+	size_t constants_size = align_size(sizeof(value_t) * chunk->constants.count);
+	char *block = aligned_alloc(CHUNK_ALIGNMENT, align_size(constants_size + chunk->count + 1));
+	if (block == NULL)
+		exit(1);
+	value_t *constants = (value_t *)block;
+	uint8_t *code = (uint8_t *)block + constants_size;
+	if (chunk->constants.count > 0)
+		memcpy(constants, chunk->constants.values, sizeof(value_t) * chunk->constants.count);
+	if (chunk->count > 0)
+		memcpy(code, chunk->code, chunk->count);
+
+	free_array(chunk->code);
+	free_array(chunk->constants.values);
+	chunk->code = code;
+	chunk->capacity = chunk->count;
+	chunk->constants.values = constants;
+	chunk->constants.capacity = chunk->constants.count;
+	chunk->frozen = block;
+
+	chunk->lines = grow_array(chunk->lines, chunk->lines_capacity, chunk->lines_count, sizeof(int));
+	chunk->lines_capacity = chunk->lines_count;
+	chunk->caches = grow_array(chunk->caches, chunk->cache_capacity, chunk->cache_count, sizeof(inline_cache_t));
+	chunk->cache_capacity = chunk->cache_count;
+}
+
+/**
+ * rewind_chunk - Discards the most recently written bytes of a chunk.
+ * @chunk: Pointer to the chunk to shorten.
+ * @count: The number of bytes to keep.
+ *
+ * The line information for the discarded bytes is dropped as well, so the
+ * compiler can take back code it has just emitted.
+ */
+void rewind_chunk(chunk_t *chunk, int count)
+{
+	int removed = chunk->count - count;
+	chunk->count = count;
+	while (removed > 0)
+	{
+		int *run = &chunk->lines[chunk->lines_count - 1];
+		int dropped = *run < removed ? *run : removed;
+		*run -= dropped;
+		removed -= dropped;
+		if (*run == 0)
+			chunk->lines_count -= 2;
+	}
+}
+
 /**
  * add_constant - Adds a constant value to the chunk's constants array.
  * @chunk: Pointer to the chunk to add the constant to.
@@ -97,6 +179,24 @@ int add_constant(chunk_t *chunk, value_t value)
 	return (chunk->constants.count - 1);
 }
 
+/**
+ * add_cache - Adds an empty inline cache for a property instruction.
+ * @chunk: Pointer to the chunk the instruction is in.
+ *
+ * Return: The index of the cache.
+ */
+int add_cache(chunk_t *chunk)
+{
+	if (chunk->cache_count == chunk->cache_capacity)
+	{
+		int old_capacity = chunk->cache_capacity;
+		chunk->cache_capacity = (int)grow_capacity(old_capacity);
+		chunk->caches = grow_array(chunk->caches, old_capacity, chunk->cache_capacity, sizeof(inline_cache_t));
+	}
+	memset(&chunk->caches[chunk->cache_count], 0, sizeof(inline_cache_t));
+	return (chunk->cache_count++);
+}
+
 /**
  * get_line - Retrieves the line number for a given instruction index.
  * @chunk: Pointer to the chunk containing the instruction.
@@ -107,7 +207,7 @@ int add_constant(chunk_t *chunk, value_t value)
  *
  * Return: The line number, or -1 if the instruction index is out of bounds.
  */
-int get_line(chunk_t *chunk, size_t instruction_idx)
+int get_line(const chunk_t *chunk, size_t instruction_idx)
 {
 	size_t current_idx = 0;
 	for (size_t i = 0; i < chunk->lines_count; i += 2)
@@ -121,3 +221,67 @@ int get_line(chunk_t *chunk, size_t instruction_idx)
 	}
 	return (-1);
 }
+
+/**
+ * instruction_length - Returns the encoded size of an instruction.
+ * @opcode: The instruction's opcode.
+ *
+ * Return: The number of bytes the opcode and its operands occupy.
+ */
+int instruction_length(uint8_t opcode)
+{
+	switch (opcode)
+	{
+	case OP_CONSTANT:
+	case OP_INPUT:
+	case OP_POPN:
+	case OP_GET_LOCAL:
+	case OP_SET_LOCAL:
+	case OP_GET_GLOBAL:
+	case OP_SET_GLOBAL:
+	case OP_DEFINE_GLOBAL:
+	case OP_ARRAY:
+	case OP_MAP:
+	case OP_CALL:
+	case OP_TAIL_CALL:
+		return (2);
+	case OP_SUPER_INVOKE:
+		return (3);
+	case OP_GET_PROPERTY:
+	case OP_SET_PROPERTY:
+		return (4);
+	case OP_INVOKE:
+		return (5);
+	default:
+		if (is_jump(opcode))
+			return ((opcode - OP_JUMP) % 2 == 0 ? 3 : 2);
+		return (1);
+	}
+}
+
+/**
+ * is_jump - Checks whether an opcode is a jump, in either width.
+ * @opcode: The opcode.
+ *
+ * Return: true for jumps.
+ */
+bool is_jump(uint8_t opcode)
+{
+	return (opcode >= OP_JUMP && opcode <= OP_LOOP_SHORT);
+}
+
+/**
+ * jump_target - Decodes where a jump goes.
+ * @chunk: The chunk holding the jump.
+ * @offset: Offset of the jump instruction.
+ *
+ * Return: The offset of the instruction the jump lands on.
+ */
+int jump_target(const chunk_t *chunk, int offset)
+{
+	uint8_t opcode = chunk->code[offset];
+	bool wide = (opcode - OP_JUMP) % 2 == 0;
+	int distance = wide ? (chunk->code[offset + 1] << 8) | chunk->code[offset + 2] : chunk->code[offset + 1];
+	int end = offset + (wide ? 3 : 2);
+	return (opcode >= OP_LOOP ? end - distance : end + distance);
+}
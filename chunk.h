@@ -2,11 +2,21 @@
 
 #include <stdint.h>
 #include "common.h"
+#include "shape.h"
 #include "value.h"
 
 typedef enum opcode_s
 {
 	OP_CONSTANT,
+	OP_INPUT,
+	OP_POP,
+	OP_POPN,
+
+	OP_GET_LOCAL,
+	OP_SET_LOCAL,
+	OP_GET_GLOBAL,
+	OP_SET_GLOBAL,
+	OP_DEFINE_GLOBAL,
 
 	OP_NEGATE,
 	OP_ADD,
@@ -22,24 +32,135 @@ typedef enum opcode_s
 	OP_LESS,
 
 	OP_RETURN,
+	OP_CALL,
+	OP_TAIL_CALL,
+	OP_GET_PROPERTY,
+	OP_SET_PROPERTY,
+	OP_INVOKE,
+	OP_SUPER_INVOKE,
+
+	OP_NULL,
+
+	OP_ARRAY,
+	OP_GET_INDEX,
+	OP_SET_INDEX,
+	OP_LEN,
+	OP_SUM,
+	OP_ARRAY_MIN,
+	OP_ARRAY_MAX,
+	OP_DOT,
+	OP_PUSH,
+	OP_RANGE,
+	OP_FILL,
+	OP_MAP,
+	OP_MAP_HAS,
+	OP_MAP_DELETE,
+	OP_MAP_KEYS,
+	OP_ARRAY_MAP,
+	OP_ARRAY_FILTER,
+	OP_ARRAY_REDUCE,
+	OP_ARRAY_SORT,
+	OP_MMAP,
+	OP_SHAPE,
 
-	OP_NULL
+	// Math intrinsics: the unary ones, then from OP_MIN the binary ones.
+	OP_SQRT,
+	OP_ABS,
+	OP_FLOOR,
+	OP_CEIL,
+	OP_ROUND,
+	OP_EXP,
+	OP_LOG,
+	OP_SIN,
+	OP_COS,
+	OP_TAN,
+	OP_ASIN,
+	OP_ACOS,
+	OP_ATAN,
+	OP_MIN,
+	OP_MAX,
+	OP_POW,
+	OP_ATAN2,
+
+	// Jumps come in pairs: a wide form with a 16-bit big-endian offset,
+	// then its short form (opcode + 1) with an 8-bit offset. Offsets are
+	// relative to the end of the instruction; OP_LOOP jumps backwards.
+	OP_JUMP,
+	OP_JUMP_SHORT,
+	OP_JUMP_IF_FALSE,
+	OP_JUMP_IF_FALSE_SHORT,
+	OP_JUMP_IF_LESS,
+	OP_JUMP_IF_LESS_SHORT,
+	OP_JUMP_IF_NOT_LESS,
+	OP_JUMP_IF_NOT_LESS_SHORT,
+	OP_JUMP_IF_GREATER,
+	OP_JUMP_IF_GREATER_SHORT,
+	OP_JUMP_IF_NOT_GREATER,
+	OP_JUMP_IF_NOT_GREATER_SHORT,
+	OP_JUMP_IF_EQUAL,
+	OP_JUMP_IF_EQUAL_SHORT,
+	OP_JUMP_IF_NOT_EQUAL,
+	OP_JUMP_IF_NOT_EQUAL_SHORT,
+	OP_JUMP_IF_TRUE,
+	OP_JUMP_IF_TRUE_SHORT,
+	OP_JUMP_IF_FALSE_OR_POP,
+	OP_JUMP_IF_FALSE_OR_POP_SHORT,
+	OP_JUMP_IF_TRUE_OR_POP,
+	OP_JUMP_IF_TRUE_OR_POP_SHORT,
+	OP_LOOP,
+	OP_LOOP_SHORT
 } opcode_t;
 
+#define OPCODE_COUNT (OP_LOOP_SHORT + 1) // OP_LOOP_SHORT is the last opcode.
+#define CHUNK_ALIGNMENT 64 // Frozen code and constants start on a cache line.
+
+/**
+ * struct chunk_s - A unit of bytecode with its constants.
+ * @code: The instructions.
+ * @constants: Values the instructions refer to by index.
+ * @caches: Inline caches of the property instructions.
+ * @count: Bytes of code.
+ * @capacity: Bytes allocated for @code.
+ * @frozen: The single block holding @constants then @code once the chunk
+ *          is frozen, or NULL while it is still being written.
+ * @cache_count: Number of entries in @caches.
+ * @cache_capacity: Capacity of @caches.
+ * @lines: Run-length encoded lines, as (line, byte count) pairs; only read
+ *         to report errors and to profile.
+ * @lines_count: Number of ints in @lines.
+ * @lines_capacity: Capacity of @lines.
+ *
+ * Description: The fields the VM reads on every instruction come first.
+ * The compiler grows @code and @constants as separate arrays with slack;
+ * freeze_chunk() then packs them into one cache-line-aligned block of
+ * exactly the size needed and trims @lines, a side table that is never
+ * touched while running. After that only the collector writes to a chunk,
+ * to update constants whose objects it moves, and the VM, to its caches.
+ */
 typedef struct chunk_s
 {
+	uint8_t *code;
+	value_array_t constants;
+	inline_cache_t *caches;
 	int count;
 	int capacity;
-	uint8_t *code;
+	void *frozen;
+	int cache_count;
+	int cache_capacity;
 
 	int *lines;
 	size_t lines_count;
 	size_t lines_capacity;
-	value_array_t constants;
 } chunk_t;
 
 void init_chunk(chunk_t *chunk);
 void free_chunk(chunk_t *chunk);
 void write_chunk(chunk_t *chunk, uint8_t byte, int line);
+void freeze_chunk(chunk_t *chunk);
+void rewind_chunk(chunk_t *chunk, int count);
 int add_constant(chunk_t *chunk, value_t value);
-int get_line(chunk_t *chunk, size_t instruction_idx);
\ No newline at end of file
+int add_cache(chunk_t *chunk);
+int get_line(const chunk_t *chunk, size_t instruction_idx);
+int instruction_length(uint8_t opcode);
+bool is_jump(uint8_t opcode);
+int jump_target(const chunk_t *chunk, int offset);
@@ -0,0 +1,189 @@
+#include "class.h"
+#include "gc.h"
+#include "memory.h"
+#include "vm.h"
+
+/**
+ * new_class - Allocates a class with no name, methods or superclass.
+ *
+ * The class is not reachable from anything yet, so the caller must root
+ * it before allocating again.
+ *
+ * Return: The class value.
+ */
+value_t new_class(void)
+{
+	obj_class_t *klass = (obj_class_t *)allocate_tenured(sizeof(obj_class_t), OBJ_CLASS);
+	klass->name = null_val();
+	klass->superclass = null_val();
+	klass->shape = new_root_shape();
+	klass->field_hint = 0;
+	klass->initializer = null_val();
+	init_value_array(&klass->method_names);
+	init_value_array(&klass->methods);
+	return (obj_val(&klass->obj));
+}
+
+// Releases the method tables of a class that is being freed.
+void free_class(obj_class_t *klass)
+{
+	free_value_array(&klass->method_names);
+	free_value_array(&klass->methods);
+}
+
+bool is_class(value_t value) { return (is_obj_type(value, OBJ_CLASS)); }
+
+obj_class_t *as_class(value_t value) { return ((obj_class_t *)as_obj(value)); }
+
+/**
+ * class_add_method - Adds a method, replacing an inherited one of the same name.
+ * @klass: The class.
+ * @name: The method's name, a string value.
+ * @method: The method, a function.
+ */
+void class_add_method(obj_class_t *klass, value_t name, value_t method)
+{
+	int i = 0;
+	while (i < klass->method_names.count && !same_name(klass->method_names.values[i], name))
+		i++;
+	if (i == klass->method_names.count)
+	{
+		write_value_array(&klass->method_names, name);
+		write_value_array(&klass->methods, method);
+	}
+	else
+	{
+		klass->methods.values[i] = method;
+	}
+	write_barrier(&klass->obj, name);
+	write_barrier(&klass->obj, method);
+}
+
+/**
+ * class_find_method - Looks a method up by name.
+ * @klass: The class.
+ * @name: The name, a string value.
+ * @method: Where the method goes if there is one.
+ *
+ * Return: Whether the class has the method.
+ */
+bool class_find_method(const obj_class_t *klass, value_t name, value_t *method)
+{
+	for (int i = 0; i < klass->method_names.count; i++)
+	{
+		if (same_name(klass->method_names.values[i], name))
+		{
+			*method = klass->methods.values[i];
+			return (true);
+		}
+	}
+	return (false);
+}
+
+/**
+ * class_inherit - Copies a superclass's methods into a class.
+ * @klass: The class, which has no methods yet.
+ * @superclass: The superclass.
+ *
+ * Methods are copied down once, so looking one up never walks the chain.
+ */
+void class_inherit(obj_class_t *klass, obj_class_t *superclass)
+{
+	for (int i = 0; i < superclass->method_names.count; i++)
+		class_add_method(klass, superclass->method_names.values[i], superclass->methods.values[i]);
+	klass->superclass = obj_val(&superclass->obj);
+	klass->initializer = superclass->initializer;
+	klass->field_hint = superclass->field_hint;
+	write_barrier(&klass->obj, klass->initializer);
+}
+
+// Allocates storage for an instance's fields.
+static obj_buffer_t *allocate_fields(int capacity)
+{
+	obj_buffer_t *fields = (obj_buffer_t *)allocate_object(sizeof(obj_buffer_t) + sizeof(value_t) * capacity,
+							       OBJ_BUFFER);
+	fields->capacity = capacity;
+	return (fields);
+}
+
+/**
+ * new_instance - Allocates an instance with no fields.
+ * @klass: Slot holding its class; it must be a GC root.
+ *
+ * Room is reserved for as many fields as the class's instances have had,
+ * so instances built by the same initializer allocate their storage once.
+ * The instance is kept on the VM stack meanwhile, so callers must re-read
+ * any pointer they hold into the stack.
+ *
+ * Return: The instance value.
+ */
+value_t new_instance(const value_t *klass)
+{
+	obj_instance_t *instance = (obj_instance_t *)allocate_object(sizeof(obj_instance_t), OBJ_INSTANCE);
+	instance->klass = *klass;
+	instance->shape = as_class(*klass)->shape;
+	instance->fields = NULL;
+	int hint = as_class(*klass)->field_hint;
+	if (hint == 0)
+		return (obj_val(&instance->obj));
+
+	push(obj_val(&instance->obj));
+	obj_buffer_t *fields = allocate_fields(hint);
+	instance = as_instance(pop());
+	instance->fields = fields;
+	write_barrier(&instance->obj, obj_val(&fields->obj));
+	return (obj_val(&instance->obj));
+}
+
+bool is_instance(value_t value) { return (is_obj_type(value, OBJ_INSTANCE)); }
+
+obj_instance_t *as_instance(value_t value) { return ((obj_instance_t *)as_obj(value)); }
+
+/**
+ * instance_add_field - Adds a field, growing the storage as needed.
+ * @instance: Slot holding the instance; it must be a GC root.
+ * @shape: The instance's shape plus the new field.
+ * @value: The field's value; it must live in a GC root too.
+ */
+void instance_add_field(value_t *instance, shape_t *shape, const value_t *value)
+{
+	obj_instance_t *owner = as_instance(*instance);
+	int offset = shape->count - 1;
+	if (!instance_has_room(owner, offset))
+	{
+		int capacity = owner->fields != NULL ? owner->fields->capacity : 0;
+		obj_buffer_t *fields = allocate_fields((int)grow_capacity(capacity));
+		owner = as_instance(*instance);
+		if (offset > 0)
+			memcpy(fields->numbers, instance_fields(owner), sizeof(value_t) * offset);
+		owner->fields = fields;
+		write_barrier(&owner->obj, obj_val(&fields->obj));
+	}
+	instance_fields(owner)[offset] = *value;
+	owner->shape = shape;
+	write_barrier(&owner->obj, *value);
+
+	obj_class_t *klass = as_class(owner->klass);
+	if (shape->count > klass->field_hint && shape->count <= FIELD_HINT_MAX)
+		klass->field_hint = shape->count;
+}
+
+/**
+ * new_bound_method - Pairs a method with the instance it was read from.
+ * @receiver: Slot holding the instance; it must be a GC root.
+ * @method: Slot holding the method; it must be a GC root too.
+ *
+ * Return: The bound method value.
+ */
+value_t new_bound_method(const value_t *receiver, const value_t *method)
+{
+	obj_bound_method_t *bound = (obj_bound_method_t *)allocate_object(sizeof(obj_bound_method_t),
+									  OBJ_BOUND_METHOD);
+	bound->receiver = *receiver;
+	bound->method = *method;
+	return (obj_val(&bound->obj));
+}
+
+bool is_bound_method(value_t value) { return (is_obj_type(value, OBJ_BOUND_METHOD)); }
+
+obj_bound_method_t *as_bound_method(value_t value) { return ((obj_bound_method_t *)as_obj(value)); }
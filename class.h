@@ -0,0 +1,100 @@
+#pragma once
+#ifndef CLASS_H
+#define CLASS_H
+
+#include "common.h"
+#include "array.h"
+#include "function.h"
+#include "object.h"
+#include "shape.h"
+
+#define FIELD_HINT_MAX 16 // Most field slots reserved up front per instance.
+
+/**
+ * struct obj_class_s - A class.
+ * @obj: Object header.
+ * @name: The class's name, a string value.
+ * @superclass: The class it inherits from, or null.
+ * @shape: Root shape of its instances.
+ * @field_hint: Fields the largest instance so far has had; new instances
+ *              reserve that many slots, up to FIELD_HINT_MAX.
+ * @initializer: The init method, or null.
+ * @method_names: Names of its methods, inherited ones included.
+ * @methods: The methods, as functions, in the same order.
+ *
+ * Description: Classes are built while compiling and never change once
+ * their declaration is compiled, so a method found through an instance's
+ * shape can be cached with it. Like functions they are tenured and own
+ * their method tables outside the heap.
+ */
+typedef struct obj_class_s
+{
+	obj_t obj;
+	value_t name;
+	value_t superclass;
+	shape_t *shape;
+	int field_hint;
+	value_t initializer;
+	value_array_t method_names;
+	value_array_t methods;
+} obj_class_t;
+
+/**
+ * struct obj_instance_s - An instance of a class.
+ * @obj: Object header.
+ * @klass: Its class.
+ * @shape: Layout of its fields; fields are only ever added.
+ * @fields: Storage for the fields, at the offsets @shape gives them, or
+ *          NULL while there is none.
+ */
+typedef struct obj_instance_s
+{
+	obj_t obj;
+	value_t klass;
+	shape_t *shape;
+	obj_buffer_t *fields;
+} obj_instance_t;
+
+/**
+ * struct obj_bound_method_s - A method read as a property, with its receiver.
+ * @obj: Object header.
+ * @receiver: The instance it was read from.
+ * @method: The method, a function.
+ */
+typedef struct obj_bound_method_s
+{
+	obj_t obj;
+	value_t receiver;
+	value_t method;
+} obj_bound_method_t;
+
+value_t new_class(void);
+void free_class(obj_class_t *klass);
+bool is_class(value_t value);
+obj_class_t *as_class(value_t value);
+void class_add_method(obj_class_t *klass, value_t name, value_t method);
+bool class_find_method(const obj_class_t *klass, value_t name, value_t *method);
+void class_inherit(obj_class_t *klass, obj_class_t *superclass);
+
+value_t new_instance(const value_t *klass);
+bool is_instance(value_t value);
+obj_instance_t *as_instance(value_t value);
+void instance_add_field(value_t *instance, shape_t *shape, const value_t *value);
+
+value_t new_bound_method(const value_t *receiver, const value_t *method);
+bool is_bound_method(value_t value);
+obj_bound_method_t *as_bound_method(value_t value);
+
+// Returns the fields of an instance with storage.
+static inline value_t *instance_fields(const obj_instance_t *instance)
+{
+	return ((value_t *)instance->fields->numbers);
+}
+
+// Checks whether an instance has room for a field at an offset.
+static inline bool instance_has_room(const obj_instance_t *instance, int offset)
+{
+	return (instance->fields != NULL && offset < instance->fields->capacity);
+}
+
+#endif // CLASS_H
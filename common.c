@@ -28,6 +28,14 @@ value_t number_val(double value)
 	return (result);
 }
 
+value_t obj_val(obj_t *object)
+{
+	value_t result;
+	result.type = VAL_OBJ;
+	result.as.obj = object;
+	return (result);
+}
+
 bool as_bool(value_t value)
 {
 	if (!is_bool(value))
@@ -48,8 +56,20 @@ double as_number(value_t value)
 	return value.as.number;
 }
 
+obj_t *as_obj(value_t value)
+{
+	if (!is_obj(value))
+	{
+		fprintf(stderr, "Error: Expected object value.\n");
+		exit(1);
+	}
+	return value.as.obj;
+}
+
 bool is_bool(value_t value) { return (value.type == VAL_BOOLEAN); }
 
 bool is_null(value_t value) { return (value.type == VAL_NULL); }
 
 bool is_number(value_t value) { return (value.type == VAL_NUMBER); }
+
+bool is_obj(value_t value) { return (value.type == VAL_OBJ); }
@@ -8,15 +8,32 @@
 #include <sys/types.h>
 
 // #define DEBUG_PRINT_CODE
-#define DEBUG_TRACE_EXECUTION
+// #define DEBUG_STRESS_GC
+
+#define SMALL_STRING_MAX 8 // Strings up to this many bytes live inside the value.
 
 typedef enum value_type_s
 {
 	VAL_BOOLEAN,
 	VAL_NULL,
 	VAL_NUMBER,
+	VAL_OBJ,
+	VAL_SMALL_STRING,
 } value_type_t;
 
+typedef struct obj_s obj_t;
+
+/**
+ * struct value_s - A dynamically typed value.
+ * @type: The value's type.
+ * @as: The payload: a boolean, a number, a heap object, or the bytes of a
+ *      small string, NUL-padded when shorter than SMALL_STRING_MAX.
+ *
+ * Description: Every string of at most SMALL_STRING_MAX bytes (without
+ * NULs) is stored inline and every longer one is an interned heap string,
+ * so each string has exactly one representation and equality never needs
+ * to look at characters.
+ */
 typedef struct value_s
 {
 	value_type_t type;
@@ -24,6 +41,8 @@ typedef struct value_s
 	{
 		bool boolean;
 		double number;
+		obj_t *obj;
+		char small[SMALL_STRING_MAX];
 	} as;
 } value_t;
 
@@ -31,11 +50,14 @@ typedef struct value_s
 value_t bool_val(bool value);
 value_t null_val(void);
 value_t number_val(double value);
+value_t obj_val(obj_t *object);
 
 bool as_bool(value_t value);
 double as_number(value_t value);
+obj_t *as_obj(value_t value);
 
 bool is_bool(value_t value);
 bool is_null(value_t value);
 bool is_number(value_t value);
+bool is_obj(value_t value);
 #endif // COMMON_H
\ No newline at end of file
@@ -1,25 +1,66 @@
 #include "compiler.h"
+#include "class.h"
+#include "error.h"
+#include "gc.h"
+#include "intrinsic.h"
+#include "memory.h"
+#include "object.h"
+#include "optimizer.h"
+#include "vm.h"
 
-parser_t parser;
-chunk_t *compiling_chunk;
+// Each thread compiles on its own, so that modules can be compiled in
+// parallel (see module.h).
+_Thread_local parser_t parser;
+static _Thread_local compiler_t *current;
+static _Thread_local const char *const *compiling_inputs;
+static _Thread_local int compiling_input_count;
+static _Thread_local bool program_has_value;
+static _Thread_local bool imports_allowed; // Whether nothing but imports came before.
+static _Thread_local int operand_start; // Where the left operand of an infix rule starts.
+static _Thread_local operand_t *operands;  // Operands being parsed, innermost last.
+static _Thread_local int operand_count;
+static _Thread_local int operand_capacity;
+static _Thread_local int nesting; // Calls of parse_precedence() in progress.
+static _Thread_local int visible_globals = -1; // Globals a deferred body may see, or -1 for all.
+static _Thread_local lookahead_t *lookahead; // Tokens scanned ahead while timed, or NULL.
 
-static void literal(void);
-static void unary(void);
-static void binary(void);
-static void ternary(void);
-static void grouping(void);
-static void number(void);
+static void literal(bool can_assign);
+static void unary(bool can_assign);
+static void binary(bool can_assign);
+static void ternary(bool can_assign);
+static void and_(bool can_assign);
+static void or_(bool can_assign);
+static void grouping(bool can_assign);
+static void number(bool can_assign);
+static void string(bool can_assign);
+static void variable(bool can_assign);
+static void array(bool can_assign);
+static void map_literal(bool can_assign);
+static void subscript(bool can_assign);
+static void call(bool can_assign);
+static void dot(bool can_assign);
+static void this_(bool can_assign);
+static void super_(bool can_assign);
+static void declaration(void);
+static void block(void);
+static int declare_global(const token_t *name);
+static int emit_jump(uint8_t instruction);
+static void patch_jump(int operand);
+static int emit_branch_if_false(int start);
+static bool constant_between(int start, int end, value_t *value);
 
 parse_rule_t rules[] = {
-	[TOKEN_LEFT_PAREN] = {grouping, NULL, PREC_NONE},
+	[TOKEN_LEFT_PAREN] = {grouping, call, PREC_CALL},
 	[TOKEN_RIGHT_PAREN] = {NULL, NULL, PREC_NONE},
-	[TOKEN_LEFT_BRACE] = {NULL, NULL, PREC_NONE},
+	[TOKEN_LEFT_BRACE] = {map_literal, NULL, PREC_NONE},
 	[TOKEN_RIGHT_BRACE] = {NULL, NULL, PREC_NONE},
+	[TOKEN_LEFT_BRACKET] = {array, subscript, PREC_CALL},
+	[TOKEN_RIGHT_BRACKET] = {NULL, NULL, PREC_NONE},
 	[TOKEN_COLON] = {NULL, NULL, PREC_NONE},
 	[TOKEN_COMMA] = {NULL, NULL, PREC_NONE},
 	[TOKEN_CONST] = {NULL, NULL, PREC_NONE},
 	[TOKEN_DEFINE] = {NULL, NULL, PREC_NONE},
-	[TOKEN_DOT] = {NULL, NULL, PREC_NONE},
+	[TOKEN_DOT] = {NULL, dot, PREC_CALL},
 	[TOKEN_LET] = {NULL, NULL, PREC_NONE},
 	[TOKEN_MINUS] = {unary, binary, PREC_TERM},
 	[TOKEN_PLUS] = {unary, binary, PREC_TERM},
@@ -34,22 +75,24 @@ parse_rule_t rules[] = {
 	[TOKEN_GREATER_EQUAL] = {NULL, binary, PREC_COMPARISON},
 	[TOKEN_LESS] = {NULL, binary, PREC_COMPARISON},
 	[TOKEN_LESS_EQUAL] = {NULL, binary, PREC_COMPARISON},
-	[TOKEN_IDENTIFIER] = {NULL, NULL, PREC_NONE},
-	[TOKEN_STRING] = {NULL, NULL, PREC_NONE},
+	[TOKEN_IDENTIFIER] = {variable, NULL, PREC_NONE},
+	[TOKEN_STRING] = {string, NULL, PREC_NONE},
 	[TOKEN_QUESTION] = {NULL, ternary, PREC_TERNARY},
 	[TOKEN_NUMBER] = {number, NULL, PREC_NONE},
-	[TOKEN_AND] = {NULL, NULL, PREC_NONE},
+	[TOKEN_AND] = {NULL, and_, PREC_AND},
 	[TOKEN_CLASS] = {NULL, NULL, PREC_NONE},
 	[TOKEN_ELSE] = {NULL, NULL, PREC_NONE},
 	[TOKEN_FALSE] = {literal, NULL, PREC_NONE},
+	[TOKEN_FN] = {NULL, NULL, PREC_NONE},
 	[TOKEN_FOR] = {NULL, NULL, PREC_NONE},
 	[TOKEN_IF] = {NULL, NULL, PREC_NONE},
+	[TOKEN_IMPORT] = {NULL, NULL, PREC_NONE},
 	[TOKEN_NULL] = {literal, NULL, PREC_NONE},
-	[TOKEN_OR] = {NULL, NULL, PREC_NONE},
+	[TOKEN_OR] = {NULL, or_, PREC_OR},
 	[TOKEN_PRINT] = {NULL, NULL, PREC_NONE},
 	[TOKEN_RETURN] = {NULL, NULL, PREC_NONE},
-	[TOKEN_SUPER] = {NULL, NULL, PREC_NONE},
-	[TOKEN_THIS] = {NULL, NULL, PREC_NONE},
+	[TOKEN_SUPER] = {super_, NULL, PREC_NONE},
+	[TOKEN_THIS] = {this_, NULL, PREC_NONE},
 	[TOKEN_TRUE] = {literal, NULL, PREC_NONE},
 	[TOKEN_WHILE] = {NULL, NULL, PREC_NONE},
 	[TOKEN_ERROR] = {NULL, NULL, PREC_NONE},
@@ -57,7 +100,7 @@ parse_rule_t rules[] = {
 };
 
 // Returns the current chunk being compiled.
-static chunk_t *current_chunk(void) { return compiling_chunk; }
+static chunk_t *current_chunk(void) { return current->chunk; }
 
 // Reports an error at a specific token.
 static void error_at(token_t *token, const char *message)
@@ -65,12 +108,12 @@ static void error_at(token_t *token, const char *message)
 	if (parser.panic_mode)
 		return;
 	parser.panic_mode = true;
-	fprintf(stderr, "[line %d] Error", token->line);
 	if (token->type == TOKEN_EOF)
-		fprintf(stderr, " at end");
-	else if (token->type != TOKEN_ERROR)
-		fprintf(stderr, " at '%.*s'", token->length, token->start);
-	fprintf(stderr, " at '%s\n", message);
+		report_error("[line %d] Error at end: %s", token->line, message);
+	else if (token->type == TOKEN_ERROR)
+		report_error("[line %d] Error: %s", token->line, message);
+	else
+		report_error("[line %d] Error at '%.*s': %s", token->line, token->length, token->start, message);
 	parser.had_error = true;
 }
 
@@ -80,13 +123,31 @@ static void error_at_current(const char *message) { error_at(&parser.current, me
 // Reports an error at the previous token.
 static void error(const char *message) { error_at(&parser.previous, message); }
 
+// Scans the next token, or takes it from those scanned ahead while compiling is timed.
+static token_t next_token(void)
+{
+	if (lookahead == NULL)
+		return scan_token();
+	if (lookahead->next == lookahead->count)
+	{
+		timings_begin(vm.timings, PHASE_SCAN);
+		lookahead->count = 0;
+		do
+			lookahead->tokens[lookahead->count++] = scan_token();
+		while (lookahead->count < SCAN_AHEAD && lookahead->tokens[lookahead->count - 1].type != TOKEN_EOF);
+		timings_end(vm.timings);
+		lookahead->next = 0;
+	}
+	return lookahead->tokens[lookahead->next++];
+}
+
 // Advances the parser to the next token.
 static void advance(void)
 {
 	parser.previous = parser.current;
 	while (true)
 	{
-		parser.current = scan_token();
+		parser.current = next_token();
 		if (parser.current.type != TOKEN_ERROR)
 			break;
 		error_at_current(parser.current.start);
@@ -104,6 +165,18 @@ static void consume(token_type_t type, const char *message)
 	error_at_current(message);
 }
 
+// Checks whether the current token has the given type.
+static bool check(token_type_t type) { return parser.current.type == type; }
+
+// Consumes the current token if it has the given type.
+static bool match(token_type_t type)
+{
+	if (!check(type))
+		return false;
+	advance();
+	return true;
+}
+
 // Emits a byte of bytecode.
 static void emit_byte(uint8_t byte) { write_chunk(current_chunk(), byte, parser.previous.line); }
 
@@ -114,9 +187,32 @@ static void emit_bytes(uint8_t byte1, uint8_t byte2)
 	emit_byte(byte2);
 }
 
-// Adds a constant value to the chunk and returns its index.
+// Checks whether two constants are interchangeable, bit for bit.
+static bool same_constant(value_t a, value_t b)
+{
+	if (a.type != b.type)
+		return false;
+	switch (a.type)
+	{
+	case VAL_NUMBER:
+		return memcmp(&a.as.number, &b.as.number, sizeof(double)) == 0;
+	case VAL_OBJ:
+		return a.as.obj == b.as.obj;
+	case VAL_SMALL_STRING:
+		return memcmp(a.as.small, b.as.small, SMALL_STRING_MAX) == 0;
+	default:
+		return a.as.boolean == b.as.boolean;
+	}
+}
+
+// Adds a constant value to the chunk, reusing an equal one, and returns its index.
 static uint8_t make_constant(value_t value)
 {
+	value_array_t *constants = &current_chunk()->constants;
+	for (int i = 0; i < constants->count; i++)
+		if (same_constant(constants->values[i], value))
+			return (uint8_t)i;
+
 	int constant = add_constant(current_chunk(), value);
 	if (constant > UINT8_MAX)
 	{
@@ -129,50 +225,103 @@ static uint8_t make_constant(value_t value)
 // Emits a constant instruction.
 static void emit_constant(value_t value) { emit_bytes(OP_CONSTANT, make_constant(value)); }
 
+// Emits the cheapest instruction that loads a value.
+static void emit_value(value_t value)
+{
+	if (is_bool(value))
+		emit_byte(as_bool(value) ? OP_TRUE : OP_FALSE);
+	else if (is_null(value))
+		emit_byte(OP_NULL);
+	else
+		emit_constant(value);
+}
+
 // Emits a return instruction.
 static void emit_return(void) { emit_byte(OP_RETURN); }
 
-// Finalizes the compilation process.
+// Starts compiling a script or function body with no variables in scope.
+static void init_compiler(compiler_t *compiler, chunk_t *chunk, obj_function_t *function, function_type_t type)
+{
+	compiler->enclosing = current;
+	compiler->function = function;
+	compiler->type = type;
+	compiler->klass = NULL;
+	compiler->chunk = chunk;
+	compiler->local_count = 0;
+	compiler->slot_count = 0;
+	compiler->scope_depth = 0;
+	compiler->emitted_jumps = false;
+	current = compiler;
+}
+
+// Finalizes the compilation process; a program without a value returns null.
 static void end_compiler(void)
 {
+	if (!program_has_value)
+		emit_byte(OP_NULL);
 	emit_return();
+	if (current->emitted_jumps && !parser.had_error)
+		optimize_jumps(current_chunk());
 #ifdef DEBUG_PRINT_CODE
 	if (!parser.had_error)
 		disassemble_chunk(current_chunk(), "code");
 #endif
+	freeze_chunk(current_chunk());
+}
+
+/**
+ * end_function - Finishes a function body and returns to the enclosing code.
+ *
+ * A body that runs off its end returns null, or `this` for an
+ * initializer. Once compiled, the chunk is frozen and its
+ * constants are traced through the function, which is tenured, so each is
+ * recorded with the write barrier.
+ */
+static void end_function(void)
+{
+	obj_function_t *function = current->function;
+	if (current->type == TYPE_INITIALIZER)
+		emit_bytes(OP_GET_LOCAL, 0);
+	else
+		emit_byte(OP_NULL);
+	emit_return();
+	if (current->emitted_jumps && !parser.had_error)
+		optimize_jumps(current_chunk());
+#ifdef DEBUG_PRINT_CODE
+	if (!parser.had_error)
+		disassemble_chunk(current_chunk(), string_chars(&function->name));
+#endif
+	freeze_chunk(function->chunk);
+	gc_remove_chunk(function->chunk);
+	for (int i = 0; i < function->chunk->constants.count; i++)
+		write_barrier(&function->obj, function->chunk->constants.values[i]);
+	current = current->enclosing;
 }
 
 // Retrieves the parsing rule for a token type.
 static parse_rule_t *get_rule(token_type_t type) { return &rules[type]; }
 
-// Parses an expression with a given precedence level.
-static void parse_precedence(precedence_t precedence)
+// Starts an operand for the parser to finish before what is below it.
+static void push_operand(precedence_t precedence, operand_step_t step, int jump)
 {
-	advance();
-	parse_fn prefix_rule = get_rule(parser.previous.type)->prefix;
-	if (prefix_rule == NULL)
-	{
-		error("Expect expression.");
-		return;
-	}
-	prefix_rule();
-	while (precedence <= get_rule(parser.current.type)->precedence)
+	if (operand_count == operand_capacity)
 	{
-		advance();
-		parse_fn infix_rule = get_rule(parser.previous.type)->infix;
-		infix_rule();
+		int capacity = (int)grow_capacity(operand_capacity);
+		operands = grow_array(operands, operand_capacity, capacity, sizeof(operand_t));
+		operand_capacity = capacity;
 	}
+	operand_t *operand = &operands[operand_count++];
+	operand->precedence = precedence;
+	operand->can_assign = precedence <= PREC_ASSIGNMENT;
+	operand->start = current_chunk()->count;
+	operand->step = step;
+	operand->operator = parser.previous.type;
+	operand->jump = jump;
 }
 
-// Parses an expression starting with the lowest precedence.
-static void expression(void) { parse_precedence(PREC_ASSIGNMENT); }
-
-// Parses and emits bytecode for a binary expression.
-static void binary(void)
+// Emits the instruction of a binary operator.
+static void emit_binary(token_type_t operator_type)
 {
-	token_type_t operator_type = parser.previous.type;
-	parse_rule_t *rule = get_rule(operator_type);
-	parse_precedence((precedence_t)(rule->precedence + 1));
 	switch (operator_type)
 	{
 	case TOKEN_PLUS:
@@ -210,14 +359,130 @@ static void binary(void)
 	}
 }
 
-// Parses a grouping expression (enclosed in parentheses).
-static void grouping(void)
+// Emits the instruction of a unary operator.
+static void emit_unary(token_type_t operator_type)
 {
-	expression();
-	consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+	switch (operator_type)
+	{
+	case TOKEN_MINUS:
+		emit_byte(OP_NEGATE);
+		break;
+	case TOKEN_PLUS:
+		break;
+	case TOKEN_BANG:
+		emit_byte(OP_NOT);
+		break;
+	default:
+		return;
+	}
 }
 
-static void literal(void)
+// Pops the operand just parsed and emits what follows it.
+static void finish_operand(void)
+{
+	operand_t operand = operands[--operand_count];
+	switch (operand.step)
+	{
+	case STEP_EXPRESSION:
+		break;
+	case STEP_GROUPING:
+		consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+		break;
+	case STEP_UNARY:
+		emit_unary(operand.operator);
+		break;
+	case STEP_BINARY:
+		emit_binary(operand.operator);
+		break;
+	case STEP_LOGICAL:
+		patch_jump(operand.jump);
+		break;
+	case STEP_THEN:
+	{
+		int end_jump = emit_jump(OP_JUMP);
+		consume(TOKEN_COLON, "Expect ':' after then branch of ternary expression.");
+		patch_jump(operand.jump);
+		push_operand(PREC_TERNARY, STEP_ELSE, end_jump);
+		break;
+	}
+	case STEP_ELSE:
+		patch_jump(operand.jump);
+		break;
+	}
+}
+
+/**
+ * parse_precedence - Parses an expression with a given precedence level.
+ * @precedence: Lowest precedence of the operators it may contain.
+ *
+ * Operators push the operands they wait for instead of parsing them
+ * recursively, so parentheses, prefix operators and ?: nest as deep as
+ * memory allows. Brackets, calls and assignments call expression() again
+ * and are limited to NESTING_MAX levels. Each token is handled a bounded
+ * number of times, so the time is linear in the length of the expression.
+ */
+static void parse_precedence(precedence_t precedence)
+{
+	if (nesting == NESTING_MAX)
+	{
+		error_at_current("Expression nests too deeply.");
+		return;
+	}
+	nesting++;
+	int base = operand_count;
+	bool parsed = false; // Whether the top operand's prefix is compiled.
+	push_operand(precedence, STEP_EXPRESSION, -1);
+	while (operand_count > base)
+	{
+		int top = operand_count - 1;
+		if (!parsed)
+		{
+			operands[top].start = current_chunk()->count;
+			advance();
+			parse_fn prefix_rule = get_rule(parser.previous.type)->prefix;
+			if (prefix_rule == NULL)
+			{
+				error("Expect expression.");
+				finish_operand();
+				parsed = operand_count == top;
+				continue;
+			}
+			prefix_rule(operands[top].can_assign);
+			parsed = operand_count == top + 1;
+		}
+		else if (operands[top].precedence <= get_rule(parser.current.type)->precedence)
+		{
+			advance();
+			parse_fn infix_rule = get_rule(parser.previous.type)->infix;
+			operand_start = operands[top].start;
+			infix_rule(operands[top].can_assign);
+			parsed = operand_count == top + 1;
+		}
+		else
+		{
+			if (operands[top].can_assign && match(TOKEN_EQUAL))
+				error("Invalid assignment target.");
+			finish_operand();
+			parsed = operand_count == top;
+		}
+	}
+	nesting--;
+}
+
+// Parses an expression starting with the lowest precedence.
+static void expression(void) { parse_precedence(PREC_ASSIGNMENT); }
+
+// Starts the right operand of a binary operator.
+static void binary(bool can_assign)
+{
+	parse_rule_t *rule = get_rule(parser.previous.type);
+	push_operand((precedence_t)(rule->precedence + 1), STEP_BINARY, -1);
+}
+
+// Starts a grouping expression (enclosed in parentheses).
+static void grouping(bool can_assign) { push_operand(PREC_ASSIGNMENT, STEP_GROUPING, -1); }
+
+static void literal(bool can_assign)
 {
 	switch (parser.previous.type)
 	{
@@ -236,50 +501,1323 @@ static void literal(void)
 }
 
 // Parses and emits bytecode for a numeric literal.
-static void number(void)
+static void number(bool can_assign)
 {
 	double value = strtod(parser.previous.start, NULL);
 	emit_constant(number_val(value));
 }
 
-// Parses and emits bytecode for a unary expression.
-static void unary(void)
+// Parses and emits bytecode for a string literal, without its quotes.
+static void string(bool can_assign)
 {
-	token_type_t operator_type = parser.previous.type;
-	parse_precedence(PREC_UNARY);
-	switch (operator_type)
+	emit_constant(copy_string(parser.previous.start + 1, parser.previous.length - 2));
+}
+
+// Builtins, compiled to their opcode rather than called.
+static const builtin_t builtins[] = {
+	{"len", OP_LEN, 1},
+	{"sum", OP_SUM, 1},
+	{"min", OP_ARRAY_MIN, 1},
+	{"min", OP_MIN, 2},
+	{"max", OP_ARRAY_MAX, 1},
+	{"max", OP_MAX, 2},
+	{"dot", OP_DOT, 2},
+	{"scale", OP_MULTIPLY, 2},
+	{"push", OP_PUSH, 2},
+	{"range", OP_RANGE, 1},
+	{"fill", OP_FILL, 2},
+	{"has", OP_MAP_HAS, 2},
+	{"delete", OP_MAP_DELETE, 2},
+	{"keys", OP_MAP_KEYS, 1},
+	{"map", OP_ARRAY_MAP, 2},
+	{"filter", OP_ARRAY_FILTER, 2},
+	{"reduce", OP_ARRAY_REDUCE, 3},
+	{"sort", OP_ARRAY_SORT, 1},
+	{"mmap", OP_MMAP, 2},
+	{"shape", OP_SHAPE, 1},
+	{"sqrt", OP_SQRT, 1},
+	{"abs", OP_ABS, 1},
+	{"floor", OP_FLOOR, 1},
+	{"ceil", OP_CEIL, 1},
+	{"round", OP_ROUND, 1},
+	{"exp", OP_EXP, 1},
+	{"log", OP_LOG, 1},
+	{"sin", OP_SIN, 1},
+	{"cos", OP_COS, 1},
+	{"tan", OP_TAN, 1},
+	{"asin", OP_ASIN, 1},
+	{"acos", OP_ACOS, 1},
+	{"atan", OP_ATAN, 1},
+	{"atan", OP_ATAN2, 2},
+	{"pow", OP_POW, 2},
+};
+
+// Returns the first builtin spelled like a token, or NULL.
+static const builtin_t *find_builtin(const token_t *name)
+{
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+		if (strlen(builtins[i].name) == (size_t)name->length &&
+		    memcmp(builtins[i].name, name->start, name->length) == 0)
+			return &builtins[i];
+	return NULL;
+}
+
+/**
+ * fold_intrinsic - Replaces a math intrinsic on constants by its result.
+ * @opcode: The intrinsic.
+ * @starts: Offsets where each argument's code starts.
+ * @constant_count: Size of the constant table before the arguments; the
+ *                  constants they added are dropped with their code.
+ *
+ * Return: true if every argument was a constant number and the call was
+ * folded, false if the intrinsic still has to be emitted.
+ */
+static bool fold_intrinsic(uint8_t opcode, const int *starts, int constant_count)
+{
+	int arity = intrinsic_arity(opcode);
+	value_t arguments[2] = {number_val(0), number_val(0)};
+	for (int i = 0; i < arity; i++)
 	{
-	case TOKEN_MINUS:
-		emit_byte(OP_NEGATE);
-		break;
-	case TOKEN_PLUS:
-		break;
-	case TOKEN_BANG:
-		emit_byte(OP_NOT);
-		break;
-	default:
+		int end = i + 1 < arity ? starts[i + 1] : current_chunk()->count;
+		if (!constant_between(starts[i], end, &arguments[i]) || !is_number(arguments[i]))
+			return false;
+	}
+	rewind_chunk(current_chunk(), starts[0]);
+	current_chunk()->constants.count = constant_count;
+	emit_constant(number_val(apply_intrinsic(opcode, as_number(arguments[0]), as_number(arguments[1]))));
+	return true;
+}
+
+/**
+ * builtin_call - Compiles a call to a builtin.
+ * @builtin: The first builtin with the called name.
+ *
+ * The arguments are compiled in order and the builtin taking that many
+ * becomes a single instruction; a math intrinsic whose arguments are all
+ * constants is computed on the spot instead.
+ */
+static void builtin_call(const builtin_t *builtin)
+{
+	const char *name = builtin->name;
+	int constant_count = current_chunk()->constants.count;
+	int starts[2];
+	int count = 0;
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after builtin name.");
+	if (!check(TOKEN_RIGHT_PAREN))
+	{
+		do
+		{
+			if (count < 2)
+				starts[count] = current_chunk()->count;
+			expression();
+			count++;
+		} while (match(TOKEN_COMMA));
+	}
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+
+	const builtin_t *end = builtins + sizeof(builtins) / sizeof(builtins[0]);
+	for (; builtin < end && strcmp(builtin->name, name) == 0; builtin++)
+	{
+		if (builtin->arity != count)
+			continue;
+		if (!is_intrinsic(builtin->opcode) || !fold_intrinsic(builtin->opcode, starts, constant_count))
+			emit_byte(builtin->opcode);
+		return;
+	}
+	error("Wrong number of arguments to builtin.");
+}
+
+// Compiles an array literal: its elements, then one instruction to collect them.
+static void array(bool can_assign)
+{
+	int count = 0;
+	if (!check(TOKEN_RIGHT_BRACKET))
+	{
+		do
+		{
+			if (check(TOKEN_RIGHT_BRACKET))
+				break; // Trailing comma.
+			expression();
+			if (count == UINT8_MAX)
+				error("Can't have more than 255 elements in an array literal.");
+			count++;
+		} while (match(TOKEN_COMMA));
+	}
+	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after array elements.");
+	emit_bytes(OP_ARRAY, (uint8_t)count);
+}
+
+// Compiles a map literal: keys and values in pairs, then one instruction to
+// collect them. A statement starting with '{' is a block instead.
+static void map_literal(bool can_assign)
+{
+	int count = 0;
+	if (!check(TOKEN_RIGHT_BRACE))
+	{
+		do
+		{
+			if (check(TOKEN_RIGHT_BRACE))
+				break; // Trailing comma.
+			expression();
+			consume(TOKEN_COLON, "Expect ':' after map key.");
+			expression();
+			if (count == UINT8_MAX)
+				error("Can't have more than 255 entries in a map literal.");
+			count++;
+		} while (match(TOKEN_COMMA));
+	}
+	consume(TOKEN_RIGHT_BRACE, "Expect '}' after map entries.");
+	emit_bytes(OP_MAP, (uint8_t)count);
+}
+
+// Compiles `target[index]`, or an assignment to it.
+static void subscript(bool can_assign)
+{
+	expression();
+	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+	if (can_assign && match(TOKEN_EQUAL))
+	{
+		expression();
+		emit_byte(OP_SET_INDEX);
+	}
+	else
+	{
+		emit_byte(OP_GET_INDEX);
+	}
+}
+
+// Checks whether a token spells the given string value.
+static bool names_equal(const token_t *name, const value_t *string)
+{
+	return string_length(string) == name->length &&
+	       memcmp(string_chars(string), name->start, name->length) == 0;
+}
+
+// Checks whether two identifier tokens are the same name.
+static bool identifiers_equal(const token_t *a, const token_t *b)
+{
+	return a->length == b->length && memcmp(a->start, b->start, a->length) == 0;
+}
+
+// Finds the innermost local with the given name, or returns -1.
+static int resolve_local(compiler_t *compiler, const token_t *name)
+{
+	for (int i = compiler->local_count - 1; i >= 0; i--)
+	{
+		local_t *local = &compiler->locals[i];
+		if (identifiers_equal(name, &local->name))
+		{
+			if (local->depth == -1)
+				error("Can't read local variable in its own initializer.");
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * resolve_enclosing - Finds a local of the code around a function.
+ * @name: The name.
+ * @value: Receives the local's value.
+ *
+ * A function runs with its own stack slots, so it can only use the locals
+ * around it that were folded to a value known while compiling; using any
+ * other is reported as an error.
+ *
+ * Return: Whether an enclosing local has the name.
+ */
+static bool resolve_enclosing(const token_t *name, value_t *value)
+{
+	for (compiler_t *compiler = current->enclosing; compiler != NULL; compiler = compiler->enclosing)
+	{
+		int index = resolve_local(compiler, name);
+		if (index == -1)
+			continue;
+		local_t *local = &compiler->locals[index];
+		if (!local->is_folded)
+		{
+			error("Functions can't use the variables of enclosing blocks.");
+			*value = null_val();
+		}
+		else if (local->load[0] == OP_CONSTANT)
+			*value = compiler->chunk->constants.values[local->load[1]];
+		else
+			*value = local->load[0] == OP_NULL ? null_val() : bool_val(local->load[0] == OP_TRUE);
+		return true;
+	}
+	return false;
+}
+
+// Finds the input with the given name, or returns -1.
+static int resolve_input(const token_t *name)
+{
+	for (int i = 0; i < compiling_input_count; i++)
+	{
+		const char *input = compiling_inputs[i];
+		if ((int)strlen(input) == name->length && memcmp(input, name->start, name->length) == 0)
+			return i;
+	}
+	return -1;
+}
+
+// Finds the global with the given name among the first count, or returns -1.
+static int find_global(const token_t *name, int count)
+{
+	for (int i = count - 1; i >= 0; i--)
+		if (names_equal(name, &vm.global_info[i].name))
+			return i;
+	return -1;
+}
+
+// Finds the global with the given name, or returns -1.
+static int resolve_global(const token_t *name)
+{
+	return find_global(name, visible_globals == -1 ? vm.globals.count : visible_globals);
+}
+
+// Parses and emits bytecode for a variable reference or assignment.
+static void variable(bool can_assign)
+{
+	token_t name = parser.previous;
+	bool assign = can_assign && match(TOKEN_EQUAL);
+	const builtin_t *builtin;
+	int index;
+
+	value_t value;
+	if ((index = resolve_local(current, &name)) != -1)
+	{
+		local_t *local = &current->locals[index];
+		if (assign && local->is_const)
+			error("Cannot assign to a constant.");
+		if (assign)
+		{
+			expression();
+			emit_bytes(OP_SET_LOCAL, (uint8_t)local->slot);
+		}
+		else if (local->is_folded)
+		{
+			emit_byte(local->load[0]);
+			if (local->load[0] == OP_CONSTANT)
+				emit_byte(local->load[1]);
+		}
+		else
+		{
+			emit_bytes(OP_GET_LOCAL, (uint8_t)local->slot);
+		}
+	}
+	else if (resolve_enclosing(&name, &value))
+	{
+		if (assign)
+			error("Cannot assign to a constant.");
+		emit_value(value);
+	}
+	else if ((index = resolve_input(&name)) != -1)
+	{
+		if (assign)
+			error("Cannot assign to an input.");
+		emit_bytes(OP_INPUT, (uint8_t)index);
+	}
+	else if ((index = resolve_global(&name)) != -1)
+	{
+		global_t *global = &vm.global_info[index];
+		if (assign && global->is_const)
+			error("Cannot assign to a constant.");
+		if (assign)
+		{
+			expression();
+			emit_bytes(OP_SET_GLOBAL, (uint8_t)index);
+		}
+		else if (global->is_folded)
+		{
+			emit_value(vm.globals.values[index]);
+		}
+		else
+		{
+			emit_bytes(OP_GET_GLOBAL, (uint8_t)index);
+		}
+	}
+	else if (!assign && check(TOKEN_LEFT_PAREN) && (builtin = find_builtin(&name)) != NULL)
+	{
+		builtin_call(builtin);
+	}
+	else if (!assign && check(TOKEN_LEFT_PAREN) && visible_globals != -1)
+	{
+		// A deferred body is compiled once its whole program has been, so
+		// a function declared further down already exists.
+		if ((index = find_global(&name, vm.globals.count)) == -1)
+			error("Undefined variable.");
+		else if (vm.global_info[index].is_folded)
+			emit_value(vm.globals.values[index]);
+		else
+			emit_bytes(OP_GET_GLOBAL, (uint8_t)index);
+	}
+	else if (!assign && check(TOKEN_LEFT_PAREN))
+	{
+		// A call to a function declared further down, as in mutual recursion.
+		index = declare_global(&name);
+		vm.global_info[index].is_const = true;
+		vm.global_info[index].is_folded = false;
+		vm.global_info[index].forward_line = name.line;
+		emit_bytes(OP_GET_GLOBAL, (uint8_t)index);
+	}
+	else
+	{
+		error("Undefined variable.");
+	}
+}
+
+// Compiles the arguments of a call up to its closing parenthesis.
+static uint8_t argument_list(void)
+{
+	int count = 0;
+	if (!check(TOKEN_RIGHT_PAREN))
+	{
+		do
+		{
+			expression();
+			if (count == ARGS_MAX)
+				error("Can't have more than 255 arguments.");
+			count++;
+		} while (match(TOKEN_COMMA));
+	}
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+	return (uint8_t)count;
+}
+
+// Compiles a call; the callee is already on the stack, below its arguments.
+static void call(bool can_assign)
+{
+	uint8_t count = argument_list();
+	current->emitted_jumps = true; // optimize_jumps() marks the tail calls.
+	emit_bytes(OP_CALL, count);
+}
+
+// Adds an inline cache for the property instruction just emitted.
+static void emit_cache(void)
+{
+	int cache = add_cache(current_chunk());
+	if (cache > UINT16_MAX)
+		error("Too many property accesses in one chunk.");
+	emit_bytes((uint8_t)(cache >> 8), (uint8_t)cache);
+}
+
+// Adds a name to the constants and returns its index.
+static uint8_t identifier_constant(const token_t *name)
+{
+	return make_constant(copy_string(name->start, name->length));
+}
+
+/**
+ * dot - Compiles a property read, store or method call.
+ * @can_assign: Whether a store is allowed here.
+ *
+ * A call through a property compiles to a single invoke, so calling a
+ * method never materializes a bound method.
+ */
+static void dot(bool can_assign)
+{
+	consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
+	uint8_t name = identifier_constant(&parser.previous);
+	if (can_assign && match(TOKEN_EQUAL))
+	{
+		expression();
+		emit_bytes(OP_SET_PROPERTY, name);
+	}
+	else if (match(TOKEN_LEFT_PAREN))
+	{
+		uint8_t count = argument_list();
+		emit_bytes(OP_INVOKE, name);
+		emit_byte(count);
+	}
+	else
+	{
+		emit_bytes(OP_GET_PROPERTY, name);
+	}
+	emit_cache();
+}
+
+// Checks that `this` or `super` is used in a method.
+static bool in_method(const char *message)
+{
+	if (current->type == TYPE_METHOD || current->type == TYPE_INITIALIZER)
+		return true;
+	error(message);
+	return false;
+}
+
+// Compiles `this`, the receiver in slot 0 of a method.
+static void this_(bool can_assign)
+{
+	if (in_method("Can't use 'this' outside of a method."))
+		emit_bytes(OP_GET_LOCAL, 0);
+}
+
+/**
+ * super_ - Compiles super.name(arguments).
+ * @can_assign: Unused.
+ *
+ * The superclass is known while compiling and never changes, so the
+ * method is looked up here and called directly on `this`.
+ */
+static void super_(bool can_assign)
+{
+	bool valid = in_method("Can't use 'super' outside of a method.");
+	if (valid && is_null(current->klass->superclass))
+	{
+		error("Can't use 'super' in a class with no superclass.");
+		valid = false;
+	}
+	consume(TOKEN_DOT, "Expect '.' after 'super'.");
+	consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
+	value_t name = copy_string(parser.previous.start, parser.previous.length);
+	value_t method = null_val();
+	if (valid && !class_find_method(as_class(current->klass->superclass), name, &method))
+		error("Undefined superclass method.");
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after superclass method name.");
+
+	emit_bytes(OP_GET_LOCAL, 0);
+	uint8_t count = argument_list();
+	if (is_null(method))
+		return;
+	emit_bytes(OP_SUPER_INVOKE, make_constant(method));
+	emit_byte(count);
+}
+
+// Starts the operand of a unary operator.
+static void unary(bool can_assign) { push_operand(PREC_UNARY, STEP_UNARY, -1); }
+
+// Starts the branches of a ternary expression; the condition is compiled.
+static void ternary(bool can_assign)
+{
+	int else_jump = emit_branch_if_false(operand_start);
+	push_operand(PREC_TERNARY + 1, STEP_THEN, else_jump); // Higher precedence than ?:
+}
+
+// Compiles `and`: a falsy left operand is the result, else the right one.
+static void and_(bool can_assign)
+{
+	int end_jump = emit_jump(OP_JUMP_IF_FALSE_OR_POP);
+	push_operand(PREC_AND + 1, STEP_LOGICAL, end_jump);
+}
+
+// Compiles `or`: a truthy left operand is the result, else the right one.
+static void or_(bool can_assign)
+{
+	int end_jump = emit_jump(OP_JUMP_IF_TRUE_OR_POP);
+	push_operand(PREC_OR + 1, STEP_LOGICAL, end_jump);
+}
+
+/**
+ * constant_between - Checks whether a run of code is a single constant
+ * load, possibly negated.
+ * @start: Offset where the code starts.
+ * @end: Offset where it ends.
+ * @value: Receives the loaded value.
+ *
+ * Return: true if the code's value is known at compile time.
+ */
+static bool constant_between(int start, int end, value_t *value)
+{
+	chunk_t *chunk = current_chunk();
+	int length = end - start;
+	uint8_t *code = chunk->code + start;
+
+	if (length == 1 && (code[0] == OP_TRUE || code[0] == OP_FALSE))
+		*value = bool_val(code[0] == OP_TRUE);
+	else if (length == 1 && code[0] == OP_NULL)
+		*value = null_val();
+	else if (length == 2 && code[0] == OP_CONSTANT)
+		*value = chunk->constants.values[code[1]];
+	else if (length == 3 && code[0] == OP_CONSTANT && code[2] == OP_NEGATE &&
+		 is_number(chunk->constants.values[code[1]]))
+		*value = number_val(-as_number(chunk->constants.values[code[1]]));
+	else
+		return false;
+	return true;
+}
+
+// Checks whether the code emitted since an offset is a constant load.
+static bool emitted_constant(int start, value_t *value)
+{
+	return constant_between(start, current_chunk()->count, value);
+}
+
+// Ends a statement; the semicolon may be left off the last one.
+static void end_statement(const char *message)
+{
+	if (!match(TOKEN_SEMICOLON) && !check(TOKEN_EOF))
+		error_at_current(message);
+}
+
+// Adds a local whose initializer is about to be compiled; false if full.
+static bool declare_local(const token_t *name)
+{
+	for (int i = current->local_count - 1; i >= 0; i--)
+	{
+		local_t *local = &current->locals[i];
+		if (local->depth != -1 && local->depth < current->scope_depth)
+			break;
+		if (identifiers_equal(name, &local->name))
+			error("Already a variable with this name in this scope.");
+	}
+	if (current->local_count == LOCALS_MAX)
+	{
+		error("Too many local variables in scope.");
+		return false;
+	}
+	local_t *local = &current->locals[current->local_count++];
+	local->name = *name;
+	local->depth = -1;
+	local->slot = -1;
+	local->is_const = false;
+	local->is_folded = false;
+	return true;
+}
+
+// Finds or creates the global with the given name and returns its index.
+static int declare_global(const token_t *name)
+{
+	int index = resolve_global(name);
+	if (index != -1)
+	{
+		vm.global_info[index].forward_line = 0;
+		return index;
+	}
+	if (vm.globals.count == UINT8_MAX + 1)
+	{
+		error("Too many global variables.");
+		return 0;
+	}
+
+	value_t string = copy_string(name->start, name->length);
+	if (vm.globals.count == vm.global_info_capacity)
+	{
+		int old_capacity = vm.global_info_capacity;
+		vm.global_info_capacity = (int)grow_capacity(old_capacity);
+		vm.global_info = grow_array(vm.global_info, old_capacity, vm.global_info_capacity, sizeof(global_t));
+	}
+	vm.global_info[vm.globals.count].name = string;
+	vm.global_info[vm.globals.count].forward_line = 0;
+	write_value_array(&vm.globals, null_val());
+	return vm.globals.count - 1;
+}
+
+/**
+ * var_declaration - Compiles a let, const or define declaration.
+ * @keyword: The declaring keyword.
+ *
+ * A const whose initializer is a constant, and every define (which must
+ * have one), is folded: its initializer code is taken back and each use
+ * loads the value directly. Other variables get a stack slot in a block
+ * and a global slot at top level.
+ */
+static void var_declaration(token_type_t keyword)
+{
+	consume(TOKEN_IDENTIFIER, "Expect variable name.");
+	token_t name = parser.previous;
+	bool is_const = keyword != TOKEN_LET;
+	bool is_local = current->scope_depth > 0;
+	bool declared = is_local && declare_local(&name);
+
+	int start = current_chunk()->count;
+	if (match(TOKEN_EQUAL))
+		expression();
+	else if (is_const)
+		error_at_current("Expect '=' after constant name.");
+	else
+		emit_byte(OP_NULL);
+	end_statement("Expect ';' after variable declaration.");
+
+	int global = is_local ? -1 : declare_global(&name);
+	value_t value;
+	bool is_folded = is_const && emitted_constant(start, &value);
+	if (keyword == TOKEN_DEFINE && !is_folded)
+		error("Define requires a constant value.");
+	if (is_folded)
+		rewind_chunk(current_chunk(), start);
+
+	if (!is_local)
+	{
+		vm.global_info[global].is_const = is_const;
+		vm.global_info[global].is_folded = is_folded;
+		if (is_folded)
+			vm.globals.values[global] = value;
+		else
+			emit_bytes(OP_DEFINE_GLOBAL, (uint8_t)global);
+		return;
+	}
+	if (!declared)
+		return;
+
+	local_t *local = &current->locals[current->local_count - 1];
+	local->depth = current->scope_depth;
+	local->is_const = is_const;
+	local->is_folded = is_folded;
+	if (!is_folded)
+	{
+		local->slot = current->slot_count++;
+	}
+	else if (is_bool(value) || is_null(value))
+	{
+		local->load[0] = is_null(value) ? OP_NULL : as_bool(value) ? OP_TRUE : OP_FALSE;
+	}
+	else
+	{
+		local->load[0] = OP_CONSTANT;
+		local->load[1] = make_constant(value);
+	}
+}
+
+/**
+ * function_body - Compiles a function's parameter list and body.
+ * @function: The function, rooted by the caller.
+ * @type: TYPE_FUNCTION, or for a method TYPE_METHOD or TYPE_INITIALIZER.
+ * @klass: For a method, its class.
+ *
+ * Parameters are the first locals of the body after slot 0, in the slots
+ * where the caller leaves its arguments.
+ */
+static void function_body(obj_function_t *function, function_type_t type, obj_class_t *klass)
+{
+	compiler_t compiler;
+	init_compiler(&compiler, function->chunk, function, type);
+	compiler.klass = klass;
+	compiler.scope_depth = 1;
+	compiler.slot_count = 1;
+	gc_add_chunk(function->chunk);
+
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+	if (!check(TOKEN_RIGHT_PAREN))
+	{
+		do
+		{
+			if (function->arity == ARGS_MAX)
+				error_at_current("Can't have more than 255 parameters.");
+			else
+				function->arity++;
+			consume(TOKEN_IDENTIFIER, "Expect parameter name.");
+			if (declare_local(&parser.previous))
+			{
+				local_t *local = &current->locals[current->local_count - 1];
+				local->depth = current->scope_depth;
+				local->slot = current->slot_count++;
+			}
+		} while (match(TOKEN_COMMA));
+	}
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+	block();
+	end_function();
+}
+
+/**
+ * bind_constant - Folds the name of a function or class declaration.
+ * @name: The name.
+ * @declared: For a local, whether declare_local() made room for it.
+ * @value: The function or class, on the VM stack.
+ *
+ * Names are bound before the body is compiled, so that it can refer to
+ * the function or class being declared.
+ */
+static void bind_constant(const token_t *name, bool declared, value_t value)
+{
+	if (current->scope_depth == 0)
+	{
+		int global = declare_global(name);
+		vm.global_info[global].is_const = true;
+		vm.global_info[global].is_folded = true;
+		vm.globals.values[global] = value;
+	}
+	else if (declared)
+	{
+		local_t *local = &current->locals[current->local_count - 1];
+		local->depth = current->scope_depth;
+		local->is_const = true;
+		local->is_folded = true;
+		local->load[0] = OP_CONSTANT;
+		local->load[1] = make_constant(value);
+	}
+}
+
+// Creates a function with the given name and pushes it to keep it rooted.
+static obj_function_t *push_function(const token_t *name)
+{
+	value_t function = new_function();
+	push(function);
+	value_t function_name = copy_string(name->start, name->length);
+	as_function(function)->name = function_name;
+	write_barrier(&as_function(function)->obj, function_name);
+	return as_function(function);
+}
+
+/**
+ * defer_body - Records where a function's body is instead of compiling it.
+ * @function: The function, whose name is bound.
+ *
+ * Only the parameters are parsed, for the arity; the body is skipped by
+ * matching braces and a copy of its source kept, for compile_function()
+ * to compile when the function is first called. Errors inside the body
+ * are only reported then.
+ */
+static void defer_body(obj_function_t *function)
+{
+	const char *start = parser.current.start;
+	int line = parser.current.line;
+
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+	if (!check(TOKEN_RIGHT_PAREN))
+	{
+		do
+		{
+			if (function->arity == ARGS_MAX)
+				error_at_current("Can't have more than 255 parameters.");
+			else
+				function->arity++;
+			consume(TOKEN_IDENTIFIER, "Expect parameter name.");
+		} while (match(TOKEN_COMMA));
+	}
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+	for (int depth = 1; depth > 0; advance())
+	{
+		if (check(TOKEN_EOF))
+		{
+			error_at_current("Expect '}' after block.");
+			return;
+		}
+		if (check(TOKEN_LEFT_BRACE))
+			depth++;
+		else if (check(TOKEN_RIGHT_BRACE))
+			depth--;
+	}
+	if (parser.had_error)
+		return;
+
+	size_t length = (size_t)(parser.previous.start + parser.previous.length - start);
+	function->source = malloc(length + 1);
+	if (function->source == NULL)
+		exit(1);
+	memcpy(function->source, start, length);
+	function->source[length] = '\0';
+	function->line = line;
+	function->globals = vm.globals.count;
+}
+
+/**
+ * fn_declaration - Compiles fn name(parameters) { body }.
+ *
+ * The name is folded like a define's, to the function itself. The
+ * function is kept on the VM stack meanwhile, as compiling allocates.
+ * The body of a function declared at the top level of a script is only
+ * compiled when first called, unless vm.eager is set or the script has
+ * inputs; others depend on the code around them and are compiled here.
+ */
+static void fn_declaration(void)
+{
+	consume(TOKEN_IDENTIFIER, "Expect function name.");
+	token_t name = parser.previous;
+	bool declared = current->scope_depth > 0 && declare_local(&name);
+
+	obj_function_t *function = push_function(&name);
+	bind_constant(&name, declared, obj_val(&function->obj));
+	if (!vm.eager && current->enclosing == NULL && current->scope_depth == 0 && compiling_input_count == 0)
+		defer_body(function);
+	else
+		function_body(function, TYPE_FUNCTION, NULL);
+	pop();
+}
+
+/**
+ * method - Compiles a method of a class declaration.
+ * @klass: The class, on the VM stack.
+ *
+ * The method is added before its body is compiled, so the body can call
+ * it through `this`; a method named init becomes the initializer.
+ */
+static void method(obj_class_t *klass)
+{
+	consume(TOKEN_IDENTIFIER, "Expect method name.");
+	token_t name = parser.previous;
+	obj_function_t *function = push_function(&name);
+	bool is_initializer = name.length == 4 && memcmp(name.start, "init", 4) == 0;
+
+	class_add_method(klass, function->name, obj_val(&function->obj));
+	if (is_initializer)
+	{
+		klass->initializer = obj_val(&function->obj);
+		write_barrier(&klass->obj, klass->initializer);
+	}
+	function_body(function, is_initializer ? TYPE_INITIALIZER : TYPE_METHOD, klass);
+	pop();
+}
+
+/**
+ * class_declaration - Compiles class Name [< Superclass] { methods }.
+ *
+ * Like a function, a class is built while compiling and its name folded
+ * to it, so its superclass must be a class known at compile time too. The
+ * superclass's methods are copied in first and the class's own override
+ * them.
+ */
+static void class_declaration(void)
+{
+	consume(TOKEN_IDENTIFIER, "Expect class name.");
+	token_t name = parser.previous;
+	bool declared = current->scope_depth > 0 && declare_local(&name);
+
+	value_t klass = new_class();
+	push(klass);
+	value_t class_name = copy_string(name.start, name.length);
+	as_class(klass)->name = class_name;
+	write_barrier(as_obj(klass), class_name);
+	bind_constant(&name, declared, klass);
+
+	if (match(TOKEN_LESS))
+	{
+		consume(TOKEN_IDENTIFIER, "Expect superclass name.");
+		int start = current_chunk()->count;
+		value_t superclass;
+		variable(false);
+		if (!emitted_constant(start, &superclass) || !is_class(superclass))
+			error("Superclass must be a class declared earlier.");
+		else if (as_obj(superclass) == as_obj(klass))
+			error("A class can't inherit from itself.");
+		else
+			class_inherit(as_class(klass), as_class(superclass));
+		rewind_chunk(current_chunk(), start);
+	}
+
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before class body.");
+	while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
+		method(as_class(klass));
+	consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
+	pop();
+}
+
+// Compiles return, which leaves the function with a value, null if omitted.
+static void return_statement(void)
+{
+	if (current->function == NULL)
+		error("Can't return from top-level code.");
+	if (match(TOKEN_SEMICOLON))
+	{
+		emit_byte(current->type == TYPE_INITIALIZER ? OP_GET_LOCAL : OP_NULL);
+		if (current->type == TYPE_INITIALIZER)
+			emit_byte(0);
+	}
+	else
+	{
+		if (current->type == TYPE_INITIALIZER)
+			error("Can't return a value from an initializer.");
+		expression();
+		end_statement("Expect ';' after return value.");
+	}
+	emit_return();
+}
+
+// Compiles an expression statement. A program's value is that of its
+// final top-level expression statement; all others are discarded.
+static void expression_statement(void)
+{
+	expression();
+	bool terminated = match(TOKEN_SEMICOLON);
+	if (current->scope_depth == 0 && check(TOKEN_EOF))
+	{
+		program_has_value = true;
 		return;
 	}
+	if (!terminated)
+		error_at_current("Expect ';' after expression.");
+	emit_byte(OP_POP);
+}
+
+/**
+ * emit_jump - Emits a forward jump whose target is not known yet.
+ * @instruction: The wide form of the jump.
+ *
+ * Every jump starts wide; optimize_jumps() shortens those that can be once
+ * the chunk is complete.
+ *
+ * Return: The offset of the jump's operand, for patch_jump().
+ */
+static int emit_jump(uint8_t instruction)
+{
+	current->emitted_jumps = true;
+	emit_byte(instruction);
+	emit_byte(0xff);
+	emit_byte(0xff);
+	return current_chunk()->count - 2;
+}
+
+// Points a jump emitted by emit_jump() at the next instruction.
+static void patch_jump(int operand)
+{
+	if (operand == -1)
+		return;
+	int distance = current_chunk()->count - operand - 2;
+	if (distance > UINT16_MAX)
+		error("Too much code to jump over.");
+	current_chunk()->code[operand] = (uint8_t)(distance >> 8);
+	current_chunk()->code[operand + 1] = (uint8_t)distance;
+}
+
+// Emits a jump back to the start of a loop.
+static void emit_loop(int loop_start)
+{
+	current->emitted_jumps = true;
+	emit_byte(OP_LOOP);
+	int distance = current_chunk()->count - loop_start + 2;
+	if (distance > UINT16_MAX)
+		error("Loop body too large.");
+	emit_byte((uint8_t)(distance >> 8));
+	emit_byte((uint8_t)distance);
+}
+
+/**
+ * emit_branch_if_false - Emits the jump taken when a condition is false.
+ * @start: Offset where the condition's code starts.
+ *
+ * A condition that is constantly truthy is removed and no jump is emitted.
+ * A trailing comparison is fused into the jump later, by optimize_jumps().
+ *
+ * Return: The operand offset for patch_jump(), or -1 if there is no jump.
+ */
+static int emit_branch_if_false(int start)
+{
+	value_t value;
+	if (emitted_constant(start, &value) && !is_null(value) && !(is_bool(value) && !as_bool(value)))
+	{
+		rewind_chunk(current_chunk(), start);
+		return -1;
+	}
+	return emit_jump(OP_JUMP_IF_FALSE);
+}
+
+static void begin_scope(void) { current->scope_depth++; }
+
+// Leaves a block, popping the slots of its locals in one instruction.
+static void end_scope(void)
+{
+	int slots = 0;
+	current->scope_depth--;
+	while (current->local_count > 0 && current->locals[current->local_count - 1].depth > current->scope_depth)
+	{
+		if (!current->locals[current->local_count - 1].is_folded)
+			slots++;
+		current->local_count--;
+	}
+	current->slot_count -= slots;
+	if (slots == 1)
+		emit_byte(OP_POP);
+	else if (slots > 1)
+		emit_bytes(OP_POPN, (uint8_t)slots);
+}
+
+// Compiles the declarations of a block up to its closing brace.
+static void block(void)
+{
+	while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
+		declaration();
+	consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+}
+
+static void statement(void);
+
+// Compiles the body of a loop or if in a scope of its own, so that it is
+// never mistaken for the program's final expression.
+static void body(void)
+{
+	begin_scope();
+	statement();
+	end_scope();
+}
+
+static void while_statement(void)
+{
+	int loop_start = current_chunk()->count;
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+	expression();
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+	int exit_jump = emit_branch_if_false(loop_start);
+	body();
+	emit_loop(loop_start);
+	patch_jump(exit_jump);
+}
+
+/**
+ * for_statement - Compiles for (initializer; condition; increment) body.
+ *
+ * The increment is compiled where it appears, then moved after the body,
+ * so each iteration runs the test, the body, the increment and a single
+ * backward jump.
+ */
+static void for_statement(void)
+{
+	chunk_t *chunk = current_chunk();
+	begin_scope();
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+	if (match(TOKEN_LET))
+	{
+		var_declaration(TOKEN_LET);
+	}
+	else if (!match(TOKEN_SEMICOLON))
+	{
+		expression();
+		consume(TOKEN_SEMICOLON, "Expect ';' after loop initializer.");
+		emit_byte(OP_POP);
+	}
+
+	int loop_start = chunk->count;
+	int exit_jump = -1;
+	if (!match(TOKEN_SEMICOLON))
+	{
+		expression();
+		consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+		exit_jump = emit_branch_if_false(loop_start);
+	}
+
+	int increment_start = chunk->count;
+	int increment_length = 0;
+	uint8_t *increment = NULL;
+	int *increment_lines = NULL;
+	if (!check(TOKEN_RIGHT_PAREN))
+	{
+		expression();
+		emit_byte(OP_POP);
+		increment_length = chunk->count - increment_start;
+		increment = malloc(increment_length);
+		increment_lines = malloc(sizeof(int) * increment_length);
+		if (increment == NULL || increment_lines == NULL)
+			exit(1);
+		for (int i = 0; i < increment_length; i++)
+		{
+			increment[i] = chunk->code[increment_start + i];
+			increment_lines[i] = get_line(chunk, increment_start + i);
+		}
+		rewind_chunk(chunk, increment_start);
+	}
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+
+	body();
+	for (int i = 0; i < increment_length; i++)
+		write_chunk(chunk, increment[i], increment_lines[i]);
+	free(increment);
+	free(increment_lines);
+	emit_loop(loop_start);
+	patch_jump(exit_jump);
+	end_scope();
+}
+
+static void if_statement(void)
+{
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+	int start = current_chunk()->count;
+	expression();
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+	int then_jump = emit_branch_if_false(start);
+	body();
+	if (match(TOKEN_ELSE))
+	{
+		int else_jump = emit_jump(OP_JUMP);
+		patch_jump(then_jump);
+		body();
+		patch_jump(else_jump);
+	}
+	else
+	{
+		patch_jump(then_jump);
+	}
+}
+
+static void statement(void)
+{
+	if (match(TOKEN_WHILE))
+		while_statement();
+	else if (match(TOKEN_FOR))
+		for_statement();
+	else if (match(TOKEN_IF))
+		if_statement();
+	else if (match(TOKEN_RETURN))
+		return_statement();
+	else if (match(TOKEN_LEFT_BRACE))
+	{
+		begin_scope();
+		block();
+		end_scope();
+	}
+	else
+	{
+		expression_statement();
+	}
+}
+
+// Skips to the next statement boundary after a syntax error.
+static void synchronize(void)
+{
+	parser.panic_mode = false;
+	while (parser.current.type != TOKEN_EOF)
+	{
+		if (parser.previous.type == TOKEN_SEMICOLON)
+			return;
+		switch (parser.current.type)
+		{
+		case TOKEN_LET:
+		case TOKEN_CONST:
+		case TOKEN_DEFINE:
+		case TOKEN_LEFT_BRACE:
+		case TOKEN_WHILE:
+		case TOKEN_FOR:
+		case TOKEN_IF:
+		case TOKEN_IMPORT:
+		case TOKEN_FN:
+		case TOKEN_CLASS:
+		case TOKEN_RETURN:
+			return;
+		default:
+			advance();
+		}
+	}
 }
 
-// Parses and emits bytecode for a ternary expression
-static void ternary(void)
+/**
+ * import_declaration - Compiles import "path";.
+ *
+ * Modules are loaded and run before the program that imports them is
+ * compiled (see load_imports()), so their globals are declared by then and
+ * the declaration compiles to nothing.
+ */
+static void import_declaration(void)
 {
-	parse_precedence(PREC_TERNARY + 1); // Higher precedence than ?:
-	consume(TOKEN_COLON, "Expect ':' after then branch of ternary expression.");
-	parse_precedence(PREC_TERNARY);
+	if (!imports_allowed)
+		error("Imports must come before anything else.");
+	consume(TOKEN_STRING, "Expect module path after 'import'.");
+	end_statement("Expect ';' after import.");
+}
+
+static void declaration(void)
+{
+	if (!check(TOKEN_IMPORT))
+		imports_allowed = false;
+	if (match(TOKEN_IMPORT))
+		import_declaration();
+	else if (match(TOKEN_LET) || match(TOKEN_CONST) || match(TOKEN_DEFINE))
+		var_declaration(parser.previous.type);
+	else if (match(TOKEN_FN))
+		fn_declaration();
+	else if (match(TOKEN_CLASS))
+		class_declaration();
+	else
+		statement();
+	if (parser.panic_mode)
+		synchronize();
+}
+
+/**
+ * compile_function - Compiles the body of a function deferred by compile().
+ * @function: The function; its source is freed once the body compiles.
+ *
+ * The body sees the globals declared before the function, as it would
+ * have when compiled in place, and functions declared after it.
+ *
+ * Return: false, with the errors reported, if the body does not compile;
+ * the function is left uncompiled then.
+ */
+bool compile_function(obj_function_t *function)
+{
+	int arity = function->arity;
+	lookahead_t tokens = {.count = 0, .next = 0};
+	if (vm.timings != NULL)
+	{
+		timings_begin(vm.timings, PHASE_COMPILE);
+		lookahead = &tokens;
+	}
+	init_scanner_at(function->source, function->line);
+	parser.had_error = false;
+	parser.panic_mode = false;
+	visible_globals = function->globals;
+	imports_allowed = false;
+	function->arity = 0;
+	advance();
+	function_body(function, TYPE_FUNCTION, NULL);
+	visible_globals = -1;
+	current = NULL;
+	free_array(operands);
+	operands = NULL;
+	operand_capacity = 0;
+	if (vm.timings != NULL)
+		timings_end(vm.timings);
+	lookahead = NULL;
+	if (parser.had_error)
+	{
+		free_chunk(function->chunk);
+		function->arity = arity;
+		return false;
+	}
+	free(function->source);
+	function->source = NULL;
+	return true;
 }
 
 // Compiles source code into bytecode.
 bool compile(const char *source, chunk_t *chunk)
 {
+	return compile_with_inputs(source, chunk, NULL, 0);
+}
+
+// Compiles source code that may refer to the given host-bound inputs by name.
+// Names resolve to locals first, then inputs, then globals. Globals persist
+// across compilations, except those declared by a program that fails.
+bool compile_with_inputs(const char *source, chunk_t *chunk, const char *const *inputs, int input_count)
+{
+	compiler_t compiler;
+	int global_count = vm.globals.count;
+
+	clear_error();
+	if (input_count > UINT8_MAX + 1)
+	{
+		report_error("Too many inputs (at most %d).", UINT8_MAX + 1);
+		return false;
+	}
+	lookahead_t tokens = {.count = 0, .next = 0};
+	if (vm.timings != NULL)
+	{
+		timings_begin(vm.timings, PHASE_COMPILE);
+		lookahead = &tokens;
+	}
+	compiling_inputs = inputs;
+	compiling_input_count = input_count;
 	init_scanner(source);
-	compiling_chunk = chunk;
+	gc_add_chunk(chunk); // Its constants are roots until free_chunk().
 	parser.had_error = false;
 	parser.panic_mode = false;
+	program_has_value = false;
+	imports_allowed = true;
+	init_compiler(&compiler, chunk, NULL, TYPE_SCRIPT);
 	advance();
-	expression();
-	consume(TOKEN_EOF, "Expect end of expression.");
+	while (!match(TOKEN_EOF))
+		declaration();
 	end_compiler();
+	for (int i = global_count; i < vm.globals.count; i++)
+	{
+		global_t *global = &vm.global_info[i];
+		if (global->forward_line == 0)
+			continue;
+		report_error("[line %d] Error at '%.*s': Undefined variable.", global->forward_line,
+			     string_length(&global->name), string_chars(&global->name));
+		parser.had_error = true;
+	}
+	compiling_inputs = NULL;
+	compiling_input_count = 0;
+	current = NULL;
+	free_array(operands);
+	operands = NULL;
+	operand_capacity = 0;
+	if (parser.had_error)
+		vm.globals.count = global_count;
+	if (vm.timings != NULL)
+		timings_end(vm.timings);
+	lookahead = NULL;
 	return !parser.had_error;
-}
\ No newline at end of file
+}
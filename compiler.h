@@ -3,6 +3,7 @@
 #define COMPILER_H
 #include "common.h"
 #include "chunk.h"
+#include "function.h"
 #include "scanner.h"
 
 #ifdef DEBUG_PRINT_CODE
@@ -27,6 +28,27 @@ typedef struct parser_s
     bool panic_mode;
 } parser_t;
 
+#define SCAN_AHEAD 64 // Tokens scanned at a time while compiling is timed.
+
+/**
+ * struct lookahead_s - Tokens scanned ahead of the parser.
+ * @tokens: The tokens, the next one at @next.
+ * @count: Number of tokens scanned into @tokens.
+ * @next: Index of the next token to hand to the parser.
+ *
+ * Description: While timings are taken, the parser reads its tokens from
+ * here and the scanner fills it SCAN_AHEAD tokens at a time inside a phase
+ * of its own, so scanning is timed apart from compiling without reading
+ * the clock and counters for every token. The scanner keeps no state the
+ * parser depends on, so scanning ahead changes nothing else.
+ */
+typedef struct lookahead_s
+{
+    token_t tokens[SCAN_AHEAD];
+    int count;
+    int next;
+} lookahead_t;
+
 /**
  * enum precedence_s - Represents the precedence levels for parsing expressions.
  * @PREC_NONE: No precedence (lowest).
@@ -61,7 +83,7 @@ typedef enum precedence_s
     PREC_PRIMARY
 } precedence_t;
 
-typedef void (*parse_fn)(void);
+typedef void (*parse_fn)(bool can_assign);
 
 /**
  * struct parse_rule_s - Represents a parsing rule for a token type.
@@ -79,6 +101,139 @@ typedef struct parse_rule_s
     precedence_t precedence;
 } parse_rule_t;
 
+#define NESTING_MAX 1024 // Deepest nesting of brackets, calls and assignments.
+
+/**
+ * enum operand_step_s - What is emitted once a pending operand is parsed.
+ * @STEP_EXPRESSION: Nothing; the operand is the whole expression.
+ * @STEP_GROUPING: The closing parenthesis is consumed.
+ * @STEP_UNARY: The instruction of a prefix operator.
+ * @STEP_BINARY: The instruction of an infix operator.
+ * @STEP_LOGICAL: The jump of `and` or `or` is patched.
+ * @STEP_THEN: The jump over the else branch of ?:, whose operand follows.
+ * @STEP_ELSE: The jump past the else branch is patched.
+ */
+typedef enum operand_step_s
+{
+    STEP_EXPRESSION,
+    STEP_GROUPING,
+    STEP_UNARY,
+    STEP_BINARY,
+    STEP_LOGICAL,
+    STEP_THEN,
+    STEP_ELSE
+} operand_step_t;
+
+/**
+ * struct operand_s - An operand the expression parser has yet to finish.
+ * @precedence: Lowest precedence of the operators it may contain.
+ * @can_assign: Whether it may be an assignment.
+ * @start: Offset in the chunk where its code starts.
+ * @step: What to emit after it.
+ * @operator: The operator it belongs to, for STEP_UNARY and STEP_BINARY.
+ * @jump: The jump to patch, for STEP_LOGICAL, STEP_THEN and STEP_ELSE.
+ *
+ * Description: Operators push the operands they wait for on a stack rather
+ * than parsing them recursively, so nesting is bounded by memory, not by
+ * the C stack. Each entry stands for one call of the recursive parser.
+ */
+typedef struct operand_s
+{
+    precedence_t precedence;
+    bool can_assign;
+    int start;
+    operand_step_t step;
+    token_type_t operator;
+    int jump;
+} operand_t;
+
+/**
+ * struct builtin_s - A builtin function, compiled to a single instruction.
+ * @name: The name it is called by.
+ * @opcode: The instruction a call compiles to.
+ * @arity: Number of arguments; a name may have one entry per arity.
+ *
+ * Description: Builtins are only found when no variable of the same name
+ * is in scope. Their arguments are left on the stack for the instruction.
+ */
+typedef struct builtin_s
+{
+    const char *name;
+    uint8_t opcode;
+    int arity;
+} builtin_t;
+
+#define LOCALS_MAX (UINT8_MAX + 1)
+
+/**
+ * struct local_s - A block-scoped variable.
+ * @name: The token that declared it.
+ * @depth: Scope depth of its block, or -1 while its initializer is compiled.
+ * @slot: The stack slot holding its value; unused when folded.
+ * @is_const: Whether assignments to it are rejected.
+ * @is_folded: Whether its value was known at compile time.
+ * @load: For a folded variable, the instruction that loads its value
+ *        (an opcode and, for OP_CONSTANT, its operand).
+ */
+typedef struct local_s
+{
+    token_t name;
+    int depth;
+    int slot;
+    bool is_const;
+    bool is_folded;
+    uint8_t load[2];
+} local_t;
+
+/**
+ * enum function_type_s - The kinds of code a compiler compiles.
+ * @TYPE_SCRIPT: A script's top level.
+ * @TYPE_FUNCTION: A function declared with fn.
+ * @TYPE_METHOD: A method, which has `this` in slot 0.
+ * @TYPE_INITIALIZER: A class's init method, which returns `this`.
+ */
+typedef enum function_type_s
+{
+    TYPE_SCRIPT,
+    TYPE_FUNCTION,
+    TYPE_METHOD,
+    TYPE_INITIALIZER
+} function_type_t;
+
+/**
+ * struct compiler_s - Variables in scope in the code being compiled.
+ * @enclosing: The compiler of the surrounding code, or NULL for a script.
+ * @function: The function being compiled, or NULL for a script.
+ * @type: What kind of code it is.
+ * @klass: For a method, the class being declared.
+ * @chunk: Where the code goes.
+ * @locals: The variables, innermost last.
+ * @local_count: Number of entries in @locals.
+ * @slot_count: Number of stack slots the locals occupy.
+ * @scope_depth: Number of blocks around the current statement.
+ * @emitted_jumps: Whether the code has jumps or calls for optimize_jumps().
+ *
+ * Description: Every local is resolved to a stack slot while compiling,
+ * so the VM addresses it by index and never looks a name up. A function
+ * gets a compiler of its own; its slot 0 holds the function, or the
+ * receiver of a method, and its parameters follow.
+ */
+typedef struct compiler_s
+{
+    struct compiler_s *enclosing;
+    obj_function_t *function;
+    function_type_t type;
+    struct obj_class_s *klass;
+    chunk_t *chunk;
+    local_t locals[LOCALS_MAX];
+    int local_count;
+    int slot_count;
+    int scope_depth;
+    bool emitted_jumps;
+} compiler_t;
+
 bool compile(const char *source, chunk_t *chunk);
+bool compile_with_inputs(const char *source, chunk_t *chunk, const char *const *inputs, int input_count);
+bool compile_function(obj_function_t *function);
 
 #endif // COMPILER_H
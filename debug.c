@@ -2,6 +2,112 @@
 #include "debug.h"
 #include "chunk.h"
 
+static const char *const opcode_names[] = {
+	[OP_CONSTANT] = "OP_CONSTANT",
+	[OP_INPUT] = "OP_INPUT",
+	[OP_POP] = "OP_POP",
+	[OP_POPN] = "OP_POPN",
+	[OP_GET_LOCAL] = "OP_GET_LOCAL",
+	[OP_SET_LOCAL] = "OP_SET_LOCAL",
+	[OP_GET_GLOBAL] = "OP_GET_GLOBAL",
+	[OP_SET_GLOBAL] = "OP_SET_GLOBAL",
+	[OP_DEFINE_GLOBAL] = "OP_DEFINE_GLOBAL",
+	[OP_NEGATE] = "OP_NEGATE",
+	[OP_ADD] = "OP_ADD",
+	[OP_SUBTRACT] = "OP_SUBTRACT",
+	[OP_MULTIPLY] = "OP_MULTIPLY",
+	[OP_DIVIDE] = "OP_DIVIDE",
+	[OP_TRUE] = "OP_TRUE",
+	[OP_FALSE] = "OP_FALSE",
+	[OP_NOT] = "OP_NOT",
+	[OP_EQUAL] = "OP_EQUAL",
+	[OP_GREATER] = "OP_GREATER",
+	[OP_LESS] = "OP_LESS",
+	[OP_RETURN] = "OP_RETURN",
+	[OP_CALL] = "OP_CALL",
+	[OP_TAIL_CALL] = "OP_TAIL_CALL",
+	[OP_GET_PROPERTY] = "OP_GET_PROPERTY",
+	[OP_SET_PROPERTY] = "OP_SET_PROPERTY",
+	[OP_INVOKE] = "OP_INVOKE",
+	[OP_SUPER_INVOKE] = "OP_SUPER_INVOKE",
+	[OP_NULL] = "OP_NULL",
+	[OP_ARRAY] = "OP_ARRAY",
+	[OP_GET_INDEX] = "OP_GET_INDEX",
+	[OP_SET_INDEX] = "OP_SET_INDEX",
+	[OP_LEN] = "OP_LEN",
+	[OP_SUM] = "OP_SUM",
+	[OP_ARRAY_MIN] = "OP_ARRAY_MIN",
+	[OP_ARRAY_MAX] = "OP_ARRAY_MAX",
+	[OP_DOT] = "OP_DOT",
+	[OP_PUSH] = "OP_PUSH",
+	[OP_RANGE] = "OP_RANGE",
+	[OP_FILL] = "OP_FILL",
+	[OP_MAP] = "OP_MAP",
+	[OP_MAP_HAS] = "OP_MAP_HAS",
+	[OP_MAP_DELETE] = "OP_MAP_DELETE",
+	[OP_MAP_KEYS] = "OP_MAP_KEYS",
+	[OP_ARRAY_MAP] = "OP_ARRAY_MAP",
+	[OP_ARRAY_FILTER] = "OP_ARRAY_FILTER",
+	[OP_ARRAY_REDUCE] = "OP_ARRAY_REDUCE",
+	[OP_ARRAY_SORT] = "OP_ARRAY_SORT",
+	[OP_MMAP] = "OP_MMAP",
+	[OP_SHAPE] = "OP_SHAPE",
+	[OP_SQRT] = "OP_SQRT",
+	[OP_ABS] = "OP_ABS",
+	[OP_FLOOR] = "OP_FLOOR",
+	[OP_CEIL] = "OP_CEIL",
+	[OP_ROUND] = "OP_ROUND",
+	[OP_EXP] = "OP_EXP",
+	[OP_LOG] = "OP_LOG",
+	[OP_SIN] = "OP_SIN",
+	[OP_COS] = "OP_COS",
+	[OP_TAN] = "OP_TAN",
+	[OP_ASIN] = "OP_ASIN",
+	[OP_ACOS] = "OP_ACOS",
+	[OP_ATAN] = "OP_ATAN",
+	[OP_MIN] = "OP_MIN",
+	[OP_MAX] = "OP_MAX",
+	[OP_POW] = "OP_POW",
+	[OP_ATAN2] = "OP_ATAN2",
+	[OP_JUMP] = "OP_JUMP",
+	[OP_JUMP_SHORT] = "OP_JUMP_SHORT",
+	[OP_JUMP_IF_FALSE] = "OP_JUMP_IF_FALSE",
+	[OP_JUMP_IF_FALSE_SHORT] = "OP_JUMP_IF_FALSE_SHORT",
+	[OP_JUMP_IF_LESS] = "OP_JUMP_IF_LESS",
+	[OP_JUMP_IF_LESS_SHORT] = "OP_JUMP_IF_LESS_SHORT",
+	[OP_JUMP_IF_NOT_LESS] = "OP_JUMP_IF_NOT_LESS",
+	[OP_JUMP_IF_NOT_LESS_SHORT] = "OP_JUMP_IF_NOT_LESS_SHORT",
+	[OP_JUMP_IF_GREATER] = "OP_JUMP_IF_GREATER",
+	[OP_JUMP_IF_GREATER_SHORT] = "OP_JUMP_IF_GREATER_SHORT",
+	[OP_JUMP_IF_NOT_GREATER] = "OP_JUMP_IF_NOT_GREATER",
+	[OP_JUMP_IF_NOT_GREATER_SHORT] = "OP_JUMP_IF_NOT_GREATER_SHORT",
+	[OP_JUMP_IF_EQUAL] = "OP_JUMP_IF_EQUAL",
+	[OP_JUMP_IF_EQUAL_SHORT] = "OP_JUMP_IF_EQUAL_SHORT",
+	[OP_JUMP_IF_NOT_EQUAL] = "OP_JUMP_IF_NOT_EQUAL",
+	[OP_JUMP_IF_NOT_EQUAL_SHORT] = "OP_JUMP_IF_NOT_EQUAL_SHORT",
+	[OP_JUMP_IF_TRUE] = "OP_JUMP_IF_TRUE",
+	[OP_JUMP_IF_TRUE_SHORT] = "OP_JUMP_IF_TRUE_SHORT",
+	[OP_JUMP_IF_FALSE_OR_POP] = "OP_JUMP_IF_FALSE_OR_POP",
+	[OP_JUMP_IF_FALSE_OR_POP_SHORT] = "OP_JUMP_IF_FALSE_OR_POP_SHORT",
+	[OP_JUMP_IF_TRUE_OR_POP] = "OP_JUMP_IF_TRUE_OR_POP",
+	[OP_JUMP_IF_TRUE_OR_POP_SHORT] = "OP_JUMP_IF_TRUE_OR_POP_SHORT",
+	[OP_LOOP] = "OP_LOOP",
+	[OP_LOOP_SHORT] = "OP_LOOP_SHORT",
+};
+
+/**
+ * opcode_name - Returns the printable name of an opcode.
+ * @opcode: The opcode to name.
+ *
+ * Return: The opcode's name, or "OP_UNKNOWN" for bytes that are not opcodes.
+ */
+const char *opcode_name(uint8_t opcode)
+{
+	if (opcode >= sizeof(opcode_names) / sizeof(opcode_names[0]) || opcode_names[opcode] == NULL)
+		return ("OP_UNKNOWN");
+	return (opcode_names[opcode]);
+}
+
 /**
  * disassemble_chunk - Disassembles a chunk of bytecode.
  * @chunk: Pointer to the chunk to disassemble.
@@ -53,6 +159,21 @@ int disassemble_instruction(chunk_t *chunk, int offset)
 	{
 	case OP_RETURN:
 		return simple_instruction("OP_RETURN", offset);
+	case OP_CALL:
+		return byte_instruction("OP_CALL", chunk, offset);
+	case OP_TAIL_CALL:
+		return byte_instruction("OP_TAIL_CALL", chunk, offset);
+	case OP_GET_PROPERTY:
+		return property_instruction("OP_GET_PROPERTY", chunk, offset);
+	case OP_SET_PROPERTY:
+		return property_instruction("OP_SET_PROPERTY", chunk, offset);
+	case OP_INVOKE:
+		return property_instruction("OP_INVOKE", chunk, offset);
+	case OP_SUPER_INVOKE:
+		printf("%-16s %4d (%d args) ", "OP_SUPER_INVOKE", chunk->code[offset + 1], chunk->code[offset + 2]);
+		print_value(chunk->constants.values[chunk->code[offset + 1]]);
+		printf("\n");
+		return (offset + 3);
 
 	case OP_NEGATE:
 		return simple_instruction("OP_NEGATE", offset);
@@ -83,8 +204,104 @@ int disassemble_instruction(chunk_t *chunk, int offset)
 
 	case OP_CONSTANT:
 		return constant_instruction("OP_CONSTANT", chunk, offset);
+	case OP_INPUT:
+		return byte_instruction("OP_INPUT", chunk, offset);
+	case OP_POP:
+		return simple_instruction("OP_POP", offset);
+	case OP_POPN:
+		return byte_instruction("OP_POPN", chunk, offset);
+
+	case OP_GET_LOCAL:
+		return byte_instruction("OP_GET_LOCAL", chunk, offset);
+	case OP_SET_LOCAL:
+		return byte_instruction("OP_SET_LOCAL", chunk, offset);
+	case OP_GET_GLOBAL:
+		return byte_instruction("OP_GET_GLOBAL", chunk, offset);
+	case OP_SET_GLOBAL:
+		return byte_instruction("OP_SET_GLOBAL", chunk, offset);
+	case OP_DEFINE_GLOBAL:
+		return byte_instruction("OP_DEFINE_GLOBAL", chunk, offset);
+
+	case OP_ARRAY:
+		return byte_instruction("OP_ARRAY", chunk, offset);
+	case OP_GET_INDEX:
+		return simple_instruction("OP_GET_INDEX", offset);
+	case OP_SET_INDEX:
+		return simple_instruction("OP_SET_INDEX", offset);
+	case OP_LEN:
+		return simple_instruction("OP_LEN", offset);
+	case OP_SUM:
+		return simple_instruction("OP_SUM", offset);
+	case OP_ARRAY_MIN:
+		return simple_instruction("OP_ARRAY_MIN", offset);
+	case OP_ARRAY_MAX:
+		return simple_instruction("OP_ARRAY_MAX", offset);
+	case OP_DOT:
+		return simple_instruction("OP_DOT", offset);
+	case OP_PUSH:
+		return simple_instruction("OP_PUSH", offset);
+	case OP_RANGE:
+		return simple_instruction("OP_RANGE", offset);
+	case OP_FILL:
+		return simple_instruction("OP_FILL", offset);
+	case OP_MAP:
+		return byte_instruction("OP_MAP", chunk, offset);
+	case OP_MAP_HAS:
+		return simple_instruction("OP_MAP_HAS", offset);
+	case OP_MAP_DELETE:
+		return simple_instruction("OP_MAP_DELETE", offset);
+	case OP_MAP_KEYS:
+		return simple_instruction("OP_MAP_KEYS", offset);
+	case OP_ARRAY_MAP:
+		return simple_instruction("OP_ARRAY_MAP", offset);
+	case OP_ARRAY_FILTER:
+		return simple_instruction("OP_ARRAY_FILTER", offset);
+	case OP_ARRAY_REDUCE:
+		return simple_instruction("OP_ARRAY_REDUCE", offset);
+	case OP_ARRAY_SORT:
+		return simple_instruction("OP_ARRAY_SORT", offset);
+	case OP_MMAP:
+		return simple_instruction("OP_MMAP", offset);
+	case OP_SHAPE:
+		return simple_instruction("OP_SHAPE", offset);
+	case OP_SQRT:
+		return simple_instruction("OP_SQRT", offset);
+	case OP_ABS:
+		return simple_instruction("OP_ABS", offset);
+	case OP_FLOOR:
+		return simple_instruction("OP_FLOOR", offset);
+	case OP_CEIL:
+		return simple_instruction("OP_CEIL", offset);
+	case OP_ROUND:
+		return simple_instruction("OP_ROUND", offset);
+	case OP_EXP:
+		return simple_instruction("OP_EXP", offset);
+	case OP_LOG:
+		return simple_instruction("OP_LOG", offset);
+	case OP_SIN:
+		return simple_instruction("OP_SIN", offset);
+	case OP_COS:
+		return simple_instruction("OP_COS", offset);
+	case OP_TAN:
+		return simple_instruction("OP_TAN", offset);
+	case OP_ASIN:
+		return simple_instruction("OP_ASIN", offset);
+	case OP_ACOS:
+		return simple_instruction("OP_ACOS", offset);
+	case OP_ATAN:
+		return simple_instruction("OP_ATAN", offset);
+	case OP_MIN:
+		return simple_instruction("OP_MIN", offset);
+	case OP_MAX:
+		return simple_instruction("OP_MAX", offset);
+	case OP_POW:
+		return simple_instruction("OP_POW", offset);
+	case OP_ATAN2:
+		return simple_instruction("OP_ATAN2", offset);
 
 	default:
+		if (is_jump(instruction))
+			return jump_instruction(chunk, offset);
 		printf("Unknown opcode %d\n", instruction);
 		return (offset + 1);
 	}
@@ -106,6 +323,34 @@ static int simple_instruction(const char *name, int offset)
 	return (offset + 1);
 }
 
+/**
+ * byte_instruction - Prints an instruction with a one-byte operand.
+ * @name: Name of the instruction.
+ * @chunk: Pointer to the chunk containing the instruction.
+ * @offset: Offset of the instruction in the chunk's code array.
+ *
+ * Return: The offset of the next instruction.
+ */
+static int byte_instruction(const char *name, chunk_t *chunk, int offset)
+{
+	uint8_t operand = chunk->code[offset + 1];
+	printf("%-16s %4d\n", name, operand);
+	return (offset + 2);
+}
+
+/**
+ * jump_instruction - Prints a jump, in either width, with its target.
+ * @chunk: Pointer to the chunk containing the instruction.
+ * @offset: Offset of the instruction in the chunk's code array.
+ *
+ * Return: The offset of the next instruction.
+ */
+static int jump_instruction(chunk_t *chunk, int offset)
+{
+	printf("%-16s %4d -> %d\n", opcode_name(chunk->code[offset]), offset, jump_target(chunk, offset));
+	return (offset + instruction_length(chunk->code[offset]));
+}
+
 /**
  * constant_instruction - Prints a constant instruction (with operands).
  * @name: Name of the instruction.
@@ -125,3 +370,26 @@ static int constant_instruction(const char *name, chunk_t *chunk, int offset)
 	printf("'\n");
 	return (offset + 2);
 }
+
+/**
+ * property_instruction - Prints a property access with its name and cache.
+ * @name: Name of the instruction.
+ * @chunk: Pointer to the chunk containing the instruction.
+ * @offset: Offset of the instruction in the chunk's code array.
+ *
+ * Return: The offset of the next instruction.
+ */
+static int property_instruction(const char *name, chunk_t *chunk, int offset)
+{
+	uint8_t constant = chunk->code[offset + 1];
+	bool invoke = chunk->code[offset] == OP_INVOKE;
+	int cache = chunk->code[offset + 2 + invoke] << 8 | chunk->code[offset + 3 + invoke];
+	printf("%-16s %4d '", name, constant);
+	print_value(chunk->constants.values[constant]);
+	if (invoke)
+		printf("' (%d args)", chunk->code[offset + 2]);
+	else
+		printf("'");
+	printf(" [cache %d]\n", cache);
+	return (offset + instruction_length(chunk->code[offset]));
+}
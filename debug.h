@@ -4,5 +4,9 @@
 
 void disassemble_chunk(chunk_t *chunk, const char *name);
 int disassemble_instruction(chunk_t *chunk, int offset);
+const char *opcode_name(uint8_t opcode);
 static int simple_instruction(const char *name, int offset);
-static int constant_instruction(const char *name, chunk_t *chunk, int offset);
\ No newline at end of file
+static int byte_instruction(const char *name, chunk_t *chunk, int offset);
+static int jump_instruction(chunk_t *chunk, int offset);
+static int constant_instruction(const char *name, chunk_t *chunk, int offset);
+static int property_instruction(const char *name, chunk_t *chunk, int offset);
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "error.h"
+
+// Shared by every thread, each of which may set it through charis_init().
+static _Atomic(FILE *) error_stream;
+static atomic_bool error_stream_set;
+static _Thread_local char first_error[ERROR_MESSAGE_MAX]; // Each thread compiles and runs on its own.
+
+/**
+ * set_error_stream - Chooses where reported errors are echoed.
+ * @stream: The stream to print errors to, or NULL to only record them.
+ *
+ * Errors go to stderr until this is called. Embedders pass NULL and read
+ * the message back with last_error() instead.
+ */
+void set_error_stream(FILE *stream)
+{
+	atomic_store(&error_stream, stream);
+	atomic_store(&error_stream_set, true);
+}
+
+/**
+ * clear_error - Forgets the recorded error before a new compile or run.
+ */
+void clear_error(void)
+{
+	first_error[0] = '\0';
+}
+
+/**
+ * report_error - Records an error message and echoes it to the error stream.
+ * @format: printf-style format of the message, without a trailing newline.
+ *
+ * Only the first error since clear_error() is kept, since later ones are
+ * usually knock-on effects of it; every error is still echoed, after
+ * whatever the program printed before it.
+ */
+void report_error(const char *format, ...)
+{
+	char message[ERROR_MESSAGE_MAX];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+
+	if (first_error[0] == '\0')
+		snprintf(first_error, sizeof(first_error), "%s", message);
+
+	FILE *stream = atomic_load(&error_stream_set) ? atomic_load(&error_stream) : stderr;
+	if (stream != NULL)
+	{
+		fflush(stdout);
+		fprintf(stream, "%s\n", message);
+	}
+}
+
+/**
+ * last_error - Returns the first error recorded since clear_error().
+ *
+ * Return: The message, or an empty string when nothing went wrong.
+ */
+const char *last_error(void)
+{
+	return (first_error);
+}
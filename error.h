@@ -0,0 +1,14 @@
+#pragma once
+#ifndef ERROR_H
+#define ERROR_H
+
+#include <stdio.h>
+
+#define ERROR_MESSAGE_MAX 512
+
+void set_error_stream(FILE *stream);
+void clear_error(void);
+void report_error(const char *format, ...) __attribute__((format(printf, 1, 2)));
+const char *last_error(void);
+
+#endif // ERROR_H
@@ -0,0 +1,327 @@
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include "format.h"
+
+#define G_PRECISION 6     // Significant digits of %g.
+#define SHORTEST_FIRST 15 // Any decimal of this many digits survives a round trip.
+#define DIGITS_MAX 17     // Digits that always identify a double.
+
+typedef unsigned __int128 uint128_t;
+
+static const uint64_t powers_of_5[] = {
+	1u,
+	5u,
+	25u,
+	125u,
+	625u,
+	3125u,
+	15625u,
+	78125u,
+	390625u,
+	1953125u,
+	9765625u,
+	48828125u,
+	244140625u,
+	1220703125u,
+	6103515625u,
+	30517578125u,
+	152587890625u,
+	762939453125u,
+	3814697265625u,
+	19073486328125u,
+	95367431640625u,
+	476837158203125u,
+	2384185791015625u,
+	11920928955078125u,
+	59604644775390625u,
+	298023223876953125u,
+	1490116119384765625u,
+	7450580596923828125u,
+};
+
+static const uint64_t powers_of_10[] = {
+	1u,
+	10u,
+	100u,
+	1000u,
+	10000u,
+	100000u,
+	1000000u,
+	10000000u,
+	100000000u,
+	1000000000u,
+	10000000000u,
+	100000000000u,
+	1000000000000u,
+	10000000000000u,
+	100000000000000u,
+	1000000000000000u,
+	10000000000000000u,
+	100000000000000000u,
+};
+
+// Powers of ten that are exact doubles.
+static const double exact_powers_of_10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+					    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+					    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#define POWERS_OF_5_MAX ((int)(sizeof(powers_of_5) / sizeof(powers_of_5[0])) - 1)
+#define EXACT_POWERS_MAX ((int)(sizeof(exact_powers_of_10) / sizeof(exact_powers_of_10[0])) - 1)
+
+/**
+ * scale_exactly - Rounds mantissa * 2^binary * 10^decimal to an integer.
+ * @mantissa: Mantissa of a double, below 2^53.
+ * @binary: Its binary exponent.
+ * @decimal: Power of ten to scale by.
+ * @result: Receives the result, rounded half to even.
+ *
+ * The product is kept as an exact fraction of 128-bit integers, so the
+ * rounding is the one printf() does on the exact binary value.
+ *
+ * Return: false if the fraction or the result does not fit.
+ */
+static bool scale_exactly(uint64_t mantissa, int binary, int decimal, uint64_t *result)
+{
+	uint128_t numerator;
+	uint128_t denominator;
+	if (decimal >= 0)
+	{
+		if (decimal > POWERS_OF_5_MAX)
+			return (false);
+		numerator = (uint128_t)mantissa * powers_of_5[decimal];
+		int shift = binary + decimal;
+		if (shift >= 0)
+		{
+			if (shift >= 64 || (numerator >> (64 - shift)) != 0)
+				return (false);
+			*result = (uint64_t)(numerator << shift);
+			return (true);
+		}
+		if (-shift >= 127)
+			return (false);
+		// Dividing by a power of two is a shift; it is also the usual case.
+		uint128_t half = (uint128_t)1 << (-shift - 1);
+		uint128_t quotient = numerator >> -shift;
+		uint128_t remainder = numerator & ((half << 1) - 1);
+		if (remainder > half || (remainder == half && (quotient & 1)))
+			quotient++;
+		if ((quotient >> 64) != 0)
+			return (false);
+		*result = (uint64_t)quotient;
+		return (true);
+	}
+	else
+	{
+		if (-decimal > POWERS_OF_5_MAX)
+			return (false);
+		int shift = binary + decimal;
+		if (shift > 74 || shift < -64)
+			return (false);
+		numerator = shift >= 0 ? (uint128_t)mantissa << shift : mantissa;
+		denominator = (uint128_t)powers_of_5[-decimal] << (shift >= 0 ? 0 : -shift);
+	}
+
+	uint128_t quotient = numerator / denominator;
+	uint128_t remainder = numerator % denominator;
+	if (remainder > denominator - remainder || (remainder == denominator - remainder && (quotient & 1)))
+		quotient++;
+	if ((quotient >> 64) != 0)
+		return (false);
+	*result = (uint64_t)quotient;
+	return (true);
+}
+
+/**
+ * decimal_digits - Rounds a positive finite number to significant digits.
+ * @number: The number.
+ * @precision: Digits wanted, at most DIGITS_MAX.
+ * @digits: Receives exactly @precision digits, without a terminator.
+ * @exponent: Receives the decimal exponent of the first digit.
+ *
+ * Numbers too large or too small for scale_exactly() are left to
+ * snprintf(), which rounds the same way.
+ */
+static void decimal_digits(double number, int precision, char *digits, int *exponent)
+{
+	uint64_t bits;
+	memcpy(&bits, &number, sizeof(bits));
+	int biased = (int)(bits >> 52) & 0x7ff;
+	uint64_t mantissa = bits & (((uint64_t)1 << 52) - 1);
+	int binary = -1074;
+	if (biased != 0)
+	{
+		mantissa |= (uint64_t)1 << 52;
+		binary = biased - 1075;
+	}
+
+	// floor(log2(number) * log10(2)) is the exponent or one less; a carry
+	// when rounding can add one more.
+	int log2 = binary + 63 - __builtin_clzll(mantissa);
+	int estimate = (int)floor(log2 * 0.30102999566398120);
+	for (int guess = estimate; guess <= estimate + 2; guess++)
+	{
+		uint64_t scaled;
+		if (!scale_exactly(mantissa, binary, precision - 1 - guess, &scaled))
+			break;
+		if (scaled < powers_of_10[precision])
+		{
+			for (int i = precision - 1; i >= 0; i--, scaled /= 10)
+				digits[i] = (char)('0' + scaled % 10);
+			*exponent = guess;
+			return;
+		}
+	}
+
+	char text[NUMBER_BUFFER_SIZE];
+	snprintf(text, sizeof(text), "%.*e", precision - 1, number);
+	digits[0] = text[0];
+	memcpy(digits + 1, text + 2, precision - 1);
+	*exponent = atoi(strchr(text, 'e') + 1);
+}
+
+// Checks whether a decimal reads back as the number it was made from.
+static bool reads_back(double number, const char *digits, int count, int exponent)
+{
+	int scale = count - 1 - exponent;
+	if (count <= SHORTEST_FIRST && scale >= -EXACT_POWERS_MAX && scale <= EXACT_POWERS_MAX)
+	{
+		// Both operands are exact, so the one rounding is strtod()'s.
+		uint64_t integer = 0;
+		for (int i = 0; i < count; i++)
+			integer = integer * 10 + (uint64_t)(digits[i] - '0');
+		double value = scale >= 0 ? (double)integer / exact_powers_of_10[scale]
+					  : (double)integer * exact_powers_of_10[-scale];
+		return (value == number);
+	}
+
+	char text[NUMBER_BUFFER_SIZE];
+	memcpy(text, digits, count);
+	snprintf(text + count, sizeof(text) - count, "e%d", -scale);
+	return (strtod(text, NULL) == number);
+}
+
+/**
+ * shortest_digits - Finds the fewest digits that read back as a number.
+ * @number: A positive finite number.
+ * @digits: Receives the digits, possibly with trailing zeros.
+ * @exponent: Receives the decimal exponent of the first digit.
+ *
+ * If any decimal of at most SHORTEST_FIRST digits reads back as a normal
+ * @number, rounding to that many digits finds it, padded with zeros;
+ * otherwise the closest 16-digit decimal is tried before settling for 17.
+ *
+ * Return: Number of digits written.
+ */
+static int shortest_digits(double number, char *digits, int *exponent)
+{
+	// Subnormals carry fewer significant bits, so short decimals can read
+	// back as them without being the nearest of their length.
+	int first = number < DBL_MIN ? 1 : SHORTEST_FIRST;
+	for (int precision = first; precision < DIGITS_MAX; precision++)
+	{
+		decimal_digits(number, precision, digits, exponent);
+		if (reads_back(number, digits, precision, *exponent))
+			return (precision);
+	}
+	decimal_digits(number, DIGITS_MAX, digits, exponent);
+	return (DIGITS_MAX);
+}
+
+// Counts the digits left once trailing zeros are dropped.
+static int significant(const char *digits, int count)
+{
+	while (count > 1 && digits[count - 1] == '0')
+		count--;
+	return (count);
+}
+
+/**
+ * layout - Writes significant digits the way %g does.
+ * @buffer: Where to write, NUMBER_BUFFER_SIZE bytes.
+ * @negative: Whether to write a minus sign.
+ * @digits: The digits.
+ * @count: Number of digits, with no trailing zeros.
+ * @exponent: Decimal exponent of the first digit.
+ * @precision: Exponents from -4 to below this are written without 'e'.
+ *
+ * Return: The length written.
+ */
+static int layout(char *buffer, bool negative, const char *digits, int count, int exponent, int precision)
+{
+	char *out = buffer;
+	if (negative)
+		*out++ = '-';
+
+	if (exponent < -4 || exponent >= precision)
+	{
+		*out++ = digits[0];
+		if (count > 1)
+		{
+			*out++ = '.';
+			memcpy(out, digits + 1, count - 1);
+			out += count - 1;
+		}
+		*out++ = 'e';
+		*out++ = exponent < 0 ? '-' : '+';
+		int magnitude = abs(exponent);
+		if (magnitude >= 100)
+			*out++ = (char)('0' + magnitude / 100);
+		*out++ = (char)('0' + magnitude / 10 % 10);
+		*out++ = (char)('0' + magnitude % 10);
+	}
+	else if (exponent >= 0)
+	{
+		for (int i = 0; i <= exponent; i++)
+			*out++ = i < count ? digits[i] : '0';
+		if (count > exponent + 1)
+		{
+			*out++ = '.';
+			memcpy(out, digits + exponent + 1, count - exponent - 1);
+			out += count - exponent - 1;
+		}
+	}
+	else
+	{
+		*out++ = '0';
+		*out++ = '.';
+		for (int i = -1; i > exponent; i--)
+			*out++ = '0';
+		memcpy(out, digits, count);
+		out += count;
+	}
+	*out = '\0';
+	return ((int)(out - buffer));
+}
+
+/**
+ * format_number - Formats a number for printing.
+ * @number: The number.
+ * @format: NUMBER_FORMAT_G for printf("%g")'s output, byte for byte, or
+ *          NUMBER_FORMAT_SHORTEST.
+ * @buffer: Receives the text, NUL-terminated; NUMBER_BUFFER_SIZE bytes.
+ *
+ * Digits are produced with integer arithmetic rather than through stdio,
+ * which parses a format and consults the locale on every call.
+ *
+ * Return: The length of the text.
+ */
+int format_number(double number, number_format_t format, char *buffer)
+{
+	if (!isfinite(number))
+		return (snprintf(buffer, NUMBER_BUFFER_SIZE, "%g", number));
+
+	bool negative = signbit(number);
+	if (number == 0)
+		return (layout(buffer, negative, "0", 1, 0, G_PRECISION));
+
+	char digits[DIGITS_MAX];
+	int exponent;
+	if (format == NUMBER_FORMAT_G)
+	{
+		decimal_digits(fabs(number), G_PRECISION, digits, &exponent);
+		return (layout(buffer, negative, digits, significant(digits, G_PRECISION), exponent, G_PRECISION));
+	}
+	int count = shortest_digits(fabs(number), digits, &exponent);
+	return (layout(buffer, negative, digits, significant(digits, count), exponent, DIGITS_MAX));
+}
@@ -0,0 +1,24 @@
+#pragma once
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "common.h"
+
+#define NUMBER_BUFFER_SIZE 32          // Enough for any formatted number.
+#define OUTPUT_BUFFER_SIZE (64 * 1024) // Bytes of stdout written at once.
+
+/**
+ * enum number_format_s - How numbers are printed.
+ * @NUMBER_FORMAT_G: Exactly as printf("%g"): six significant digits.
+ * @NUMBER_FORMAT_SHORTEST: The fewest digits that read back as the same
+ *                          number, laid out like %g with up to 17 digits.
+ */
+typedef enum number_format_s
+{
+	NUMBER_FORMAT_G,
+	NUMBER_FORMAT_SHORTEST
+} number_format_t;
+
+int format_number(double number, number_format_t format, char *buffer);
+
+#endif // FORMAT_H
@@ -0,0 +1,46 @@
+#include "function.h"
+#include "gc.h"
+
+/**
+ * new_function - Allocates a function with an empty chunk, no parameters
+ * and a null name.
+ *
+ * The function is not reachable from anything yet, so the caller must
+ * root it before allocating again.
+ *
+ * Return: The function value.
+ */
+value_t new_function(void)
+{
+	chunk_t *chunk = malloc(sizeof(chunk_t));
+	if (chunk == NULL)
+		exit(1);
+	init_chunk(chunk);
+
+	obj_function_t *function = (obj_function_t *)allocate_tenured(sizeof(obj_function_t), OBJ_FUNCTION);
+	function->arity = 0;
+	function->name = null_val();
+	function->chunk = chunk;
+	function->source = NULL;
+	function->line = 0;
+	function->globals = 0;
+	return (obj_val(&function->obj));
+}
+
+/**
+ * free_function - Releases the chunk and any uncompiled source of a
+ * function that is being freed.
+ * @function: The function.
+ */
+void free_function(obj_function_t *function)
+{
+	free_chunk(function->chunk);
+	free(function->chunk);
+	function->chunk = NULL;
+	free(function->source);
+	function->source = NULL;
+}
+
+bool is_function(value_t value) { return (is_obj_type(value, OBJ_FUNCTION)); }
+
+obj_function_t *as_function(value_t value) { return ((obj_function_t *)as_obj(value)); }
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include "common.h"
+#include "chunk.h"
+#include "object.h"
+
+#define ARGS_MAX UINT8_MAX // Most parameters a function may declare.
+
+/**
+ * struct obj_function_s - A compiled function.
+ * @obj: Object header.
+ * @arity: Number of parameters.
+ * @name: The function's name, a string value.
+ * @chunk: The function's code, allocated outside the heap.
+ * @source: Until the body is first called, a copy of its source from the
+ *          parameter list to the closing brace; NULL once compiled.
+ * @line: Line of the source's first character.
+ * @globals: Number of globals the body may see: those declared before it.
+ *
+ * Description: Functions are allocated straight into the old generation,
+ * so they never move and the sweep that finds them dead can free their
+ * chunk. The constants of the chunk are traced through the function.
+ */
+typedef struct obj_function_s
+{
+	obj_t obj;
+	int arity;
+	value_t name;
+	chunk_t *chunk;
+	char *source;
+	int line;
+	int globals;
+} obj_function_t;
+
+value_t new_function(void);
+void free_function(obj_function_t *function);
+bool is_function(value_t value);
+obj_function_t *as_function(value_t value);
+
+#endif // FUNCTION_H
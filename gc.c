@@ -0,0 +1,579 @@
+#include <time.h>
+#include "gc.h"
+#include "array.h"
+#include "class.h"
+#include "function.h"
+#include "map.h"
+#include "mapped.h"
+#include "memory.h"
+#include "table.h"
+#include "vm.h"
+
+_Thread_local heap_t heap; // Empty on pool workers, which may not allocate.
+
+// Returns a monotonic timestamp in nanoseconds.
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * init_heap - Creates an empty heap with a fresh nursery.
+ */
+void init_heap(void)
+{
+	memset(&heap, 0, sizeof(heap));
+	heap.nursery = malloc(GC_NURSERY_SIZE);
+	if (heap.nursery == NULL)
+	{
+		fprintf(stderr, "Error: Failed to allocate nursery\n");
+		exit(INTERPRET_RUNTIME_ERROR);
+	}
+	heap.nursery_top = heap.nursery;
+	heap.nursery_end = heap.nursery + GC_NURSERY_SIZE;
+	heap.next_major = GC_FIRST_MAJOR;
+	heap.started_ns = now_ns();
+}
+
+// Releases an old object and whatever memory it owns outside the heap.
+static void free_object(obj_t *object)
+{
+	if (object->type == OBJ_FUNCTION)
+		free_function((obj_function_t *)object);
+	else if (object->type == OBJ_CLASS)
+		free_class((obj_class_t *)object);
+	else if (object->type == OBJ_MAPPED)
+		free_mapped((obj_mapped_t *)object);
+	free(object);
+}
+
+/**
+ * free_heap - Releases every object and the heap's own storage.
+ */
+void free_heap(void)
+{
+	obj_t *object = heap.old_objects;
+	while (object != NULL)
+	{
+		obj_t *next = object->next;
+		free_object(object);
+		object = next;
+	}
+	free(heap.nursery);
+	free_array(heap.remembered);
+	free_array(heap.gray);
+	free_array(heap.chunks);
+	free_array(heap.roots);
+	free_shapes();
+	memset(&heap, 0, sizeof(heap));
+}
+
+/**
+ * push_object - Appends an object to a growable array of objects.
+ * @array: The array.
+ * @count: Its length.
+ * @capacity: Its capacity.
+ * @object: The object.
+ */
+static void push_object(obj_t ***array, int *count, int *capacity, obj_t *object)
+{
+	if (*count == *capacity)
+	{
+		int old_capacity = *capacity;
+		*capacity = (int)grow_capacity(old_capacity);
+		*array = grow_array(*array, old_capacity, *capacity, sizeof(obj_t *));
+	}
+	(*array)[(*count)++] = object;
+}
+
+/**
+ * allocate_old - Allocates an object directly in the old generation.
+ * @size: Size in bytes, already rounded.
+ * @type: The object's type.
+ *
+ * Return: The object, with its header filled in.
+ */
+static obj_t *allocate_old(size_t size, obj_type_t type)
+{
+	obj_t *object = reallocate(NULL, 0, size);
+	object->type = type;
+	object->generation = GEN_OLD;
+	object->marked = false;
+	object->remembered = false;
+	object->size = (uint32_t)size;
+	object->next = heap.old_objects;
+	heap.old_objects = object;
+	heap.old_bytes += size;
+	return (object);
+}
+
+/**
+ * allocate_object_slow - Allocates an object that does not fit the nursery.
+ * @size: Size in bytes, already rounded.
+ * @type: The object's type.
+ *
+ * Large objects go straight to the old generation, where they are never
+ * copied. Otherwise the nursery is full: it is collected and the
+ * allocation retried.
+ *
+ * Return: The object.
+ */
+obj_t *allocate_object_slow(size_t size, obj_type_t type)
+{
+	if (size > GC_LARGE_OBJECT)
+	{
+		// Collect first: the new object is not reachable from any root yet.
+		if (heap.old_bytes + size > heap.next_major)
+			collect_garbage(true);
+		heap.stats.bytes_allocated += size;
+		return (allocate_old(size, type));
+	}
+	collect_garbage(false);
+	return (allocate_object(size, type));
+}
+
+/**
+ * allocate_tenured - Allocates an object directly in the old generation.
+ * @size: Size of the object in bytes, header included.
+ * @type: The object's type.
+ *
+ * For objects that own memory outside the heap: nursery objects die
+ * without being visited, so only the old generation's sweep can release
+ * it. The object never moves.
+ *
+ * Return: The object.
+ */
+obj_t *allocate_tenured(size_t size, obj_type_t type)
+{
+	size = (size + 7) & ~(size_t)7;
+	if (heap.old_bytes + size > heap.next_major)
+		collect_garbage(true);
+	heap.stats.bytes_allocated += size;
+	return (allocate_old(size, type));
+}
+
+/**
+ * discard_object - Gives back an object that was never published.
+ * @object: The most recently allocated object.
+ *
+ * A nursery object that is still the last allocation is reclaimed on the
+ * spot; anything else is simply left for the collector.
+ */
+void discard_object(obj_t *object)
+{
+	if (object->generation == GEN_YOUNG && (char *)object + object->size == heap.nursery_top)
+	{
+		heap.nursery_top = (char *)object;
+		heap.stats.bytes_allocated -= object->size;
+	}
+}
+
+/**
+ * gc_add_chunk - Makes a chunk's constants roots.
+ * @chunk: The chunk; it stays registered until gc_remove_chunk().
+ */
+void gc_add_chunk(chunk_t *chunk)
+{
+	for (int i = 0; i < heap.chunk_count; i++)
+		if (heap.chunks[i] == chunk)
+			return;
+	if (heap.chunk_count == heap.chunk_capacity)
+	{
+		int old_capacity = heap.chunk_capacity;
+		heap.chunk_capacity = (int)grow_capacity(old_capacity);
+		heap.chunks = grow_array(heap.chunks, old_capacity, heap.chunk_capacity, sizeof(chunk_t *));
+	}
+	heap.chunks[heap.chunk_count++] = chunk;
+}
+
+/**
+ * gc_remove_chunk - Stops treating a chunk's constants as roots.
+ * @chunk: The chunk; unregistered chunks are ignored.
+ */
+void gc_remove_chunk(chunk_t *chunk)
+{
+	for (int i = 0; i < heap.chunk_count; i++)
+	{
+		if (heap.chunks[i] == chunk)
+		{
+			heap.chunks[i] = heap.chunks[--heap.chunk_count];
+			return;
+		}
+	}
+}
+
+/**
+ * gc_add_roots - Makes values held outside the heap roots.
+ * @values: The values; they stay registered until gc_remove_roots().
+ * @count: Number of values.
+ */
+void gc_add_roots(value_t *values, int count)
+{
+	if (heap.root_count == heap.root_capacity)
+	{
+		int old_capacity = heap.root_capacity;
+		heap.root_capacity = (int)grow_capacity(old_capacity);
+		heap.roots = grow_array(heap.roots, old_capacity, heap.root_capacity, sizeof(root_range_t));
+	}
+	heap.roots[heap.root_count++] = (root_range_t){values, count};
+}
+
+/**
+ * gc_remove_roots - Stops treating values registered by gc_add_roots() as roots.
+ * @values: The values; unregistered ones are ignored.
+ */
+void gc_remove_roots(value_t *values)
+{
+	for (int i = 0; i < heap.root_count; i++)
+	{
+		if (heap.roots[i].values == values)
+		{
+			heap.roots[i] = heap.roots[--heap.root_count];
+			return;
+		}
+	}
+}
+
+/**
+ * gc_remember - Adds an old object to the remembered set.
+ * @object: An old object that now refers to a nursery object.
+ */
+void gc_remember(obj_t *object)
+{
+	object->remembered = true;
+	push_object(&heap.remembered, &heap.remembered_count, &heap.remembered_capacity, object);
+}
+
+/**
+ * promote - Copies a nursery object into the old generation.
+ * @object: The nursery object.
+ *
+ * The copy is queued so the references it holds are traced in turn, and
+ * the nursery original is left as a forwarding pointer to it.
+ *
+ * Return: The old copy.
+ */
+static obj_t *promote(obj_t *object)
+{
+	if (object->generation == GEN_FORWARDED)
+		return (object->next);
+
+	obj_t *copy = reallocate(NULL, 0, object->size);
+	memcpy(copy, object, object->size);
+	copy->generation = GEN_OLD;
+	copy->next = heap.old_objects;
+	heap.old_objects = copy;
+	heap.old_bytes += copy->size;
+	heap.stats.bytes_promoted += copy->size;
+
+	object->generation = GEN_FORWARDED;
+	object->next = copy;
+	push_object(&heap.gray, &heap.gray_count, &heap.gray_capacity, copy);
+	return (copy);
+}
+
+/**
+ * evacuate_value - Minor-collection visitor: promotes a young referent.
+ * @value: The slot to update in place.
+ */
+static void evacuate_value(value_t *value)
+{
+	if (value->type == VAL_OBJ && value->as.obj->generation != GEN_OLD)
+		value->as.obj = promote(value->as.obj);
+}
+
+/**
+ * mark_value - Major-collection visitor: marks an unmarked referent.
+ * @value: The slot holding the reference.
+ */
+static void mark_value(value_t *value)
+{
+	if (value->type != VAL_OBJ || value->as.obj->marked)
+		return;
+	value->as.obj->marked = true;
+	push_object(&heap.gray, &heap.gray_count, &heap.gray_capacity, value->as.obj);
+}
+
+/**
+ * trace_array - Applies a visitor to an array's storage and elements.
+ * @array: The array.
+ * @visit: The visitor.
+ *
+ * The storage is visited first, so the elements are read from wherever it
+ * has been moved to.
+ */
+static void trace_array(obj_array_t *array, void (*visit)(value_t *))
+{
+	if (array->buffer == NULL)
+		return;
+	value_t buffer = obj_val(&array->buffer->obj);
+	visit(&buffer);
+	array->buffer = (obj_buffer_t *)as_obj(buffer);
+	if (!array->packed)
+		for (int i = 0; i < array->count; i++)
+			visit(&array_values(array)[i]);
+}
+
+/**
+ * trace_map - Applies a visitor to a map's storage, keys and values.
+ * @map: The map.
+ * @visit: The visitor.
+ */
+static void trace_map(obj_map_t *map, void (*visit)(value_t *))
+{
+	if (map->storage == NULL)
+		return;
+	value_t storage = obj_val(&map->storage->obj);
+	visit(&storage);
+	map->storage = (obj_buffer_t *)as_obj(storage);
+	for (int i = 0; i < map->capacity; i++)
+	{
+		if (map_control(map)[i] < 0)
+			continue;
+		visit(&map_entries(map)[i].key);
+		visit(&map_entries(map)[i].value);
+	}
+}
+
+// Applies a visitor to a function's name and the constants of its code.
+static void trace_function(obj_function_t *function, void (*visit)(value_t *))
+{
+	visit(&function->name);
+	value_array_t *constants = &function->chunk->constants;
+	for (int i = 0; i < constants->count; i++)
+		visit(&constants->values[i]);
+}
+
+// Applies a visitor to a class's name, superclass and methods.
+static void trace_class(obj_class_t *klass, void (*visit)(value_t *))
+{
+	visit(&klass->name);
+	visit(&klass->superclass);
+	visit(&klass->initializer);
+	for (int i = 0; i < klass->methods.count; i++)
+	{
+		visit(&klass->method_names.values[i]);
+		visit(&klass->methods.values[i]);
+	}
+}
+
+/**
+ * trace_instance - Applies a visitor to an instance's class, storage and fields.
+ * @instance: The instance.
+ * @visit: The visitor.
+ */
+static void trace_instance(obj_instance_t *instance, void (*visit)(value_t *))
+{
+	visit(&instance->klass);
+	if (instance->fields == NULL)
+		return;
+	value_t fields = obj_val(&instance->fields->obj);
+	visit(&fields);
+	instance->fields = (obj_buffer_t *)as_obj(fields);
+	for (int i = 0; i < instance->shape->count; i++)
+		visit(&instance_fields(instance)[i]);
+}
+
+// Applies a visitor to a bound method's receiver and method.
+static void trace_bound_method(obj_bound_method_t *bound, void (*visit)(value_t *))
+{
+	visit(&bound->receiver);
+	visit(&bound->method);
+}
+
+/**
+ * trace_references - Applies a visitor to every reference an object holds.
+ * @object: The object.
+ * @visit: The visitor.
+ */
+static void trace_references(obj_t *object, void (*visit)(value_t *))
+{
+	switch (object->type)
+	{
+	case OBJ_ARRAY:
+		trace_array((obj_array_t *)object, visit);
+		break;
+	case OBJ_MAP:
+		trace_map((obj_map_t *)object, visit);
+		break;
+	case OBJ_FUNCTION:
+		trace_function((obj_function_t *)object, visit);
+		break;
+	case OBJ_CLASS:
+		trace_class((obj_class_t *)object, visit);
+		break;
+	case OBJ_INSTANCE:
+		trace_instance((obj_instance_t *)object, visit);
+		break;
+	case OBJ_BOUND_METHOD:
+		trace_bound_method((obj_bound_method_t *)object, visit);
+		break;
+	case OBJ_STRING:
+	case OBJ_BUFFER:
+	case OBJ_MAPPED:
+		break;
+	}
+}
+
+/**
+ * visit_roots - Applies a visitor to every root.
+ * @visit: The visitor.
+ */
+static void visit_roots(void (*visit)(value_t *))
+{
+	for (value_t *slot = vm.stack; slot < vm.stack_top; slot++)
+		visit(slot);
+	visit(&vm.result);
+	for (int i = 0; i < vm.globals.count; i++)
+	{
+		visit(&vm.globals.values[i]);
+		visit(&vm.global_info[i].name);
+	}
+	for (int i = 0; i < heap.chunk_count; i++)
+	{
+		value_array_t *constants = &heap.chunks[i]->constants;
+		for (int j = 0; j < constants->count; j++)
+			visit(&constants->values[j]);
+	}
+	for (int i = 0; i < heap.root_count; i++)
+		for (int j = 0; j < heap.roots[i].count; j++)
+			visit(&heap.roots[i].values[j]);
+	trace_shapes(visit);
+}
+
+// Drains the gray list, tracing each object with the given visitor.
+static void trace_gray(void (*visit)(value_t *))
+{
+	while (heap.gray_count > 0)
+		trace_references(heap.gray[--heap.gray_count], visit);
+}
+
+// Weak intern table entries keep promoted strings and drop dead ones.
+static obj_string_t *forwarded_string(obj_string_t *string)
+{
+	if (string->obj.generation == GEN_OLD)
+		return (string);
+	if (string->obj.generation == GEN_FORWARDED)
+		return ((obj_string_t *)string->obj.next);
+	return (NULL);
+}
+
+static obj_string_t *marked_string(obj_string_t *string)
+{
+	return (string->obj.marked ? string : NULL);
+}
+
+/**
+ * collect_nursery - Promotes the live nursery objects and empties it.
+ */
+static void collect_nursery(void)
+{
+	visit_roots(evacuate_value);
+	for (int i = 0; i < heap.remembered_count; i++)
+	{
+		heap.remembered[i]->remembered = false;
+		trace_references(heap.remembered[i], evacuate_value);
+	}
+	heap.remembered_count = 0;
+	trace_gray(evacuate_value);
+
+	string_table_retain(&vm.strings, forwarded_string);
+	heap.nursery_top = heap.nursery;
+	heap.stats.minor_collections++;
+}
+
+/**
+ * collect_old - Marks from the roots and sweeps the old generation.
+ *
+ * Runs right after a minor collection, so every live object is old.
+ */
+static void collect_old(void)
+{
+	visit_roots(mark_value);
+	trace_gray(mark_value);
+	string_table_retain(&vm.strings, marked_string);
+
+	obj_t **link = &heap.old_objects;
+	while (*link != NULL)
+	{
+		obj_t *object = *link;
+		if (object->marked)
+		{
+			object->marked = false;
+			link = &object->next;
+			continue;
+		}
+		*link = object->next;
+		heap.old_bytes -= object->size;
+		heap.stats.bytes_freed += object->size;
+		free_object(object);
+	}
+
+	heap.next_major = heap.old_bytes * GC_HEAP_GROW_FACTOR;
+	if (heap.next_major < GC_FIRST_MAJOR)
+		heap.next_major = GC_FIRST_MAJOR;
+	heap.stats.major_collections++;
+}
+
+/**
+ * collect_garbage - Runs a collection.
+ * @major: Whether to collect the old generation as well.
+ *
+ * A minor collection escalates to a major one once the old generation has
+ * outgrown its budget. A pool worker has an empty heap with no nursery
+ * and no budget, so every allocation it attempts ends up here, and the
+ * worker gives up.
+ */
+void collect_garbage(bool major)
+{
+	if (heap.nursery == NULL)
+		abandon_worker();
+	if (vm.timings != NULL)
+		timings_begin(vm.timings, PHASE_GC);
+	uint64_t start = now_ns();
+	collect_nursery();
+	uint64_t minor_end = now_ns();
+	heap.stats.minor_pause_ns += minor_end - start;
+
+	uint64_t pause = minor_end - start;
+	if (major || heap.old_bytes > heap.next_major)
+	{
+		collect_old();
+		uint64_t end = now_ns();
+		heap.stats.major_pause_ns += end - minor_end;
+		pause = end - start;
+	}
+	if (pause > heap.stats.max_pause_ns)
+		heap.stats.max_pause_ns = pause;
+	if (vm.timings != NULL)
+		timings_end(vm.timings);
+}
+
+/**
+ * gc_report - Prints collector statistics.
+ * @out: The stream to print to.
+ */
+void gc_report(FILE *out)
+{
+	const gc_stats_t *stats = &heap.stats;
+	uint64_t elapsed = now_ns() - heap.started_ns;
+	uint64_t paused = stats->minor_pause_ns + stats->major_pause_ns;
+	uint64_t collections = stats->minor_collections + stats->major_collections;
+
+	fprintf(out, "== gc ==\n");
+	fprintf(out, "allocated   %12.1f KiB\n", stats->bytes_allocated / 1024.0);
+	fprintf(out, "promoted    %12.1f KiB (%.1f%%)\n", stats->bytes_promoted / 1024.0,
+		stats->bytes_allocated ? 100.0 * stats->bytes_promoted / stats->bytes_allocated : 0.0);
+	fprintf(out, "freed old   %12.1f KiB\n", stats->bytes_freed / 1024.0);
+	fprintf(out, "old live    %12.1f KiB\n", heap.old_bytes / 1024.0);
+	fprintf(out, "minor       %12llu collections, %.3f ms\n",
+		(unsigned long long)stats->minor_collections, stats->minor_pause_ns / 1e6);
+	fprintf(out, "major       %12llu collections, %.3f ms\n",
+		(unsigned long long)stats->major_collections, stats->major_pause_ns / 1e6);
+	fprintf(out, "pause       %12.3f ms mean, %.3f ms max\n",
+		collections ? paused / 1e6 / collections : 0.0, stats->max_pause_ns / 1e6);
+	fprintf(out, "throughput  %11.2f%% of %.3f ms outside the collector\n",
+		elapsed ? 100.0 * (elapsed - paused) / elapsed : 100.0, elapsed / 1e6);
+}
@@ -0,0 +1,186 @@
+#pragma once
+#ifndef GC_H
+#define GC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "common.h"
+#include "chunk.h"
+#include "object.h"
+
+#define GC_NURSERY_SIZE (1024 * 1024)               // Bytes of young generation.
+#define GC_LARGE_OBJECT (GC_NURSERY_SIZE / 8)       // Bigger objects start old.
+#define GC_FIRST_MAJOR (4 * 1024 * 1024)           // Old bytes before the first major GC.
+#define GC_HEAP_GROW_FACTOR 2
+
+/**
+ * enum generation_s - Where an object lives.
+ * @GEN_YOUNG: In the nursery.
+ * @GEN_OLD: Individually allocated in the old generation.
+ * @GEN_FORWARDED: A nursery object that has been promoted; its next
+ *                 field points at the old copy.
+ */
+typedef enum generation_s
+{
+	GEN_YOUNG,
+	GEN_OLD,
+	GEN_FORWARDED
+} generation_t;
+
+/**
+ * struct gc_stats_s - Collector statistics since the heap was created.
+ * @minor_collections: Number of nursery collections.
+ * @major_collections: Number of full collections.
+ * @bytes_allocated: Bytes handed out, in either generation.
+ * @bytes_promoted: Bytes copied from the nursery into the old generation.
+ * @bytes_freed: Bytes released by old-generation sweeps.
+ * @minor_pause_ns: Total time spent in minor collections.
+ * @major_pause_ns: Total time spent in major collections.
+ * @max_pause_ns: Longest single pause.
+ */
+typedef struct gc_stats_s
+{
+	uint64_t minor_collections;
+	uint64_t major_collections;
+	uint64_t bytes_allocated;
+	uint64_t bytes_promoted;
+	uint64_t bytes_freed;
+	uint64_t minor_pause_ns;
+	uint64_t major_pause_ns;
+	uint64_t max_pause_ns;
+} gc_stats_t;
+
+/**
+ * struct root_range_s - Host-owned values that the collector treats as roots.
+ * @values: The values; the collector updates them when objects move.
+ * @count: Number of values.
+ */
+typedef struct root_range_s
+{
+	value_t *values;
+	int count;
+} root_range_t;
+
+/**
+ * struct heap_s - The managed object heap.
+ * @nursery: Start of the young generation.
+ * @nursery_top: Next free byte in the nursery.
+ * @nursery_end: End of the nursery.
+ * @old_objects: Every old object, linked through obj_t.next.
+ * @old_bytes: Bytes held by the old generation.
+ * @next_major: Old generation size that triggers a major collection.
+ * @remembered: Old objects that may point into the nursery.
+ * @remembered_count: Number of entries in @remembered.
+ * @remembered_capacity: Capacity of @remembered.
+ * @gray: Work list of objects whose references are still to be traced.
+ * @gray_count: Number of entries in @gray.
+ * @gray_capacity: Capacity of @gray.
+ * @chunks: Chunks whose constants are roots.
+ * @chunk_count: Number of entries in @chunks.
+ * @chunk_capacity: Capacity of @chunks.
+ * @roots: Ranges of host-owned values that are roots.
+ * @root_count: Number of entries in @roots.
+ * @root_capacity: Capacity of @roots.
+ * @started_ns: When the heap was created, for throughput figures.
+ * @stats: Collector statistics.
+ *
+ * Description: New objects are bump-allocated in the nursery. A minor
+ * collection copies the nursery objects reachable from the roots and the
+ * remembered set into the old generation, then reuses the whole nursery,
+ * so its cost is proportional to the survivors rather than to the garbage.
+ * Old objects never move; a major collection marks from the roots and
+ * sweeps the old generation, and runs only once it has doubled since the
+ * last one.
+ */
+typedef struct heap_s
+{
+	char *nursery;
+	char *nursery_top;
+	char *nursery_end;
+
+	obj_t *old_objects;
+	size_t old_bytes;
+	size_t next_major;
+
+	obj_t **remembered;
+	int remembered_count;
+	int remembered_capacity;
+
+	obj_t **gray;
+	int gray_count;
+	int gray_capacity;
+
+	chunk_t **chunks;
+	int chunk_count;
+	int chunk_capacity;
+
+	root_range_t *roots;
+	int root_count;
+	int root_capacity;
+
+	uint64_t started_ns;
+	gc_stats_t stats;
+} heap_t;
+
+extern _Thread_local heap_t heap;
+
+void init_heap(void);
+void free_heap(void);
+obj_t *allocate_object_slow(size_t size, obj_type_t type);
+obj_t *allocate_tenured(size_t size, obj_type_t type);
+void discard_object(obj_t *object);
+void collect_garbage(bool major);
+void gc_add_chunk(chunk_t *chunk);
+void gc_remove_chunk(chunk_t *chunk);
+void gc_add_roots(value_t *values, int count);
+void gc_remove_roots(value_t *values);
+void gc_remember(obj_t *object);
+void gc_report(FILE *out);
+
+/**
+ * allocate_object - Allocates a heap object.
+ * @size: Size of the object in bytes, header included.
+ * @type: The object's type.
+ *
+ * The common case is a pointer bump in the nursery; anything else,
+ * including running a collection, happens out of line.
+ *
+ * Return: The object, with its header filled in.
+ */
+static inline obj_t *allocate_object(size_t size, obj_type_t type)
+{
+	size = (size + 7) & ~(size_t)7;
+#ifdef DEBUG_STRESS_GC
+	collect_garbage(false);
+#endif
+	if (size > (size_t)(heap.nursery_end - heap.nursery_top))
+		return (allocate_object_slow(size, type));
+
+	obj_t *object = (obj_t *)heap.nursery_top;
+	heap.nursery_top += size;
+	heap.stats.bytes_allocated += size;
+	object->type = type;
+	object->generation = GEN_YOUNG;
+	object->marked = false;
+	object->remembered = false;
+	object->size = (uint32_t)size;
+	object->next = NULL;
+	return (object);
+}
+
+/**
+ * write_barrier - Records a store of a reference into an object.
+ * @owner: The object being written to.
+ * @value: The value stored.
+ *
+ * Must follow every store of a value into an object field, so that old
+ * objects pointing into the nursery are found by minor collections.
+ */
+static inline void write_barrier(obj_t *owner, value_t value)
+{
+	if (owner->generation == GEN_OLD && !owner->remembered && value.type == VAL_OBJ &&
+	    value.as.obj->generation == GEN_YOUNG)
+		gc_remember(owner);
+}
+
+#endif // GC_H
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef INTRINSIC_H
+#define INTRINSIC_H
+
+#include <math.h>
+#include "chunk.h"
+
+// Checks whether an opcode is a math intrinsic.
+static inline bool is_intrinsic(uint8_t opcode) { return (opcode >= OP_SQRT && opcode <= OP_ATAN2); }
+
+// Returns the number of operands a math intrinsic takes.
+static inline int intrinsic_arity(uint8_t opcode) { return (opcode >= OP_MIN ? 2 : 1); }
+
+/**
+ * apply_intrinsic - Computes a math intrinsic.
+ * @opcode: The intrinsic.
+ * @a: First operand.
+ * @b: Second operand; ignored by unary intrinsics.
+ *
+ * The VM, the batch kernels and the compiler's constant folding all go
+ * through here, so a folded call yields exactly what running it would.
+ * Called with a constant opcode, it inlines to the one operation.
+ *
+ * Return: The result.
+ */
+static inline __attribute__((always_inline)) double apply_intrinsic(uint8_t opcode, double a, double b)
+{
+	switch (opcode)
+	{
+	case OP_SQRT:
+		return (sqrt(a));
+	case OP_ABS:
+		return (fabs(a));
+	case OP_FLOOR:
+		return (floor(a));
+	case OP_CEIL:
+		return (ceil(a));
+	case OP_ROUND:
+		return (round(a));
+	case OP_EXP:
+		return (exp(a));
+	case OP_LOG:
+		return (log(a));
+	case OP_SIN:
+		return (sin(a));
+	case OP_COS:
+		return (cos(a));
+	case OP_TAN:
+		return (tan(a));
+	case OP_ASIN:
+		return (asin(a));
+	case OP_ACOS:
+		return (acos(a));
+	case OP_ATAN:
+		return (atan(a));
+	case OP_MIN:
+		return (fmin(a, b));
+	case OP_MAX:
+		return (fmax(a, b));
+	case OP_POW:
+		return (pow(a, b));
+	case OP_ATAN2:
+		return (atan2(a, b));
+	default:
+		return (NAN);
+	}
+}
+
+#endif // INTRINSIC_H
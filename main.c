@@ -4,15 +4,29 @@
  * (c) Alemi Herbert 2024
  */
 
+#include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
 #include "common.h"
 #include "debug.h"
 #include "chunk.h"
+#include "parallel.h"
+#include "snapshot.h"
+#include "stream.h"
 #include "value.h"
 #include "vm.h"
 
 static void repl(void);
-static void run_file(const char *path);
+static interpret_result_t run_file(const char *path);
 static char *read_file(const char *path);
+static void on_trace_signal(int signum);
+static void write_profile(profile_t *profile, const char *folded_path);
+static void write_timings(timings_t *timings, const char *timings_path);
+static bool parse_separator(const char *arg, char *separator);
+static void usage(void);
+
+// Buffers stdout when it is not a terminal; only the CLI writes through it.
+static char output[OUTPUT_BUFFER_SIZE];
 
 /**
  * main - the entry point to the program
@@ -23,25 +37,237 @@ static char *read_file(const char *path);
  */
 int main(int argc, char *argv[])
 {
-	init_vm();
+	const char *path = NULL;
+	const char *expression = NULL;
+	const char *folded_path = NULL;
+	const char *snapshot_path = NULL;
+	const char *save_path = NULL;
+	const char *timings_path = NULL;
+	char separator = '\0';
+	bool trace = false;
+	bool gc_stats = false;
+	bool eager = false;
+	bool strict = false;
+	number_format_t number_format = NUMBER_FORMAT_G;
+	profile_t *profile = NULL;
+	timings_t *timings = NULL;
 
-	if (argc == 1)
+	for (int i = 1; i < argc; i++)
 	{
-		repl();
+		if (strcmp(argv[i], "--trace") == 0)
+		{
+			trace = true;
+		}
+		else if (strcmp(argv[i], "--profile") == 0 || strcmp(argv[i], "--profile=count") == 0)
+		{
+			free_profile(profile);
+			profile = new_profile(PROFILE_COUNT);
+		}
+		else if (strcmp(argv[i], "--profile=sample") == 0)
+		{
+			free_profile(profile);
+			profile = new_profile(PROFILE_SAMPLE);
+		}
+		else if (strcmp(argv[i], "--gc-stats") == 0)
+		{
+			gc_stats = true;
+		}
+		else if (strcmp(argv[i], "--eager") == 0)
+		{
+			eager = true;
+		}
+		else if (strcmp(argv[i], "--strict") == 0)
+		{
+			strict = true;
+		}
+		else if (strcmp(argv[i], "--numbers=g") == 0)
+		{
+			number_format = NUMBER_FORMAT_G;
+		}
+		else if (strcmp(argv[i], "--numbers=shortest") == 0)
+		{
+			number_format = NUMBER_FORMAT_SHORTEST;
+		}
+		else if (strcmp(argv[i], "--timings") == 0)
+		{
+			timings_path = NULL;
+			if (timings == NULL)
+				timings = new_timings();
+		}
+		else if (strncmp(argv[i], "--timings=", 10) == 0)
+		{
+			timings_path = argv[i] + 10;
+			if (timings == NULL)
+				timings = new_timings();
+		}
+		else if (strncmp(argv[i], "--profile-out=", 14) == 0)
+		{
+			folded_path = argv[i] + 14;
+		}
+		else if (strncmp(argv[i], "--threads=", 10) == 0 && isdigit((unsigned char)argv[i][10]))
+		{
+			set_parallel_threads(atoi(argv[i] + 10));
+		}
+		else if (strncmp(argv[i], "--snapshot=", 11) == 0)
+		{
+			snapshot_path = argv[i] + 11;
+		}
+		else if (strncmp(argv[i], "--save-snapshot=", 16) == 0)
+		{
+			save_path = argv[i] + 16;
+		}
+		else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc && expression == NULL)
+		{
+			expression = argv[++i];
+		}
+		else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc && parse_separator(argv[i + 1], &separator))
+		{
+			i++;
+		}
+		else if (argv[i][0] != '-' && path == NULL)
+		{
+			path = argv[i];
+		}
+		else
+		{
+			usage();
+		}
 	}
-	else if (argc == 2)
+	if (expression != NULL && path != NULL)
+		usage();
+
+	init_vm();
+	set_timings(timings);
+	vm.number_format = number_format;
+	vm.eager = eager;
+	if (!isatty(STDOUT_FILENO))
+		setvbuf(stdout, output, _IOFBF, sizeof(output));
+	if (snapshot_path != NULL && !load_snapshot(snapshot_path))
+		exit(74);
+
+	if (trace)
 	{
-		run_file(argv[1]);
+		set_trace(true);
+		signal(SIGUSR1, on_trace_signal);
 	}
+
+	if (folded_path != NULL && profile == NULL)
+		profile = new_profile(PROFILE_COUNT);
+	set_profile(profile);
+
+	interpret_result_t result = INTERPRET_OK;
+	if (expression != NULL)
+		result = run_stream(expression, STDIN_FILENO, separator, strict);
+	else if (path == NULL)
+		repl();
 	else
+		result = run_file(path);
+	if (save_path != NULL && result == INTERPRET_OK && !save_snapshot(save_path))
+		exit(74);
+
+	if (profile != NULL)
 	{
-		fprintf(stderr, "Usage: charis [path\n]");
+		write_profile(profile, folded_path);
+		free_profile(profile);
+	}
+	if (gc_stats)
+		gc_report(stderr);
+	if (timings != NULL)
+	{
+		set_timings(NULL);
+		write_timings(timings, timings_path);
+		free_timings(timings);
 	}
 
 	free_vm();
-	return (0);
+	if (result == INTERPRET_COMPILE_ERROR)
+		return (65);
+	return (result == INTERPRET_RUNTIME_ERROR ? 70 : 0);
 }
 
+/**
+ * usage - print how to invoke charis and exit
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: charis [--trace] [--profile[=count|sample]] "
+		"[--profile-out=path] [--gc-stats] [--eager] [--numbers=g|shortest] "
+		"[--threads=n] [--timings[=path]] [--snapshot=path] [--save-snapshot=path] "
+		"[path | -e expr [-F sep] [--strict]]\n");
+	exit(64);
+}
+
+/**
+ * parse_separator - read the argument of -F, a single character or \t
+ * @arg: the argument
+ * @separator: receives the separator
+ *
+ * Return: whether the argument names a separator
+ */
+static bool parse_separator(const char *arg, char *separator)
+{
+	if (strcmp(arg, "\\t") == 0)
+		*separator = '\t';
+	else if (arg[0] != '\0' && arg[1] == '\0' && arg[0] != '\n')
+		*separator = arg[0];
+	else
+		return (false);
+	return (true);
+}
+
+/**
+ * on_trace_signal - SIGUSR1 handler asking for a dump of the trace ring
+ * @signum: the signal number (unused)
+ */
+static void on_trace_signal(int signum)
+{
+	(void)signum;
+	request_trace_dump();
+}
+
+/**
+ * write_profile - print the profile report and the optional folded stacks
+ * @profile: the profile gathered while running
+ * @folded_path: where to write folded stacks, or NULL
+ */
+static void write_profile(profile_t *profile, const char *folded_path)
+{
+	profile_report(profile, stderr);
+	if (folded_path == NULL)
+		return;
+
+	FILE *file = fopen(folded_path, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open file '%s'.\n", folded_path);
+		return;
+	}
+	profile_write_folded(profile, file);
+	fclose(file);
+}
+
+/**
+ * write_timings - print the time and hardware events per phase as JSON
+ * @timings: the timings gathered while running
+ * @timings_path: where to write them, or NULL for stderr
+ */
+static void write_timings(timings_t *timings, const char *timings_path)
+{
+	if (timings_path == NULL)
+	{
+		timings_write_json(timings, stderr);
+		return;
+	}
+
+	FILE *file = fopen(timings_path, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open file '%s'.\n", timings_path);
+		return;
+	}
+	timings_write_json(timings, file);
+	fclose(file);
+}
 
 static void repl(void) {
     char *line = NULL;
@@ -75,17 +301,21 @@ static void repl(void) {
 /**
  * run_file - run a source file
  * @path: path to the source code
+ *
+ * Return: the result of the interpretation
  */
-static void run_file(const char *path)
+static interpret_result_t run_file(const char *path)
 {
+	if (vm.timings != NULL)
+		timings_begin(vm.timings, PHASE_READ);
 	char *source = read_file(path);
-	interpret_result_t result = interpret(source);
+	if (vm.timings != NULL)
+		timings_end(vm.timings);
+	if (source == NULL)
+		exit(74);
+	interpret_result_t result = interpret_file(source, path);
 	free(source);
-
-	if (result == INTERPRET_COMPILE_ERROR)
-		exit(65);
-	if (result == INTERPRET_RUNTIME_ERROR)
-		exit(70);
+	return (result);
 }
 
 /**
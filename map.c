@@ -0,0 +1,378 @@
+#include <math.h>
+#include "map.h"
+#include "gc.h"
+#include "memory.h"
+#include "vm.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CONTROL_EMPTY ((int8_t)-128)
+#define CONTROL_DELETED ((int8_t)-2)
+#define MAX_LOAD_NUMERATOR 7 // A map rehashes once 7/8 of its slots are used.
+
+/**
+ * match_byte - Finds the control bytes of a group equal to a byte.
+ * @group: MAP_GROUP control bytes.
+ * @byte: The byte to look for.
+ *
+ * Return: A mask with bit i set if group[i] matches.
+ */
+static inline uint32_t match_byte(const int8_t *group, int8_t byte)
+{
+#ifdef __SSE2__
+	__m128i control = _mm_loadu_si128((const __m128i *)group);
+	return ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(byte))));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < MAP_GROUP; i++)
+		mask |= (uint32_t)(group[i] == byte) << i;
+	return (mask);
+#endif
+}
+
+// Finds the empty or deleted slots of a group, whose control bytes are < -1.
+static inline uint32_t match_free(const int8_t *group)
+{
+#ifdef __SSE2__
+	__m128i control = _mm_loadu_si128((const __m128i *)group);
+	return ((uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), control)));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < MAP_GROUP; i++)
+		mask |= (uint32_t)(group[i] < -1) << i;
+	return (mask);
+#endif
+}
+
+// Finalizer of MurmurHash3: spreads every input bit over the whole word.
+static uint64_t mix_bits(uint64_t bits)
+{
+	bits ^= bits >> 33;
+	bits *= 0xff51afd7ed558ccdULL;
+	bits ^= bits >> 33;
+	bits *= 0xc4ceb9fe1a85ec53ULL;
+	bits ^= bits >> 33;
+	return (bits);
+}
+
+/**
+ * is_map_key - Checks whether a value can be used as a map key.
+ * @key: The value.
+ *
+ * Other objects are excluded because they have no stable identity to
+ * hash: the collector moves them.
+ *
+ * Return: true for strings, booleans, null and numbers other than NaN.
+ */
+bool is_map_key(value_t key)
+{
+	if (key.type == VAL_NUMBER)
+		return (!isnan(key.as.number));
+	return (key.type != VAL_OBJ || is_string(key));
+}
+
+/**
+ * hash_key - Hashes a map key.
+ * @key: A valid key.
+ *
+ * The low 7 bits go into the control byte and the rest pick where probing
+ * starts. Heap strings reuse the hash they were interned with.
+ *
+ * Return: The hash.
+ */
+uint64_t hash_key(value_t key)
+{
+	uint64_t bits = 0;
+	switch (key.type)
+	{
+	case VAL_NUMBER:
+	{
+		double number = key.as.number == 0 ? 0 : key.as.number; // -0 is 0.
+		memcpy(&bits, &number, sizeof(bits));
+		break;
+	}
+	case VAL_BOOLEAN:
+		bits = key.as.boolean ? 1 : 2;
+		break;
+	case VAL_NULL:
+		bits = 3;
+		break;
+	case VAL_SMALL_STRING:
+		memcpy(&bits, key.as.small, sizeof(bits));
+		break;
+	case VAL_OBJ:
+		bits = as_string(key)->hash;
+		break;
+	}
+	return (mix_bits(bits ^ ((uint64_t)key.type << 56)));
+}
+
+// Compares two valid keys by type and value.
+static inline bool keys_equal(value_t a, value_t b)
+{
+	if (a.type != b.type)
+		return (false);
+	switch (a.type)
+	{
+	case VAL_NUMBER:
+		return (a.as.number == b.as.number);
+	case VAL_BOOLEAN:
+		return (a.as.boolean == b.as.boolean);
+	case VAL_NULL:
+		return (true);
+	case VAL_SMALL_STRING:
+		return (memcmp(a.as.small, b.as.small, SMALL_STRING_MAX) == 0);
+	case VAL_OBJ:
+		return (a.as.obj == b.as.obj);
+	}
+	return (false);
+}
+
+value_t new_map(void)
+{
+	obj_map_t *map = (obj_map_t *)allocate_object(sizeof(obj_map_t), OBJ_MAP);
+	map->count = 0;
+	map->capacity = 0;
+	map->growth_left = 0;
+	map->storage = NULL;
+	return (obj_val(&map->obj));
+}
+
+bool is_map(value_t value) { return (is_obj_type(value, OBJ_MAP)); }
+
+obj_map_t *as_map(value_t value) { return ((obj_map_t *)as_obj(value)); }
+
+// Sets a control byte and its mirror past the end.
+static inline void set_control(const obj_map_t *map, int index, int8_t control)
+{
+	int8_t *controls = map_control(map);
+	controls[index] = control;
+	if (index < MAP_GROUP)
+		controls[map->capacity + index] = control;
+}
+
+/**
+ * find_index - Looks a key up.
+ * @map: The map.
+ * @key: A valid key.
+ * @hash: Its hash.
+ *
+ * Groups are probed in triangular steps, which visits every group of a
+ * power-of-two table. A group with an empty slot ends the search, since
+ * the key would have been inserted there. Slots whose control byte
+ * matches are confirmed by comparing keys alone: the 7 bits of hash that
+ * matched already rule out all but one in 128 other keys.
+ *
+ * Return: The key's slot, or -1.
+ */
+static inline __attribute__((always_inline)) int find_index(const obj_map_t *map, value_t key, uint64_t hash)
+{
+	if (map->capacity == 0)
+		return (-1);
+	const int8_t *controls = map_control(map);
+	const map_entry_t *entries = map_entries(map);
+	int mask = map->capacity - 1;
+	int position = (int)(hash >> 7) & mask;
+	for (int stride = MAP_GROUP;; stride += MAP_GROUP)
+	{
+		const int8_t *group = controls + position;
+		for (uint32_t match = match_byte(group, (int8_t)(hash & 0x7f)); match != 0; match &= match - 1)
+		{
+			int index = (position + __builtin_ctz(match)) & mask;
+			if (keys_equal(entries[index].key, key))
+				return (index);
+		}
+		if (match_byte(group, CONTROL_EMPTY) != 0)
+			return (-1);
+		position = (position + stride) & mask;
+	}
+}
+
+// Returns the first empty or deleted slot on a hash's probe sequence.
+static int find_free(const obj_map_t *map, uint64_t hash)
+{
+	const int8_t *controls = map_control(map);
+	int mask = map->capacity - 1;
+	int position = (int)(hash >> 7) & mask;
+	for (int stride = MAP_GROUP;; stride += MAP_GROUP)
+	{
+		uint32_t match = match_free(controls + position);
+		if (match != 0)
+			return ((position + __builtin_ctz(match)) & mask);
+		position = (position + stride) & mask;
+	}
+}
+
+/**
+ * rehash - Moves a map's entries into fresh storage.
+ * @map: Slot holding the map; it must be a GC root.
+ * @capacity: Number of slots, a power of two of at least MAP_GROUP.
+ *
+ * Deleted slots are dropped on the way, so rehashing at the same capacity
+ * reclaims them. Keys are hashed again, which for heap strings only reads
+ * the hash they were interned with.
+ */
+static void rehash(value_t *map, int capacity)
+{
+	size_t size = (sizeof(map_entry_t) + 1) * capacity + MAP_GROUP;
+	obj_buffer_t *storage = (obj_buffer_t *)allocate_object(sizeof(obj_buffer_t) + size, OBJ_BUFFER);
+	storage->capacity = capacity;
+	obj_map_t *owner = as_map(*map);
+	obj_map_t old = *owner;
+
+	owner->storage = storage;
+	owner->capacity = capacity;
+	owner->growth_left = capacity / 8 * MAX_LOAD_NUMERATOR - owner->count;
+	memset(map_control(owner), (uint8_t)CONTROL_EMPTY, capacity + MAP_GROUP);
+	for (int i = 0; i < old.capacity; i++)
+	{
+		if (map_control(&old)[i] < 0)
+			continue;
+		const map_entry_t *entry = &map_entries(&old)[i];
+		uint64_t hash = hash_key(entry->key);
+		int index = find_free(owner, hash);
+		set_control(owner, index, (int8_t)(hash & 0x7f));
+		map_entries(owner)[index] = *entry;
+	}
+	write_barrier(&owner->obj, obj_val(&storage->obj));
+}
+
+/**
+ * map_get - Looks a key up.
+ * @map: The map.
+ * @key: A valid key.
+ * @value: Where the value goes if the key is present.
+ *
+ * Return: Whether the key is present.
+ */
+bool map_get(const obj_map_t *map, value_t key, value_t *value)
+{
+	int index = find_index(map, key, hash_key(key));
+	if (index < 0)
+		return (false);
+	*value = map_entries(map)[index].value;
+	return (true);
+}
+
+/**
+ * map_set - Adds a key or replaces its value.
+ * @map: Slot holding the map; it must be a GC root.
+ * @key: A valid key; it must live in a GC root too.
+ * @value: The value; it must live in a GC root too.
+ *
+ * Return: false if the key is new and the map already holds MAP_MAX keys.
+ */
+bool map_set(value_t *map, const value_t *key, const value_t *value)
+{
+	uint64_t hash = hash_key(*key);
+	obj_map_t *owner = as_map(*map);
+	int index = find_index(owner, *key, hash);
+	if (index >= 0)
+	{
+		map_entries(owner)[index].value = *value;
+		write_barrier(&owner->obj, *value);
+		return (true);
+	}
+	if (owner->count == MAP_MAX)
+		return (false);
+
+	if (owner->growth_left == 0)
+	{
+		int capacity = owner->capacity;
+		if (capacity == 0)
+			capacity = MAP_GROUP;
+		else if (owner->count >= capacity / 16 * MAX_LOAD_NUMERATOR)
+			capacity *= 2;
+		rehash(map, capacity);
+		owner = as_map(*map);
+	}
+
+	index = find_free(owner, hash);
+	if (map_control(owner)[index] == CONTROL_EMPTY)
+		owner->growth_left--;
+	set_control(owner, index, (int8_t)(hash & 0x7f));
+	map_entries(owner)[index] = (map_entry_t){*key, *value};
+	owner->count++;
+	write_barrier(&owner->obj, *key);
+	write_barrier(&owner->obj, *value);
+	return (true);
+}
+
+/**
+ * map_delete - Removes a key.
+ * @map: The map.
+ * @key: A valid key.
+ *
+ * The slot becomes a tombstone so probes for other keys continue past it,
+ * unless its group still has an empty slot and so never stopped a probe.
+ *
+ * Return: Whether the key was present.
+ */
+bool map_delete(obj_map_t *map, value_t key)
+{
+	int index = find_index(map, key, hash_key(key));
+	if (index < 0)
+		return (false);
+
+	int mask = map->capacity - 1;
+	const int8_t *controls = map_control(map);
+	uint32_t empty_after = match_byte(controls + index, CONTROL_EMPTY);
+	uint32_t empty_before = match_byte(controls + ((index - MAP_GROUP) & mask), CONTROL_EMPTY);
+	bool reusable = empty_after != 0 && empty_before != 0 &&
+			__builtin_ctz(empty_after) + __builtin_clz(empty_before) - (32 - MAP_GROUP) < MAP_GROUP;
+	if (reusable)
+	{
+		set_control(map, index, CONTROL_EMPTY);
+		map->growth_left++;
+	}
+	else
+		set_control(map, index, CONTROL_DELETED);
+	map_entries(map)[index] = (map_entry_t){null_val(), null_val()};
+	map->count--;
+	return (true);
+}
+
+/**
+ * print_map - Prints a map as braced key: value pairs, in slot order.
+ * @map: The map.
+ *
+ * A map nested in itself is printed as {...}.
+ */
+void print_map(const obj_map_t *map)
+{
+	static const obj_map_t *printing[64];
+	static int depth;
+
+	for (int i = 0; i < depth; i++)
+	{
+		if (printing[i] == map)
+		{
+			fputs("{...}", stdout);
+			return;
+		}
+	}
+	if (depth == (int)(sizeof(printing) / sizeof(printing[0])))
+	{
+		fputs("{...}", stdout);
+		return;
+	}
+
+	printing[depth++] = map;
+	putchar('{');
+	bool first = true;
+	for (int i = 0; i < map->capacity; i++)
+	{
+		if (map_control(map)[i] < 0)
+			continue;
+		if (!first)
+			fputs(", ", stdout);
+		first = false;
+		print_value(map_entries(map)[i].key);
+		fputs(": ", stdout);
+		print_value(map_entries(map)[i].value);
+	}
+	putchar('}');
+	depth--;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdint.h>
+#include "common.h"
+#include "array.h"
+#include "object.h"
+
+#define MAP_GROUP 16         // Control bytes examined per probe step.
+#define MAP_MAX (1 << 24)    // Most keys a map may hold.
+
+/**
+ * struct map_entry_s - A key and its value.
+ * @key: The key.
+ * @value: The value.
+ *
+ * Description: Entries keep no copy of their key's hash, which keeps them
+ * at 32 bytes, so a lookup touches one cache line of entries rather than
+ * often two.
+ */
+typedef struct map_entry_s
+{
+	value_t key;
+	value_t value;
+} map_entry_t;
+
+/**
+ * struct obj_map_s - A hash map from values to values.
+ * @obj: Object header.
+ * @count: Number of keys.
+ * @capacity: Number of slots; zero or a power of two of at least MAP_GROUP.
+ * @growth_left: Empty slots that may still be filled before a rehash.
+ * @storage: The slots' entries followed by their control bytes, or NULL
+ *           while the map has no slots.
+ *
+ * Description: An open-addressing table in the Swiss-table style. Each
+ * slot has a control byte holding 7 bits of its key's hash, or marking it
+ * empty or deleted, and a probe compares MAP_GROUP control bytes at once,
+ * so entries are only touched when those bits already match. The first
+ * MAP_GROUP control bytes are mirrored past the end, so a group can start
+ * at any slot. Keys are numbers, strings, booleans or null, and compare by
+ * type and value.
+ */
+typedef struct obj_map_s
+{
+	obj_t obj;
+	int count;
+	int capacity;
+	int growth_left;
+	obj_buffer_t *storage;
+} obj_map_t;
+
+value_t new_map(void);
+bool is_map(value_t value);
+obj_map_t *as_map(value_t value);
+bool is_map_key(value_t key);
+uint64_t hash_key(value_t key);
+bool map_get(const obj_map_t *map, value_t key, value_t *value);
+bool map_set(value_t *map, const value_t *key, const value_t *value);
+bool map_delete(obj_map_t *map, value_t key);
+void print_map(const obj_map_t *map);
+
+// Returns the entries of a map with slots.
+static inline map_entry_t *map_entries(const obj_map_t *map) { return ((map_entry_t *)map->storage->numbers); }
+
+// Returns the control bytes of a map with slots; full slots are >= 0.
+static inline int8_t *map_control(const obj_map_t *map) { return ((int8_t *)(map_entries(map) + map->capacity)); }
+
+#endif // MAP_H
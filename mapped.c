@@ -0,0 +1,228 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapped.h"
+#include "gc.h"
+#include "value.h"
+
+static const char *const type_names[MAPPED_TYPE_COUNT] = {"f64", "i32", "i64"};
+static const size_t type_sizes[MAPPED_TYPE_COUNT] = {sizeof(double), sizeof(int32_t), sizeof(int64_t)};
+
+// Mappings held by live or unswept arrays, and the number that triggers a
+// major collection. The arrays are too small for the heap's own budget to
+// notice, while the kernel limits how many mappings a process may have.
+static _Thread_local int live_mappings;
+static _Thread_local int next_sweep = MAPPED_SWEEP_FIRST;
+
+/**
+ * struct layout_s - Where the elements of a data file are.
+ * @type: How they are stored.
+ * @rank: Number of dimensions.
+ * @shape: Length of each dimension.
+ * @count: Number of elements.
+ * @offset: Where the first one starts.
+ */
+typedef struct layout_s
+{
+	mapped_type_t type;
+	int rank;
+	int shape[MAPPED_RANK_MAX];
+	int count;
+	size_t offset;
+} layout_t;
+
+/**
+ * read_header - Finds the elements of a file that starts with a header.
+ * @bytes: The file.
+ * @length: Its size.
+ * @layout: Receives the layout.
+ *
+ * Return: NULL, or why the header is unusable.
+ */
+static const char *read_header(const char *bytes, size_t length, layout_t *layout)
+{
+	mapped_header_t header;
+	if (length < sizeof(header) || memcmp(bytes, MAPPED_MAGIC, sizeof(header.magic)) != 0)
+		return ("no header; give the element type");
+	memcpy(&header, bytes, sizeof(header));
+	if (header.version != MAPPED_VERSION)
+		return ("unsupported header version");
+	if (header.byte_order != MAPPED_BYTE_ORDER)
+		return ("written with a different byte order");
+	if (header.type >= MAPPED_TYPE_COUNT)
+		return ("unknown element type in header");
+	if (header.rank < 1 || header.rank > MAPPED_RANK_MAX)
+		return ("bad rank in header");
+
+	size_t size = type_sizes[header.type];
+	uint64_t count = 1;
+	for (uint32_t i = 0; i < header.rank; i++)
+	{
+		if (header.shape[i] > MAPPED_MAX || count * header.shape[i] > MAPPED_MAX)
+			return ("too many elements");
+		count *= header.shape[i];
+		layout->shape[i] = (int)header.shape[i];
+	}
+	if (header.offset < sizeof(header) || header.offset % size != 0 || header.offset > length ||
+	    count > (length - header.offset) / size)
+		return ("file is shorter than its header says");
+
+	layout->type = header.type;
+	layout->rank = (int)header.rank;
+	layout->count = (int)count;
+	layout->offset = header.offset;
+	return (NULL);
+}
+
+/**
+ * read_layout - Finds the elements of a file.
+ * @bytes: The file.
+ * @length: Its size.
+ * @type: An element type name, for a file of nothing but elements, or null
+ *        for a file with a header.
+ * @layout: Receives the layout.
+ *
+ * Return: NULL, or why the file cannot be used.
+ */
+static const char *read_layout(const char *bytes, size_t length, value_t type, layout_t *layout)
+{
+	if (is_null(type))
+		return (read_header(bytes, length, layout));
+
+	int kind = 0;
+	while (kind < MAPPED_TYPE_COUNT && !(is_string(type) && string_length(&type) == 3 &&
+					     memcmp(string_chars(&type), type_names[kind], 3) == 0))
+		kind++;
+	if (kind == MAPPED_TYPE_COUNT)
+		return ("element type must be \"f64\", \"i32\", \"i64\" or null");
+	if (length % type_sizes[kind] != 0)
+		return ("size is not a whole number of elements");
+	if (length / type_sizes[kind] > MAPPED_MAX)
+		return ("too many elements");
+
+	layout->type = (mapped_type_t)kind;
+	layout->rank = 1;
+	layout->count = (int)(length / type_sizes[kind]);
+	layout->shape[0] = layout->count;
+	layout->offset = 0;
+	return (NULL);
+}
+
+/**
+ * open_mapped - Maps a data file as a read-only array.
+ * @path: The file.
+ * @type: An element type name ("f64", "i32" or "i64") for a file of
+ *        nothing but elements, or null for a file with a header.
+ * @result: Receives the array.
+ *
+ * Return: NULL, or why the file cannot be mapped.
+ */
+const char *open_mapped(const char *path, value_t type, value_t *result)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return (strerror(errno));
+	struct stat info;
+	if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode))
+	{
+		close(fd);
+		return ("not a regular file");
+	}
+
+	if (live_mappings >= next_sweep)
+	{
+		collect_garbage(true);
+		next_sweep = live_mappings * 2 > MAPPED_SWEEP_FIRST ? live_mappings * 2 : MAPPED_SWEEP_FIRST;
+	}
+	size_t length = (size_t)info.st_size;
+	void *mapping = NULL;
+	if (length > 0)
+		mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	int error = errno;
+	close(fd);
+	if (mapping == MAP_FAILED)
+		return (strerror(error));
+
+	layout_t layout;
+	const char *why = read_layout(mapping, length, type, &layout);
+	if (why != NULL)
+	{
+		if (mapping != NULL)
+			munmap(mapping, length);
+		return (why);
+	}
+
+	obj_mapped_t *mapped = (obj_mapped_t *)allocate_tenured(sizeof(obj_mapped_t), OBJ_MAPPED);
+	mapped->type = (uint8_t)layout.type;
+	mapped->rank = (uint8_t)layout.rank;
+	mapped->count = layout.count;
+	memcpy(mapped->shape, layout.shape, sizeof(mapped->shape));
+	mapped->elements = (const char *)mapping + layout.offset;
+	mapped->mapping = mapping;
+	mapped->length = length;
+	live_mappings += mapping != NULL;
+	*result = obj_val(&mapped->obj);
+	return (NULL);
+}
+
+// Unmaps the file of an array that is being freed.
+void free_mapped(obj_mapped_t *mapped)
+{
+	if (mapped->mapping == NULL)
+		return;
+	munmap(mapped->mapping, mapped->length);
+	live_mappings--;
+}
+
+bool is_mapped(value_t value) { return (is_obj_type(value, OBJ_MAPPED)); }
+
+obj_mapped_t *as_mapped(value_t value) { return ((obj_mapped_t *)as_obj(value)); }
+
+/**
+ * mapped_numbers - Reads a run of elements as doubles.
+ * @mapped: The array.
+ * @start: The first element.
+ * @count: Number of elements.
+ * @scratch: Room for @count doubles.
+ *
+ * Doubles are read where they are; other elements are converted into
+ * @scratch.
+ *
+ * Return: The elements.
+ */
+const double *mapped_numbers(const obj_mapped_t *mapped, int start, int count, double *scratch)
+{
+	if (mapped->type == MAPPED_I32)
+	{
+		const int32_t *elements = (const int32_t *)mapped->elements + start;
+		for (int i = 0; i < count; i++)
+			scratch[i] = (double)elements[i];
+		return (scratch);
+	}
+	if (mapped->type == MAPPED_I64)
+	{
+		const int64_t *elements = (const int64_t *)mapped->elements + start;
+		for (int i = 0; i < count; i++)
+			scratch[i] = (double)elements[i];
+		return (scratch);
+	}
+	return ((const double *)mapped->elements + start);
+}
+
+/**
+ * print_mapped - Prints a mapped array as a bracketed list, like an array.
+ * @mapped: The array.
+ */
+void print_mapped(const obj_mapped_t *mapped)
+{
+	putchar('[');
+	for (int i = 0; i < mapped->count; i++)
+	{
+		if (i > 0)
+			fputs(", ", stdout);
+		print_value(number_val(mapped_get(mapped, i)));
+	}
+	putchar(']');
+}
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <stdint.h>
+#include "common.h"
+#include "object.h"
+
+#define MAPPED_MAGIC "charis\0d" // First bytes of a data file with a header.
+#define MAPPED_VERSION 1         // Changes whenever the header layout does.
+#define MAPPED_BYTE_ORDER 0x01020304u
+#define MAPPED_RANK_MAX 4        // Most dimensions a header may describe.
+#define MAPPED_MAX 0x7ffff000    // Most elements; a whole number of blocks within an int.
+#define MAPPED_BLOCK 1024        // Elements converted to doubles at a time.
+#define MAPPED_SWEEP_FIRST 1024  // Live mappings before the first major GC they cause.
+
+/**
+ * enum mapped_type_s - How the elements of a data file are stored.
+ * @MAPPED_F64: IEEE 754 doubles.
+ * @MAPPED_I32: Signed 32-bit integers.
+ * @MAPPED_I64: Signed 64-bit integers; those beyond 2^53 read rounded.
+ *
+ * Description: Elements are in the byte order of the machine reading them.
+ */
+typedef enum mapped_type_s
+{
+	MAPPED_F64,
+	MAPPED_I32,
+	MAPPED_I64,
+	MAPPED_TYPE_COUNT
+} mapped_type_t;
+
+/**
+ * struct mapped_header_s - The optional start of a data file.
+ * @magic: MAPPED_MAGIC.
+ * @version: MAPPED_VERSION.
+ * @byte_order: MAPPED_BYTE_ORDER, as the writing machine stores it.
+ * @type: How the elements are stored (a mapped_type_t).
+ * @rank: Number of dimensions, from 1 to MAPPED_RANK_MAX.
+ * @shape: Length of each dimension; entries past @rank are ignored.
+ * @offset: Where the elements start in the file, at least the size of the
+ *          header and a multiple of the size of an element.
+ *
+ * Description: The elements are stored in row-major order and fill the
+ * file from @offset onwards; anything after the last is ignored.
+ */
+typedef struct mapped_header_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t type;
+	uint32_t rank;
+	uint64_t shape[MAPPED_RANK_MAX];
+	uint64_t offset;
+} mapped_header_t;
+
+/**
+ * struct obj_mapped_s - A read-only array of numbers backed by a file.
+ * @obj: Object header.
+ * @type: How the elements are stored (a mapped_type_t).
+ * @rank: Number of dimensions.
+ * @count: Number of elements.
+ * @shape: Length of each dimension.
+ * @elements: The first element, in the mapping.
+ * @mapping: The whole mapping, or NULL for an empty file.
+ * @length: Size of the mapping in bytes.
+ *
+ * Description: Elements are read from the page cache when they are used
+ * and never copied into the heap, so a file may be larger than memory.
+ * The object is tenured, so the sweep that frees it can unmap the file.
+ */
+typedef struct obj_mapped_s
+{
+	obj_t obj;
+	uint8_t type;
+	uint8_t rank;
+	int count;
+	int shape[MAPPED_RANK_MAX];
+	const char *elements;
+	void *mapping;
+	size_t length;
+} obj_mapped_t;
+
+const char *open_mapped(const char *path, value_t type, value_t *result);
+void free_mapped(obj_mapped_t *mapped);
+bool is_mapped(value_t value);
+obj_mapped_t *as_mapped(value_t value);
+const double *mapped_numbers(const obj_mapped_t *mapped, int start, int count, double *scratch);
+void print_mapped(const obj_mapped_t *mapped);
+
+/**
+ * mapped_get - Reads an element.
+ * @mapped: The array.
+ * @index: A valid index.
+ *
+ * Return: The element, as a double.
+ */
+static inline double mapped_get(const obj_mapped_t *mapped, int index)
+{
+	switch (mapped->type)
+	{
+	case MAPPED_I32:
+		return ((double)((const int32_t *)mapped->elements)[index]);
+	case MAPPED_I64:
+		return ((double)((const int64_t *)mapped->elements)[index]);
+	default:
+		return (((const double *)mapped->elements)[index]);
+	}
+}
+
+#endif // MAPPED_H
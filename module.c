@@ -0,0 +1,711 @@
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "module.h"
+#include "error.h"
+#include "gc.h"
+#include "memory.h"
+#include "parallel.h"
+#include "snapshot.h"
+
+#define KEY_SEED 0xcbf29ce484222325u  // FNV-1a offset basis.
+#define KEY_PRIME 0x100000001b3u      // FNV-1a prime.
+
+/**
+ * enum module_state_s - How far a module of an import graph has got.
+ * @MODULE_STALE: Its cache is missing or out of date, so it waits to be
+ *                compiled.
+ * @MODULE_COMPILING: A compile thread is compiling it.
+ * @MODULE_READY: Its image is in memory.
+ * @MODULE_FAILED: It did not compile.
+ */
+typedef enum module_state_s
+{
+	MODULE_STALE,
+	MODULE_COMPILING,
+	MODULE_READY,
+	MODULE_FAILED
+} module_state_t;
+
+/**
+ * struct module_s - A module of an import graph.
+ * @path: Its file, as an absolute path without links.
+ * @source: Its source code.
+ * @key: Hash of its source and the keys of the modules it imports.
+ * @imports: The modules it imports, by index in the graph.
+ * @import_count: Number of entries in @imports.
+ * @state: How far it has got.
+ * @image: Its image, once it is ready.
+ * @image_size: Size of @image.
+ */
+typedef struct module_s
+{
+	char *path;
+	char *source;
+	uint64_t key;
+	int *imports;
+	int import_count;
+	module_state_t state;
+	uint8_t *image;
+	size_t image_size;
+} module_t;
+
+/**
+ * struct graph_s - The modules a program imports, directly or not.
+ * @modules: The modules; each comes after every module it imports.
+ * @count: Number of entries in @modules.
+ * @capacity: Capacity of @modules.
+ * @lock: Guards the modules' states and images, and what follows.
+ * @changed: Signalled when a module is compiled or the threads should stop.
+ * @running: Number of modules being compiled.
+ * @threads: Number of compile threads that have not given up.
+ * @stopping: Whether compile threads should stop claiming modules.
+ *
+ * Description: Compile threads claim any stale module whose imports are
+ * all ready, so modules that do not depend on each other are compiled at
+ * the same time, while the calling thread runs the ready ones in order.
+ */
+typedef struct graph_s
+{
+	module_t *modules;
+	int count;
+	int capacity;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	int running;
+	int threads;
+	bool stopping;
+} graph_t;
+
+/**
+ * struct import_s - An import declaration.
+ * @start: The module's path as written, without its quotes.
+ * @length: Length of the path.
+ * @line: Line of the declaration.
+ */
+typedef struct import_s
+{
+	const char *start;
+	int length;
+	int line;
+} import_t;
+
+/**
+ * struct loaded_module_s - A module this thread has run.
+ * @path: Its file.
+ * @key: Its key when it ran.
+ * @image: The image it ran from.
+ * @image_size: Size of @image.
+ *
+ * Description: A module runs once per thread and is never compiled again,
+ * even if its source has changed since: modules that import it later are
+ * compiled against the image it ran from, which declared the globals they
+ * will see.
+ */
+typedef struct loaded_module_s
+{
+	char *path;
+	uint64_t key;
+	uint8_t *image;
+	size_t image_size;
+} loaded_module_t;
+
+static _Thread_local loaded_module_t *loaded;
+static _Thread_local int loaded_count;
+static _Thread_local int loaded_capacity;
+
+static int add_module(graph_t *graph, char *path, const char **chain, int depth);
+
+// Adds bytes to an FNV-1a hash.
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		hash = (hash ^ ((const uint8_t *)bytes)[i]) * KEY_PRIME;
+	return (hash);
+}
+
+// Finds a module this thread has run, or returns NULL.
+static const loaded_module_t *find_loaded(const char *path)
+{
+	for (int i = 0; i < loaded_count; i++)
+		if (strcmp(loaded[i].path, path) == 0)
+			return (&loaded[i]);
+	return (NULL);
+}
+
+// Copies a module image.
+static uint8_t *copy_image(const uint8_t *image, size_t size)
+{
+	uint8_t *copy = malloc(size > 0 ? size : 1);
+	if (copy == NULL)
+		exit(1);
+	memcpy(copy, image, size);
+	return (copy);
+}
+
+// Records that this thread has run a module, and what it ran.
+static void remember_loaded(const module_t *module)
+{
+	if (loaded_count == loaded_capacity)
+	{
+		int old_capacity = loaded_capacity;
+		loaded_capacity = (int)grow_capacity(old_capacity);
+		loaded = grow_array(loaded, old_capacity, loaded_capacity, sizeof(loaded_module_t));
+	}
+	char *path = strdup(module->path);
+	if (path == NULL)
+		exit(1);
+	loaded[loaded_count++] = (loaded_module_t){path, module->key, copy_image(module->image, module->image_size),
+						   module->image_size};
+}
+
+/**
+ * free_modules - Forgets which modules have run, as the globals they
+ * declared go with the VM.
+ */
+void free_modules(void)
+{
+	for (int i = 0; i < loaded_count; i++)
+	{
+		free(loaded[i].path);
+		free(loaded[i].image);
+	}
+	free(loaded);
+	loaded = NULL;
+	loaded_count = 0;
+	loaded_capacity = 0;
+}
+
+// Reads a whole file, or returns NULL.
+static char *read_source(const char *path)
+{
+	if (vm.timings != NULL)
+		timings_begin(vm.timings, PHASE_READ);
+	FILE *file = fopen(path, "rb");
+	char *source = NULL;
+	if (file != NULL && fseek(file, 0L, SEEK_END) == 0)
+	{
+		long size = ftell(file);
+		rewind(file);
+		source = size >= 0 ? malloc((size_t)size + 1) : NULL;
+		if (source != NULL && fread(source, 1, (size_t)size, file) == (size_t)size)
+			source[size] = '\0';
+		else
+		{
+			free(source);
+			source = NULL;
+		}
+	}
+	if (file != NULL)
+		fclose(file);
+	if (vm.timings != NULL)
+		timings_end(vm.timings);
+	return (source);
+}
+
+/**
+ * scan_imports - Finds the import declarations a source starts with.
+ * @source: The source.
+ * @imports: Receives the imports, to be freed by the caller.
+ *
+ * Imports must come before anything else, so scanning stops at the first
+ * token that is not part of one; the compiler reports misplaced and
+ * malformed imports.
+ *
+ * Return: The number of imports.
+ */
+static int scan_imports(const char *source, import_t **imports)
+{
+	int count = 0;
+	int capacity = 0;
+	*imports = NULL;
+	init_scanner(source);
+	while (scan_token().type == TOKEN_IMPORT)
+	{
+		token_t path = scan_token();
+		token_type_t end = scan_token().type;
+		if (path.type != TOKEN_STRING || (end != TOKEN_SEMICOLON && end != TOKEN_EOF))
+			break;
+		if (count == capacity)
+		{
+			int old_capacity = capacity;
+			capacity = (int)grow_capacity(old_capacity);
+			*imports = grow_array(*imports, old_capacity, capacity, sizeof(import_t));
+		}
+		(*imports)[count++] = (import_t){path.start + 1, path.length - 2, path.line};
+	}
+	return (count);
+}
+
+/**
+ * resolve_import - Finds the file an import names.
+ * @importer: The importing module's file, or NULL for a program that is
+ *            not in a file.
+ * @import: The import.
+ *
+ * A relative path is relative to the directory of the importing file, or
+ * to the working directory.
+ *
+ * Return: The file as an absolute path without links, to be freed by the
+ * caller, or NULL with the error reported.
+ */
+static char *resolve_import(const char *importer, const import_t *import)
+{
+	char joined[PATH_MAX];
+	const char *slash = importer != NULL && import->start[0] != '/' ? strrchr(importer, '/') : NULL;
+	int directory = slash != NULL ? (int)(slash - importer + 1) : 0;
+	snprintf(joined, sizeof(joined), "%.*s%.*s", directory, importer, import->length, import->start);
+
+	char *path = malloc(PATH_MAX);
+	if (path == NULL)
+		exit(1);
+	if (realpath(joined, path) == NULL)
+	{
+		report_error("[line %d] Can't open module '%.*s' imported by %s.", import->line, import->length,
+			     import->start, importer != NULL ? importer : "the program");
+		free(path);
+		return (NULL);
+	}
+	return (path);
+}
+
+/**
+ * add_imports - Adds the modules a source imports to a graph.
+ * @graph: The graph.
+ * @source: The source.
+ * @importer: The file the source came from, or NULL.
+ * @chain: The modules whose imports are being added, outermost first.
+ * @depth: Number of entries in @chain.
+ * @imports: Receives the modules, by index, to be freed by the caller.
+ * @count: Receives the number of modules.
+ *
+ * Return: false, with the error reported, if a module cannot be added.
+ */
+static bool add_imports(graph_t *graph, const char *source, const char *importer, const char **chain, int depth,
+			int **imports, int *count)
+{
+	import_t *found;
+	int found_count = scan_imports(source, &found);
+	*imports = NULL;
+	*count = 0;
+	if (found_count > 0)
+		*imports = grow_array(NULL, 0, found_count, sizeof(int));
+
+	bool added = true;
+	for (int i = 0; i < found_count && added; i++)
+	{
+		char *path = resolve_import(importer, &found[i]);
+		int index = path != NULL ? add_module(graph, path, chain, depth) : -1;
+		if (index == -1)
+			added = false;
+		else
+			(*imports)[(*count)++] = index;
+	}
+	free(found);
+	return (added);
+}
+
+/**
+ * add_module - Adds a module to a graph, after the modules it imports.
+ * @graph: The graph.
+ * @path: The module's file, resolved; the graph takes it over.
+ * @chain: The modules whose imports are being added, outermost first,
+ *         with room for MODULE_DEPTH_MAX entries.
+ * @depth: Number of entries in @chain.
+ *
+ * Return: The module's index, or -1 with the error reported.
+ */
+static int add_module(graph_t *graph, char *path, const char **chain, int depth)
+{
+	for (int i = 0; i < graph->count; i++)
+	{
+		if (strcmp(graph->modules[i].path, path) == 0)
+		{
+			free(path);
+			return (i);
+		}
+	}
+	const char *error = depth == MODULE_DEPTH_MAX ? "Imports are nested too deeply at module '%s'." : NULL;
+	for (int i = 0; i < depth && error == NULL; i++)
+		if (strcmp(chain[i], path) == 0)
+			error = "Module '%s' is part of an import cycle.";
+	char *source = error == NULL ? read_source(path) : NULL;
+	if (error == NULL && source == NULL)
+		error = "Failed to read module '%s'.";
+	if (error != NULL)
+	{
+		report_error(error, path);
+		free(path);
+		return (-1);
+	}
+
+	chain[depth] = path;
+	int *imports;
+	int import_count;
+	if (!add_imports(graph, source, path, chain, depth + 1, &imports, &import_count))
+	{
+		free(imports);
+		free(source);
+		free(path);
+		return (-1);
+	}
+	uint64_t key = hash_bytes(KEY_SEED, source, strlen(source));
+	for (int i = 0; i < import_count; i++)
+		key = hash_bytes(key, &graph->modules[imports[i]].key, sizeof(key));
+	const loaded_module_t *ran = find_loaded(path);
+	if (ran != NULL)
+		key = ran->key; // What importers are compiled against.
+
+	if (graph->count == graph->capacity)
+	{
+		int old_capacity = graph->capacity;
+		graph->capacity = (int)grow_capacity(old_capacity);
+		graph->modules = grow_array(graph->modules, old_capacity, graph->capacity, sizeof(module_t));
+	}
+	graph->modules[graph->count] = (module_t){path, source, key, imports, import_count, MODULE_STALE, NULL, 0};
+	return (graph->count++);
+}
+
+// Names the cache of a module: its path followed by MODULE_CACHE_SUFFIX.
+static void cache_path(const module_t *module, char *cache, size_t size)
+{
+	snprintf(cache, size, "%s%s", module->path, MODULE_CACHE_SUFFIX);
+}
+
+/**
+ * read_cache - Reads a module's image from its cache.
+ * @module: The module.
+ *
+ * Return: false if there is no cache, or it is out of date, damaged or
+ * written by another build.
+ */
+static bool read_cache(module_t *module)
+{
+	char cache[PATH_MAX + sizeof(MODULE_CACHE_SUFFIX)];
+	cache_path(module, cache, sizeof(cache));
+	if (vm.timings != NULL)
+		timings_begin(vm.timings, PHASE_READ);
+	FILE *file = fopen(cache, "rb");
+	module_header_t header;
+	uint8_t *image = NULL;
+	bool read = file != NULL && fread(&header, sizeof(header), 1, file) == 1 &&
+		    memcmp(header.magic, MODULE_MAGIC, sizeof(header.magic)) == 0 &&
+		    header.version == MODULE_VERSION && header.byte_order == MODULE_BYTE_ORDER &&
+		    header.opcode_count == OPCODE_COUNT && header.key == module->key && header.size <= INT32_MAX;
+	if (read)
+	{
+		image = malloc(header.size + 1);
+		read = image != NULL && fread(image, 1, header.size, file) == header.size && fgetc(file) == EOF &&
+		       header.checksum == hash_string((const char *)image, (int)header.size);
+	}
+	if (file != NULL)
+		fclose(file);
+	if (vm.timings != NULL)
+		timings_end(vm.timings);
+	if (!read)
+	{
+		free(image);
+		return (false);
+	}
+	module->image = image;
+	module->image_size = header.size;
+	return (true);
+}
+
+/**
+ * write_cache - Writes a module's image to its cache.
+ * @module: The module.
+ * @image: Its image.
+ * @size: Size of @image.
+ *
+ * The cache is written under a temporary name and renamed, so another
+ * process never reads half of it. A cache that cannot be written, e.g. in
+ * a read-only directory, is left out: the module is compiled next time.
+ */
+static void write_cache(const module_t *module, const uint8_t *image, size_t size)
+{
+	module_header_t header = {0};
+	memcpy(header.magic, MODULE_MAGIC, sizeof(header.magic));
+	header.version = MODULE_VERSION;
+	header.byte_order = MODULE_BYTE_ORDER;
+	header.opcode_count = OPCODE_COUNT;
+	header.checksum = hash_string((const char *)image, (int)size);
+	header.key = module->key;
+	header.size = size;
+
+	char cache[PATH_MAX + sizeof(MODULE_CACHE_SUFFIX)];
+	char temporary[sizeof(cache) + 32];
+	cache_path(module, cache, sizeof(cache));
+	snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", cache, (long)getpid());
+	FILE *file = fopen(temporary, "wb");
+	if (file == NULL)
+		return;
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(image, 1, size, file) == size;
+	if (fclose(file) != 0)
+		written = false;
+	if (!written || rename(temporary, cache) != 0)
+		remove(temporary);
+}
+
+/**
+ * compile_module - Compiles a module on a context of the calling thread's
+ * own.
+ * @graph: The graph; every module the module imports, directly or not,
+ *         is ready.
+ * @index: The module.
+ * @size: Receives the size of the image.
+ *
+ * The context loads the images of those modules first, without running
+ * them, so that the module is compiled against their globals as if it
+ * followed them in a single program. Function bodies are compiled at
+ * once, since an image holds compiled code.
+ *
+ * Return: The module's image, or NULL with the errors reported.
+ */
+static uint8_t *compile_module(graph_t *graph, int index, size_t *size)
+{
+	const module_t *module = &graph->modules[index];
+	bool *needed = calloc(index + 1, sizeof(bool));
+	if (needed == NULL)
+		exit(1);
+	needed[index] = true;
+	for (int i = index; i >= 0; i--)
+		for (int j = 0; needed[i] && j < graph->modules[i].import_count; j++)
+			needed[graph->modules[i].imports[j]] = true;
+
+	init_vm();
+	vm.eager = true;
+	value_t script = null_val();
+	gc_add_roots(&script, 1);
+	bool loaded = true;
+	for (int i = 0; i < index && loaded; i++)
+		if (needed[i] && !(loaded = load_module(graph->modules[i].image, graph->modules[i].image_size, &script)))
+			report_error("Failed to load module '%s'.", graph->modules[i].path);
+	gc_remove_roots(&script);
+
+	chunk_t chunk;
+	init_chunk(&chunk);
+	int first_global = vm.globals.count;
+	uint8_t *image = NULL;
+	if (loaded && compile(module->source, &chunk))
+		image = save_module(&chunk, first_global, size);
+	free_chunk(&chunk);
+	free_context();
+	free(needed);
+	return (image);
+}
+
+// Finds a stale module whose imports are all ready, or returns -1.
+static int claim_module(const graph_t *graph)
+{
+	for (int i = 0; i < graph->count; i++)
+	{
+		const module_t *module = &graph->modules[i];
+		bool ready = module->state == MODULE_STALE;
+		for (int j = 0; j < module->import_count && ready; j++)
+			ready = graph->modules[module->imports[j]].state == MODULE_READY;
+		if (ready)
+			return (i);
+	}
+	return (-1);
+}
+
+/**
+ * compile_modules - The body of a compile thread.
+ * @context: The graph.
+ *
+ * The thread compiles modules as they become ready to compile, until it
+ * is told to stop or none is left that could be: when nothing is being
+ * compiled either, the rest import a module that failed. The last thread
+ * to give up wakes the calling thread, which may be waiting on one of them.
+ *
+ * Return: NULL.
+ */
+static void *compile_modules(void *context)
+{
+	graph_t *graph = context;
+	sigset_t signals;
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	pthread_mutex_lock(&graph->lock);
+	while (!graph->stopping)
+	{
+		int index = claim_module(graph);
+		if (index == -1 && graph->running == 0)
+			break;
+		if (index == -1)
+		{
+			pthread_cond_wait(&graph->changed, &graph->lock);
+			continue;
+		}
+		graph->modules[index].state = MODULE_COMPILING;
+		graph->running++;
+		pthread_mutex_unlock(&graph->lock);
+
+		size_t size = 0;
+		uint8_t *image = compile_module(graph, index, &size);
+		if (image != NULL)
+			write_cache(&graph->modules[index], image, size);
+
+		pthread_mutex_lock(&graph->lock);
+		graph->modules[index].image = image;
+		graph->modules[index].image_size = size;
+		graph->modules[index].state = image != NULL ? MODULE_READY : MODULE_FAILED;
+		graph->running--;
+		pthread_cond_broadcast(&graph->changed);
+	}
+	graph->threads--;
+	pthread_cond_broadcast(&graph->changed);
+	pthread_mutex_unlock(&graph->lock);
+	return (NULL);
+}
+
+/**
+ * run_module - Loads a module's image and runs its top level.
+ * @module: The module, ready.
+ *
+ * Return: The result of running it.
+ */
+static interpret_result_t run_module(const module_t *module)
+{
+	value_t script = null_val();
+	gc_add_roots(&script, 1);
+	interpret_result_t result = INTERPRET_COMPILE_ERROR;
+	if (!load_module(module->image, module->image_size, &script))
+		report_error("Failed to load module '%s'.", module->path);
+	else if ((result = interpret_chunk(as_function(script)->chunk)) != INTERPRET_OK)
+		report_error("Failed to run module '%s'.", module->path);
+	gc_remove_roots(&script);
+	if (result == INTERPRET_OK)
+		remember_loaded(module);
+	return (result);
+}
+
+// Frees the modules of a graph.
+static void free_graph(graph_t *graph)
+{
+	for (int i = 0; i < graph->count; i++)
+	{
+		free(graph->modules[i].path);
+		free(graph->modules[i].source);
+		free(graph->modules[i].imports);
+		free(graph->modules[i].image);
+	}
+	free(graph->modules);
+	pthread_mutex_destroy(&graph->lock);
+	pthread_cond_destroy(&graph->changed);
+}
+
+/**
+ * load_imports - Runs the modules a source imports, and those they import,
+ * unless this thread has run them already.
+ * @source: The source, whose imports come before anything else in it.
+ * @path: The file the source came from, which relative imports are
+ *        relative to, or NULL for the working directory.
+ *
+ * Each module is compiled once into an image, cached next to its source
+ * and used for as long as neither it nor any module it imports changes.
+ * Modules whose caches are out of date are compiled by a thread each, up
+ * to parallel_threads() at a time, as soon as the modules they import are
+ * ready, while the calling thread runs the modules in order, each after
+ * those it imports. Modules share the globals of the program. Modules this
+ * thread has run are ready with the image they ran from (see
+ * loaded_module_t).
+ *
+ * Return: The result of compiling or running the first module that fails
+ * or cannot be compiled because a module it imports failed, or
+ * INTERPRET_OK.
+ */
+interpret_result_t load_imports(const char *source, const char *path)
+{
+	graph_t graph = {0};
+	pthread_mutex_init(&graph.lock, NULL);
+	pthread_cond_init(&graph.changed, NULL);
+	const char *chain[MODULE_DEPTH_MAX];
+	char program[PATH_MAX];
+	int depth = path != NULL && realpath(path, program) != NULL;
+	chain[0] = program;
+
+	int *roots;
+	int root_count;
+	bool added = add_imports(&graph, source, path, chain, depth, &roots, &root_count);
+	free(roots);
+	interpret_result_t result = added ? INTERPRET_OK : INTERPRET_COMPILE_ERROR;
+
+	int stale = 0;
+	for (int i = 0; i < graph.count && added; i++)
+	{
+		module_t *module = &graph.modules[i];
+		const loaded_module_t *ran = find_loaded(module->path);
+		if (ran != NULL)
+		{
+			module->image = copy_image(ran->image, ran->image_size);
+			module->image_size = ran->image_size;
+			module->state = MODULE_READY;
+		}
+		else if (read_cache(module))
+			module->state = MODULE_READY;
+		else
+			stale++;
+	}
+	pthread_t threads[WORKERS_MAX];
+	int thread_count = 0;
+	int wanted = stale < parallel_threads() ? stale : parallel_threads();
+	graph.threads = wanted; // Before any starts, as each counts itself out.
+	while (thread_count < wanted && pthread_create(&threads[thread_count], NULL, compile_modules, &graph) == 0)
+		thread_count++;
+	pthread_mutex_lock(&graph.lock);
+	graph.threads -= wanted - thread_count;
+	pthread_mutex_unlock(&graph.lock);
+	if (wanted > 0 && thread_count == 0)
+	{
+		fprintf(stderr, "Error: Failed to start compile threads\n");
+		exit(INTERPRET_RUNTIME_ERROR);
+	}
+
+	for (int i = 0; i < graph.count && result == INTERPRET_OK; i++)
+	{
+		module_t *module = &graph.modules[i];
+		if (find_loaded(module->path) != NULL)
+			continue;
+		// Waiting on the compile threads is charged to compiling, the
+		// only share of their work this thread's timings can see. A
+		// stale module is only waited for while some thread may still
+		// claim it; once all have given up, a module it imports failed.
+		pthread_mutex_lock(&graph.lock);
+		bool waiting = module->state == MODULE_STALE || module->state == MODULE_COMPILING;
+		if (waiting && vm.timings != NULL)
+			timings_begin(vm.timings, PHASE_COMPILE);
+		while (module->state == MODULE_COMPILING || (module->state == MODULE_STALE && graph.threads > 0))
+			pthread_cond_wait(&graph.changed, &graph.lock);
+		module_state_t state = module->state;
+		pthread_mutex_unlock(&graph.lock);
+		if (waiting && vm.timings != NULL)
+			timings_end(vm.timings);
+		if (state != MODULE_READY)
+		{
+			if (state == MODULE_FAILED)
+				report_error("Failed to compile module '%s'.", module->path);
+			else
+				report_error("Can't compile module '%s': a module it imports did not compile.",
+					     module->path);
+			result = INTERPRET_COMPILE_ERROR;
+		}
+		else
+		{
+			result = run_module(module);
+		}
+	}
+
+	pthread_mutex_lock(&graph.lock);
+	graph.stopping = true;
+	pthread_cond_broadcast(&graph.changed);
+	pthread_mutex_unlock(&graph.lock);
+	for (int i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+	free_graph(&graph);
+	return (result);
+}
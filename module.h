@@ -0,0 +1,43 @@
+#pragma once
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stdint.h>
+#include "common.h"
+#include "vm.h"
+
+#define MODULE_MAGIC "charis\0m"  // First bytes of every module cache.
+#define MODULE_VERSION 1          // Changes whenever the cache layout does.
+#define MODULE_BYTE_ORDER 0x01020304u
+#define MODULE_CACHE_SUFFIX "c"   // Appended to a module's path to name its cache.
+#define MODULE_DEPTH_MAX 256      // Longest chain of modules importing each other.
+
+/**
+ * struct module_header_s - The start of a module cache.
+ * @magic: MODULE_MAGIC.
+ * @version: MODULE_VERSION.
+ * @byte_order: MODULE_BYTE_ORDER, as the writing machine stores it.
+ * @opcode_count: Number of opcodes of the build that wrote the cache.
+ * @checksum: FNV-1a hash of the @size bytes after the header.
+ * @key: The key of the module the cache was written for.
+ * @size: Bytes after the header, the image written by save_module().
+ *
+ * Description: A module's key hashes its source together with the keys
+ * of the modules it imports, since their folded globals are compiled into
+ * its code, so any change that could change the code changes the key.
+ */
+typedef struct module_header_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t opcode_count;
+	uint32_t checksum;
+	uint64_t key;
+	uint64_t size;
+} module_header_t;
+
+interpret_result_t load_imports(const char *source, const char *path);
+void free_modules(void);
+
+#endif // MODULE_H
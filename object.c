@@ -0,0 +1,209 @@
+#include "object.h"
+#include "array.h"
+#include "class.h"
+#include "function.h"
+#include "gc.h"
+#include "map.h"
+#include "mapped.h"
+#include "memory.h"
+#include "table.h"
+#include "vm.h"
+
+/**
+ * hash_string - Computes the FNV-1a hash of a string.
+ * @chars: The string's bytes.
+ * @length: The string's length.
+ *
+ * Return: The hash.
+ */
+uint32_t hash_string(const char *chars, int length)
+{
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < length; i++)
+	{
+		hash ^= (uint8_t)chars[i];
+		hash *= 16777619u;
+	}
+	return (hash);
+}
+
+/**
+ * fits_inline - Checks whether a string is stored inside its value.
+ * @chars: The string's bytes.
+ * @length: The string's length.
+ *
+ * Return: true for strings of at most SMALL_STRING_MAX bytes without NULs.
+ */
+static bool fits_inline(const char *chars, int length)
+{
+	return length <= SMALL_STRING_MAX && memchr(chars, '\0', length) == NULL;
+}
+
+// Builds the inline representation of a short string.
+static value_t small_string(const char *chars, int length)
+{
+	value_t value;
+	value.type = VAL_SMALL_STRING;
+	memset(value.as.small, 0, SMALL_STRING_MAX);
+	memcpy(value.as.small, chars, length);
+	return value;
+}
+
+/**
+ * allocate_string - Allocates an uninitialized heap string.
+ * @length: The string's length.
+ *
+ * Return: The string, with room for @length bytes and a NUL.
+ */
+static obj_string_t *allocate_string(int length)
+{
+	obj_string_t *string = (obj_string_t *)allocate_object(sizeof(obj_string_t) + length + 1, OBJ_STRING);
+	string->length = length;
+	string->chars[length] = '\0';
+	return string;
+}
+
+/**
+ * copy_string - Makes a string value from a run of bytes.
+ * @chars: The bytes; they are copied.
+ * @length: Number of bytes.
+ *
+ * Short strings are stored inline; longer ones are looked up in the intern
+ * table and only allocated the first time they are seen.
+ *
+ * Return: The string value.
+ */
+value_t copy_string(const char *chars, int length)
+{
+	if (fits_inline(chars, length))
+		return small_string(chars, length);
+
+	uint32_t hash = hash_string(chars, length);
+	obj_string_t *interned = string_table_find(&vm.strings, chars, length, hash);
+	if (interned != NULL)
+		return obj_val(&interned->obj);
+
+	obj_string_t *string = allocate_string(length);
+	memcpy(string->chars, chars, length);
+	string->hash = hash;
+	string_table_add(&vm.strings, string);
+	return obj_val(&string->obj);
+}
+
+/**
+ * concatenate_strings - Joins two string values.
+ * @a: The left string.
+ * @b: The right string.
+ *
+ * Both operands are passed by reference, and must live in GC roots such as
+ * stack slots, since allocating the result may move them.
+ *
+ * Return: The joined string value.
+ */
+value_t concatenate_strings(const value_t *a, const value_t *b)
+{
+	int a_length = string_length(a);
+	int b_length = string_length(b);
+	int length = a_length + b_length;
+
+	if (length <= SMALL_STRING_MAX)
+	{
+		char chars[SMALL_STRING_MAX];
+		memcpy(chars, string_chars(a), a_length);
+		memcpy(chars + a_length, string_chars(b), b_length);
+		return copy_string(chars, length);
+	}
+
+	// Build the result in place; drop it again if it was already interned.
+	obj_string_t *string = allocate_string(length);
+	memcpy(string->chars, string_chars(a), a_length);
+	memcpy(string->chars + a_length, string_chars(b), b_length);
+	string->hash = hash_string(string->chars, length);
+
+	obj_string_t *interned = string_table_find(&vm.strings, string->chars, length, string->hash);
+	if (interned != NULL)
+	{
+		discard_object(&string->obj);
+		return obj_val(&interned->obj);
+	}
+	string_table_add(&vm.strings, string);
+	return obj_val(&string->obj);
+}
+
+bool is_obj_type(value_t value, obj_type_t type)
+{
+	return (is_obj(value) && as_obj(value)->type == type);
+}
+
+bool is_string(value_t value)
+{
+	return (value.type == VAL_SMALL_STRING || is_obj_type(value, OBJ_STRING));
+}
+
+obj_string_t *as_string(value_t value) { return ((obj_string_t *)as_obj(value)); }
+
+/**
+ * string_length - Returns the length of a string value.
+ * @value: The string value.
+ *
+ * Return: The length in bytes.
+ */
+int string_length(const value_t *value)
+{
+	if (value->type == VAL_SMALL_STRING)
+		return (int)strnlen(value->as.small, SMALL_STRING_MAX);
+	return (((obj_string_t *)value->as.obj)->length);
+}
+
+/**
+ * string_chars - Returns the bytes of a string value.
+ * @value: The string value; small strings point into it.
+ *
+ * Return: The bytes, not NUL-terminated for full-length small strings.
+ */
+const char *string_chars(const value_t *value)
+{
+	if (value->type == VAL_SMALL_STRING)
+		return (value->as.small);
+	return (((obj_string_t *)value->as.obj)->chars);
+}
+
+/**
+ * print_object - Prints a heap object.
+ * @value: The object value.
+ */
+void print_object(value_t value)
+{
+	switch (as_obj(value)->type)
+	{
+	case OBJ_STRING:
+		fwrite(as_string(value)->chars, 1, as_string(value)->length, stdout);
+		break;
+	case OBJ_ARRAY:
+		print_array(as_array(value));
+		break;
+	case OBJ_MAP:
+		print_map(as_map(value));
+		break;
+	case OBJ_FUNCTION:
+		printf("<fn %.*s>", string_length(&as_function(value)->name), string_chars(&as_function(value)->name));
+		break;
+	case OBJ_CLASS:
+		printf("<class %.*s>", string_length(&as_class(value)->name), string_chars(&as_class(value)->name));
+		break;
+	case OBJ_INSTANCE:
+	{
+		const value_t *name = &as_class(as_instance(value)->klass)->name;
+		printf("<%.*s instance>", string_length(name), string_chars(name));
+		break;
+	}
+	case OBJ_BOUND_METHOD:
+		print_object(as_bound_method(value)->method);
+		break;
+	case OBJ_MAPPED:
+		print_mapped(as_mapped(value));
+		break;
+	case OBJ_BUFFER:
+		break;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdint.h>
+#include "common.h"
+
+typedef enum obj_type_s
+{
+	OBJ_STRING,
+	OBJ_ARRAY,
+	OBJ_BUFFER,
+	OBJ_MAP,
+	OBJ_FUNCTION,
+	OBJ_CLASS,
+	OBJ_INSTANCE,
+	OBJ_BOUND_METHOD,
+	OBJ_MAPPED,
+} obj_type_t;
+
+/**
+ * struct obj_s - Header shared by every heap object.
+ * @type: The object's type (an obj_type_t).
+ * @generation: The object's generation (a generation_t).
+ * @marked: Set while a major collection finds the object reachable.
+ * @remembered: Set while the object is in the remembered set.
+ * @size: Size of the object in bytes, header included.
+ * @next: Next old object; for a promoted nursery object, its old copy.
+ */
+struct obj_s
+{
+	uint8_t type;
+	uint8_t generation;
+	bool marked;
+	bool remembered;
+	uint32_t size;
+	struct obj_s *next;
+};
+
+/**
+ * struct obj_string_s - An interned heap string.
+ * @obj: Object header.
+ * @length: Length in bytes.
+ * @hash: FNV-1a hash of the bytes, computed once at creation.
+ * @chars: The bytes, NUL-terminated.
+ *
+ * Description: Only strings longer than SMALL_STRING_MAX are allocated;
+ * all of them go through the VM's intern table, so two heap strings are
+ * equal exactly when they are the same object.
+ */
+typedef struct obj_string_s
+{
+	obj_t obj;
+	int length;
+	uint32_t hash;
+	char chars[];
+} obj_string_t;
+
+uint32_t hash_string(const char *chars, int length);
+value_t copy_string(const char *chars, int length);
+value_t concatenate_strings(const value_t *a, const value_t *b);
+bool is_string(value_t value);
+bool is_obj_type(value_t value, obj_type_t type);
+obj_string_t *as_string(value_t value);
+int string_length(const value_t *value);
+const char *string_chars(const value_t *value);
+void print_object(value_t value);
+
+#endif // OBJECT_H
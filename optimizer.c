@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include "optimizer.h"
+#include "memory.h"
+
+/**
+ * struct jump_map_s - A chunk decoded into instructions for rewriting.
+ * @count: Number of instructions.
+ * @starts: Offset of each instruction in the original code, followed by
+ *          the length of the code.
+ * @opcodes: Opcode of each instruction, jumps always in their wide form.
+ * @targets: Instruction each jump lands on, or -1 for other instructions.
+ * @targeted: Number of jumps landing on each instruction.
+ * @lengths: Length of each instruction once rewritten; 0 if it was deleted.
+ * @new_starts: Offset of each instruction once rewritten, followed by the
+ *              new length of the code.
+ */
+typedef struct jump_map_s
+{
+	int count;
+	int *starts;
+	uint8_t *opcodes;
+	int *targets;
+	int *targeted;
+	int *lengths;
+	int *new_starts;
+} jump_map_t;
+
+// Returns the wide form of a jump opcode.
+static uint8_t wide_jump(uint8_t opcode)
+{
+	return ((uint8_t)(OP_JUMP + ((opcode - OP_JUMP) & ~1)));
+}
+
+/**
+ * decode_jumps - Splits a chunk into instructions and resolves its jumps.
+ * @chunk: The chunk.
+ * @map: The map to fill in.
+ */
+static void decode_jumps(const chunk_t *chunk, jump_map_t *map)
+{
+	int count = 0;
+	for (int offset = 0; offset < chunk->count; offset += instruction_length(chunk->code[offset]))
+		count++;
+
+	map->count = count;
+	map->starts = malloc(sizeof(int) * (count + 1));
+	map->opcodes = malloc(count);
+	map->targets = malloc(sizeof(int) * count);
+	map->targeted = malloc(sizeof(int) * count);
+	map->lengths = malloc(sizeof(int) * count);
+	map->new_starts = malloc(sizeof(int) * (count + 1));
+	if (map->starts == NULL || map->opcodes == NULL || map->targets == NULL ||
+	    map->targeted == NULL || map->lengths == NULL || map->new_starts == NULL)
+		exit(1);
+
+	for (int i = 0, offset = 0; i < count; offset += instruction_length(chunk->code[offset]), i++)
+		map->starts[i] = offset;
+	map->starts[count] = chunk->count;
+	for (int i = 0; i < count; i++)
+	{
+		uint8_t opcode = chunk->code[map->starts[i]];
+		map->opcodes[i] = opcode;
+		map->targets[i] = -1;
+		map->lengths[i] = map->starts[i + 1] - map->starts[i];
+		if (!is_jump(opcode))
+			continue;
+
+		map->opcodes[i] = wide_jump(opcode);
+		int target = jump_target(chunk, map->starts[i]);
+		int low = 0, high = count;
+		while (low < high)
+		{
+			int middle = (low + high) / 2;
+			if (map->starts[middle] < target)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		map->targets[i] = low;
+	}
+}
+
+/**
+ * thread_jump - Retargets a forward jump past the jumps it lands on.
+ * @map: The decoded chunk.
+ * @i: The jump.
+ *
+ * Unconditional jumps are followed outright. The value-keeping jumps of
+ * `and`/`or` also see through a test of the value they leave behind, whose
+ * outcome is then already known: landing on the same test again means
+ * jumping on, landing on the opposite test means falling through it, and
+ * landing on a popping test turns the jump into that test. Every step moves
+ * forward, so chains of conditionals collapse into a single jump.
+ */
+static void thread_jump(jump_map_t *map, int i)
+{
+	if (map->opcodes[i] >= OP_LOOP)
+		return;
+	for (;;)
+	{
+		int target = map->targets[i];
+		uint8_t opcode = map->opcodes[i];
+		uint8_t next = target < map->count ? map->opcodes[target] : OP_RETURN;
+
+		if (next == OP_JUMP || (opcode == next && (opcode == OP_JUMP_IF_FALSE_OR_POP ||
+							   opcode == OP_JUMP_IF_TRUE_OR_POP)))
+			map->targets[i] = map->targets[target];
+		else if (opcode == OP_JUMP_IF_FALSE_OR_POP && next == OP_JUMP_IF_FALSE)
+		{
+			map->opcodes[i] = OP_JUMP_IF_FALSE;
+			map->targets[i] = map->targets[target];
+		}
+		else if (opcode == OP_JUMP_IF_FALSE_OR_POP && next == OP_JUMP_IF_TRUE_OR_POP)
+		{
+			map->opcodes[i] = OP_JUMP_IF_FALSE;
+			map->targets[i] = target + 1;
+		}
+		else if (opcode == OP_JUMP_IF_TRUE_OR_POP &&
+			 (next == OP_JUMP_IF_FALSE || next == OP_JUMP_IF_FALSE_OR_POP))
+		{
+			map->opcodes[i] = OP_JUMP_IF_TRUE;
+			map->targets[i] = target + 1;
+		}
+		else
+			return;
+	}
+}
+
+/**
+ * mark_tail_call - Turns a call whose result is returned into a tail call.
+ * @map: The decoded chunk, with jumps threaded.
+ * @i: A call.
+ *
+ * The result is returned if the call is followed by a return, or by a jump
+ * that now lands on one, as at the end of a branch of `?:` or `if`.
+ */
+static void mark_tail_call(jump_map_t *map, int i)
+{
+	int next = i + 1;
+	if (next < map->count && map->opcodes[next] == OP_JUMP)
+		next = map->targets[next];
+	if (next < map->count && map->opcodes[next] == OP_RETURN)
+		map->opcodes[i] = OP_TAIL_CALL;
+}
+
+// Returns the fused compare-and-branch for a comparison, or 0.
+static uint8_t fused_branch(uint8_t compare)
+{
+	switch (compare)
+	{
+	case OP_LESS:
+		return (OP_JUMP_IF_LESS);
+	case OP_GREATER:
+		return (OP_JUMP_IF_GREATER);
+	case OP_EQUAL:
+		return (OP_JUMP_IF_EQUAL);
+	default:
+		return (0);
+	}
+}
+
+/**
+ * fuse_branch - Folds the comparison feeding a conditional jump into it.
+ * @map: The decoded chunk, with jump targets counted.
+ * @i: A popping conditional jump.
+ *
+ * `a < b` followed by a test of its result, possibly through a NOT, becomes
+ * one compare-and-branch. The comparison and NOT are deleted; this is only
+ * valid when no other jump can reach the test with a different value.
+ */
+static void fuse_branch(jump_map_t *map, int i)
+{
+	bool jump_when = map->opcodes[i] == OP_JUMP_IF_TRUE;
+	if (map->targeted[i] > 0 || i == 0)
+		return;
+
+	int compare = i - 1;
+	if (map->opcodes[compare] == OP_NOT && map->lengths[compare] > 0)
+	{
+		if (map->targeted[compare] > 0 || compare == 0)
+			return;
+		jump_when = !jump_when;
+		compare--;
+	}
+	uint8_t fused = map->lengths[compare] > 0 ? fused_branch(map->opcodes[compare]) : 0;
+	if (fused == 0)
+		return;
+
+	for (int j = compare; j < i; j++)
+		map->lengths[j] = 0;
+	map->opcodes[i] = jump_when ? fused : (uint8_t)(fused + 2);
+}
+
+/**
+ * relax_jumps - Picks the shortest encoding of every jump that reaches.
+ * @map: The decoded chunk.
+ *
+ * Starting from all-short, any jump whose distance does not fit a byte is
+ * widened until nothing changes; widening only ever lengthens code, so
+ * this terminates.
+ */
+static void relax_jumps(jump_map_t *map)
+{
+	for (int i = 0; i < map->count; i++)
+		if (map->targets[i] != -1 && map->lengths[i] > 0)
+			map->lengths[i] = 2;
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		map->new_starts[0] = 0;
+		for (int i = 0; i < map->count; i++)
+			map->new_starts[i + 1] = map->new_starts[i] + map->lengths[i];
+		for (int i = 0; i < map->count; i++)
+		{
+			if (map->targets[i] == -1 || map->lengths[i] != 2)
+				continue;
+			int distance = abs(map->new_starts[map->targets[i]] - map->new_starts[i + 1]);
+			if (distance > UINT8_MAX)
+			{
+				map->lengths[i] = 3;
+				changed = true;
+			}
+		}
+	}
+}
+
+/**
+ * encode_jumps - Rewrites a chunk from its decoded form.
+ * @chunk: The chunk the map was decoded from.
+ * @map: The decoded chunk, relaxed.
+ *
+ * The line table is rebuilt alongside the code.
+ */
+static void encode_jumps(chunk_t *chunk, const jump_map_t *map)
+{
+	chunk_t rewritten;
+	init_chunk(&rewritten);
+	size_t run = 0;
+	int run_left = chunk->lines_count > 0 ? chunk->lines[1] : 0;
+	for (int i = 0; i < map->count; i++)
+	{
+		int line = chunk->lines[run];
+		int length = map->starts[i + 1] - map->starts[i];
+		uint8_t *code = chunk->code + map->starts[i];
+
+		if (map->lengths[i] == 0)
+			;
+		else if (map->targets[i] == -1)
+		{
+			write_chunk(&rewritten, map->opcodes[i], line);
+			for (int j = 1; j < length; j++)
+				write_chunk(&rewritten, code[j], line);
+		}
+		else
+		{
+			int distance = abs(map->new_starts[map->targets[i]] - map->new_starts[i + 1]);
+			if (map->lengths[i] == 3)
+			{
+				write_chunk(&rewritten, map->opcodes[i], line);
+				write_chunk(&rewritten, (uint8_t)(distance >> 8), line);
+				write_chunk(&rewritten, (uint8_t)distance, line);
+			}
+			else
+			{
+				write_chunk(&rewritten, (uint8_t)(map->opcodes[i] + 1), line);
+				write_chunk(&rewritten, (uint8_t)distance, line);
+			}
+		}
+
+		// Advance through the old line table past this instruction.
+		for (run_left -= length; run_left <= 0 && run + 2 < chunk->lines_count; )
+		{
+			run += 2;
+			run_left += chunk->lines[run + 1];
+		}
+	}
+
+	free_array(chunk->code);
+	free_array(chunk->lines);
+	chunk->code = rewritten.code;
+	chunk->count = rewritten.count;
+	chunk->capacity = rewritten.capacity;
+	chunk->lines = rewritten.lines;
+	chunk->lines_count = rewritten.lines_count;
+	chunk->lines_capacity = rewritten.lines_capacity;
+}
+
+/**
+ * optimize_jumps - Threads, fuses and re-encodes the jumps of a chunk.
+ * @chunk: A complete chunk, whose jumps may be in either form.
+ *
+ * The compiler emits every jump wide and every condition as a plain test,
+ * because targets are not known yet and `and`/`or` leave jumps landing in
+ * the middle of a condition. Once the whole chunk exists, jumps are
+ * threaded through the jumps they land on, comparisons feeding a test that
+ * nothing else reaches are fused into it, and every jump is given the
+ * shortest encoding that reaches. Calls in tail position become tail
+ * calls on the way.
+ */
+void optimize_jumps(chunk_t *chunk)
+{
+	jump_map_t map;
+	decode_jumps(chunk, &map);
+
+	for (int i = 0; i < map.count; i++)
+		if (map.targets[i] != -1)
+			thread_jump(&map, i);
+	for (int i = 0; i < map.count; i++)
+		if (map.opcodes[i] == OP_CALL)
+			mark_tail_call(&map, i);
+
+	for (int i = 0; i < map.count; i++)
+		map.targeted[i] = 0;
+	for (int i = 0; i < map.count; i++)
+		if (map.targets[i] != -1)
+			map.targeted[map.targets[i]]++;
+	for (int i = 0; i < map.count; i++)
+		if (map.opcodes[i] == OP_JUMP_IF_FALSE || map.opcodes[i] == OP_JUMP_IF_TRUE)
+			fuse_branch(&map, i);
+
+	relax_jumps(&map);
+	encode_jumps(chunk, &map);
+
+	free(map.starts);
+	free(map.opcodes);
+	free(map.targets);
+	free(map.targeted);
+	free(map.lengths);
+	free(map.new_starts);
+}
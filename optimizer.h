@@ -0,0 +1,9 @@
+#pragma once
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "chunk.h"
+
+void optimize_jumps(chunk_t *chunk);
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,224 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "parallel.h"
+#include "vm.h"
+
+/**
+ * struct pool_s - The worker threads and the job they are running.
+ * @threads: The workers started so far.
+ * @count: Number of entries in @threads.
+ * @wanted: Workers to start, or 0 for one per core.
+ * @job: Held by the thread whose job the pool is running, from posting it
+ *       until it is done, since the pool is shared by every thread.
+ * @lock: Guards everything below.
+ * @wake: Signalled when a job is posted or the pool stops.
+ * @done: Signalled when the last worker finishes a job.
+ * @generation: Number of jobs posted; a worker runs each exactly once.
+ * @busy: Workers still running the current job.
+ * @stopping: Whether the workers should exit.
+ * @task: The current job's task.
+ * @context: The current job's context.
+ * @blocks: Number of blocks in the current job.
+ * @next: The next block to claim.
+ *
+ * Description: Workers claim blocks from a shared counter rather than
+ * being handed fixed ranges, so an idle worker takes over the blocks a
+ * slow one has not reached.
+ */
+typedef struct pool_s
+{
+	pthread_t threads[WORKERS_MAX];
+	int count;
+	int wanted;
+	pthread_mutex_t job;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	unsigned generation;
+	int busy;
+	bool stopping;
+	parallel_task_t task;
+	void *context;
+	int blocks;
+	atomic_int next;
+} pool_t;
+
+static pool_t pool = {
+	.job = PTHREAD_MUTEX_INITIALIZER,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * set_parallel_threads - Sets the number of threads parallel builtins use.
+ * @threads: The number, or 0 for one per core; 1 keeps everything on the
+ *           calling thread.
+ */
+void set_parallel_threads(int threads)
+{
+	free_parallel();
+	pool.wanted = threads < 0 ? 0 : threads > WORKERS_MAX ? WORKERS_MAX : threads;
+}
+
+// Returns the number of threads parallel builtins use.
+int parallel_threads(void)
+{
+	if (pool.wanted > 0)
+		return (pool.wanted);
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cores < 1 ? 1 : cores > WORKERS_MAX ? WORKERS_MAX : (int)cores);
+}
+
+/**
+ * work - The body of a worker thread.
+ * @generation: The number of jobs posted before it was started.
+ *
+ * Signals are left to the main thread, whose context they inspect.
+ *
+ * Return: NULL.
+ */
+static void *work(void *generation)
+{
+	sigset_t signals;
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	init_worker();
+
+	unsigned seen = (unsigned)(uintptr_t)generation;
+	pthread_mutex_lock(&pool.lock);
+	while (true)
+	{
+		while (pool.generation == seen && !pool.stopping)
+			pthread_cond_wait(&pool.wake, &pool.lock);
+		if (pool.stopping)
+			break;
+		seen = pool.generation;
+		pthread_mutex_unlock(&pool.lock);
+
+		int block;
+		while ((block = atomic_fetch_add(&pool.next, 1)) < pool.blocks)
+			pool.task(pool.context, block);
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.busy == 0)
+			pthread_cond_signal(&pool.done);
+	}
+	pthread_mutex_unlock(&pool.lock);
+	free_worker();
+	return (NULL);
+}
+
+/**
+ * run_parallel - Runs a task on every block of a job on the pool's threads.
+ * @blocks: Number of blocks.
+ * @task: The task.
+ * @context: Passed to @task.
+ *
+ * Tasks always run on pool threads, never on the caller's, which waits
+ * for them to finish. The pool is started on first use. Threads with
+ * contexts of their own take turns: a job waits for the one before it.
+ */
+void run_parallel(int blocks, parallel_task_t task, void *context)
+{
+	pthread_mutex_lock(&pool.job);
+	pthread_mutex_lock(&pool.lock);
+	int threads = parallel_threads();
+	while (pool.count < threads)
+	{
+		if (pthread_create(&pool.threads[pool.count], NULL, work, (void *)(uintptr_t)pool.generation) != 0)
+			break;
+		pool.count++;
+	}
+	if (pool.count == 0)
+	{
+		pthread_mutex_unlock(&pool.lock);
+		pthread_mutex_unlock(&pool.job);
+		fprintf(stderr, "Error: Failed to start worker threads\n");
+		exit(INTERPRET_RUNTIME_ERROR);
+	}
+
+	pool.task = task;
+	pool.context = context;
+	pool.blocks = blocks;
+	atomic_store(&pool.next, 0);
+	pool.busy = pool.count;
+	pool.generation++;
+	pthread_cond_broadcast(&pool.wake);
+	while (pool.busy > 0)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+	pthread_mutex_unlock(&pool.job);
+}
+
+/**
+ * free_parallel - Stops the pool's threads; the next job starts new ones.
+ */
+void free_parallel(void)
+{
+	pthread_mutex_lock(&pool.job);
+	pthread_mutex_lock(&pool.lock);
+	pool.stopping = true;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+	for (int i = 0; i < pool.count; i++)
+		pthread_join(pool.threads[i], NULL);
+	pool.count = 0;
+	pool.stopping = false;
+	pthread_mutex_unlock(&pool.job);
+}
+
+/**
+ * parallel_safe - Checks whether code can run on a worker.
+ * @chunk: The code, compiled.
+ *
+ * Workers read the objects and globals of the thread that started them,
+ * so the code may read anything but must not store into objects or
+ * globals, learn inline caches, call functions, which might do any of
+ * that or need compiling, or start parallel work of its own. Instructions
+ * that may allocate are allowed: a worker gives up if one does.
+ *
+ * Return: Whether every instruction is one that only reads shared state.
+ */
+bool parallel_safe(const chunk_t *chunk)
+{
+	for (int offset = 0; offset < chunk->count; offset += instruction_length(chunk->code[offset]))
+	{
+		uint8_t opcode = chunk->code[offset];
+		if (is_jump(opcode) || (opcode >= OP_SQRT && opcode <= OP_ATAN2))
+			continue;
+		switch (opcode)
+		{
+		case OP_CONSTANT:
+		case OP_INPUT:
+		case OP_POP:
+		case OP_POPN:
+		case OP_GET_LOCAL:
+		case OP_SET_LOCAL:
+		case OP_GET_GLOBAL:
+		case OP_NEGATE:
+		case OP_ADD:
+		case OP_SUBTRACT:
+		case OP_MULTIPLY:
+		case OP_DIVIDE:
+		case OP_TRUE:
+		case OP_FALSE:
+		case OP_NULL:
+		case OP_NOT:
+		case OP_EQUAL:
+		case OP_GREATER:
+		case OP_LESS:
+		case OP_RETURN:
+		case OP_GET_INDEX:
+		case OP_LEN:
+		case OP_MAP_HAS:
+			continue;
+		default:
+			return (false);
+		}
+	}
+	return (true);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "common.h"
+#include "chunk.h"
+
+#define PARALLEL_BLOCK 4096                // Elements per block of a parallel builtin.
+#define PARALLEL_MIN (2 * PARALLEL_BLOCK) // Shortest array handed to the pool.
+#define WORKERS_MAX 64                    // Most threads in the pool.
+
+/**
+ * typedef parallel_task_t - Work on one block of a job.
+ * @context: The job's context.
+ * @block: Index of the block, from 0.
+ *
+ * Description: Blocks are claimed by whichever worker is idle next, so a
+ * task must not depend on which thread runs it or in what order blocks
+ * run. Results that combine blocks are combined by the caller, in block
+ * order, once the job is done.
+ */
+typedef void (*parallel_task_t)(void *context, int block);
+
+void set_parallel_threads(int threads);
+int parallel_threads(void);
+void run_parallel(int blocks, parallel_task_t task, void *context);
+void free_parallel(void);
+bool parallel_safe(const chunk_t *chunk);
+
+#endif // PARALLEL_H
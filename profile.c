@@ -0,0 +1,663 @@
+#include <signal.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "profile.h"
+#include "debug.h"
+#include "memory.h"
+#include "vm.h"
+
+#define PROFILE_TOP_PAIRS 16
+
+// State read by the SIGPROF handler while a sampled chunk runs: where the
+// samples and their stacks go, and the context running the chunk.
+static sample_slot_t *volatile sample_slots;
+static sample_stack_t *volatile sample_stacks;
+static volatile uint64_t *volatile sample_lost;
+static struct vm_s *volatile sample_vm;
+
+/**
+ * new_profile - Allocates an empty profile.
+ * @mode: How the profile should gather its data.
+ *
+ * Return: The new profile.
+ */
+profile_t *new_profile(profile_mode_t mode)
+{
+	profile_t *profile = calloc(1, sizeof(profile_t));
+	if (profile == NULL)
+		exit(1);
+	profile->mode = mode;
+	profile->node = -1;
+	profile->pairs = calloc(PROFILE_OPCODES * PROFILE_OPCODES, sizeof(uint64_t));
+	if (profile->pairs == NULL)
+		exit(1);
+	if (mode == PROFILE_SAMPLE)
+	{
+		profile->samples = calloc(PROFILE_SAMPLE_SLOTS, sizeof(sample_slot_t));
+		profile->stacks = calloc(PROFILE_SAMPLE_STACKS, sizeof(sample_stack_t));
+		if (profile->samples == NULL || profile->stacks == NULL)
+			exit(1);
+	}
+	return (profile);
+}
+
+/**
+ * free_profile - Releases a profile and everything it owns.
+ * @profile: The profile to free.
+ */
+void free_profile(profile_t *profile)
+{
+	if (profile == NULL)
+		return;
+	free(profile->pairs);
+	free(profile->lines);
+	for (int i = 0; i < profile->node_count; i++)
+		free(profile->nodes[i].hits);
+	free(profile->nodes);
+	free(profile->index);
+	free(profile->samples);
+	free(profile->stacks);
+	for (int i = 0; i < profile->stack_line_count; i++)
+		free(profile->stack_lines[i].stack);
+	free(profile->stack_lines);
+	free(profile->stack_index);
+	free(profile);
+}
+
+// Number of frames of a call stack a profile keeps.
+static inline int kept_depth(int count) { return (count < PROFILE_STACK_DEPTH ? count : PROFILE_STACK_DEPTH); }
+
+// The frame a profile keeps at a position of a stack: the outermost ones, then the innermost.
+static inline const call_frame_t *kept_frame(const call_frame_t *frames, int count, int i)
+{
+	return (&frames[i == kept_depth(count) - 1 ? count - 1 : i]);
+}
+
+/**
+ * find_sample_stack - Finds or adds the entry of a call stack being sampled.
+ * @frames: The frames of the stack.
+ * @count: Number of frames.
+ *
+ * Runs in the SIGPROF handler, so it only probes the preallocated table.
+ *
+ * Return: The entry's index, or -1 if the table is full.
+ */
+static int find_sample_stack(const call_frame_t *frames, int count)
+{
+	int depth = kept_depth(count);
+	size_t hash = (size_t)depth;
+
+	for (int i = 0; i < depth; i++)
+		hash = (hash ^ (uintptr_t)kept_frame(frames, count, i)->function) * 1099511628211u;
+	for (size_t probe = 0; probe < PROFILE_SAMPLE_STACKS; probe++)
+	{
+		int index = (int)((hash + probe) & (PROFILE_SAMPLE_STACKS - 1));
+		sample_stack_t *stack = &sample_stacks[index];
+		if (stack->depth == 0)
+		{
+			for (int i = 0; i < depth; i++)
+				stack->functions[i] = kept_frame(frames, count, i)->function;
+			stack->hash = hash;
+			stack->depth = depth;
+			return (index);
+		}
+		if (stack->hash != hash || stack->depth != depth)
+			continue;
+		int i = 0;
+		while (i < depth && stack->functions[i] == kept_frame(frames, count, i)->function)
+			i++;
+		if (i == depth)
+			return (index);
+	}
+	return (-1);
+}
+
+/**
+ * on_sigprof - Attributes one timer tick to the instruction being executed.
+ * @signum: The signal number (unused).
+ *
+ * The tick goes to the chunk the VM is running under its current call
+ * stack. vm.ip has already moved past the opcode being executed, so the
+ * sample is charged to the byte before it; profile_end() folds operand
+ * bytes back into their instruction. A tick that lands while a call or
+ * return has switched only some of the frames, the chunk and the
+ * instruction pointer is dropped: call_function() fills a frame in before
+ * counting it, so the innermost frame then runs some other chunk, or the
+ * instruction pointer falls outside the chunk.
+ */
+static void on_sigprof(int signum)
+{
+	(void)signum;
+	const struct vm_s *running = sample_vm;
+	if (running == NULL)
+		return;
+	const chunk_t *chunk = running->chunk;
+	uint8_t *ip = running->ip;
+	const call_frame_t *frames = running->frames;
+	int count = running->frame_count;
+
+	if (chunk == NULL || ip == NULL || count < 1 || frames[count - 1].chunk != chunk || ip <= chunk->code ||
+	    ip > chunk->code + chunk->count)
+		return;
+	int stack = find_sample_stack(frames, count);
+	if (stack < 0)
+	{
+		(*sample_lost)++;
+		return;
+	}
+	size_t offset = (size_t)(ip - chunk->code) - 1;
+	size_t hash = ((uintptr_t)chunk >> 4) ^ (offset * 2654435761u) ^ ((size_t)stack * 40503u);
+	for (size_t probe = 0; probe < PROFILE_SAMPLE_SLOTS; probe++)
+	{
+		sample_slot_t *slot = &sample_slots[(hash + probe) & (PROFILE_SAMPLE_SLOTS - 1)];
+		if (slot->chunk == NULL)
+		{
+			slot->chunk = chunk;
+			slot->offset = offset;
+			slot->stack = stack;
+		}
+		if (slot->chunk == chunk && slot->offset == offset && slot->stack == stack)
+		{
+			slot->hits++;
+			return;
+		}
+	}
+	(*sample_lost)++;
+}
+
+/**
+ * set_sample_timer - Arms or disarms the profiling interval timer.
+ * @hz: Samples per second, or 0 to disarm.
+ */
+static void set_sample_timer(int hz)
+{
+	struct itimerval timer;
+
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = hz > 0 ? 1000000 / hz : 0;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+/**
+ * profile_begin - Prepares a profile for a run of a chunk.
+ * @profile: The profile to record into.
+ * @vm: The context about to run the chunk, with its first frame pushed;
+ *      read by the sampler.
+ */
+void profile_begin(profile_t *profile, struct vm_s *vm)
+{
+	profile->script = vm->chunk;
+	profile->node = -1;
+	profile->depth = 0;
+	profile->chunk = NULL;
+	profile->hits = NULL;
+	if (profile->mode == PROFILE_SAMPLE)
+	{
+		struct sigaction action;
+
+		sample_slots = profile->samples;
+		sample_stacks = profile->stacks;
+		sample_lost = &profile->lost;
+		sample_vm = vm;
+
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = on_sigprof;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGPROF, &action, NULL);
+		set_sample_timer(PROFILE_SAMPLE_HZ);
+	}
+}
+
+/**
+ * add_line_hits - Charges hits to a source line, growing the line table.
+ * @profile: The profile to update.
+ * @line: The source line.
+ * @hits: Number of hits to add.
+ */
+static void add_line_hits(profile_t *profile, int line, uint64_t hits)
+{
+	if (line < 0 || hits == 0)
+		return;
+	if ((size_t)line >= profile->lines_capacity)
+	{
+		size_t old_capacity = profile->lines_capacity;
+		size_t new_capacity = grow_capacity(old_capacity);
+		while (new_capacity <= (size_t)line)
+			new_capacity = grow_capacity(new_capacity);
+		profile->lines = grow_array(profile->lines, old_capacity, new_capacity, sizeof(uint64_t));
+		memset(profile->lines + old_capacity, 0, (new_capacity - old_capacity) * sizeof(uint64_t));
+		profile->lines_capacity = new_capacity;
+	}
+	profile->lines[line] += hits;
+}
+
+// Finds where the entry of a stack line is in a profile's stack lines, or would go.
+static int *find_stack_line(profile_t *profile, const char *stack, size_t hash, int line)
+{
+	size_t mask = (size_t)profile->stack_line_capacity * 2 - 1;
+	for (size_t i = (hash ^ (size_t)line * 2654435761u) & mask;; i = (i + 1) & mask)
+	{
+		int *entry = &profile->stack_index[i];
+		if (*entry == 0)
+			return (entry);
+		const stack_line_t *candidate = &profile->stack_lines[*entry - 1];
+		if (candidate->line == line && strcmp(candidate->stack, stack) == 0)
+			return (entry);
+	}
+}
+
+/**
+ * add_stack_line_hits - Charges hits to a source line under a call stack.
+ * @profile: The profile to update.
+ * @stack: The stack's frame names joined by ';'.
+ * @hash: Hash of @stack.
+ * @line: The source line.
+ * @hits: Number of hits to add.
+ */
+static void add_stack_line_hits(profile_t *profile, const char *stack, size_t hash, int line, uint64_t hits)
+{
+	if (line < 0 || hits == 0)
+		return;
+	if (profile->stack_line_count == profile->stack_line_capacity)
+	{
+		int old_capacity = profile->stack_line_capacity;
+		profile->stack_line_capacity = (int)grow_capacity(old_capacity);
+		profile->stack_lines = grow_array(profile->stack_lines, old_capacity, profile->stack_line_capacity,
+						  sizeof(stack_line_t));
+		free(profile->stack_index);
+		profile->stack_index = calloc(profile->stack_line_capacity * 2, sizeof(int));
+		if (profile->stack_index == NULL)
+			exit(1);
+		for (int i = 0; i < profile->stack_line_count; i++)
+		{
+			const stack_line_t *entry = &profile->stack_lines[i];
+			*find_stack_line(profile, entry->stack, hash_string(entry->stack, (int)strlen(entry->stack)),
+					 entry->line) = i + 1;
+		}
+	}
+
+	int *entry = find_stack_line(profile, stack, hash, line);
+	if (*entry == 0)
+	{
+		char *copy = strdup(stack);
+		if (copy == NULL)
+			exit(1);
+		profile->stack_lines[profile->stack_line_count++] = (stack_line_t){copy, line, 0};
+		*entry = profile->stack_line_count;
+	}
+	profile->stack_lines[*entry - 1].hits += hits;
+}
+
+// Finds where the node of a function called from a stack is in a profile's nodes, or would go.
+static int *find_node_entry(profile_t *profile, int parent, const obj_function_t *function)
+{
+	size_t mask = (size_t)profile->node_capacity * 2 - 1;
+	size_t hash = ((uintptr_t)function >> 4) * 2654435761u ^ (size_t)(parent + 1) * 40503u;
+	for (size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		int *entry = &profile->index[i];
+		if (*entry == 0 || (profile->nodes[*entry - 1].parent == parent &&
+				    profile->nodes[*entry - 1].function == function))
+			return (entry);
+	}
+}
+
+/**
+ * find_node - Finds or adds the node of a function called from a stack.
+ * @profile: The profile.
+ * @parent: The node of the calling stack, or -1 for the script's own.
+ * @function: The function called, or NULL for the script.
+ * @chunk: The code it runs.
+ *
+ * A new node gets one counter per offset of @chunk, folded into lines by
+ * profile_end().
+ *
+ * Return: The node's index.
+ */
+static int find_node(profile_t *profile, int parent, const obj_function_t *function, const chunk_t *chunk)
+{
+	if (profile->node_count == profile->node_capacity)
+	{
+		int old_capacity = profile->node_capacity;
+		profile->node_capacity = (int)grow_capacity(old_capacity);
+		profile->nodes = grow_array(profile->nodes, old_capacity, profile->node_capacity,
+					    sizeof(profile_node_t));
+		free(profile->index);
+		profile->index = calloc(profile->node_capacity * 2, sizeof(int));
+		if (profile->index == NULL)
+			exit(1);
+		for (int i = 0; i < profile->node_count; i++)
+			*find_node_entry(profile, profile->nodes[i].parent, profile->nodes[i].function) = i + 1;
+	}
+
+	int *entry = find_node_entry(profile, parent, function);
+	if (*entry == 0)
+	{
+		uint64_t *hits = calloc(chunk->count > 0 ? (size_t)chunk->count : 1, sizeof(uint64_t));
+		if (hits == NULL)
+			exit(1);
+		profile->nodes[profile->node_count++] = (profile_node_t){parent, function, chunk, hits};
+		*entry = profile->node_count;
+	}
+	return (*entry - 1);
+}
+
+/**
+ * profile_enter - Switches counting to the stack a call or return went to.
+ * @profile: The profile to record into.
+ * @frames: The VM's frames.
+ * @count: Number of frames.
+ *
+ * A call, a return or a tail call only moves one frame, so the new stack
+ * is found from the one counted before it; anything else looks the whole
+ * stack up again.
+ */
+void profile_enter(profile_t *profile, const call_frame_t *frames, int count)
+{
+	int kept = kept_depth(count);
+	int entered = kept_depth(profile->depth);
+	const call_frame_t *top = &frames[count - 1];
+	int node = profile->node;
+	int parent = node < 0 ? -1 : profile->nodes[node].parent;
+
+	if (node >= 0 && kept == entered + 1)
+		node = find_node(profile, node, top->function, top->chunk);
+	else if (parent >= 0 && kept == entered - 1)
+		node = parent;
+	else if (parent >= 0 && kept == entered)
+		node = find_node(profile, parent, top->function, top->chunk);
+	else
+	{
+		node = find_node(profile, -1, NULL, frames[0].chunk);
+		for (int i = 1; i < kept; i++)
+		{
+			const call_frame_t *frame = kept_frame(frames, count, i);
+			node = find_node(profile, node, frame->function, frame->chunk);
+		}
+	}
+	profile->node = node;
+	profile->depth = count;
+	profile->chunk = profile->nodes[node].chunk;
+	profile->hits = profile->nodes[node].hits;
+}
+
+/**
+ * fold_node - Charges the hits on a stack's code offsets to its lines.
+ * @profile: The profile to update.
+ * @node: The stack.
+ * @stack: Its frame names joined by ';'.
+ *
+ * Walks the stack's chunk one instruction at a time, charging each
+ * instruction's hits (including samples that landed on its operand bytes)
+ * to its source line, overall and under @stack, and, for sampled profiles,
+ * to its opcode. The line table is decoded in the same pass, so this is
+ * linear in the size of the chunk.
+ */
+static void fold_node(profile_t *profile, const profile_node_t *node, const char *stack)
+{
+	const chunk_t *chunk = node->chunk;
+	size_t hash = hash_string(stack, (int)strlen(stack));
+	// Walk the run-length encoded line table alongside the code.
+	size_t run = 0;
+	size_t run_end = chunk->lines_count > 0 ? (size_t)chunk->lines[1] : 0;
+
+	for (int offset = 0; offset < chunk->count;)
+	{
+		uint8_t opcode = chunk->code[offset];
+		int next = offset + instruction_length(opcode);
+		uint64_t total = 0;
+
+		for (int at = offset; at < next && at < chunk->count; at++)
+			total += node->hits[at];
+		if (total > 0)
+		{
+			while (run + 2 < chunk->lines_count && (size_t)offset >= run_end)
+			{
+				run += 2;
+				run_end += (size_t)chunk->lines[run + 1];
+			}
+			int line = chunk->lines_count > 0 ? chunk->lines[run] : -1;
+			if (profile->mode == PROFILE_SAMPLE)
+				profile->opcodes[opcode] += total;
+			profile->total += total;
+			add_line_hits(profile, line, total);
+			add_stack_line_hits(profile, stack, hash, line, total);
+		}
+		offset = next;
+	}
+}
+
+/**
+ * fold_nodes - Charges the hits of every stack of a finished run to lines.
+ * @profile: The profile to update.
+ *
+ * Every chunk that ran is still alive: functions are only ever constants
+ * of the chunks that declare them, and the run's own chunk outlives it.
+ * A node always comes after its parent, so the parent's name is ready
+ * when the node's is built from it.
+ */
+static void fold_nodes(profile_t *profile)
+{
+	char **stacks = malloc((profile->node_count > 0 ? (size_t)profile->node_count : 1) * sizeof(char *));
+	if (stacks == NULL)
+		exit(1);
+	for (int i = 0; i < profile->node_count; i++)
+	{
+		const profile_node_t *node = &profile->nodes[i];
+		const char *name = "script";
+		size_t length = strlen(name);
+		if (node->function != NULL)
+		{
+			name = string_chars(&node->function->name);
+			length = (size_t)string_length(&node->function->name);
+		}
+		size_t prefix = node->parent < 0 ? 0 : strlen(stacks[node->parent]) + 1;
+		stacks[i] = malloc(prefix + length + 1);
+		if (stacks[i] == NULL)
+			exit(1);
+		if (prefix > 0)
+		{
+			memcpy(stacks[i], stacks[node->parent], prefix - 1);
+			stacks[i][prefix - 1] = ';';
+		}
+		memcpy(stacks[i] + prefix, name, length);
+		stacks[i][prefix + length] = '\0';
+		fold_node(profile, node, stacks[i]);
+	}
+	for (int i = 0; i < profile->node_count; i++)
+	{
+		free(stacks[i]);
+		free(profile->nodes[i].hits);
+	}
+	free(stacks);
+	profile->node_count = 0;
+	if (profile->index != NULL)
+		memset(profile->index, 0, profile->node_capacity * 2 * sizeof(int));
+}
+
+/**
+ * fold_samples - Adds the samples of a finished run to its stacks' hits.
+ * @profile: The profile, whose timer is disarmed.
+ *
+ * A sample whose chunk is not the one its stack's innermost function runs
+ * is dropped as lost.
+ */
+static void fold_samples(profile_t *profile)
+{
+	int nodes[PROFILE_SAMPLE_STACKS];
+
+	for (int i = 0; i < PROFILE_SAMPLE_STACKS; i++)
+	{
+		const sample_stack_t *stack = &profile->stacks[i];
+		nodes[i] = -1;
+		if (stack->depth == 0)
+			continue;
+		int node = find_node(profile, -1, NULL, profile->script);
+		for (int frame = 1; frame < stack->depth && node >= 0; frame++)
+		{
+			const obj_function_t *function = stack->functions[frame];
+			node = function == NULL ? -1 : find_node(profile, node, function, function->chunk);
+		}
+		nodes[i] = node;
+	}
+
+	for (int i = 0; i < PROFILE_SAMPLE_SLOTS; i++)
+	{
+		const sample_slot_t *slot = &profile->samples[i];
+		if (slot->chunk == NULL)
+			continue;
+		int node = nodes[slot->stack];
+		if (node >= 0 && profile->nodes[node].chunk == slot->chunk && slot->offset < (size_t)slot->chunk->count)
+			profile->nodes[node].hits[slot->offset] += slot->hits;
+		else
+			profile->lost += slot->hits;
+	}
+	memset(profile->samples, 0, PROFILE_SAMPLE_SLOTS * sizeof(sample_slot_t));
+	memset(profile->stacks, 0, PROFILE_SAMPLE_STACKS * sizeof(sample_stack_t));
+}
+
+/**
+ * profile_end - Folds the hits of a finished run into the profile.
+ * @profile: The profile to update.
+ */
+void profile_end(profile_t *profile)
+{
+	if (profile->mode == PROFILE_SAMPLE)
+	{
+		set_sample_timer(0);
+		sample_vm = NULL;
+		fold_samples(profile);
+	}
+	fold_nodes(profile);
+	profile->node = -1;
+	profile->depth = 0;
+	profile->chunk = NULL;
+	profile->hits = NULL;
+}
+
+/**
+ * percent - Expresses a count as a percentage of the profile total.
+ * @profile: The profile.
+ * @hits: The count.
+ *
+ * Return: The percentage.
+ */
+static double percent(profile_t *profile, uint64_t hits)
+{
+	return profile->total > 0 ? 100.0 * (double)hits / (double)profile->total : 0.0;
+}
+
+/**
+ * profile_report - Prints a human-readable profile.
+ * @profile: The profile to print.
+ * @out: The stream to print to.
+ *
+ * Opcodes are listed by decreasing hits, followed by the hottest opcode
+ * pairs (counting mode only) and every source line that was hit.
+ */
+void profile_report(profile_t *profile, FILE *out)
+{
+	const char *unit = profile->mode == PROFILE_SAMPLE ? "samples" : "instructions";
+
+	if (profile->lost > 0)
+		fprintf(out, "== profile (%llu %s, %llu lost) ==\n", (unsigned long long)profile->total, unit,
+			(unsigned long long)profile->lost);
+	else
+		fprintf(out, "== profile (%llu %s) ==\n", (unsigned long long)profile->total, unit);
+
+	fprintf(out, "-- opcodes --\n");
+	bool listed[PROFILE_OPCODES] = {false};
+	while (true)
+	{
+		int best = -1;
+		for (int op = 0; op < PROFILE_OPCODES; op++)
+			if (!listed[op] && profile->opcodes[op] > 0 &&
+			    (best < 0 || profile->opcodes[op] > profile->opcodes[best]))
+				best = op;
+		if (best < 0)
+			break;
+		listed[best] = true;
+		fprintf(out, "%12llu %6.2f%%  %s\n", (unsigned long long)profile->opcodes[best],
+			percent(profile, profile->opcodes[best]), opcode_name((uint8_t)best));
+	}
+
+	if (profile->mode == PROFILE_COUNT)
+	{
+		int top[PROFILE_TOP_PAIRS];
+		int found = 0;
+
+		fprintf(out, "-- opcode pairs --\n");
+		for (int pair = 0; pair < PROFILE_OPCODES * PROFILE_OPCODES; pair++)
+		{
+			int slot;
+
+			if (profile->pairs[pair] == 0)
+				continue;
+			if (found < PROFILE_TOP_PAIRS)
+				slot = found++;
+			else if (profile->pairs[top[PROFILE_TOP_PAIRS - 1]] >= profile->pairs[pair])
+				continue;
+			else
+				slot = PROFILE_TOP_PAIRS - 1;
+			while (slot > 0 && profile->pairs[top[slot - 1]] < profile->pairs[pair])
+			{
+				top[slot] = top[slot - 1];
+				slot--;
+			}
+			top[slot] = pair;
+		}
+		for (int i = 0; i < found; i++)
+		{
+			int previous = top[i] / PROFILE_OPCODES;
+			int current = top[i] % PROFILE_OPCODES;
+			fprintf(out, "%12llu %6.2f%%  %s -> %s\n", (unsigned long long)profile->pairs[top[i]],
+				percent(profile, profile->pairs[top[i]]),
+				previous == PROFILE_NO_OPCODE ? "(start)" : opcode_name((uint8_t)previous),
+				opcode_name((uint8_t)current));
+		}
+	}
+
+	fprintf(out, "-- lines --\n");
+	for (size_t line = 0; line < profile->lines_capacity; line++)
+	{
+		if (profile->lines[line] > 0)
+			fprintf(out, "%12llu %6.2f%%  line %zu\n", (unsigned long long)profile->lines[line],
+				percent(profile, profile->lines[line]), line);
+	}
+}
+
+// Orders pointers to stack lines by stack, then by line.
+static int compare_stack_lines(const void *a, const void *b)
+{
+	const stack_line_t *left = *(const stack_line_t *const *)a, *right = *(const stack_line_t *const *)b;
+	int order = strcmp(left->stack, right->stack);
+	if (order != 0)
+		return (order);
+	return (left->line < right->line ? -1 : left->line > right->line);
+}
+
+/**
+ * profile_write_folded - Writes the profile in folded-stack format.
+ * @profile: The profile to write.
+ * @out: The stream to write to.
+ *
+ * Each line reads "script;fn1;fn2;line N <hits>", naming the functions on
+ * the call stack from the outermost in, the input format of flamegraph
+ * tools such as flamegraph.pl and speedscope.
+ */
+void profile_write_folded(profile_t *profile, FILE *out)
+{
+	int count = profile->stack_line_count;
+	const stack_line_t **sorted = malloc((count > 0 ? (size_t)count : 1) * sizeof(stack_line_t *));
+	if (sorted == NULL)
+		exit(1);
+	for (int i = 0; i < count; i++)
+		sorted[i] = &profile->stack_lines[i];
+	qsort(sorted, count, sizeof(stack_line_t *), compare_stack_lines);
+	for (int i = 0; i < count; i++)
+		fprintf(out, "%s;line %d %llu\n", sorted[i]->stack, sorted[i]->line,
+			(unsigned long long)sorted[i]->hits);
+	free(sorted);
+}
@@ -0,0 +1,172 @@
+#pragma once
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "common.h"
+#include "chunk.h"
+
+#define PROFILE_OPCODES 256
+#define PROFILE_NO_OPCODE 0xff // "previous opcode" at the start of a run
+#define PROFILE_SAMPLE_HZ 1000
+#define PROFILE_SAMPLE_SLOTS 4096 // Distinct instructions a sampled run can hit; a power of two.
+#define PROFILE_SAMPLE_STACKS 512 // Distinct call stacks a sampled run can hit; a power of two.
+#define PROFILE_STACK_DEPTH 64    // Frames kept of a stack: the outermost ones and the innermost.
+
+struct call_frame_s;
+struct obj_function_s;
+struct vm_s;
+
+/**
+ * struct sample_stack_s - A call stack samples were taken in.
+ * @depth: Number of entries in @functions, or 0 for a free entry.
+ * @hash: Hash of @functions.
+ * @functions: The function of each frame kept, outermost first, NULL for
+ *             the script.
+ */
+typedef struct sample_stack_s
+{
+	int depth;
+	size_t hash;
+	const struct obj_function_s *functions[PROFILE_STACK_DEPTH];
+} sample_stack_t;
+
+/**
+ * struct sample_slot_s - Samples taken at one code offset under one stack.
+ * @chunk: The chunk, or NULL for a free slot.
+ * @offset: The offset, the byte before the instruction pointer.
+ * @stack: The stack's entry in the profile's stacks.
+ * @hits: Samples taken there.
+ */
+typedef struct sample_slot_s
+{
+	const chunk_t *chunk;
+	size_t offset;
+	int stack;
+	uint64_t hits;
+} sample_slot_t;
+
+/**
+ * struct profile_node_s - A call stack instructions ran in during a run.
+ * @parent: The stack one frame shorter, or -1 for the script's own.
+ * @function: The function of its innermost frame, or NULL for the script.
+ * @chunk: The code that frame runs.
+ * @hits: Hits per offset of @chunk.
+ */
+typedef struct profile_node_s
+{
+	int parent;
+	const struct obj_function_s *function;
+	const chunk_t *chunk;
+	uint64_t *hits;
+} profile_node_t;
+
+/**
+ * struct stack_line_s - Hits on one source line under one call stack.
+ * @stack: The names of the stack's frames, outermost first, joined by ';'.
+ * @line: The line.
+ * @hits: Instructions counted or samples taken.
+ */
+typedef struct stack_line_s
+{
+	char *stack;
+	int line;
+	uint64_t hits;
+} stack_line_t;
+
+/**
+ * enum profile_mode_s - How a profile gathers its data.
+ * @PROFILE_COUNT: Count every executed instruction (exact, slower).
+ * @PROFILE_SAMPLE: Sample the instruction pointer from a SIGPROF timer.
+ */
+typedef enum profile_mode_s
+{
+	PROFILE_COUNT,
+	PROFILE_SAMPLE
+} profile_mode_t;
+
+/**
+ * struct profile_s - Execution counts gathered across one or more runs.
+ * @mode: How the data is gathered.
+ * @total: Instructions counted or samples taken.
+ * @opcodes: Hits per opcode.
+ * @pairs: Hits per (previous, current) opcode pair, PROFILE_OPCODES^2.
+ * @lines: Hits per source line, indexed by line number.
+ * @lines_capacity: Number of entries in @lines.
+ * @nodes: The call stacks of the run.
+ * @node_count: Number of entries in @nodes.
+ * @node_capacity: Room in @nodes.
+ * @index: Entries of @nodes by parent and function, each an index plus
+ *         one or 0 when free; twice as many as @node_capacity.
+ * @node: The stack instructions are being counted in, or -1.
+ * @depth: The number of frames it was entered with.
+ * @chunk: Its chunk.
+ * @hits: Its hits per offset.
+ * @script: The chunk of the run.
+ * @samples: Hits per chunk, offset and stack, PROFILE_SAMPLE_SLOTS, when
+ *           sampling.
+ * @stacks: The stacks of @samples, PROFILE_SAMPLE_STACKS.
+ * @lost: Samples dropped because @samples or @stacks was full; not in
+ *        @total.
+ * @stack_lines: Hits per stack and line, across runs.
+ * @stack_line_count: Number of entries in @stack_lines.
+ * @stack_line_capacity: Room in @stack_lines.
+ * @stack_index: Entries of @stack_lines by stack and line, like @index.
+ *
+ * Description: While a chunk runs only @hits or @samples (and, when
+ * counting, @opcodes and @pairs) are touched, @hits being looked up again
+ * only when a call or return changes the stack. Offsets are folded into
+ * source lines through their chunk's line table once the run ends, so the
+ * hot path never decodes line information. Stacks deeper than
+ * PROFILE_STACK_DEPTH keep their outermost frames and the innermost one.
+ */
+typedef struct profile_s
+{
+	profile_mode_t mode;
+	uint64_t total;
+	uint64_t opcodes[PROFILE_OPCODES];
+	uint64_t *pairs;
+	uint64_t *lines;
+	size_t lines_capacity;
+	profile_node_t *nodes;
+	int node_count;
+	int node_capacity;
+	int *index;
+	int node;
+	int depth;
+	const chunk_t *chunk;
+	uint64_t *hits;
+	const chunk_t *script;
+	sample_slot_t *samples;
+	sample_stack_t *stacks;
+	uint64_t lost;
+	stack_line_t *stack_lines;
+	int stack_line_count;
+	int stack_line_capacity;
+	int *stack_index;
+} profile_t;
+
+profile_t *new_profile(profile_mode_t mode);
+void free_profile(profile_t *profile);
+void profile_begin(profile_t *profile, struct vm_s *vm);
+void profile_end(profile_t *profile);
+void profile_enter(profile_t *profile, const struct call_frame_s *frames, int count);
+void profile_report(profile_t *profile, FILE *out);
+void profile_write_folded(profile_t *profile, FILE *out);
+
+/**
+ * profile_count - Records one executed instruction.
+ * @profile: The profile to record into.
+ * @previous: The opcode executed before this one.
+ * @opcode: The opcode being executed.
+ * @offset: Offset of the instruction in the chunk of the stack last
+ *          entered with profile_enter().
+ */
+static inline void profile_count(profile_t *profile, uint8_t previous, uint8_t opcode, size_t offset)
+{
+	profile->opcodes[opcode]++;
+	profile->pairs[previous * PROFILE_OPCODES + opcode]++;
+	profile->hits[offset]++;
+}
+
+#endif // PROFILE_H
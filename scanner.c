@@ -3,14 +3,17 @@
 #include "common.h"
 #include "scanner.h"
 
-scanner_t scanner;
+_Thread_local scanner_t scanner;
 
 // Initializes the scanner with the source code.
-void init_scanner(const char *source)
+void init_scanner(const char *source) { init_scanner_at(source, 1); }
+
+// Initializes the scanner with source code that starts on a given line.
+void init_scanner_at(const char *source, int line)
 {
 	scanner.start = source;
 	scanner.current = source;
-	scanner.line = 1;
+	scanner.line = line;
 }
 
 // Checks if a character is a digit.
@@ -164,13 +167,25 @@ static token_type_t identifier_type(void)
 			{
 			case 'a':
 				return check_keyword(2, 3, "lse", TOKEN_FALSE);
+			case 'n':
+				return check_keyword(2, 0, "", TOKEN_FN);
 			case 'o':
 				return check_keyword(2, 1, "r", TOKEN_FOR);
 			}
 		}
 		break;
 	case 'i':
-		return check_keyword(1, 1, "f", TOKEN_IF);
+		if (scanner.current - scanner.start > 1)
+		{
+			switch (scanner.start[1])
+			{
+			case 'f':
+				return check_keyword(2, 0, "", TOKEN_IF);
+			case 'm':
+				return check_keyword(2, 4, "port", TOKEN_IMPORT);
+			}
+		}
+		break;
 	case 'l':
 		return check_keyword(1, 2, "et", TOKEN_LET);
 	case 'n':
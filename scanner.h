@@ -47,8 +47,10 @@ typedef enum
     TOKEN_DEFINE,
     TOKEN_ELSE,
     TOKEN_FALSE,
+    TOKEN_FN,
     TOKEN_FOR,
     TOKEN_IF,
+    TOKEN_IMPORT,
     TOKEN_LET,
     TOKEN_NULL,
     TOKEN_OR,
@@ -99,6 +101,7 @@ typedef struct scanner_s
 
 // Function prototypes
 void init_scanner(const char *source);
+void init_scanner_at(const char *source, int line);
 token_t scan_token(void);
 
 #endif // SCANNER_H
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+#include "shape.h"
+#include "memory.h"
+
+// Every shape the thread has made, so its collector can update their names.
+static _Thread_local shape_t **shapes;
+static _Thread_local int shape_count;
+static _Thread_local int shape_capacity;
+
+// Allocates a shape and registers it.
+static shape_t *allocate_shape(shape_t *parent, value_t name)
+{
+	shape_t *shape = malloc(sizeof(shape_t));
+	if (shape == NULL)
+		exit(1);
+	shape->parent = parent;
+	shape->name = name;
+	shape->count = parent != NULL ? parent->count + 1 : 0;
+	shape->children = NULL;
+	shape->child_count = 0;
+	shape->child_capacity = 0;
+
+	if (shape_count == shape_capacity)
+	{
+		int old_capacity = shape_capacity;
+		shape_capacity = (int)grow_capacity(old_capacity);
+		shapes = grow_array(shapes, old_capacity, shape_capacity, sizeof(shape_t *));
+	}
+	shapes[shape_count++] = shape;
+	return (shape);
+}
+
+// Compares two names, which are strings; heap strings are interned.
+bool same_name(value_t a, value_t b)
+{
+	if (a.type != b.type)
+		return (false);
+	if (a.type == VAL_SMALL_STRING)
+		return (memcmp(a.as.small, b.as.small, SMALL_STRING_MAX) == 0);
+	return (a.as.obj == b.as.obj);
+}
+
+shape_t *new_root_shape(void) { return (allocate_shape(NULL, null_val())); }
+
+/**
+ * shape_add_field - Finds the shape that adds a field to another.
+ * @shape: The current shape, with fewer than SHAPE_FIELDS_MAX fields.
+ * @name: The new field's name, a string value not in @shape.
+ *
+ * Transitions are made once and then shared, so instances that add the
+ * same fields in the same order end up with the same shape.
+ *
+ * Return: The child shape.
+ */
+shape_t *shape_add_field(shape_t *shape, value_t name)
+{
+	for (int i = 0; i < shape->child_count; i++)
+		if (same_name(shape->children[i]->name, name))
+			return (shape->children[i]);
+
+	shape_t *child = allocate_shape(shape, name);
+	if (shape->child_count == shape->child_capacity)
+	{
+		int old_capacity = shape->child_capacity;
+		shape->child_capacity = (int)grow_capacity(old_capacity);
+		shape->children = grow_array(shape->children, old_capacity, shape->child_capacity,
+					     sizeof(shape_t *));
+	}
+	shape->children[shape->child_count++] = child;
+	return (child);
+}
+
+/**
+ * shape_find - Looks a field up by walking a shape's ancestry.
+ * @shape: The shape.
+ * @name: The field's name, a string value.
+ *
+ * Return: The field's offset, or -1 if the shape has no such field.
+ */
+int shape_find(const shape_t *shape, value_t name)
+{
+	for (; shape->parent != NULL; shape = shape->parent)
+		if (same_name(shape->name, name))
+			return (shape->count - 1);
+	return (-1);
+}
+
+// Applies a visitor to the name of every shape; they are GC roots.
+void trace_shapes(void (*visit)(value_t *))
+{
+	for (int i = 0; i < shape_count; i++)
+		visit(&shapes[i]->name);
+}
+
+// Frees every shape, once no instance or cache can refer to them.
+void free_shapes(void)
+{
+	for (int i = 0; i < shape_count; i++)
+	{
+		free(shapes[i]->children);
+		free(shapes[i]);
+	}
+	free(shapes);
+	shapes = NULL;
+	shape_count = 0;
+	shape_capacity = 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <stdint.h>
+#include "common.h"
+#include "value.h"
+
+#define SHAPE_FIELDS_MAX 256 // Most fields an instance may have.
+#define CACHE_WAYS 4         // Shapes an inline cache remembers at once.
+
+/**
+ * struct shape_s - A hidden class: the field layout shared by instances.
+ * @parent: The shape without the last field, or NULL for a root.
+ * @name: Name of the last field, a string value; null for a root.
+ * @count: Number of fields; the last one lives at offset @count - 1.
+ * @children: Shapes that add one field to this one.
+ * @child_count: Number of entries in @children.
+ * @child_capacity: Capacity of @children.
+ *
+ * Description: Each class has a root shape, and an instance moves to a
+ * child shape when a field is added to it, so instances that gain the same
+ * fields in the same order share a shape and keep each field at the same
+ * offset. Shapes live outside the heap and are never freed before it is:
+ * inline caches compare them by address, so a freed shape's address being
+ * reused could make a cache hit for the wrong layout.
+ */
+typedef struct shape_s
+{
+	struct shape_s *parent;
+	value_t name;
+	int count;
+	struct shape_s **children;
+	int child_count;
+	int child_capacity;
+} shape_t;
+
+/**
+ * struct cache_entry_s - What an inline cache learnt about one shape.
+ * @shape: The receiver's shape, or NULL for an unused entry.
+ * @next: For a store, the shape afterwards; differs from @shape when the
+ *        store adds the field.
+ * @offset: Offset of the field, or -1 if the name is a method.
+ * @method: The method, when @offset is -1.
+ */
+typedef struct cache_entry_s
+{
+	shape_t *shape;
+	shape_t *next;
+	int offset;
+	struct obj_function_s *method;
+} cache_entry_t;
+
+/**
+ * struct inline_cache_s - The shapes seen by one property access.
+ * @entries: Up to CACHE_WAYS shapes and what they resolved to.
+ * @victim: Entry to replace when a further shape is seen.
+ *
+ * Description: Each property instruction owns a cache in its chunk. A
+ * site that sees one shape (monomorphic) or a few (polymorphic) resolves
+ * with a compare per entry and a load at a known offset; only a miss walks
+ * the shape's fields or the class's methods.
+ */
+typedef struct inline_cache_s
+{
+	cache_entry_t entries[CACHE_WAYS];
+	uint8_t victim;
+} inline_cache_t;
+
+shape_t *new_root_shape(void);
+shape_t *shape_add_field(shape_t *shape, value_t name);
+int shape_find(const shape_t *shape, value_t name);
+bool same_name(value_t a, value_t b);
+void trace_shapes(void (*visit)(value_t *));
+void free_shapes(void);
+
+// Finds the entry of a cache for a shape, or returns NULL.
+static inline const cache_entry_t *cache_find(const inline_cache_t *cache, const shape_t *shape)
+{
+	for (int i = 0; i < CACHE_WAYS; i++)
+		if (cache->entries[i].shape == shape)
+			return (&cache->entries[i]);
+	return (NULL);
+}
+
+// Records an entry, replacing the oldest once the cache is full.
+static inline const cache_entry_t *cache_store(inline_cache_t *cache, cache_entry_t entry)
+{
+	cache_entry_t *slot = &cache->entries[cache->victim];
+	*slot = entry;
+	cache->victim = (uint8_t)((cache->victim + 1) % CACHE_WAYS);
+	return (slot);
+}
+
+#endif // SHAPE_H
@@ -0,0 +1,1025 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snapshot.h"
+#include "array.h"
+#include "class.h"
+#include "compiler.h"
+#include "error.h"
+#include "function.h"
+#include "gc.h"
+#include "map.h"
+#include "memory.h"
+#include "object.h"
+#include "vm.h"
+
+#define SCRATCH_SLOTS 2 // Rooted slots for values being stored.
+#define RECORD_EXTERNAL 0xff // Record of an object a module takes from one it imports.
+
+/**
+ * struct writer_s - An image being written.
+ * @bytes: The records and globals written so far.
+ * @count: Number of bytes in @bytes.
+ * @capacity: Capacity of @bytes.
+ * @objects: The objects numbered so far, in order of their numbers.
+ * @object_count: Number of entries in @objects.
+ * @object_capacity: Capacity of @objects.
+ * @index: Open-addressing table of object numbers plus one, by address;
+ *         0 marks an empty slot.
+ * @index_capacity: Number of slots in @index, a power of two.
+ * @externals: For a module, the number of globals that belong to the
+ *             modules it imports; objects they hold are written as
+ *             references to them rather than copied. 0 for a snapshot.
+ *
+ * Description: Objects are numbered as references to them are found and
+ * written in the order they were numbered, so a reference can be written
+ * before the object it refers to. Nothing is allocated on the heap while
+ * an image is written, so no object moves.
+ */
+typedef struct writer_s
+{
+	uint8_t *bytes;
+	size_t count;
+	size_t capacity;
+	obj_t **objects;
+	int object_count;
+	int object_capacity;
+	int *index;
+	int index_capacity;
+	int externals;
+} writer_t;
+
+/**
+ * struct reader_s - An image being read.
+ * @at: The next byte to read.
+ * @end: Past the last byte.
+ * @objects: The objects made so far, by number, followed by
+ *           SCRATCH_SLOTS spare slots; all of them are GC roots.
+ * @object_count: Number of objects in the image.
+ * @globals: For a module, the index in vm.globals of each global the
+ *           image numbers; NULL for a snapshot, whose numbers are final.
+ * @global_count: Number of entries in @globals.
+ * @failed: Whether the image turned out to be malformed.
+ */
+typedef struct reader_s
+{
+	const uint8_t *at;
+	const uint8_t *end;
+	value_t *objects;
+	int object_count;
+	int *globals;
+	int global_count;
+	bool failed;
+} reader_t;
+
+// Appends bytes to an image.
+static void put_bytes(writer_t *writer, const void *bytes, size_t count)
+{
+	if (count == 0)
+		return;
+	if (writer->count + count > writer->capacity)
+	{
+		size_t capacity = writer->capacity;
+		while (writer->count + count > capacity)
+			capacity = grow_capacity(capacity);
+		writer->bytes = grow_array(writer->bytes, writer->capacity, capacity, 1);
+		writer->capacity = capacity;
+	}
+	memcpy(writer->bytes + writer->count, bytes, count);
+	writer->count += count;
+}
+
+static void put_u8(writer_t *writer, uint8_t value) { put_bytes(writer, &value, sizeof(value)); }
+
+static void put_int(writer_t *writer, int32_t value) { put_bytes(writer, &value, sizeof(value)); }
+
+// Finds the slot of an object in the index, or the empty slot it would take.
+static int *index_slot(const writer_t *writer, const obj_t *object)
+{
+	uint32_t mask = (uint32_t)writer->index_capacity - 1;
+	uint32_t slot = (uint32_t)(((uintptr_t)object >> 3) * 2654435761u) & mask;
+	while (writer->index[slot] != 0 && writer->objects[writer->index[slot] - 1] != object)
+		slot = (slot + 1) & mask;
+	return (&writer->index[slot]);
+}
+
+/**
+ * number_object - Returns an object's number, giving it the next one if
+ * it has none yet.
+ * @writer: The image.
+ * @object: The object.
+ *
+ * Return: The number.
+ */
+static int number_object(writer_t *writer, obj_t *object)
+{
+	if (writer->index_capacity > 0)
+	{
+		int *slot = index_slot(writer, object);
+		if (*slot != 0)
+			return (*slot - 1);
+	}
+	if (writer->object_count == writer->object_capacity)
+	{
+		int capacity = (int)grow_capacity(writer->object_capacity);
+		writer->objects = grow_array(writer->objects, writer->object_capacity, capacity, sizeof(obj_t *));
+		writer->object_capacity = capacity;
+	}
+	writer->objects[writer->object_count++] = object;
+
+	if (writer->object_count * 2 > writer->index_capacity)
+	{
+		free(writer->index);
+		writer->index_capacity = writer->index_capacity == 0 ? 64 : writer->index_capacity * 2;
+		writer->index = calloc(writer->index_capacity, sizeof(int));
+		if (writer->index == NULL)
+			exit(1);
+		for (int i = 0; i < writer->object_count; i++)
+			*index_slot(writer, writer->objects[i]) = i + 1;
+	}
+	else
+	{
+		*index_slot(writer, object) = writer->object_count;
+	}
+	return (writer->object_count - 1);
+}
+
+// Writes a value; an object is written as its number.
+static void put_value(writer_t *writer, value_t value)
+{
+	put_u8(writer, (uint8_t)value.type);
+	switch (value.type)
+	{
+	case VAL_BOOLEAN:
+		put_u8(writer, value.as.boolean);
+		break;
+	case VAL_NULL:
+		break;
+	case VAL_NUMBER:
+		put_bytes(writer, &value.as.number, sizeof(double));
+		break;
+	case VAL_OBJ:
+		put_int(writer, number_object(writer, value.as.obj));
+		break;
+	case VAL_SMALL_STRING:
+		put_bytes(writer, value.as.small, SMALL_STRING_MAX);
+		break;
+	}
+}
+
+// Writes compiled code: its instructions, constants and lines.
+static void put_chunk(writer_t *writer, const chunk_t *chunk)
+{
+	put_int(writer, chunk->count);
+	put_bytes(writer, chunk->code, chunk->count);
+	put_int(writer, chunk->constants.count);
+	for (int i = 0; i < chunk->constants.count; i++)
+		put_value(writer, chunk->constants.values[i]);
+	put_int(writer, (int)chunk->lines_count);
+	put_bytes(writer, chunk->lines, sizeof(int) * chunk->lines_count);
+	put_int(writer, chunk->cache_count);
+}
+
+// Writes the contents of a function, compiled or deferred.
+static void put_function(writer_t *writer, const obj_function_t *function)
+{
+	put_value(writer, function->name);
+	put_int(writer, function->arity);
+	put_int(writer, function->line);
+	put_int(writer, function->globals);
+	if (function->source != NULL)
+	{
+		int length = (int)strlen(function->source);
+		put_u8(writer, true);
+		put_int(writer, length);
+		put_bytes(writer, function->source, length);
+		return;
+	}
+	put_u8(writer, false);
+	put_chunk(writer, function->chunk);
+}
+
+// Writes the fields of an instance in the order they were added.
+static void put_fields(writer_t *writer, const obj_instance_t *instance)
+{
+	const shape_t *shapes[SHAPE_FIELDS_MAX];
+	int count = 0;
+	for (const shape_t *shape = instance->shape; shape->parent != NULL; shape = shape->parent)
+		shapes[count++] = shape;
+	put_int(writer, count);
+	while (count-- > 0)
+	{
+		put_value(writer, shapes[count]->name);
+		put_value(writer, instance_fields(instance)[shapes[count]->count - 1]);
+	}
+}
+
+// Finds the imported global an object is the value of, or returns -1.
+static int external_global(const writer_t *writer, const obj_t *object)
+{
+	for (int i = 0; i < writer->externals; i++)
+		if (is_obj(vm.globals.values[i]) && as_obj(vm.globals.values[i]) == object)
+			return (i);
+	return (-1);
+}
+
+/**
+ * put_object - Writes the record of an object.
+ * @writer: The image.
+ * @object: The object.
+ *
+ * Inline caches are not written: they only hold what a run has learnt and
+ * start out empty again. An object a module takes from one it imports is
+ * written as the number of the global holding it, and what it refers to
+ * is not written at all.
+ */
+static void put_object(writer_t *writer, obj_t *object)
+{
+	int external = external_global(writer, object);
+	if (external != -1)
+	{
+		put_u8(writer, RECORD_EXTERNAL);
+		put_int(writer, sizeof(int32_t));
+		put_int(writer, external);
+		return;
+	}
+	put_u8(writer, object->type);
+	size_t length_at = writer->count;
+	put_int(writer, 0);
+
+	switch (object->type)
+	{
+	case OBJ_STRING:
+	{
+		obj_string_t *string = (obj_string_t *)object;
+		put_int(writer, string->length);
+		put_bytes(writer, string->chars, string->length);
+		break;
+	}
+	case OBJ_FUNCTION:
+		put_function(writer, (obj_function_t *)object);
+		break;
+	case OBJ_CLASS:
+	{
+		obj_class_t *klass = (obj_class_t *)object;
+		put_value(writer, klass->name);
+		put_value(writer, klass->superclass);
+		put_value(writer, klass->initializer);
+		put_int(writer, klass->field_hint);
+		put_int(writer, klass->methods.count);
+		for (int i = 0; i < klass->methods.count; i++)
+		{
+			put_value(writer, klass->method_names.values[i]);
+			put_value(writer, klass->methods.values[i]);
+		}
+		break;
+	}
+	case OBJ_ARRAY:
+	{
+		obj_array_t *array = (obj_array_t *)object;
+		put_u8(writer, array->packed);
+		put_int(writer, array->count);
+		if (array->packed)
+			put_bytes(writer, array_numbers(array), sizeof(double) * array->count);
+		else
+			for (int i = 0; i < array->count; i++)
+				put_value(writer, array_values(array)[i]);
+		break;
+	}
+	case OBJ_MAP:
+	{
+		obj_map_t *map = (obj_map_t *)object;
+		put_int(writer, map->count);
+		for (int i = 0; i < map->capacity; i++)
+		{
+			if (map_control(map)[i] < 0)
+				continue;
+			put_value(writer, map_entries(map)[i].key);
+			put_value(writer, map_entries(map)[i].value);
+		}
+		break;
+	}
+	case OBJ_INSTANCE:
+	{
+		obj_instance_t *instance = (obj_instance_t *)object;
+		put_value(writer, instance->klass);
+		put_fields(writer, instance);
+		break;
+	}
+	case OBJ_BOUND_METHOD:
+	{
+		obj_bound_method_t *bound = (obj_bound_method_t *)object;
+		put_value(writer, bound->receiver);
+		put_value(writer, bound->method);
+		break;
+	}
+	default:
+		break;
+	}
+
+	int32_t length = (int32_t)(writer->count - length_at - sizeof(int32_t));
+	memcpy(writer->bytes + length_at, &length, sizeof(length));
+}
+
+/**
+ * compile_deferred - Compiles the bodies the compiler deferred, so that an
+ * image holds compiled code.
+ *
+ * Deferred functions are only ever declared at the top level, so they are
+ * all globals. Every body is tried, so that all of their errors are
+ * reported at once.
+ *
+ * Return: false if any body does not compile.
+ */
+static bool compile_deferred(void)
+{
+	bool compiled = true;
+	for (int i = 0; i < vm.globals.count; i++)
+	{
+		value_t value = vm.globals.values[i];
+		if (is_function(value) && as_function(value)->source != NULL && !compile_function(as_function(value)))
+			compiled = false;
+	}
+	return (compiled);
+}
+
+/**
+ * save_snapshot - Writes the globals and everything they reach to an image.
+ * @path: Where to write it.
+ *
+ * Return: false, with the error reported, if a function body does not
+ * compile, the globals reach a mapped array or the file cannot be written.
+ */
+bool save_snapshot(const char *path)
+{
+	writer_t writer = {0};
+
+	if (!compile_deferred())
+	{
+		report_error("A function that does not compile can't be saved in snapshot '%s'.", path);
+		return (false);
+	}
+	for (int i = 0; i < vm.globals.count; i++)
+	{
+		if (is_obj(vm.global_info[i].name))
+			number_object(&writer, as_obj(vm.global_info[i].name));
+		if (is_obj(vm.globals.values[i]))
+			number_object(&writer, as_obj(vm.globals.values[i]));
+	}
+	for (int i = 0; i < writer.object_count; i++)
+		put_object(&writer, writer.objects[i]);
+	for (int i = 0; i < vm.globals.count; i++)
+	{
+		put_value(&writer, vm.global_info[i].name);
+		put_u8(&writer, vm.global_info[i].is_const);
+		put_u8(&writer, vm.global_info[i].is_folded);
+		put_value(&writer, vm.globals.values[i]);
+	}
+
+	// A mapped array is a view of a file that the image cannot promise to find again.
+	bool written = true;
+	for (int i = 0; i < writer.object_count && written; i++)
+		written = writer.objects[i]->type != OBJ_MAPPED;
+	if (!written)
+		report_error("A mapped array can't be saved in snapshot '%s'.", path);
+
+	snapshot_header_t header = {0};
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.byte_order = SNAPSHOT_BYTE_ORDER;
+	header.opcode_count = OPCODE_COUNT;
+	header.object_count = (uint32_t)writer.object_count;
+	header.global_count = (uint32_t)vm.globals.count;
+	header.checksum = hash_string((const char *)writer.bytes, (int)writer.count);
+	header.size = writer.count;
+
+	if (written)
+	{
+		FILE *file = fopen(path, "wb");
+		written = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1 &&
+			  fwrite(writer.bytes, 1, writer.count, file) == writer.count;
+		if (file != NULL && fclose(file) != 0)
+			written = false;
+		if (!written)
+			report_error("Failed to write snapshot '%s'.", path);
+	}
+
+	free(writer.bytes);
+	free(writer.objects);
+	free(writer.index);
+	return (written);
+}
+
+/**
+ * save_module - Writes the compiled top level of a module to an image.
+ * @chunk: The module's top-level code.
+ * @first_global: The globals before this one were declared by the modules
+ *                it imports, which were loaded before it was compiled.
+ * @size: Receives the size of the image.
+ *
+ * The image starts with the name of every global, which a loader matches
+ * to its own globals by name, so it does not depend on what else the VM
+ * loading it has loaded. Objects that come from the imported modules are
+ * referred to through their globals rather than copied. The module's code
+ * and the values of its folded globals end the image, but are numbered
+ * first, so that the records include everything they refer to.
+ *
+ * Return: The image, to be freed by the caller.
+ */
+uint8_t *save_module(const chunk_t *chunk, int first_global, size_t *size)
+{
+	writer_t writer = {0};
+	writer.externals = first_global;
+	for (int i = first_global; i < vm.globals.count; i++)
+		put_value(&writer, vm.globals.values[i]);
+	put_chunk(&writer, chunk);
+	writer_t tail = writer;
+	writer.bytes = NULL;
+	writer.count = 0;
+	writer.capacity = 0;
+	for (int i = 0; i < writer.object_count; i++)
+		put_object(&writer, writer.objects[i]);
+
+	writer_t head = {0};
+	put_int(&head, vm.globals.count);
+	for (int i = 0; i < vm.globals.count; i++)
+	{
+		const global_t *global = &vm.global_info[i];
+		put_u8(&head, i < first_global);
+		put_u8(&head, global->is_const);
+		put_u8(&head, global->is_folded);
+		put_int(&head, string_length(&global->name));
+		put_bytes(&head, string_chars(&global->name), string_length(&global->name));
+	}
+	put_int(&head, writer.object_count);
+	put_bytes(&head, writer.bytes, writer.count);
+	put_bytes(&head, tail.bytes, tail.count);
+
+	free(tail.bytes);
+	free(writer.bytes);
+	free(writer.objects);
+	free(writer.index);
+	*size = head.count;
+	return (head.bytes);
+}
+
+// Reads bytes, or zeros once the image has run out.
+static void get_bytes(reader_t *reader, void *bytes, size_t count)
+{
+	if (count == 0)
+		return;
+	if ((size_t)(reader->end - reader->at) < count)
+	{
+		reader->failed = true;
+		memset(bytes, 0, count);
+		return;
+	}
+	memcpy(bytes, reader->at, count);
+	reader->at += count;
+}
+
+static uint8_t get_u8(reader_t *reader)
+{
+	uint8_t value;
+	get_bytes(reader, &value, sizeof(value));
+	return (value);
+}
+
+// Reads a count, which must be between 0 and max.
+static int get_count(reader_t *reader, int max)
+{
+	int32_t value;
+	get_bytes(reader, &value, sizeof(value));
+	if (value < 0 || value > max)
+	{
+		reader->failed = true;
+		return (0);
+	}
+	return (value);
+}
+
+// Reads a value; an object number becomes the object made for it.
+static value_t get_value(reader_t *reader)
+{
+	value_t value = null_val();
+	uint8_t type = get_u8(reader);
+	switch (type)
+	{
+	case VAL_BOOLEAN:
+		value = bool_val(get_u8(reader) != 0);
+		break;
+	case VAL_NULL:
+		break;
+	case VAL_NUMBER:
+	{
+		double number;
+		get_bytes(reader, &number, sizeof(number));
+		value = number_val(number);
+		break;
+	}
+	case VAL_OBJ:
+		value = reader->objects[get_count(reader, reader->object_count - 1)];
+		break;
+	case VAL_SMALL_STRING:
+		value.type = VAL_SMALL_STRING;
+		get_bytes(reader, value.as.small, SMALL_STRING_MAX);
+		break;
+	default:
+		reader->failed = true;
+		break;
+	}
+	return (value);
+}
+
+// Reads a value that must be null or pass a type check.
+static value_t get_optional(reader_t *reader, bool (*check)(value_t))
+{
+	value_t value = get_value(reader);
+	if (!is_null(value) && !check(value))
+		reader->failed = true;
+	return (value);
+}
+
+// Reads a value that must be a string.
+static value_t get_name(reader_t *reader)
+{
+	value_t value = get_value(reader);
+	if (!is_string(value))
+		reader->failed = true;
+	return (value);
+}
+
+/**
+ * make_object - Makes the object of a record, as far as it can be made
+ * before other objects exist.
+ * @reader: The image, positioned after the record's header.
+ * @type: The record's type.
+ * @number: The record's number.
+ * @pass: 0 for objects that refer to nothing to be made, 1 for instances,
+ *        which need their class, 2 for bound methods, which need their
+ *        receiver.
+ *
+ * The record of an object a module takes from one it imports is resolved
+ * to the object the loading VM's global holds.
+ */
+static void make_object(reader_t *reader, uint8_t type, int number, int pass)
+{
+	value_t *scratch = reader->objects + reader->object_count;
+	value_t made = null_val();
+
+	if (pass == 0 && type == OBJ_STRING)
+	{
+		int length = get_count(reader, (int)(reader->end - reader->at));
+		if (!reader->failed)
+			made = copy_string((const char *)reader->at, length);
+	}
+	else if (pass == 0 && type == OBJ_FUNCTION)
+		made = new_function();
+	else if (pass == 0 && type == OBJ_CLASS)
+		made = new_class();
+	else if (pass == 0 && type == OBJ_ARRAY)
+	{
+		bool packed = get_u8(reader) != 0;
+		made = new_array(get_count(reader, ARRAY_MAX), packed);
+	}
+	else if (pass == 0 && type == OBJ_MAP)
+		made = new_map();
+	else if (pass == 1 && type == OBJ_INSTANCE)
+	{
+		scratch[0] = get_value(reader);
+		if (!is_class(scratch[0]))
+			reader->failed = true;
+		else
+			made = new_instance(&scratch[0]);
+	}
+	else if (pass == 2 && type == OBJ_BOUND_METHOD)
+	{
+		scratch[0] = get_optional(reader, is_instance);
+		scratch[1] = get_optional(reader, is_function);
+		made = new_bound_method(&scratch[0], &scratch[1]);
+	}
+	else if (pass == 0 && type == RECORD_EXTERNAL && reader->globals != NULL)
+	{
+		int global = get_count(reader, reader->global_count - 1);
+		if (!reader->failed)
+			made = vm.globals.values[reader->globals[global]];
+		if (!is_obj(made))
+			reader->failed = true;
+	}
+	else if (type == RECORD_EXTERNAL ? reader->globals == NULL : type > OBJ_BOUND_METHOD || type == OBJ_BUFFER)
+		reader->failed = true;
+	else
+		return;
+	reader->objects[number] = made;
+}
+
+/**
+ * relocate_globals - Renumbers the globals a module's code uses to where
+ * they are in the loading VM.
+ * @reader: The image.
+ * @chunk: The code.
+ */
+static void relocate_globals(reader_t *reader, chunk_t *chunk)
+{
+	for (int offset = 0; offset < chunk->count; offset += instruction_length(chunk->code[offset]))
+	{
+		uint8_t opcode = chunk->code[offset];
+		if (opcode != OP_GET_GLOBAL && opcode != OP_SET_GLOBAL && opcode != OP_DEFINE_GLOBAL)
+			continue;
+		if (offset + 1 >= chunk->count || chunk->code[offset + 1] >= reader->global_count)
+		{
+			reader->failed = true;
+			return;
+		}
+		chunk->code[offset + 1] = (uint8_t)reader->globals[chunk->code[offset + 1]];
+	}
+}
+
+// Fills in the code and constants of a function.
+static void fill_chunk(reader_t *reader, obj_function_t *function)
+{
+	chunk_t *chunk = function->chunk;
+	int count = get_count(reader, (int)(reader->end - reader->at));
+	chunk->code = grow_array(NULL, 0, count, sizeof(uint8_t));
+	get_bytes(reader, chunk->code, count);
+	chunk->count = count;
+	chunk->capacity = count;
+	int constant_count = get_count(reader, (int)(reader->end - reader->at));
+	for (int i = 0; i < constant_count; i++)
+	{
+		value_t constant = get_value(reader);
+		write_value_array(&chunk->constants, constant);
+		write_barrier(&function->obj, constant);
+	}
+	int lines_count = get_count(reader, (int)((reader->end - reader->at) / sizeof(int)));
+	chunk->lines = grow_array(NULL, 0, lines_count, sizeof(int));
+	get_bytes(reader, chunk->lines, sizeof(int) * lines_count);
+	chunk->lines_count = lines_count;
+	chunk->lines_capacity = lines_count;
+	int cache_count = get_count(reader, count); // Each is used by an instruction.
+	for (int i = 0; i < cache_count; i++)
+		add_cache(chunk);
+	if (reader->globals != NULL)
+		relocate_globals(reader, chunk);
+	freeze_chunk(chunk);
+}
+
+// Fills in a function's name and code, or the source of a deferred body.
+static void fill_function(reader_t *reader, value_t *slot)
+{
+	obj_function_t *function = as_function(*slot);
+	function->name = get_name(reader);
+	write_barrier(&function->obj, function->name);
+	function->arity = get_count(reader, ARGS_MAX);
+	function->line = get_count(reader, INT32_MAX);
+	function->globals = get_count(reader, UINT8_MAX + 1);
+	if (get_u8(reader) != 0)
+	{
+		int length = get_count(reader, (int)(reader->end - reader->at));
+		function->source = malloc(length + 1);
+		if (function->source == NULL)
+			exit(1);
+		get_bytes(reader, function->source, length);
+		function->source[length] = '\0';
+		return;
+	}
+	fill_chunk(reader, function);
+}
+
+// Fills in a class's superclass and methods.
+static void fill_class(reader_t *reader, value_t *slot)
+{
+	obj_class_t *klass = as_class(*slot);
+	klass->name = get_name(reader);
+	klass->superclass = get_optional(reader, is_class);
+	klass->initializer = get_optional(reader, is_function);
+	klass->field_hint = get_count(reader, FIELD_HINT_MAX);
+	write_barrier(&klass->obj, klass->name);
+	write_barrier(&klass->obj, klass->superclass);
+	write_barrier(&klass->obj, klass->initializer);
+	int count = get_count(reader, (int)(reader->end - reader->at));
+	for (int i = 0; i < count && !reader->failed; i++)
+	{
+		value_t name = get_name(reader);
+		value_t method = get_value(reader);
+		if (!is_function(method))
+			reader->failed = true;
+		write_value_array(&klass->method_names, name);
+		write_value_array(&klass->methods, method);
+		write_barrier(&klass->obj, name);
+		write_barrier(&klass->obj, method);
+	}
+}
+
+/**
+ * fill_object - Stores the references of an object made by make_object().
+ * @reader: The image, positioned after the record's header.
+ * @type: The record's type.
+ * @slot: The object's slot, a GC root.
+ *
+ * Map entries and fields are stored the way running code stores them, so
+ * maps are rehashed and instances get their shapes again.
+ */
+static void fill_object(reader_t *reader, uint8_t type, value_t *slot)
+{
+	value_t *scratch = reader->objects + reader->object_count;
+
+	if (type == OBJ_FUNCTION)
+		fill_function(reader, slot);
+	else if (type == OBJ_CLASS)
+		fill_class(reader, slot);
+	else if (type == OBJ_ARRAY)
+	{
+		bool packed = get_u8(reader) != 0;
+		int count = get_count(reader, ARRAY_MAX);
+		if (packed != as_array(*slot)->packed || count != as_array(*slot)->count)
+			reader->failed = true;
+		else if (packed)
+			get_bytes(reader, array_numbers(as_array(*slot)), sizeof(double) * count);
+		else
+			for (int i = 0; i < count; i++)
+			{
+				value_t element = get_value(reader);
+				array_values(as_array(*slot))[i] = element;
+				write_barrier(as_obj(*slot), element);
+			}
+	}
+	else if (type == OBJ_MAP)
+	{
+		int count = get_count(reader, MAP_MAX);
+		for (int i = 0; i < count && !reader->failed; i++)
+		{
+			scratch[0] = get_value(reader);
+			scratch[1] = get_value(reader);
+			if (!is_map_key(scratch[0]))
+				reader->failed = true;
+			else
+				map_set(slot, &scratch[0], &scratch[1]);
+		}
+	}
+	else if (type == OBJ_INSTANCE)
+	{
+		get_value(reader);
+		int count = get_count(reader, SHAPE_FIELDS_MAX);
+		shape_t *shape = as_instance(*slot)->shape;
+		for (int i = 0; i < count && !reader->failed; i++)
+		{
+			scratch[0] = get_name(reader);
+			scratch[1] = get_value(reader);
+			if (reader->failed || shape_find(shape, scratch[0]) != -1)
+			{
+				reader->failed = true;
+				break;
+			}
+			shape = shape_add_field(shape, scratch[0]);
+			instance_add_field(slot, shape, &scratch[1]);
+		}
+	}
+}
+
+/**
+ * read_objects - Makes and fills in every object of an image.
+ * @reader: The image, positioned at its first record.
+ *
+ * Objects are made in three passes, so that each exists before the ones
+ * that need it at creation, and filled in by a fourth, once every object a
+ * reference may name exists.
+ */
+static void read_objects(reader_t *reader)
+{
+	const uint8_t *records = reader->at;
+	for (int pass = 0; pass < 4 && !reader->failed; pass++)
+	{
+		reader->at = records;
+		for (int i = 0; i < reader->object_count && !reader->failed; i++)
+		{
+			uint8_t type = get_u8(reader);
+			int length = get_count(reader, (int)(reader->end - reader->at));
+			const uint8_t *next = reader->at + length;
+			const uint8_t *end = reader->end;
+			reader->end = next;
+			if (pass < 3)
+				make_object(reader, type, i, pass);
+			else
+				fill_object(reader, type, &reader->objects[i]);
+			reader->end = end;
+			reader->at = next;
+		}
+	}
+}
+
+// Adds a global, neither const nor folded, and returns its index.
+static int append_global(value_t name, value_t value)
+{
+	if (vm.globals.count == vm.global_info_capacity)
+	{
+		int old_capacity = vm.global_info_capacity;
+		vm.global_info_capacity = (int)grow_capacity(old_capacity);
+		vm.global_info = grow_array(vm.global_info, old_capacity, vm.global_info_capacity, sizeof(global_t));
+	}
+	global_t *global = &vm.global_info[vm.globals.count];
+	global->name = name;
+	global->is_const = false;
+	global->is_folded = false;
+	global->forward_line = 0;
+	write_value_array(&vm.globals, value);
+	return (vm.globals.count - 1);
+}
+
+// Restores the globals, which follow the objects.
+static void read_globals(reader_t *reader, int count)
+{
+	for (int i = 0; i < count && !reader->failed; i++)
+	{
+		value_t name = get_name(reader);
+		bool is_const = get_u8(reader) != 0;
+		bool is_folded = get_u8(reader) != 0;
+		int index = append_global(name, get_value(reader));
+		vm.global_info[index].is_const = is_const;
+		vm.global_info[index].is_folded = is_folded;
+	}
+	if (reader->failed || reader->at != reader->end)
+	{
+		reader->failed = true;
+		vm.globals.count = 0;
+	}
+}
+
+// Checks that an image was written by this build and is intact.
+static bool check_header(const snapshot_header_t *header, size_t file_size)
+{
+	return (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+		header->version == SNAPSHOT_VERSION && header->byte_order == SNAPSHOT_BYTE_ORDER &&
+		header->opcode_count == OPCODE_COUNT && header->size == file_size - sizeof(*header) &&
+		header->global_count <= UINT8_MAX + 1 && header->object_count <= INT32_MAX - SCRATCH_SLOTS &&
+		header->checksum == hash_string((const char *)(header + 1), (int)header->size));
+}
+
+/**
+ * load_snapshot - Restores the globals saved in an image.
+ * @path: The image, written by save_snapshot().
+ *
+ * The file is mapped rather than read, and each object is made again on
+ * the heap from its record, with references resolved through a table from
+ * record numbers to the objects made. The VM must not have any globals
+ * yet.
+ *
+ * Return: false, with the error reported, if the image cannot be read or
+ * was not written by this build.
+ */
+bool load_snapshot(const char *path)
+{
+	if (vm.globals.count != 0)
+	{
+		report_error("A snapshot can only be loaded before anything else.");
+		return (false);
+	}
+	int fd = open(path, O_RDONLY);
+	struct stat status;
+	if (fd == -1 || fstat(fd, &status) == -1)
+	{
+		report_error("Failed to open snapshot '%s'.", path);
+		if (fd != -1)
+			close(fd);
+		return (false);
+	}
+	size_t size = (size_t)status.st_size;
+	void *image = size >= sizeof(snapshot_header_t) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (image == MAP_FAILED || !check_header(image, size))
+	{
+		report_error("'%s' is not a snapshot written by this build.", path);
+		if (image != MAP_FAILED)
+			munmap(image, size);
+		return (false);
+	}
+
+	const snapshot_header_t *header = image;
+	reader_t reader = {0};
+	reader.at = (const uint8_t *)(header + 1);
+	reader.end = reader.at + header->size;
+	reader.object_count = (int)header->object_count;
+	reader.objects = malloc(sizeof(value_t) * (reader.object_count + SCRATCH_SLOTS));
+	if (reader.objects == NULL)
+		exit(1);
+	for (int i = 0; i < reader.object_count + SCRATCH_SLOTS; i++)
+		reader.objects[i] = null_val();
+	gc_add_roots(reader.objects, reader.object_count + SCRATCH_SLOTS);
+
+	read_objects(&reader);
+	if (!reader.failed)
+		read_globals(&reader, (int)header->global_count);
+	if (reader.failed)
+		report_error("Snapshot '%s' is malformed.", path);
+
+	gc_remove_roots(reader.objects);
+	free(reader.objects);
+	munmap(image, size);
+	return (!reader.failed);
+}
+
+/**
+ * read_module_global - Finds or declares the global an image numbers.
+ * @reader: The module's image, positioned at the global's entry.
+ * @number: The image's number for it.
+ *
+ * A global of an imported module must already exist. One of the module's
+ * own is declared unless a global of the same name exists, which it then
+ * redefines, as a later declaration in a single program would.
+ *
+ * Return: Whether the global belongs to an imported module.
+ */
+static bool read_module_global(reader_t *reader, int number)
+{
+	bool imported = get_u8(reader) != 0;
+	bool is_const = get_u8(reader) != 0;
+	bool is_folded = get_u8(reader) != 0;
+	int length = get_count(reader, (int)(reader->end - reader->at));
+	const char *name = (const char *)reader->at;
+	if (reader->failed)
+		return (imported);
+	reader->at += length;
+
+	int index = vm.globals.count - 1;
+	while (index >= 0 && !(string_length(&vm.global_info[index].name) == length &&
+			       memcmp(string_chars(&vm.global_info[index].name), name, length) == 0))
+		index--;
+	if (index == -1 && (imported || vm.globals.count == UINT8_MAX + 1))
+	{
+		reader->failed = true;
+		return (imported);
+	}
+	if (index == -1)
+		index = append_global(copy_string(name, length), null_val());
+	if (!imported)
+	{
+		vm.global_info[index].is_const = is_const;
+		vm.global_info[index].is_folded = is_folded;
+	}
+	reader->globals[number] = index;
+	return (imported);
+}
+
+/**
+ * load_module - Loads a module's image, written by save_module().
+ * @image: The image.
+ * @size: Its size.
+ * @script: Receives the module's top-level code, as a function; a slot
+ *          the caller has made a GC root.
+ *
+ * The modules it imports must have been loaded first. Their globals and
+ * the module's own are matched by name, and the code is renumbered to
+ * use them as it is read; the values of folded globals are set, while the
+ * others are only set once the top-level code runs.
+ *
+ * Return: false if the image is malformed or refers to a global that does
+ * not exist; globals it had declared are removed again.
+ */
+bool load_module(const uint8_t *image, size_t size, value_t *script)
+{
+	int global_count = vm.globals.count;
+	reader_t reader = {0};
+	reader.at = image;
+	reader.end = image + size;
+	reader.global_count = get_count(&reader, UINT8_MAX + 1);
+	reader.globals = malloc(sizeof(int) * (reader.global_count + 1));
+	if (reader.globals == NULL)
+		exit(1);
+	int imported = 0; // The imported modules' globals come first.
+	for (int i = 0; i < reader.global_count && !reader.failed; i++)
+		imported += read_module_global(&reader, i);
+
+	// Each record takes at least its type and length.
+	reader.object_count = get_count(&reader, (int)((reader.end - reader.at) / 5));
+	reader.objects = malloc(sizeof(value_t) * (reader.object_count + SCRATCH_SLOTS));
+	if (reader.objects == NULL)
+		exit(1);
+	for (int i = 0; i < reader.object_count + SCRATCH_SLOTS; i++)
+		reader.objects[i] = null_val();
+	gc_add_roots(reader.objects, reader.object_count + SCRATCH_SLOTS);
+
+	if (!reader.failed)
+		read_objects(&reader);
+	for (int i = imported; i < reader.global_count && !reader.failed; i++)
+	{
+		value_t value = get_value(&reader);
+		if (vm.global_info[reader.globals[i]].is_folded)
+			vm.globals.values[reader.globals[i]] = value;
+	}
+	if (!reader.failed)
+	{
+		*script = new_function();
+		fill_chunk(&reader, as_function(*script));
+	}
+	if (reader.at != reader.end)
+		reader.failed = true;
+	if (reader.failed)
+		vm.globals.count = global_count;
+
+	gc_remove_roots(reader.objects);
+	free(reader.objects);
+	free(reader.globals);
+	return (!reader.failed);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "common.h"
+#include "chunk.h"
+
+#define SNAPSHOT_MAGIC "charis\0i" // First bytes of every image.
+#define SNAPSHOT_VERSION 1         // Changes whenever the image layout does.
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+/**
+ * struct snapshot_header_s - The start of an image file.
+ * @magic: SNAPSHOT_MAGIC.
+ * @version: SNAPSHOT_VERSION.
+ * @byte_order: SNAPSHOT_BYTE_ORDER, as the writing machine stores it.
+ * @opcode_count: Number of opcodes of the build that wrote the image.
+ * @object_count: Number of object records.
+ * @global_count: Number of globals.
+ * @checksum: FNV-1a hash of the @size bytes after the header.
+ * @size: Bytes after the header.
+ *
+ * Description: The header is followed by one record per object, each a
+ * type byte, a 32-bit length and the object's contents, and then by the
+ * globals. A reference to an object is its record's number, so an image
+ * does not depend on where anything was in memory. Bytecode is stored as
+ * it is, so an image is only read by a build with the same opcodes.
+ */
+typedef struct snapshot_header_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t opcode_count;
+	uint32_t object_count;
+	uint32_t global_count;
+	uint32_t checksum;
+	uint64_t size;
+} snapshot_header_t;
+
+bool save_snapshot(const char *path);
+bool load_snapshot(const char *path);
+uint8_t *save_module(const chunk_t *chunk, int first_global, size_t *size);
+bool load_module(const uint8_t *image, size_t size, value_t *script);
+
+#endif // SNAPSHOT_H
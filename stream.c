@@ -0,0 +1,420 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stream.h"
+#include "class.h"
+#include "error.h"
+#include "gc.h"
+#include "memory.h"
+#include "module.h"
+#include "object.h"
+
+#define INPUT_LINE 0  // The whole record, as a string.
+#define INPUT_NR 1    // The record's number, from 1.
+#define INPUT_NF 2    // The record's number of fields.
+#define INPUT_FIELD 3 // Input of f1; fN is INPUT_FIELD + N - 1.
+#define STREAM_INPUTS (INPUT_FIELD + STREAM_FIELDS_MAX)
+
+/**
+ * struct stream_s - Records being read from a file descriptor.
+ * @fd: Where the records come from.
+ * @separator: Field separator, or '\0' for runs of blanks.
+ * @buffer: Bytes read but not yet consumed, plus one spare byte.
+ * @capacity: Size of @buffer, without the spare byte.
+ * @start: Offset of the first unconsumed byte.
+ * @scanned: Offset up to which no newline follows @start.
+ * @end: Offset past the last byte read.
+ * @eof: Whether the input has been read to its end.
+ * @failed: Whether reading the input failed.
+ * @used: Which inputs the program reads.
+ * @fields_wanted: Fields the program reads, counting from f1.
+ * @count_fields: Whether the program reads nf, so every field is counted.
+ * @fields: Start of each field of the current record.
+ * @lengths: Length of each field of the current record.
+ * @inputs: The values bound to the inputs; these are GC roots.
+ *
+ * Description: Records and fields are never copied out of @buffer;
+ * fields the program does not use are neither split out nor converted.
+ */
+typedef struct stream_s
+{
+	int fd;
+	char separator;
+	char *buffer;
+	size_t capacity;
+	size_t start;
+	size_t scanned;
+	size_t end;
+	bool eof;
+	bool failed;
+	bool used[STREAM_INPUTS];
+	int fields_wanted;
+	bool count_fields;
+	char *fields[STREAM_FIELDS_MAX];
+	size_t lengths[STREAM_FIELDS_MAX];
+	value_t inputs[STREAM_INPUTS];
+} stream_t;
+
+// Checks whether an object is already in a list of values.
+static bool seen_before(const value_array_t *seen, value_t value)
+{
+	for (int i = 0; i < seen->count; i++)
+		if (as_obj(seen->values[i]) == as_obj(value))
+			return (true);
+	return (false);
+}
+
+/**
+ * find_inputs - Marks the inputs a chunk reads.
+ * @chunk: The chunk.
+ * @used: One flag per input.
+ * @seen: Functions and classes already searched.
+ *
+ * Functions and the methods of classes among the constants are searched
+ * too, since they may read inputs when called.
+ */
+static void find_inputs(const chunk_t *chunk, bool *used, value_array_t *seen)
+{
+	for (int offset = 0; offset < chunk->count; offset += instruction_length(chunk->code[offset]))
+		if (chunk->code[offset] == OP_INPUT)
+			used[chunk->code[offset + 1]] = true;
+
+	for (int i = 0; i < chunk->constants.count; i++)
+	{
+		value_t constant = chunk->constants.values[i];
+		if (!(is_function(constant) || is_class(constant)) || seen_before(seen, constant))
+			continue;
+		write_value_array(seen, constant);
+		if (is_function(constant))
+		{
+			find_inputs(as_function(constant)->chunk, used, seen);
+			continue;
+		}
+		const value_array_t *methods = &as_class(constant)->methods;
+		for (int j = 0; j < methods->count; j++)
+			if (!seen_before(seen, methods->values[j]))
+			{
+				write_value_array(seen, methods->values[j]);
+				find_inputs(as_function(methods->values[j])->chunk, used, seen);
+			}
+	}
+}
+
+// Prepares to read records for a compiled program.
+static void init_stream(stream_t *stream, int fd, char separator, const chunk_t *chunk)
+{
+	memset(stream, 0, sizeof(*stream));
+	stream->fd = fd;
+	stream->separator = separator;
+	stream->capacity = STREAM_BUFFER_SIZE;
+	stream->buffer = malloc(stream->capacity + 1);
+	if (stream->buffer == NULL)
+		exit(1);
+	for (int i = 0; i < STREAM_INPUTS; i++)
+		stream->inputs[i] = null_val();
+
+	value_array_t seen;
+	init_value_array(&seen);
+	find_inputs(chunk, stream->used, &seen);
+	free_value_array(&seen);
+	for (int i = 0; i < STREAM_FIELDS_MAX; i++)
+		if (stream->used[INPUT_FIELD + i])
+			stream->fields_wanted = i + 1;
+	stream->count_fields = stream->used[INPUT_NF];
+}
+
+/**
+ * fill_buffer - Reads more of the input after the unconsumed bytes.
+ * @stream: The stream.
+ *
+ * Unconsumed bytes are moved to the front first, and the buffer only grows
+ * when a single record does not fit in it.
+ *
+ * Return: false if reading failed.
+ */
+static bool fill_buffer(stream_t *stream)
+{
+	size_t pending = stream->end - stream->start;
+	memmove(stream->buffer, stream->buffer + stream->start, pending);
+	stream->scanned -= stream->start;
+	stream->start = 0;
+	stream->end = pending;
+	if (pending == stream->capacity)
+	{
+		stream->capacity *= 2;
+		stream->buffer = realloc(stream->buffer, stream->capacity + 1);
+		if (stream->buffer == NULL)
+			exit(1);
+	}
+
+	ssize_t count;
+	do
+		count = read(stream->fd, stream->buffer + stream->end, stream->capacity - stream->end);
+	while (count < 0 && errno == EINTR);
+	if (count < 0)
+		return (false);
+	stream->eof = count == 0;
+	stream->end += (size_t)count;
+	return (true);
+}
+
+/**
+ * next_record - Finds the next record, a line without its line ending.
+ * @stream: The stream.
+ * @length: Receives the record's length.
+ *
+ * The record stays valid until the next call, and may be written to just
+ * past its end.
+ *
+ * Return: The record, or NULL at the end of the input or on a read error.
+ */
+static char *next_record(stream_t *stream, size_t *length)
+{
+	while (true)
+	{
+		char *start = stream->buffer + stream->start;
+		char *newline = memchr(stream->buffer + stream->scanned, '\n', stream->end - stream->scanned);
+		char *end = newline;
+		if (newline == NULL && stream->eof && stream->start < stream->end)
+			end = stream->buffer + stream->end;
+		if (end != NULL)
+		{
+			stream->start = (size_t)(end - stream->buffer) + (newline != NULL);
+			stream->scanned = stream->start;
+			if (end > start && end[-1] == '\r')
+				end--;
+			*length = (size_t)(end - start);
+			return (start);
+		}
+		if (stream->eof)
+			return (NULL);
+		stream->scanned = stream->end;
+		if (!fill_buffer(stream))
+		{
+			stream->failed = true;
+			return (NULL);
+		}
+	}
+}
+
+// Records a field if it is one the program may read.
+static void store_field(stream_t *stream, int index, char *start, const char *end)
+{
+	if (index >= STREAM_FIELDS_MAX)
+		return;
+	stream->fields[index] = start;
+	stream->lengths[index] = (size_t)(end - start);
+}
+
+// Checks whether a character separates fields when no separator is given.
+static bool is_blank(char c) { return (c == ' ' || c == '\t'); }
+
+/**
+ * split_fields - Splits a record into fields.
+ * @stream: The stream, whose fields and lengths receive the fields.
+ * @record: The record.
+ * @length: The record's length.
+ *
+ * Without a separator, fields are separated by runs of blanks and leading
+ * and trailing blanks are ignored; with one, every separator ends a field.
+ * Splitting stops after the fields the program reads unless it reads nf.
+ *
+ * Return: The number of fields found.
+ */
+static int split_fields(stream_t *stream, char *record, size_t length)
+{
+	char *cursor = record;
+	char *end = record + length;
+	int limit = stream->count_fields ? INT_MAX : stream->fields_wanted;
+	int count = 0;
+
+	if (stream->separator == '\0')
+	{
+		while (count < limit)
+		{
+			while (cursor < end && is_blank(*cursor))
+				cursor++;
+			if (cursor == end)
+				break;
+			char *field = cursor;
+			while (cursor < end && !is_blank(*cursor))
+				cursor++;
+			store_field(stream, count++, field, cursor);
+		}
+		return (count);
+	}
+
+	if (length == 0)
+		return (0);
+	while (count < limit)
+	{
+		char *separator = memchr(cursor, stream->separator, (size_t)(end - cursor));
+		store_field(stream, count++, cursor, separator != NULL ? separator : end);
+		if (separator == NULL)
+			break;
+		cursor = separator + 1;
+	}
+	return (count);
+}
+
+/**
+ * parse_number - Reads a field as a number if it is one.
+ * @chars: The field; the byte after it may be overwritten temporarily.
+ * @length: The field's length.
+ * @number: Receives the number.
+ *
+ * Plain decimals of up to 15 digits, the usual case, are converted
+ * exactly without strtod(); exponents and longer mantissas fall back to it.
+ *
+ * Return: Whether the whole field is a number.
+ */
+static bool parse_number(char *chars, size_t length, double *number)
+{
+	static const double powers[] = {1e0, 1e1, 1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+					1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+	size_t i = 0;
+	bool negative = length > 0 && chars[0] == '-';
+	if (length > 0 && (chars[0] == '-' || chars[0] == '+'))
+		i++;
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int scale = 0;
+	for (; i < length && chars[i] >= '0' && chars[i] <= '9'; i++, digits++)
+		mantissa = mantissa * 10 + (uint64_t)(chars[i] - '0');
+	if (i < length && chars[i] == '.')
+		for (i++; i < length && chars[i] >= '0' && chars[i] <= '9'; i++, digits++, scale++)
+			mantissa = mantissa * 10 + (uint64_t)(chars[i] - '0');
+
+	if (i == length && digits > 0 && digits <= 15)
+	{
+		*number = (double)mantissa / powers[scale];
+		if (negative)
+			*number = -*number;
+		return (true);
+	}
+	if (digits == 0 || (i < length && chars[i] != 'e' && chars[i] != 'E'))
+		return (false);
+
+	char saved = chars[length];
+	chars[length] = '\0';
+	char *end;
+	*number = strtod(chars, &end);
+	chars[length] = saved;
+	return (end == chars + length);
+}
+
+// Converts a field to a number if it reads as one, else to a string.
+static value_t field_value(char *chars, size_t length)
+{
+	double number;
+	if (parse_number(chars, length, &number))
+		return (number_val(number));
+	return (copy_string(chars, (int)length));
+}
+
+/**
+ * bind_record - Binds the inputs the program reads to a record.
+ * @stream: The stream.
+ * @record: The record.
+ * @length: The record's length.
+ * @number: The record's number, from 1.
+ *
+ * Missing fields are null. Making strings may collect garbage, which is
+ * why the inputs are roots.
+ */
+static void bind_record(stream_t *stream, char *record, size_t length, uint64_t number)
+{
+	int count = 0;
+	if (stream->fields_wanted > 0 || stream->count_fields)
+		count = split_fields(stream, record, length);
+
+	stream->inputs[INPUT_NR] = number_val((double)number);
+	stream->inputs[INPUT_NF] = number_val(count);
+	for (int i = 0; i < stream->fields_wanted; i++)
+		if (stream->used[INPUT_FIELD + i])
+			stream->inputs[INPUT_FIELD + i] =
+				i < count ? field_value(stream->fields[i], stream->lengths[i]) : null_val();
+	if (stream->used[INPUT_LINE])
+		stream->inputs[INPUT_LINE] = copy_string(record, (int)length);
+}
+
+/**
+ * run_stream - Evaluates a program once per record of an input.
+ * @source: The program; it may read line, nr, nf and the fields f1 to f64.
+ * @fd: The input; each line is a record.
+ * @separator: Field separator, or '\0' to split on runs of blanks.
+ * @strict: Whether a runtime error stops the run.
+ *
+ * The modules it imports are run first, and the program compiled once.
+ * Each non-null result is printed on a line of its own. A runtime error is
+ * reported with the number of the record and, unless @strict, the run
+ * goes on with the next record, since a short or malformed record now and
+ * then is normal in the data this is meant for.
+ *
+ * Return: The status of the compile, INTERPRET_RUNTIME_ERROR if any record
+ * failed, or INTERPRET_OK.
+ */
+interpret_result_t run_stream(const char *source, int fd, char separator, bool strict)
+{
+	static char field_names[STREAM_FIELDS_MAX][4];
+	const char *names[STREAM_INPUTS] = {[INPUT_LINE] = "line", [INPUT_NR] = "nr", [INPUT_NF] = "nf"};
+	for (int i = 0; i < STREAM_FIELDS_MAX; i++)
+	{
+		snprintf(field_names[i], sizeof(field_names[i]), "f%d", i + 1);
+		names[INPUT_FIELD + i] = field_names[i];
+	}
+
+	interpret_result_t imported = load_imports(source, NULL);
+	if (imported != INTERPRET_OK)
+		return (imported);
+
+	chunk_t chunk;
+	init_chunk(&chunk);
+	if (!compile_with_inputs(source, &chunk, names, STREAM_INPUTS))
+	{
+		free_chunk(&chunk);
+		return (INTERPRET_COMPILE_ERROR);
+	}
+
+	stream_t stream;
+	init_stream(&stream, fd, separator, &chunk);
+	gc_add_roots(stream.inputs, STREAM_INPUTS);
+	vm.inputs = stream.inputs;
+	vm.input_count = STREAM_INPUTS;
+
+	interpret_result_t result = INTERPRET_OK;
+	uint64_t number = 0;
+	size_t length;
+	char *record;
+	while ((result == INTERPRET_OK || !strict) && (record = next_record(&stream, &length)) != NULL)
+	{
+		bind_record(&stream, record, length, ++number);
+		interpret_result_t run = interpret_chunk(&chunk);
+		if (run != INTERPRET_OK)
+		{
+			report_error("[record %llu]", (unsigned long long)number);
+			result = run;
+		}
+		else if (!is_null(vm.result))
+		{
+			print_value(vm.result);
+			putchar('\n');
+		}
+	}
+	fflush(stdout);
+	if (stream.failed)
+	{
+		report_error("Failed to read input: %s.", strerror(errno));
+		result = INTERPRET_RUNTIME_ERROR;
+	}
+
+	vm.inputs = NULL;
+	vm.input_count = 0;
+	gc_remove_roots(stream.inputs);
+	free(stream.buffer);
+	free_chunk(&chunk);
+	return (result);
+}
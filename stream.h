@@ -0,0 +1,13 @@
+#pragma once
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "common.h"
+#include "vm.h"
+
+#define STREAM_BUFFER_SIZE (1024 * 1024) // Bytes read from the input at once.
+#define STREAM_FIELDS_MAX 64             // Fields bound as f1 to f64.
+
+interpret_result_t run_stream(const char *source, int fd, char separator, bool strict);
+
+#endif // STREAM_H
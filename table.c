@@ -0,0 +1,142 @@
+#include "table.h"
+#include "memory.h"
+
+#define TABLE_MAX_LOAD 0.75
+
+// Marks an entry whose string was collected; probing continues past it.
+static obj_t tombstone;
+#define TOMBSTONE ((obj_string_t *)&tombstone)
+
+/**
+ * init_string_table - Initializes an empty string table.
+ * @table: The table to initialize.
+ */
+void init_string_table(string_table_t *table)
+{
+	table->count = 0;
+	table->capacity = 0;
+	table->entries = NULL;
+}
+
+/**
+ * free_string_table - Frees a string table (but not the strings in it).
+ * @table: The table to free.
+ */
+void free_string_table(string_table_t *table)
+{
+	free_array(table->entries);
+	init_string_table(table);
+}
+
+/**
+ * find_slot - Finds the entry holding a string, or the entry where it
+ * would go: the first tombstone passed, else the empty entry that ended
+ * the probe.
+ * @entries: The entries to search.
+ * @capacity: Number of entries, a power of two.
+ * @chars: The string's bytes.
+ * @length: The string's length.
+ * @hash: The string's hash.
+ *
+ * Return: Pointer to the matching, tombstone or empty entry.
+ */
+static obj_string_t **find_slot(obj_string_t **entries, int capacity, const char *chars, int length,
+				uint32_t hash)
+{
+	uint32_t index = hash & (uint32_t)(capacity - 1);
+	obj_string_t **reusable = NULL;
+	while (true)
+	{
+		obj_string_t *entry = entries[index];
+		if (entry == NULL)
+			return (reusable != NULL ? reusable : &entries[index]);
+		if (entry == TOMBSTONE)
+		{
+			if (reusable == NULL)
+				reusable = &entries[index];
+		}
+		else if (entry->hash == hash && entry->length == length && memcmp(entry->chars, chars, length) == 0)
+			return &entries[index];
+		index = (index + 1) & (uint32_t)(capacity - 1);
+	}
+}
+
+/**
+ * adjust_capacity - Rehashes a table into a new entry array.
+ * @table: The table to resize.
+ * @capacity: The new capacity, a power of two.
+ */
+static void adjust_capacity(string_table_t *table, int capacity)
+{
+	obj_string_t **entries = calloc((size_t)capacity, sizeof(obj_string_t *));
+	if (entries == NULL)
+		exit(1);
+
+	table->count = 0;
+	for (int i = 0; i < table->capacity; i++)
+	{
+		obj_string_t *string = table->entries[i];
+		if (string == NULL || string == TOMBSTONE)
+			continue;
+		*find_slot(entries, capacity, string->chars, string->length, string->hash) = string;
+		table->count++;
+	}
+	free_array(table->entries);
+	table->entries = entries;
+	table->capacity = capacity;
+}
+
+/**
+ * string_table_find - Looks up an interned string by its contents.
+ * @table: The table to search.
+ * @chars: The string's bytes.
+ * @length: The string's length.
+ * @hash: The string's hash.
+ *
+ * Return: The interned string, or NULL if there is none.
+ */
+obj_string_t *string_table_find(string_table_t *table, const char *chars, int length, uint32_t hash)
+{
+	if (table->count == 0)
+		return (NULL);
+	obj_string_t *entry = *find_slot(table->entries, table->capacity, chars, length, hash);
+	return (entry == TOMBSTONE ? NULL : entry);
+}
+
+/**
+ * string_table_retain - Rewrites or drops every entry of a table.
+ * @table: The table.
+ * @keep: Returns the string to store in place of its argument, which must
+ *        have the same contents, or NULL to drop the entry.
+ *
+ * This is how the collector treats the table as weak: dead strings become
+ * tombstones and promoted strings are replaced by their new copy.
+ */
+void string_table_retain(string_table_t *table, obj_string_t *(*keep)(obj_string_t *))
+{
+	for (int i = 0; i < table->capacity; i++)
+	{
+		obj_string_t *string = table->entries[i];
+		if (string == NULL || string == TOMBSTONE)
+			continue;
+		string = keep(string);
+		table->entries[i] = string != NULL ? string : TOMBSTONE;
+	}
+}
+
+/**
+ * string_table_add - Interns a string that is not yet in the table.
+ * @table: The table to add to.
+ * @string: The string.
+ */
+void string_table_add(string_table_t *table, obj_string_t *string)
+{
+	if (table->count + 1 > table->capacity * TABLE_MAX_LOAD)
+		adjust_capacity(table, (int)grow_capacity(table->capacity));
+
+	obj_string_t **slot = find_slot(table->entries, table->capacity, string->chars, string->length,
+					string->hash);
+	if (*slot == NULL)
+		table->count++;
+	*slot = string;
+}
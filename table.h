@@ -0,0 +1,32 @@
+#pragma once
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdint.h>
+#include "common.h"
+#include "object.h"
+
+/**
+ * struct string_table_s - Open-addressing set of interned strings.
+ * @count: Number of entries holding a string or a tombstone.
+ * @capacity: Number of entries; always zero or a power of two.
+ * @entries: The strings, NULL for empty entries.
+ *
+ * Description: Probing is linear from the string's stored hash, so a
+ * lookup touches consecutive entries and compares characters only when
+ * the hash and length already match.
+ */
+typedef struct string_table_s
+{
+	int count;
+	int capacity;
+	obj_string_t **entries;
+} string_table_t;
+
+void init_string_table(string_table_t *table);
+void free_string_table(string_table_t *table);
+obj_string_t *string_table_find(string_table_t *table, const char *chars, int length, uint32_t hash);
+void string_table_add(string_table_t *table, obj_string_t *string);
+void string_table_retain(string_table_t *table, obj_string_t *(*keep)(obj_string_t *));
+
+#endif // TABLE_H
@@ -0,0 +1,215 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "timings.h"
+
+static const char *const phase_names[PHASE_COUNT] = {"read", "scan", "compile", "run", "gc"};
+static const char *const counter_names[COUNTER_COUNT] = {"cycles", "instructions", "cache_misses",
+							  "branch_misses"};
+static const uint64_t counter_events[COUNTER_COUNT] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+// Returns a monotonic timestamp in nanoseconds.
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * open_counter - Opens a hardware counter of the calling thread.
+ * @event: The PERF_COUNT_HW_* event.
+ * @group: The group to join, or -1 to lead a new one.
+ *
+ * A leader starts disabled, so the whole group can be started at once.
+ * Only user-space events are counted, which unprivileged processes are
+ * allowed to do under the default perf_event_paranoid setting.
+ *
+ * Return: The file descriptor, or -1 with errno set.
+ */
+static int open_counter(uint64_t event, int group)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = event;
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return ((int)syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+}
+
+/**
+ * read_counts - Reads every counter of the group.
+ * @timings: The timings.
+ * @counts: Receives the counts, 0 for counters that are missing.
+ *
+ * While the kernel multiplexes the group with other users of the
+ * counters, counts are scaled up to the time the group was enabled.
+ */
+static void read_counts(const timings_t *timings, uint64_t counts[COUNTER_COUNT])
+{
+	uint64_t values[3 + COUNTER_COUNT];
+	memset(counts, 0, sizeof(uint64_t) * COUNTER_COUNT);
+	if (timings->group == -1 || read(timings->group, values, sizeof(values)) < (ssize_t)(3 * sizeof(uint64_t)))
+		return;
+
+	uint64_t enabled = values[1], running = values[2];
+	double scale = running > 0 && running < enabled ? (double)enabled / (double)running : 1;
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		if (timings->slots[i] >= 0 && (uint64_t)timings->slots[i] < values[0])
+			counts[i] = (uint64_t)((double)values[3 + timings->slots[i]] * scale);
+}
+
+/**
+ * new_timings - Starts timing phases.
+ *
+ * Counters the machine lacks are left out. When none can be opened, e.g.
+ * because perf_event_paranoid forbids it or in a virtual machine without
+ * a PMU, only wall time is measured and the reason is kept for the report.
+ *
+ * Return: The timings.
+ */
+timings_t *new_timings(void)
+{
+	timings_t *timings = calloc(1, sizeof(timings_t));
+	if (timings == NULL)
+		exit(1);
+	timings->group = -1;
+
+	int members = 0, error = 0;
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		timings->slots[i] = -1;
+		timings->fds[i] = open_counter(counter_events[i], timings->group);
+		if (timings->fds[i] == -1)
+		{
+			error = errno;
+			continue;
+		}
+		if (timings->group == -1)
+			timings->group = timings->fds[i];
+		timings->slots[i] = members++;
+	}
+	if (timings->group == -1)
+		snprintf(timings->error, sizeof(timings->error), "perf_event_open: %s", strerror(error));
+	else
+		ioctl(timings->group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+	timings->started_ns = now_ns();
+	timings->mark_ns = timings->started_ns;
+	read_counts(timings, timings->mark);
+	return (timings);
+}
+
+/**
+ * free_timings - Stops counting and releases the timings.
+ * @timings: The timings, or NULL.
+ */
+void free_timings(timings_t *timings)
+{
+	if (timings == NULL)
+		return;
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		if (timings->fds[i] != -1)
+			close(timings->fds[i]);
+	free(timings);
+}
+
+// Charges the time and events since the last phase change to the innermost phase.
+static void charge(timings_t *timings)
+{
+	uint64_t now = now_ns();
+	uint64_t counts[COUNTER_COUNT];
+	read_counts(timings, counts);
+	if (timings->depth > 0)
+	{
+		phase_stats_t *stats = &timings->phases[timings->stack[timings->depth - 1]];
+		stats->wall_ns += now - timings->mark_ns;
+		for (int i = 0; i < COUNTER_COUNT; i++)
+			stats->counts[i] += counts[i] > timings->mark[i] ? counts[i] - timings->mark[i] : 0;
+	}
+	timings->mark_ns = now;
+	memcpy(timings->mark, counts, sizeof(counts));
+}
+
+/**
+ * timings_begin - Enters a phase, nested inside whichever one is open.
+ * @timings: The timings.
+ * @phase: The phase.
+ */
+void timings_begin(timings_t *timings, phase_t phase)
+{
+	if (timings->depth == TIMINGS_DEPTH)
+	{
+		timings->overflow++;
+		return;
+	}
+	charge(timings);
+	timings->stack[timings->depth++] = phase;
+	timings->phases[phase].calls++;
+}
+
+/**
+ * timings_end - Leaves the innermost phase, going back to the one it was
+ * nested in.
+ * @timings: The timings.
+ */
+void timings_end(timings_t *timings)
+{
+	if (timings->overflow > 0)
+	{
+		timings->overflow--;
+		return;
+	}
+	if (timings->depth == 0)
+		return;
+	charge(timings);
+	timings->depth--;
+}
+
+/**
+ * timings_write_json - Writes the totals per phase as a JSON object.
+ * @timings: The timings.
+ * @out: Where to write them.
+ *
+ * Counters that could not be opened are null, and "counters" is false with
+ * the reason in "counters_error" when there are none at all.
+ */
+void timings_write_json(timings_t *timings, FILE *out)
+{
+	charge(timings);
+	fprintf(out, "{\n  \"wall_ns\": %" PRIu64 ",\n", timings->mark_ns - timings->started_ns);
+	if (timings->group == -1)
+		fprintf(out, "  \"counters\": false,\n  \"counters_error\": \"%s\",\n", timings->error);
+	else
+		fprintf(out, "  \"counters\": true,\n");
+
+	fprintf(out, "  \"phases\": {\n");
+	for (int phase = 0; phase < PHASE_COUNT; phase++)
+	{
+		const phase_stats_t *stats = &timings->phases[phase];
+		fprintf(out, "    \"%s\": {\"calls\": %" PRIu64 ", \"wall_ns\": %" PRIu64, phase_names[phase],
+			stats->calls, stats->wall_ns);
+		for (int i = 0; i < COUNTER_COUNT; i++)
+		{
+			if (timings->slots[i] >= 0)
+				fprintf(out, ", \"%s\": %" PRIu64, counter_names[i], stats->counts[i]);
+			else
+				fprintf(out, ", \"%s\": null", counter_names[i]);
+		}
+		fprintf(out, "}%s\n", phase + 1 < PHASE_COUNT ? "," : "");
+	}
+	fprintf(out, "  }\n}\n");
+}
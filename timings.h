@@ -0,0 +1,103 @@
+#pragma once
+#ifndef TIMINGS_H
+#define TIMINGS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "common.h"
+
+#define TIMINGS_DEPTH 16     // Most phases open at once; deeper ones go uncounted.
+#define TIMINGS_ERROR_MAX 128 // Longest explanation of missing counters.
+
+/**
+ * enum phase_s - What the interpreter is doing.
+ * @PHASE_READ: Reading a source file.
+ * @PHASE_SCAN: Scanning tokens, nested in @PHASE_COMPILE; while timed,
+ *              the compiler scans ahead in batches (see lookahead_t).
+ * @PHASE_COMPILE: Compiling, including function bodies compiled when first
+ *                 called.
+ * @PHASE_RUN: Running bytecode.
+ * @PHASE_GC: Collecting garbage.
+ */
+typedef enum phase_s
+{
+	PHASE_READ,
+	PHASE_SCAN,
+	PHASE_COMPILE,
+	PHASE_RUN,
+	PHASE_GC,
+	PHASE_COUNT
+} phase_t;
+
+/**
+ * enum counter_s - Hardware events counted per phase.
+ * @COUNTER_CYCLES: CPU cycles.
+ * @COUNTER_INSTRUCTIONS: Instructions retired.
+ * @COUNTER_CACHE_MISSES: Last-level cache misses.
+ * @COUNTER_BRANCH_MISSES: Mispredicted branches.
+ */
+typedef enum counter_s
+{
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_CACHE_MISSES,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_COUNT
+} counter_t;
+
+/**
+ * struct phase_stats_s - What one phase cost.
+ * @calls: Number of times the phase was entered.
+ * @wall_ns: Wall time spent in it, excluding the phases nested inside it.
+ * @counts: Events counted in it, likewise.
+ */
+typedef struct phase_stats_s
+{
+	uint64_t calls;
+	uint64_t wall_ns;
+	uint64_t counts[COUNTER_COUNT];
+} phase_stats_t;
+
+/**
+ * struct timings_s - Per-phase wall time and hardware counters.
+ * @group: The perf event group's leader, or -1 when counting is
+ *         unavailable.
+ * @fds: Each counter's descriptor, or -1 for a counter the machine lacks.
+ * @slots: Position of each counter in the group's reads, or -1.
+ * @error: Why counting is unavailable, or empty.
+ * @started_ns: When the timings were created.
+ * @mark_ns: Time of the last phase change.
+ * @mark: Counts at the last phase change.
+ * @stack: The phases open, innermost last.
+ * @depth: Number of entries in @stack.
+ * @overflow: Phases begun while @stack was full, and not yet ended.
+ * @phases: The totals per phase.
+ *
+ * Description: Time and events between two phase changes are charged to
+ * the innermost open phase only, so a collection during a run counts as
+ * collecting and not as running. Counters are read once per change, with
+ * a single read of the whole group, and cover the calling thread only;
+ * pool workers are not counted.
+ */
+typedef struct timings_s
+{
+	int group;
+	int fds[COUNTER_COUNT];
+	int slots[COUNTER_COUNT];
+	char error[TIMINGS_ERROR_MAX];
+	uint64_t started_ns;
+	uint64_t mark_ns;
+	uint64_t mark[COUNTER_COUNT];
+	phase_t stack[TIMINGS_DEPTH];
+	int depth;
+	int overflow;
+	phase_stats_t phases[PHASE_COUNT];
+} timings_t;
+
+timings_t *new_timings(void);
+void free_timings(timings_t *timings);
+void timings_begin(timings_t *timings, phase_t phase);
+void timings_end(timings_t *timings);
+void timings_write_json(timings_t *timings, FILE *out);
+
+#endif // TIMINGS_H
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include "trace.h"
+#include "debug.h"
+
+/**
+ * trace_reset - Discards every event in a trace ring.
+ * @ring: The ring to reset.
+ */
+void trace_reset(trace_ring_t *ring)
+{
+	ring->head = 0;
+}
+
+/**
+ * print_event_value - Prints the top-of-stack payload of a trace event.
+ * @event: The event to print.
+ * @out: The stream to print to.
+ */
+static void print_event_value(const trace_event_t *event, FILE *out)
+{
+	switch (event->tos_type)
+	{
+	case VAL_BOOLEAN:
+		fprintf(out, "%s", event->tos.boolean ? "true" : "false");
+		break;
+	case VAL_NULL:
+		fprintf(out, "null");
+		break;
+	case VAL_NUMBER:
+		fprintf(out, "%g", event->tos.number);
+		break;
+	case VAL_OBJ:
+		fprintf(out, "<object>");
+		break;
+	case VAL_SMALL_STRING:
+		fprintf(out, "%.*s", (int)strnlen(event->tos.small, SMALL_STRING_MAX), event->tos.small);
+		break;
+	case TRACE_EMPTY_STACK:
+		fprintf(out, "-");
+		break;
+	default:
+		fprintf(out, "<type %d>", event->tos_type);
+		break;
+	}
+}
+
+/**
+ * trace_dump - Prints the events held in a trace ring, oldest first.
+ * @ring: The ring to dump.
+ * @out: The stream to print to.
+ *
+ * Each event's line is resolved against the chunk it was recorded in,
+ * which must still be alive; the VM empties the ring at the start of each
+ * traced run, so it only ever holds events of the current one.
+ *
+ * This is the only place where trace events are formatted, so recording
+ * stays cheap and the cost of decoding is paid only when a trace is
+ * actually looked at.
+ */
+void trace_dump(const trace_ring_t *ring, FILE *out)
+{
+	uint64_t count = ring->head < TRACE_RING_SIZE ? ring->head : TRACE_RING_SIZE;
+	uint64_t first = ring->head - count;
+
+	fprintf(out, "== trace (last %llu of %llu instructions) ==\n",
+		(unsigned long long)count, (unsigned long long)ring->head);
+	for (uint64_t i = first; i < ring->head; i++)
+	{
+		const trace_event_t *event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+		int line = get_line(event->chunk, event->offset);
+
+		fprintf(out, "%8llu %04u %4d %-16s depth %-5u top ",
+			(unsigned long long)i, event->offset, line,
+			opcode_name(event->opcode), event->depth);
+		print_event_value(event, out);
+		fprintf(out, "\n");
+	}
+}
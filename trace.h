@@ -0,0 +1,87 @@
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+#include "chunk.h"
+
+#define TRACE_RING_SIZE 4096 // Must be a power of two.
+
+/**
+ * struct trace_event_s - One executed instruction, as recorded by the tracer.
+ * @chunk: The chunk the instruction belongs to.
+ * @offset: Offset of the instruction in @chunk's code array.
+ * @opcode: The instruction's opcode.
+ * @tos_type: Type of the value on top of the stack before execution.
+ * @depth: Stack depth before execution (saturated at UINT16_MAX).
+ * @tos: Raw payload of the value on top of the stack.
+ *
+ * Description: Events are 24 bytes so that recording one is a few stores
+ * into a cache-resident ring, with no formatting on the hot path.
+ */
+typedef struct trace_event_s
+{
+	const chunk_t *chunk;
+	uint32_t offset;
+	uint8_t opcode;
+	uint8_t tos_type;
+	uint16_t depth;
+	union
+	{
+		bool boolean;
+		double number;
+		char small[SMALL_STRING_MAX];
+		uint64_t bits;
+	} tos;
+} trace_event_t;
+
+/**
+ * struct trace_ring_s - Fixed-size ring of the most recent trace events.
+ * @events: The event storage.
+ * @head: Total number of events recorded so far.
+ */
+typedef struct trace_ring_s
+{
+	trace_event_t events[TRACE_RING_SIZE];
+	uint64_t head;
+} trace_ring_t;
+
+#define TRACE_EMPTY_STACK 0xff
+
+void trace_reset(trace_ring_t *ring);
+void trace_dump(const trace_ring_t *ring, FILE *out);
+
+/**
+ * trace_record - Appends an event to the ring, overwriting the oldest one.
+ * @ring: The ring to record into.
+ * @chunk: The chunk running.
+ * @offset: Offset of the instruction about to execute.
+ * @opcode: Its opcode.
+ * @stack: Bottom of the value stack.
+ * @stack_top: One past the top of the value stack.
+ */
+static inline void trace_record(trace_ring_t *ring, const chunk_t *chunk, uint32_t offset, uint8_t opcode,
+				value_t *stack, value_t *stack_top)
+{
+	trace_event_t *event = &ring->events[ring->head++ & (TRACE_RING_SIZE - 1)];
+	ptrdiff_t depth = stack_top - stack;
+
+	event->chunk = chunk;
+	event->offset = offset;
+	event->opcode = opcode;
+	event->depth = depth > UINT16_MAX ? UINT16_MAX : (uint16_t)depth;
+	if (depth > 0)
+	{
+		event->tos_type = (uint8_t)stack_top[-1].type;
+		memcpy(&event->tos, &stack_top[-1].as, sizeof(event->tos));
+	}
+	else
+	{
+		event->tos_type = TRACE_EMPTY_STACK;
+		event->tos.bits = 0;
+	}
+}
+
+#endif // TRACE_H
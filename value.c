@@ -1,5 +1,8 @@
+#include "format.h"
 #include "memory.h"
+#include "object.h"
 #include "value.h"
+#include "vm.h"
 
 void init_value_array(value_array_t *array)
 {
@@ -32,13 +35,23 @@ void print_value(value_t value)
 	switch (value.type)
 	{
 	case VAL_BOOLEAN:
-		printf(as_bool(value) ? "true" : "false");
+		fputs(as_bool(value) ? "true" : "false", stdout);
 		break;
 	case VAL_NULL:
-		printf("null");
+		fputs("null", stdout);
 		break;
 	case VAL_NUMBER:
-		printf("%g", as_number(value));
+	{
+		char text[NUMBER_BUFFER_SIZE];
+		int length = format_number(as_number(value), vm.number_format, text);
+		fwrite(text, 1, length, stdout);
+		break;
+	}
+	case VAL_OBJ:
+		print_object(value);
+		break;
+	case VAL_SMALL_STRING:
+		fwrite(string_chars(&value), 1, string_length(&value), stdout);
 		break;
 	}
 }
\ No newline at end of file
@@ -1,287 +1,2013 @@
 #include <stdarg.h>
+#include <stdatomic.h>
+#include "array.h"
+#include "class.h"
+#include "map.h"
+#include "mapped.h"
 #include "compiler.h"
 #include "common.h"
+#include "error.h"
+#include "intrinsic.h"
+#include "memory.h"
+#include "module.h"
+#include "parallel.h"
 #include "vm.h"
 
-vm_t vm;
+_Thread_local vm_t vm;
 
-void init_vm(void) { reset_stack(); }
+void init_vm(void)
+{
+	reset_stack();
+	vm.result = null_val();
+	init_heap();
+	init_string_table(&vm.strings);
+	init_value_array(&vm.globals);
+	vm.global_info = NULL;
+	vm.global_info_capacity = 0;
+	vm.eager = false;
+	vm.number_format = NUMBER_FORMAT_G;
+	vm.base_frames = 1;
+	vm.bail = NULL;
+}
+
+void free_vm(void)
+{
+	free_parallel();
+	free_context();
+}
+
+/**
+ * free_context - Releases the calling thread's context, made by init_vm().
+ *
+ * Unlike free_vm(), the pool of parallel builtins is left running, so a
+ * thread that made a context of its own for a while (see module.c) can
+ * release it while the thread that owns the pool goes on.
+ */
+void free_context(void)
+{
+	free_modules();
+	free_heap();
+	free_string_table(&vm.strings);
+	free_value_array(&vm.globals);
+	free_array(vm.global_info);
+	vm.global_info = NULL;
+	vm.global_info_capacity = 0;
+	free(vm.stack);
+	vm.stack = NULL;
+	vm.stack_top = NULL;
+	vm.stack_capacity = 0;
+	vm.ip = NULL;
+	vm.chunk = NULL;
+	vm.slots = NULL;
+	free(vm.frames);
+	vm.frames = NULL;
+	vm.frame_capacity = 0;
+	vm.frame_count = 0;
+	free(vm.trace_ring);
+	vm.trace_ring = NULL;
+	vm.trace = false;
+}
+
+/**
+ * init_worker - Sets up the context of a pool thread.
+ *
+ * A worker has a stack and frames of its own, with a placeholder frame
+ * below the function it calls, but no heap: it borrows the globals and
+ * strings of the thread that hands it work, and gives up rather than
+ * allocate.
+ */
+void init_worker(void)
+{
+	reset_stack();
+	vm.frames[0] = (call_frame_t){NULL, NULL, NULL, 0};
+	vm.frame_count = 1;
+	vm.base_frames = 2;
+	vm.bail = NULL;
+}
+
+// Releases the stack and frames of a pool thread's context.
+void free_worker(void)
+{
+	free(vm.stack);
+	vm.stack = NULL;
+	vm.stack_top = NULL;
+	vm.stack_capacity = 0;
+	free(vm.frames);
+	vm.frames = NULL;
+	vm.frame_capacity = 0;
+}
+
+// Leaves the callback a pool worker is running; see array_task().
+void abandon_worker(void)
+{
+	longjmp(*vm.bail, 1);
+}
+
+/**
+ * set_trace - Switches execution tracing on or off.
+ * @enabled: Whether subsequent runs should record trace events.
+ *
+ * Tracing selects a separately compiled instance of the dispatch loop, so
+ * leaving it off costs nothing. Switching it on (re)starts an empty ring.
+ */
+void set_trace(bool enabled)
+{
+	if (enabled && vm.trace_ring == NULL)
+	{
+		vm.trace_ring = malloc(sizeof(trace_ring_t));
+		if (vm.trace_ring == NULL)
+		{
+			fprintf(stderr, "Error: Failed to allocate trace ring\n");
+			exit(INTERPRET_RUNTIME_ERROR);
+		}
+	}
+	if (enabled)
+		trace_reset(vm.trace_ring);
+	vm.trace = enabled;
+}
+
+/**
+ * dump_trace - Prints the most recent trace events.
+ * @out: The stream to print to.
+ */
+void dump_trace(FILE *out)
+{
+	if (vm.trace_ring != NULL)
+		trace_dump(vm.trace_ring, out);
+}
+
+/**
+ * request_trace_dump - Asks the traced dispatch loop to dump its ring.
+ *
+ * Only sets a flag, so it is safe to call from a signal handler; the dump
+ * happens at the next instruction boundary.
+ */
+void request_trace_dump(void)
+{
+	vm.trace_dump_requested = 1;
+}
+
+/**
+ * set_profile - Attaches a profile to subsequent runs.
+ * @profile: The profile to record into, or NULL to stop profiling.
+ *
+ * Counting profiles select their own instance of the dispatch loop;
+ * sampling profiles run the plain loop and are fed from SIGPROF.
+ */
+void set_profile(profile_t *profile)
+{
+	vm.profile = profile;
+}
+
+/**
+ * set_timings - Attaches per-phase timings to subsequent work.
+ * @timings: The timings to record into, or NULL to stop timing.
+ *
+ * Only the calling thread's phases are timed; pool workers have timings
+ * of their own, which are always NULL.
+ */
+void set_timings(timings_t *timings)
+{
+	vm.timings = timings;
+}
+
+/**
+ * interpret - Compiles and runs source code, printing its result if any.
+ * @source: The source code; it imports modules relative to the working
+ *          directory.
+ *
+ * This is the REPL and script entry point; embedders compile once with
+ * compile() and run the chunk with interpret_chunk() instead.
+ *
+ * Return: The result of the interpretation.
+ */
+interpret_result_t interpret(const char *source)
+{
+	return interpret_file(source, NULL);
+}
+
+/**
+ * interpret_file - Runs the modules a source imports, then compiles and
+ * runs it, printing its result if any.
+ * @source: The source code.
+ * @path: The file it came from, which it imports modules relative to, or
+ *        NULL for the working directory.
+ *
+ * Return: The result of the interpretation.
+ */
+interpret_result_t interpret_file(const char *source, const char *path)
+{
+	interpret_result_t result = load_imports(source, path);
+	if (result != INTERPRET_OK)
+		return result;
+
+	chunk_t chunk;
+	init_chunk(&chunk);
+
+	if (!compile(source, &chunk))
+	{
+		free_chunk(&chunk);
+		return INTERPRET_COMPILE_ERROR;
+	}
+
+	result = interpret_chunk(&chunk);
+	if (result == INTERPRET_OK && !is_null(vm.result))
+	{
+		print_value(vm.result);
+		putchar('\n');
+	}
+	free_chunk(&chunk);
+	return result;
+}
+
+/**
+ * interpret_chunk - Runs an already compiled chunk.
+ * @chunk: The chunk to run; it is not modified or freed.
+ *
+ * The value the chunk returns is left in vm.result. Runtime errors are
+ * reported through report_error() and leave the VM ready for another run.
+ *
+ * Return: The result of the interpretation.
+ */
+interpret_result_t interpret_chunk(chunk_t *chunk)
+{
+	clear_error();
+	vm.result = null_val();
+	vm.chunk = chunk;
+	vm.ip = vm.chunk->code;
+	vm.stack_top = vm.stack;
+	vm.slots = vm.stack;
+	vm.frames[0] = (call_frame_t){NULL, chunk, NULL, 0};
+	vm.frame_count = 1;
+	vm.base_frames = 1;
+
+	if (vm.timings != NULL)
+		timings_begin(vm.timings, PHASE_RUN);
+	if (vm.trace)
+		trace_reset(vm.trace_ring); // Chunks of earlier runs may be gone.
+	if (vm.profile != NULL)
+		profile_begin(vm.profile, &vm);
+	interpret_result_t result = run();
+	if (vm.profile != NULL)
+		profile_end(vm.profile);
+	if (vm.timings != NULL)
+		timings_end(vm.timings);
+	return result;
+}
+
+static value_t peek(int distance) { return vm.stack_top[-1 - distance]; }
+
+#define TRACE_FRAMES_MAX 8 // Innermost calls listed in a runtime error.
+
+/**
+ * runtime_error - Reports a runtime error at the current instruction.
+ * @format: printf-style format of the message.
+ *
+ * The message is followed by the line of each call in progress, innermost
+ * first. The stack and frames are emptied so the VM can run again; the
+ * caller unwinds by returning the result of this function from its
+ * handler. A pool worker reports nothing and gives up instead.
+ *
+ * Return: INTERPRET_RUNTIME_ERROR.
+ */
+static interpret_result_t runtime_error(const char *format, ...)
+{
+	if (vm.bail != NULL)
+		abandon_worker();
+	char message[ERROR_MESSAGE_MAX];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+
+	vm.frames[vm.frame_count - 1].ip = vm.ip;
+	for (int i = vm.frame_count - 1; i >= 0 && length < (int)sizeof(message); i--)
+	{
+		const call_frame_t *frame = &vm.frames[i];
+		int line = get_line(frame->chunk, (int)(frame->ip - frame->chunk->code - 1));
+		if (i < vm.frame_count - TRACE_FRAMES_MAX && i > 0)
+		{
+			length += snprintf(message + length, sizeof(message) - length, "\n[%d more calls]", i);
+			i = 1;
+		}
+		else if (frame->function == NULL)
+			length += snprintf(message + length, sizeof(message) - length, "\n[line %d] in script", line);
+		else
+			length += snprintf(message + length, sizeof(message) - length, "\n[line %d] in %.*s()", line,
+					   string_length(&frame->function->name),
+					   string_chars(&frame->function->name));
+	}
+	report_error("%s", message);
+	if (vm.trace)
+		dump_trace(stderr);
+	vm.stack_top = vm.stack;
+	vm.slots = vm.stack;
+	vm.frame_count = 1;
+	return INTERPRET_RUNTIME_ERROR;
+}
+
+static bool is_falsey(value_t value)
+{
+	return (is_null(value) || (is_bool(value) && !as_bool(value)));
+}
+
+static interpret_result_t handle_OP_CONSTANT(void)
+{
+	push(vm.chunk->constants.values[*vm.ip++]);
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_INPUT(void)
+{
+	uint8_t index = *vm.ip++;
+	if (index >= vm.input_count)
+		return runtime_error("Input %d is not bound.", index);
+	push(vm.inputs[index]);
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_POP(void)
+{
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_POPN(void)
+{
+	vm.stack_top -= *vm.ip++;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_GET_LOCAL(void)
+{
+	push(vm.slots[*vm.ip++]);
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_SET_LOCAL(void)
+{
+	vm.slots[*vm.ip++] = peek(0);
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_GET_GLOBAL(void)
+{
+	push(vm.globals.values[*vm.ip++]);
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_SET_GLOBAL(void)
+{
+	vm.globals.values[*vm.ip++] = peek(0);
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_DEFINE_GLOBAL(void)
+{
+	vm.globals.values[*vm.ip++] = pop();
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_NULL(void)
+{
+	push(null_val());
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_TRUE(void)
+{
+	push(bool_val(true));
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_FALSE(void)
+{
+	push(bool_val(false));
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_NOT(void)
+{
+	value_t value = pop();
+	push(bool_val(is_falsey(value)));
+	return INTERPRET_OK;
+}
+
+/**
+ * values_equal - Compares two values as OP_EQUAL does.
+ * @a: Left operand.
+ * @b: Right operand.
+ *
+ * Booleans compare as the numbers 0 and 1; values of different types are
+ * never equal.
+ *
+ * Return: Whether the values are equal.
+ */
+static bool values_equal(value_t a, value_t b)
+{
+	if (is_bool(a))
+		a = number_val(as_bool(a) ? 1 : 0);
+	if (is_bool(b))
+		b = number_val(as_bool(b) ? 1 : 0);
+	if (a.type != b.type)
+		return false;
+
+	switch (a.type)
+	{
+	case VAL_NULL:
+		return true;
+	case VAL_NUMBER:
+		return as_number(a) == as_number(b);
+	case VAL_OBJ:
+		// Heap strings are interned, so identity is equality.
+		return as_obj(a) == as_obj(b);
+	case VAL_SMALL_STRING:
+		return memcmp(a.as.small, b.as.small, SMALL_STRING_MAX) == 0;
+	default:
+		return false;
+	}
+}
+
+/**
+ * order_operands - Checks the operands of an ordering comparison.
+ * @a: Left operand; a boolean is converted to a number in place.
+ * @b: Right operand; likewise.
+ *
+ * Return: INTERPRET_OK if both operands are now numbers, otherwise the
+ * result of reporting a runtime error.
+ */
+static interpret_result_t order_operands(value_t *a, value_t *b)
+{
+	if (is_bool(*a))
+		*a = number_val(as_bool(*a) ? 1 : 0);
+	if (is_bool(*b))
+		*b = number_val(as_bool(*b) ? 1 : 0);
+	if (a->type != b->type)
+		return runtime_error("Operands must be of the same type.");
+	if (!is_number(*a))
+		return runtime_error("Operands must be numbers.");
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_EQUAL(void) {
+    value_t b = pop();
+    value_t a = pop();
+    push(bool_val(values_equal(a, b)));
+    return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_GREATER(void) {
+    value_t b = pop();
+    value_t a = pop();
+
+    interpret_result_t status = order_operands(&a, &b);
+    if (status != INTERPRET_OK)
+        return status;
+
+    push(bool_val(as_number(a) > as_number(b)));
+    return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_LESS(void) {
+    value_t b = pop();
+    value_t a = pop();
+
+    interpret_result_t status = order_operands(&a, &b);
+    if (status != INTERPRET_OK)
+        return status;
+
+    push(bool_val(as_number(a) < as_number(b)));
+    return INTERPRET_OK;
+}
+
+// Whether a value is an array or a mapped array, which read alike.
+static bool is_sequence(value_t value) { return (is_array(value) || is_mapped(value)); }
+
+// Returns the length of an array or a mapped array.
+static inline int element_count(value_t sequence)
+{
+	if (as_obj(sequence)->type == OBJ_ARRAY)
+		return (as_array(sequence)->count);
+	return (as_mapped(sequence)->count);
+}
+
+// Reads an element of an array or a mapped array.
+static inline value_t element_at(value_t sequence, int index)
+{
+	if (as_obj(sequence)->type == OBJ_ARRAY)
+		return (array_get(as_array(sequence), index));
+	return (number_val(mapped_get(as_mapped(sequence), index)));
+}
+
+/**
+ * numbers_at - Reads a run of elements of a packed or mapped array.
+ * @sequence: The array.
+ * @start: The first element.
+ * @count: Number of elements, at most MAPPED_BLOCK.
+ * @scratch: Room for MAPPED_BLOCK doubles.
+ *
+ * Return: The elements as doubles, in place unless they had to be
+ * converted into @scratch.
+ */
+static const double *numbers_at(value_t sequence, int start, int count, double *scratch)
+{
+	if (as_obj(sequence)->type == OBJ_ARRAY)
+		return (array_numbers(as_array(sequence)) + start);
+	return (mapped_numbers(as_mapped(sequence), start, count, scratch));
+}
+
+/**
+ * array_arithmetic - Applies an arithmetic operator element-wise.
+ * @op: The operator.
+ *
+ * The operands are the top two stack slots: two arrays of the same length,
+ * or an array and a number that is combined with every element. Arrays of
+ * numbers are packed first, so the work is done by the SIMD kernels, a
+ * block at a time so that mapped arrays only convert a block at once.
+ *
+ * Return: INTERPRET_OK, or a runtime error for unsuitable operands.
+ */
+static interpret_result_t array_arithmetic(array_op_t op)
+{
+	for (int i = 1; i <= 2; i++)
+	{
+		value_t *operand = vm.stack_top - i;
+		if (is_array(*operand) ? !array_pack(operand) : !is_number(*operand) && !is_mapped(*operand))
+			return runtime_error("Operands must be numbers or arrays of numbers.");
+	}
+	int a_count = is_sequence(peek(1)) ? element_count(peek(1)) : -1;
+	int b_count = is_sequence(peek(0)) ? element_count(peek(0)) : -1;
+	if (a_count != -1 && b_count != -1 && a_count != b_count)
+		return runtime_error("Array lengths differ (%d and %d).", a_count, b_count);
+
+	int count = a_count != -1 ? a_count : b_count;
+	if (count > ARRAY_MAX)
+		return runtime_error("Array too large.");
+	value_t result = new_array(count, true);
+	value_t a = peek(1), b = peek(0);
+	double *dst = array_numbers(as_array(result));
+	double a_scratch[MAPPED_BLOCK], b_scratch[MAPPED_BLOCK];
+	for (int start = 0; start < count; start += MAPPED_BLOCK)
+	{
+		int n = count - start < MAPPED_BLOCK ? count - start : MAPPED_BLOCK;
+		if (a_count != -1 && b_count != -1)
+			combine_numbers(op, dst + start, numbers_at(a, start, n, a_scratch),
+					numbers_at(b, start, n, b_scratch), n);
+		else if (a_count != -1)
+			combine_scalar(op, dst + start, numbers_at(a, start, n, a_scratch), as_number(b), false, n);
+		else
+			combine_scalar(op, dst + start, numbers_at(b, start, n, b_scratch), as_number(a), true, n);
+	}
+	vm.stack_top -= 2;
+	push(result);
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_NEGATE(void)
+{
+	if (!is_number(peek(0)))
+		return runtime_error("Operand must be a number.");
+	(vm.stack_top - 1)->as.number = -(vm.stack_top - 1)->as.number;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_ADD(void)
+{
+	if (is_number(peek(0)) && is_number(peek(1)))
+	{
+		(vm.stack_top - 2)->as.number += (vm.stack_top - 1)->as.number;
+		vm.stack_top--;
+		return INTERPRET_OK;
+	}
+	if (is_string(peek(0)) && is_string(peek(1)))
+	{
+		value_t result = concatenate_strings(vm.stack_top - 2, vm.stack_top - 1);
+		vm.stack_top -= 2;
+		push(result);
+		return INTERPRET_OK;
+	}
+	if (is_sequence(peek(0)) || is_sequence(peek(1)))
+		return array_arithmetic(ARRAY_ADD);
+	return runtime_error("Operands must be two numbers or two strings.");
+}
+
+static interpret_result_t handle_OP_SUBTRACT(void)
+{
+	if (!is_number(peek(0)) || !is_number(peek(1)))
+	{
+		if (is_sequence(peek(0)) || is_sequence(peek(1)))
+			return array_arithmetic(ARRAY_SUBTRACT);
+		return runtime_error("Operands must be numbers.");
+	}
+
+	(vm.stack_top - 2)->as.number -= (vm.stack_top - 1)->as.number;
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_MULTIPLY(void)
+{
+	if (!is_number(peek(0)) || !is_number(peek(1)))
+	{
+		if (is_sequence(peek(0)) || is_sequence(peek(1)))
+			return array_arithmetic(ARRAY_MULTIPLY);
+		return runtime_error("Operands must be numbers.");
+	}
+
+	(vm.stack_top - 2)->as.number *= (vm.stack_top - 1)->as.number;
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_DIVIDE(void)
+{
+	if (!is_number(peek(0)) || !is_number(peek(1)))
+	{
+		if (is_sequence(peek(0)) || is_sequence(peek(1)))
+			return array_arithmetic(ARRAY_DIVIDE);
+		return runtime_error("Operands must be numbers.");
+	}
+
+	(vm.stack_top - 2)->as.number /= (vm.stack_top - 1)->as.number;
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_ARRAY(void)
+{
+	int count = *vm.ip++;
+	bool packed = true;
+	for (int i = 1; i <= count; i++)
+		packed = packed && is_number(peek(i - 1));
+
+	value_t array = new_array(count, packed);
+	value_t *elements = vm.stack_top - count;
+	for (int i = 0; i < count; i++)
+		array_set(&array, i, &elements[i]);
+	vm.stack_top -= count;
+	push(array);
+	return INTERPRET_OK;
+}
+
+// Checks that a value can key a map.
+static interpret_result_t map_key(value_t key)
+{
+	if (is_map_key(key))
+		return INTERPRET_OK;
+	if (is_number(key))
+		return runtime_error("Map key can't be NaN.");
+	return runtime_error("Map keys must be numbers, strings, booleans or null.");
+}
+
+static interpret_result_t handle_OP_MAP(void)
+{
+	int count = *vm.ip++;
+	for (int i = 0; i < count; i++)
+	{
+		interpret_result_t status = map_key(peek(2 * i + 1));
+		if (status != INTERPRET_OK)
+			return status;
+	}
+
+	push(new_map());
+	value_t *entries = vm.stack_top - 1 - 2 * count;
+	for (int i = 0; i < count; i++)
+		map_set(vm.stack_top - 1, &entries[2 * i], &entries[2 * i + 1]);
+	value_t map = pop();
+	vm.stack_top -= 2 * count;
+	push(map);
+	return INTERPRET_OK;
+}
+
+/**
+ * array_index - Checks an indexing operation.
+ * @target: The value being indexed.
+ * @index: The index.
+ * @result: Where to store the index as an integer.
+ *
+ * Return: INTERPRET_OK, or a runtime error unless @target is an array or
+ * a mapped array and @index a whole number within its bounds.
+ */
+static interpret_result_t array_index(value_t target, value_t index, int *result)
+{
+	if (!is_array(target) && !is_mapped(target))
+		return runtime_error("Only arrays and maps can be indexed.");
+	if (!is_number(index))
+		return runtime_error("Array index must be a number.");
+
+	double number = as_number(index);
+	int count = element_count(target);
+	if (!(number >= 0 && number < count))
+		return runtime_error("Array index %g out of bounds for length %d.", number, count);
+	if (number != (int)number)
+		return runtime_error("Array index must be a whole number.");
+	*result = (int)number;
+	return INTERPRET_OK;
+}
+
+// Body of OP_GET_INDEX on a map: a missing key reads as null.
+static interpret_result_t get_map_entry(void)
+{
+	interpret_result_t status = map_key(peek(0));
+	if (status != INTERPRET_OK)
+		return status;
+	if (!map_get(as_map(peek(1)), peek(0), &vm.stack_top[-2]))
+		vm.stack_top[-2] = null_val();
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+// Body of OP_SET_INDEX on a map.
+static interpret_result_t set_map_entry(void)
+{
+	interpret_result_t status = map_key(peek(1));
+	if (status != INTERPRET_OK)
+		return status;
+	if (!map_set(vm.stack_top - 3, vm.stack_top - 2, vm.stack_top - 1))
+		return runtime_error("Map too large.");
+	vm.stack_top[-3] = vm.stack_top[-1];
+	vm.stack_top -= 2;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_GET_INDEX(void)
+{
+	if (is_map(peek(1)))
+		return get_map_entry();
+	int index;
+	interpret_result_t status = array_index(peek(1), peek(0), &index);
+	if (status != INTERPRET_OK)
+		return status;
+	vm.stack_top[-2] = element_at(peek(1), index);
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_SET_INDEX(void)
+{
+	if (is_map(peek(2)))
+		return set_map_entry();
+	if (is_mapped(peek(2)))
+		return runtime_error("Mapped arrays are read-only.");
+	int index;
+	interpret_result_t status = array_index(peek(2), peek(1), &index);
+	if (status != INTERPRET_OK)
+		return status;
+	array_set(vm.stack_top - 3, index, vm.stack_top - 1);
+	vm.stack_top[-3] = vm.stack_top[-1];
+	vm.stack_top -= 2;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_LEN(void)
+{
+	value_t value = peek(0);
+	if (is_array(value))
+		vm.stack_top[-1] = number_val(as_array(value)->count);
+	else if (is_mapped(value))
+		vm.stack_top[-1] = number_val(as_mapped(value)->count);
+	else if (is_map(value))
+		vm.stack_top[-1] = number_val(as_map(value)->count);
+	else if (is_string(value))
+		vm.stack_top[-1] = number_val(string_length(&value));
+	else
+		return runtime_error("len() needs an array, a map or a string.");
+	return INTERPRET_OK;
+}
+
+/**
+ * numeric_array - Checks that a stack slot holds an array of numbers.
+ * @slot: The slot; an array is packed in place, and a mapped array is one.
+ * @name: The builtin being applied, for the error message.
+ *
+ * Return: INTERPRET_OK, or a runtime error.
+ */
+static interpret_result_t numeric_array(value_t *slot, const char *name)
+{
+	if (!is_mapped(*slot) && (!is_array(*slot) || !array_pack(slot)))
+		return runtime_error("%s() needs an array of numbers.", name);
+	return INTERPRET_OK;
+}
+
+/**
+ * reduce_numbers - Applies a reduction kernel to a packed or mapped array.
+ * @source: The array.
+ * @kernel: sum_numbers(), min_numbers() or max_numbers().
+ *
+ * A packed array is reduced in one go. A mapped array is reduced a block
+ * at a time, each block's result being combined with the running one by
+ * the kernel too.
+ *
+ * Return: The result.
+ */
+static double reduce_numbers(value_t source, double (*kernel)(const double *, int))
+{
+	int count = element_count(source);
+	if (is_array(source))
+		return (kernel(array_numbers(as_array(source)), count));
+
+	double scratch[MAPPED_BLOCK], pair[2] = {0, 0};
+	for (int start = 0; start < count; start += MAPPED_BLOCK)
+	{
+		int n = count - start < MAPPED_BLOCK ? count - start : MAPPED_BLOCK;
+		pair[1] = kernel(numbers_at(source, start, n, scratch), n);
+		pair[0] = start == 0 ? pair[1] : kernel(pair, 2);
+	}
+	return (pair[0]);
+}
+
+static interpret_result_t handle_OP_SUM(void)
+{
+	interpret_result_t status = numeric_array(vm.stack_top - 1, "sum");
+	if (status != INTERPRET_OK)
+		return status;
+	vm.stack_top[-1] = number_val(reduce_numbers(peek(0), sum_numbers));
+	return INTERPRET_OK;
+}
+
+// Body of the min() and max() reductions.
+static interpret_result_t array_extreme(const char *name, double (*reduce)(const double *, int))
+{
+	interpret_result_t status = numeric_array(vm.stack_top - 1, name);
+	if (status != INTERPRET_OK)
+		return status;
+	if (element_count(peek(0)) == 0)
+		return runtime_error("%s() of an empty array.", name);
+	vm.stack_top[-1] = number_val(reduce_numbers(peek(0), reduce));
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_ARRAY_MIN(void) { return array_extreme("min", min_numbers); }
+
+static interpret_result_t handle_OP_ARRAY_MAX(void) { return array_extreme("max", max_numbers); }
+
+static interpret_result_t handle_OP_DOT(void)
+{
+	interpret_result_t status = numeric_array(vm.stack_top - 2, "dot");
+	if (status == INTERPRET_OK)
+		status = numeric_array(vm.stack_top - 1, "dot");
+	if (status != INTERPRET_OK)
+		return status;
+
+	value_t a = peek(1), b = peek(0);
+	int count = element_count(a);
+	if (count != element_count(b))
+		return runtime_error("Array lengths differ (%d and %d).", count, element_count(b));
+	double dot = 0;
+	if (is_array(a) && is_array(b))
+	{
+		dot = dot_numbers(array_numbers(as_array(a)), array_numbers(as_array(b)), count);
+	}
+	else
+	{
+		double a_scratch[MAPPED_BLOCK], b_scratch[MAPPED_BLOCK];
+		for (int start = 0; start < count; start += MAPPED_BLOCK)
+		{
+			int n = count - start < MAPPED_BLOCK ? count - start : MAPPED_BLOCK;
+			dot += dot_numbers(numbers_at(a, start, n, a_scratch), numbers_at(b, start, n, b_scratch), n);
+		}
+	}
+	vm.stack_top[-2] = number_val(dot);
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_PUSH(void)
+{
+	if (!is_array(peek(1)))
+		return runtime_error("push() needs an array.");
+	if (as_array(peek(1))->count == ARRAY_MAX)
+		return runtime_error("Array too large.");
+	array_push(vm.stack_top - 2, vm.stack_top - 1);
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+// Checks the length argument of range() and fill().
+static interpret_result_t array_length(value_t value, const char *name, int *length)
+{
+	if (!is_number(value) || !(as_number(value) >= 0) || as_number(value) != (int)as_number(value))
+		return runtime_error("%s() needs a whole, non-negative length.", name);
+	if (as_number(value) > ARRAY_MAX)
+		return runtime_error("Array too large.");
+	*length = (int)as_number(value);
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_RANGE(void)
+{
+	int count;
+	interpret_result_t status = array_length(peek(0), "range", &count);
+	if (status != INTERPRET_OK)
+		return status;
+
+	value_t array = new_array(count, true);
+	double *numbers = array_numbers(as_array(array));
+	for (int i = 0; i < count; i++)
+		numbers[i] = i;
+	vm.stack_top[-1] = array;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_FILL(void)
+{
+	int count;
+	interpret_result_t status = array_length(peek(1), "fill", &count);
+	if (status != INTERPRET_OK)
+		return status;
+
+	bool packed = is_number(peek(0));
+	value_t array = new_array(count, packed);
+	value_t *value = vm.stack_top - 1;
+	for (int i = 0; i < count; i++)
+		array_set(&array, i, value);
+	vm.stack_top[-2] = array;
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
 
-void free_vm(void)
+// Checks the map and key arguments of has() and delete().
+static interpret_result_t map_lookup(const char *name)
 {
-	free(vm.stack);
-	vm.stack = NULL;
-	vm.stack_top = NULL;
-	vm.stack_capacity = 0;
-	vm.ip = NULL;
-	vm.chunk = NULL;
+	if (!is_map(peek(1)))
+		return runtime_error("%s() needs a map.", name);
+	return map_key(peek(0));
 }
 
-interpret_result_t interpret(const char *source)
+static interpret_result_t handle_OP_MAP_HAS(void)
 {
-	chunk_t chunk;
-	init_chunk(&chunk);
+	interpret_result_t status = map_lookup("has");
+	if (status != INTERPRET_OK)
+		return status;
+	value_t value;
+	vm.stack_top[-2] = bool_val(map_get(as_map(peek(1)), peek(0), &value));
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
 
-	if (!compile(source, &chunk))
-	{
-		free_chunk(&chunk);
-		return INTERPRET_COMPILE_ERROR;
-	}
+static interpret_result_t handle_OP_MAP_DELETE(void)
+{
+	interpret_result_t status = map_lookup("delete");
+	if (status != INTERPRET_OK)
+		return status;
+	vm.stack_top[-2] = bool_val(map_delete(as_map(peek(1)), peek(0)));
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
 
-	vm.chunk = &chunk;
-	vm.ip = vm.chunk->code;
+static interpret_result_t handle_OP_MAP_KEYS(void)
+{
+	if (!is_map(peek(0)))
+		return runtime_error("keys() needs a map.");
+	obj_map_t *map = as_map(peek(0));
+	bool packed = true;
+	for (int i = 0; i < map->capacity; i++)
+		packed = packed && (map_control(map)[i] < 0 || is_number(map_entries(map)[i].key));
 
-	interpret_result_t result = run();
-	free_chunk(&chunk);
-	return result;
+	value_t array = new_array(map->count, packed);
+	map = as_map(peek(0));
+	for (int i = 0, count = 0; i < map->capacity; i++)
+		if (map_control(map)[i] >= 0)
+			array_set(&array, count++, &map_entries(map)[i].key);
+	vm.stack_top[-1] = array;
+	return INTERPRET_OK;
 }
 
-static value_t peek(int distance) { return vm.stack_top[-1 - distance]; }
+// Body of the unary math intrinsics, which work on the stack top in place.
+static inline __attribute__((always_inline)) interpret_result_t unary_intrinsic(uint8_t opcode)
+{
+	if (!is_number(peek(0)))
+		return runtime_error("Operand must be a number.");
+	vm.stack_top[-1].as.number = apply_intrinsic(opcode, vm.stack_top[-1].as.number, 0);
+	return INTERPRET_OK;
+}
 
-static void runtime_error(const char *format, ...)
+// Body of the binary math intrinsics.
+static inline __attribute__((always_inline)) interpret_result_t binary_intrinsic(uint8_t opcode)
 {
-	va_list args;
-	va_start(args, format);
-	vfprintf(stderr, format, args);
-	va_end(args);
-	fputs("\n", stderr);
+	if (!is_number(peek(0)) || !is_number(peek(1)))
+		return runtime_error("Operands must be numbers.");
+	vm.stack_top[-2].as.number = apply_intrinsic(opcode, vm.stack_top[-2].as.number, vm.stack_top[-1].as.number);
+	vm.stack_top--;
+	return INTERPRET_OK;
+}
 
-	size_t instruction = vm.ip - vm.chunk->code - 1;
-	int line = vm.chunk->lines[instruction];
-	fprintf(stderr, "[line %d] in script\n", line);
-	reset_stack();
+static interpret_result_t handle_OP_SQRT(void) { return unary_intrinsic(OP_SQRT); }
+
+static interpret_result_t handle_OP_ABS(void) { return unary_intrinsic(OP_ABS); }
+
+static interpret_result_t handle_OP_FLOOR(void) { return unary_intrinsic(OP_FLOOR); }
+
+static interpret_result_t handle_OP_CEIL(void) { return unary_intrinsic(OP_CEIL); }
+
+static interpret_result_t handle_OP_ROUND(void) { return unary_intrinsic(OP_ROUND); }
+
+static interpret_result_t handle_OP_EXP(void) { return unary_intrinsic(OP_EXP); }
+
+static interpret_result_t handle_OP_LOG(void) { return unary_intrinsic(OP_LOG); }
+
+static interpret_result_t handle_OP_SIN(void) { return unary_intrinsic(OP_SIN); }
+
+static interpret_result_t handle_OP_COS(void) { return unary_intrinsic(OP_COS); }
+
+static interpret_result_t handle_OP_TAN(void) { return unary_intrinsic(OP_TAN); }
+
+static interpret_result_t handle_OP_ASIN(void) { return unary_intrinsic(OP_ASIN); }
+
+static interpret_result_t handle_OP_ACOS(void) { return unary_intrinsic(OP_ACOS); }
+
+static interpret_result_t handle_OP_ATAN(void) { return unary_intrinsic(OP_ATAN); }
+
+static interpret_result_t handle_OP_MIN(void) { return binary_intrinsic(OP_MIN); }
+
+static interpret_result_t handle_OP_MAX(void) { return binary_intrinsic(OP_MAX); }
+
+static interpret_result_t handle_OP_POW(void) { return binary_intrinsic(OP_POW); }
+
+static interpret_result_t handle_OP_ATAN2(void) { return binary_intrinsic(OP_ATAN2); }
+
+// Reads the 16-bit operand of a wide jump.
+static inline uint16_t read_wide(void)
+{
+	vm.ip += 2;
+	return (uint16_t)((vm.ip[-2] << 8) | vm.ip[-1]);
 }
 
-static bool extract_binary_operands(double *a, double *b)
+static interpret_result_t handle_OP_JUMP(void)
 {
-	if (!is_number(peek(0)) || !is_number(peek(1)))
+	uint16_t distance = read_wide();
+	vm.ip += distance;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_JUMP_SHORT(void)
+{
+	uint8_t distance = *vm.ip++;
+	vm.ip += distance;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_LOOP(void)
+{
+	uint16_t distance = read_wide();
+	vm.ip -= distance;
+	return INTERPRET_OK;
+}
+
+static interpret_result_t handle_OP_LOOP_SHORT(void)
+{
+	uint8_t distance = *vm.ip++;
+	vm.ip -= distance;
+	return INTERPRET_OK;
+}
+
+static inline __attribute__((always_inline)) interpret_result_t branch_if_false(int distance)
+{
+	if (is_falsey(pop()))
+		vm.ip += distance;
+	return INTERPRET_OK;
+}
+
+static inline __attribute__((always_inline)) interpret_result_t branch_if_true(int distance)
+{
+	if (!is_falsey(pop()))
+		vm.ip += distance;
+	return INTERPRET_OK;
+}
+
+// Body of the `and`/`or` jumps: jumping keeps the operand as the result.
+static inline __attribute__((always_inline)) interpret_result_t branch_or_pop(bool jump_when, int distance)
+{
+	if (!is_falsey(vm.stack_top[-1]) == jump_when)
+		vm.ip += distance;
+	else
+		vm.stack_top--;
+	return INTERPRET_OK;
+}
+
+/**
+ * branch_on_order - Body of the fused ordering compare-and-branch opcodes.
+ * @greater: Compare with > rather than <.
+ * @jump_when: The comparison result on which to jump.
+ * @distance: Forward jump distance.
+ *
+ * Pops both operands, so a loop test costs one dispatch instead of a
+ * comparison, a jump and the pop of the boolean between them.
+ *
+ * Return: INTERPRET_OK, or a runtime error for non-numeric operands.
+ */
+static inline __attribute__((always_inline)) interpret_result_t branch_on_order(bool greater, bool jump_when,
+										int distance)
+{
+	value_t b = pop();
+	value_t a = pop();
+
+	if (!is_number(a) || !is_number(b))
 	{
-		runtime_error("Operands must be numbers.");
-		return false;
+		interpret_result_t status = order_operands(&a, &b);
+		if (status != INTERPRET_OK)
+			return status;
 	}
+	bool result = greater ? as_number(a) > as_number(b) : as_number(a) < as_number(b);
+	if (result == jump_when)
+		vm.ip += distance;
+	return INTERPRET_OK;
+}
 
-	*b = (vm.stack_top - 1)->as.number;
-	*a = (vm.stack_top - 2)->as.number;
-	return true;
+// Body of the fused equality compare-and-branch opcodes.
+static inline __attribute__((always_inline)) interpret_result_t branch_on_equal(bool jump_when, int distance)
+{
+	value_t b = pop();
+	value_t a = pop();
+	if (values_equal(a, b) == jump_when)
+		vm.ip += distance;
+	return INTERPRET_OK;
 }
 
-static bool is_falsey(value_t value)
+static interpret_result_t handle_OP_JUMP_IF_FALSE(void) { return branch_if_false(read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_FALSE_SHORT(void) { return branch_if_false(*vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_TRUE(void) { return branch_if_true(read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_TRUE_SHORT(void) { return branch_if_true(*vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_FALSE_OR_POP(void) { return branch_or_pop(false, read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_FALSE_OR_POP_SHORT(void) { return branch_or_pop(false, *vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_TRUE_OR_POP(void) { return branch_or_pop(true, read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_TRUE_OR_POP_SHORT(void) { return branch_or_pop(true, *vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_LESS(void) { return branch_on_order(false, true, read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_LESS_SHORT(void) { return branch_on_order(false, true, *vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_NOT_LESS(void) { return branch_on_order(false, false, read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_NOT_LESS_SHORT(void) { return branch_on_order(false, false, *vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_GREATER(void) { return branch_on_order(true, true, read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_GREATER_SHORT(void) { return branch_on_order(true, true, *vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_NOT_GREATER(void) { return branch_on_order(true, false, read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_NOT_GREATER_SHORT(void) { return branch_on_order(true, false, *vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_EQUAL(void) { return branch_on_equal(true, read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_EQUAL_SHORT(void) { return branch_on_equal(true, *vm.ip++); }
+
+static interpret_result_t handle_OP_JUMP_IF_NOT_EQUAL(void) { return branch_on_equal(false, read_wide()); }
+
+static interpret_result_t handle_OP_JUMP_IF_NOT_EQUAL_SHORT(void) { return branch_on_equal(false, *vm.ip++); }
+
+/**
+ * call_function - Starts running a function.
+ * @function: The function.
+ * @argc: Number of arguments on top of the stack.
+ * @tail: Whether the call replaces the running function's own frame.
+ *
+ * The callee's slot and the arguments above it become the function's
+ * first locals where they are: slot 0 holds the function itself, or the
+ * receiver of a method. A tail call slides them down over the caller's,
+ * so a chain of tail calls runs in constant space.
+ *
+ * A function whose body the compiler deferred is compiled on its first
+ * call, before anything on the stack is addressed, as compiling may move it.
+ *
+ * Return: INTERPRET_OK, or a runtime error if @function does not take
+ * @argc arguments, does not compile or the frames run out.
+ */
+static inline __attribute__((always_inline)) interpret_result_t call_function(obj_function_t *function, int argc,
+									      bool tail)
 {
-	return (is_null(value) || (is_bool(value) && !as_bool(value)));
+	if (__builtin_expect(function->source != NULL, 0) && !compile_function(function))
+		return runtime_error("Can't compile %.*s().", string_length(&function->name),
+				     string_chars(&function->name));
+	if (argc != function->arity)
+		return runtime_error("Expected %d arguments but got %d.", function->arity, argc);
+
+	call_frame_t *frame;
+	bool nested = !tail || vm.frame_count == 1;
+	if (!nested)
+	{
+		frame = &vm.frames[vm.frame_count - 1];
+		memmove(vm.stack + frame->base, vm.stack_top - argc - 1, sizeof(value_t) * (argc + 1));
+		vm.stack_top = vm.stack + frame->base + argc + 1;
+	}
+	else
+	{
+		if (vm.frame_count == vm.frame_capacity && !grow_frames())
+			return runtime_error("Stack overflow.");
+		vm.frames[vm.frame_count - 1].ip = vm.ip;
+		frame = &vm.frames[vm.frame_count];
+		frame->base = (int)(vm.stack_top - vm.stack) - argc - 1;
+	}
+	frame->function = function;
+	frame->chunk = function->chunk;
+	// The sampler walks vm.frames[0..frame_count), so count a frame only once it is filled in.
+	atomic_signal_fence(memory_order_release);
+	if (nested)
+		vm.frame_count++;
+	vm.chunk = function->chunk;
+	vm.ip = function->chunk->code;
+	vm.slots = vm.stack + frame->base;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_CONSTANT(void)
+/**
+ * call_value - Calls the value below a call's arguments.
+ * @argc: Number of arguments on top of the stack.
+ * @tail: Whether the call is in tail position.
+ *
+ * Calling a class makes an instance, which takes the class's place in the
+ * callee's slot and is what the call leaves behind; the class's
+ * initializer, if it has one, then runs on it with the arguments.
+ *
+ * Return: INTERPRET_OK or a runtime error.
+ */
+static inline __attribute__((always_inline)) interpret_result_t call_value(int argc, bool tail)
 {
-	push(vm.chunk->constants.values[*vm.ip++]);
+	value_t *callee = vm.stack_top - argc - 1;
+	if (is_function(*callee))
+		return call_function(as_function(*callee), argc, tail);
+	if (is_bound_method(*callee))
+	{
+		obj_bound_method_t *bound = as_bound_method(*callee);
+		*callee = bound->receiver;
+		return call_function(as_function(bound->method), argc, tail);
+	}
+	if (!is_class(*callee))
+		return runtime_error("Can only call functions and classes.");
+
+	obj_class_t *klass = as_class(*callee);
+	value_t instance = new_instance(callee);
+	vm.stack_top[-argc - 1] = instance;
+	if (!is_null(klass->initializer))
+		return call_function(as_function(klass->initializer), argc, tail);
+	if (argc != 0)
+		return runtime_error("Expected 0 arguments but got %d.", argc);
+	return INTERPRET_OK;
 }
 
-static void handle_OP_NULL(void)
+static interpret_result_t handle_OP_CALL(void) { return call_value(*vm.ip++, false); }
+
+static interpret_result_t handle_OP_TAIL_CALL(void) { return call_value(*vm.ip++, true); }
+
+// Returns from a function, replacing its slots with its result; the
+// dispatch loop itself handles the script's final return.
+static interpret_result_t handle_OP_RETURN(void)
 {
-	push(null_val());
+	value_t result = pop();
+	call_frame_t *frame = &vm.frames[--vm.frame_count];
+	vm.stack_top = vm.stack + frame->base;
+	push(result);
+
+	frame--;
+	vm.chunk = frame->chunk;
+	vm.ip = frame->ip;
+	vm.slots = vm.stack + frame->base;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_TRUE(void)
+/**
+ * resolve_property - Looks a name up on an instance after a cache miss.
+ * @cache: The cache of the instruction, which learns the result.
+ * @instance: The instance.
+ * @name: The name, a string value.
+ *
+ * Fields shadow methods.
+ *
+ * Return: The new cache entry, or NULL if the instance has neither.
+ */
+static const cache_entry_t *resolve_property(inline_cache_t *cache, const obj_instance_t *instance, value_t name)
 {
-	push(bool_val(true));
+	int offset = shape_find(instance->shape, name);
+	if (offset >= 0)
+		return cache_store(cache, (cache_entry_t){instance->shape, instance->shape, offset, NULL});
+	value_t method;
+	if (!class_find_method(as_class(instance->klass), name, &method))
+		return NULL;
+	return cache_store(cache, (cache_entry_t){instance->shape, instance->shape, -1, as_function(method)});
 }
 
-static void handle_OP_FALSE(void)
+// Reports a property an instance does not have.
+static interpret_result_t undefined_property(value_t name)
 {
-	push(bool_val(false));
+	return runtime_error("Undefined property '%.*s'.", string_length(&name), string_chars(&name));
+}
+
+// Reads a field, or binds a method to its receiver.
+static interpret_result_t handle_OP_GET_PROPERTY(void)
+{
+	value_t name = vm.chunk->constants.values[*vm.ip++];
+	inline_cache_t *cache = &vm.chunk->caches[read_wide()];
+	if (!is_instance(peek(0)))
+		return runtime_error("Only instances have properties.");
+
+	obj_instance_t *instance = as_instance(peek(0));
+	const cache_entry_t *entry = cache_find(cache, instance->shape);
+	if (entry == NULL && (entry = resolve_property(cache, instance, name)) == NULL)
+		return undefined_property(name);
+	if (entry->offset >= 0)
+	{
+		vm.stack_top[-1] = instance_fields(instance)[entry->offset];
+		return INTERPRET_OK;
+	}
+	push(obj_val(&entry->method->obj));
+	value_t bound = new_bound_method(&vm.stack_top[-2], &vm.stack_top[-1]);
+	vm.stack_top--;
+	vm.stack_top[-1] = bound;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_NOT(void)
+// Stores into a field, adding it if the instance does not have it yet.
+static interpret_result_t handle_OP_SET_PROPERTY(void)
 {
+	value_t name = vm.chunk->constants.values[*vm.ip++];
+	inline_cache_t *cache = &vm.chunk->caches[read_wide()];
+	if (!is_instance(peek(1)))
+		return runtime_error("Only instances have fields.");
+
+	obj_instance_t *instance = as_instance(peek(1));
+	const cache_entry_t *entry = cache_find(cache, instance->shape);
+	if (entry == NULL)
+	{
+		int offset = shape_find(instance->shape, name);
+		if (offset >= 0)
+			entry = cache_store(cache, (cache_entry_t){instance->shape, instance->shape, offset, NULL});
+		else if (instance->shape->count == SHAPE_FIELDS_MAX)
+			return runtime_error("Too many fields.");
+		else
+		{
+			shape_t *next = shape_add_field(instance->shape, name);
+			entry = cache_store(cache, (cache_entry_t){instance->shape, next, next->count - 1, NULL});
+		}
+	}
+	if (entry->next == entry->shape)
+	{
+		instance_fields(instance)[entry->offset] = peek(0);
+		write_barrier(&instance->obj, peek(0));
+	}
+	else
+	{
+		instance_add_field(&vm.stack_top[-2], entry->next, &vm.stack_top[-1]);
+	}
 	value_t value = pop();
-	push(bool_val(is_falsey(value)));
+	vm.stack_top[-1] = value;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_EQUAL(void) {
-    value_t b = pop();
-    value_t a = pop();
+// Calls a method, or a function stored in a field, without binding it.
+static interpret_result_t handle_OP_INVOKE(void)
+{
+	value_t name = vm.chunk->constants.values[*vm.ip++];
+	int argc = *vm.ip++;
+	inline_cache_t *cache = &vm.chunk->caches[read_wide()];
+	if (!is_instance(peek(argc)))
+		return runtime_error("Only instances have methods.");
 
-    if (is_bool(a)) a = number_val(as_bool(a) ? 1 : 0);
-    if (is_bool(b)) b = number_val(as_bool(b) ? 1 : 0);
+	obj_instance_t *instance = as_instance(peek(argc));
+	const cache_entry_t *entry = cache_find(cache, instance->shape);
+	if (entry == NULL && (entry = resolve_property(cache, instance, name)) == NULL)
+		return undefined_property(name);
+	if (entry->offset < 0)
+		return call_function(entry->method, argc, false);
+	vm.stack_top[-argc - 1] = instance_fields(instance)[entry->offset];
+	return call_value(argc, false);
+}
+
+// Calls a superclass method, which the compiler has already looked up.
+static interpret_result_t handle_OP_SUPER_INVOKE(void)
+{
+	obj_function_t *method = as_function(vm.chunk->constants.values[vm.ip[0]]);
+	int argc = vm.ip[1];
+	vm.ip += 2;
+	return call_function(method, argc, false);
+}
 
-    if (a.type != b.type) {
-        push(bool_val(false));
-        return;
-    }
+/**
+ * call_callback - Calls a value from a builtin and waits for its result.
+ * @argc: Number of arguments on top of the stack, above the callee.
+ *
+ * The callee runs in a nested dispatch loop that returns once its frame
+ * does, so the builtin carries on where it left off.
+ *
+ * Return: INTERPRET_OK with the result in place of the callee and its
+ * arguments, or a runtime error.
+ */
+static interpret_result_t call_callback(int argc)
+{
+	int frames = vm.frame_count;
+	interpret_result_t status = call_value(argc, false);
+	if (status != INTERPRET_OK || vm.frame_count == frames)
+		return status; // A class without an initializer makes no frame.
 
-    bool result = false;
-    switch (a.type) {
-        case VAL_NULL:
-            result = true;
-            break;
-        case VAL_NUMBER:
-            result = as_number(a) == as_number(b);
-            break;
-        default:
-            result = false;
-            break;
-    }
+	int base_frames = vm.base_frames;
+	vm.base_frames = vm.frame_count;
+	status = run();
+	vm.base_frames = base_frames;
+	if (status != INTERPRET_OK)
+		return status;
 
-    push(bool_val(result));
+	call_frame_t *frame = &vm.frames[--vm.frame_count];
+	vm.stack_top = vm.stack + frame->base;
+	push(vm.result);
+	frame--;
+	vm.chunk = frame->chunk;
+	vm.ip = frame->ip;
+	vm.slots = vm.stack + frame->base;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_GREATER(void) {
-    value_t b = pop();
-    value_t a = pop();
+/**
+ * call_on_worker - Calls a function on a pool worker's context.
+ * @function: The function, which passed parallel_safe().
+ * @argc: Number of arguments.
+ * @args: The arguments.
+ *
+ * A runtime error or an allocation abandons the worker instead.
+ *
+ * Return: The function's result.
+ */
+static value_t call_on_worker(obj_function_t *function, int argc, const value_t *args)
+{
+	vm.stack_top = vm.stack;
+	vm.frame_count = 1;
+	push(obj_val(&function->obj));
+	for (int i = 0; i < argc; i++)
+		push(args[i]);
+	if (call_function(function, argc, false) != INTERPRET_OK || run() != INTERPRET_OK)
+		abandon_worker();
+	return (vm.result);
+}
+
+/**
+ * struct array_job_s - A builtin's callback applied to an array on the pool.
+ * @opcode: The builtin: OP_ARRAY_MAP, OP_ARRAY_FILTER or OP_ARRAY_REDUCE.
+ * @function: The callback, which passed parallel_safe().
+ * @array: The array or mapped array.
+ * @results: The callback's result per element for map and filter, and
+ *           each block's reduction for reduce.
+ * @owner: The context of the thread running the builtin, whose globals
+ *         and strings the workers read.
+ * @failed: Set by a worker that gave up.
+ */
+typedef struct array_job_s
+{
+	uint8_t opcode;
+	obj_function_t *function;
+	value_t array;
+	value_t *results;
+	const vm_t *owner;
+	atomic_bool failed;
+} array_job_t;
 
-    if (is_bool(a)) a = number_val(as_bool(a) ? 1 : 0);
-    if (is_bool(b)) b = number_val(as_bool(b) ? 1 : 0);
+/**
+ * array_task - Applies a callback to one block of an array on a worker.
+ * @context: The array_job_t.
+ * @block: The block.
+ *
+ * A block is reduced from its first element onwards.
+ */
+static void array_task(void *context, int block)
+{
+	array_job_t *job = context;
+	jmp_buf bail;
+	if (atomic_load(&job->failed) || setjmp(bail) != 0)
+	{
+		atomic_store(&job->failed, true);
+		vm.bail = NULL;
+		return;
+	}
+	vm.bail = &bail;
+	vm.globals = job->owner->globals;
+	vm.strings = job->owner->strings;
+	vm.inputs = job->owner->inputs;
+	vm.input_count = job->owner->input_count;
 
-    if (a.type != b.type) {
-        runtime_error("Operands must be of the same type.");
-        exit(EXIT_FAILURE);
-    }
+	int start = block * PARALLEL_BLOCK;
+	int count = element_count(job->array);
+	int end = start + PARALLEL_BLOCK < count ? start + PARALLEL_BLOCK : count;
+	value_t args[2];
+	if (job->opcode == OP_ARRAY_REDUCE)
+	{
+		args[0] = element_at(job->array, start);
+		for (int i = start + 1; i < end; i++)
+		{
+			args[1] = element_at(job->array, i);
+			args[0] = call_on_worker(job->function, 2, args);
+		}
+		job->results[block] = args[0];
+	}
+	else
+	{
+		for (int i = start; i < end; i++)
+		{
+			args[0] = element_at(job->array, i);
+			job->results[i] = call_on_worker(job->function, 1, args);
+		}
+	}
+	vm.bail = NULL;
+}
 
-    bool result = false;
-    switch (a.type) {
-        case VAL_NUMBER:
-            result = as_number(a) > as_number(b);
-            break;
-        default:
-            runtime_error("Operands must be numbers.");
-            exit(EXIT_FAILURE);
-    }
+/**
+ * apply_on_pool - Runs a builtin's callback over an array on the pool.
+ * @opcode: The builtin.
+ * @array: The array or mapped array, in a stack slot.
+ * @callback: The callback.
+ * @arity: Number of arguments the builtin passes it.
+ *
+ * Nothing is allocated while the workers run, so nothing moves.
+ *
+ * Return: The results, to be freed by the caller, or NULL if the builtin
+ * has to run on this thread: the array is short, there is a single
+ * thread, the callback may have side effects, or it failed or allocated
+ * on a worker. The results are the same either way.
+ */
+static value_t *apply_on_pool(uint8_t opcode, value_t array, value_t callback, int arity)
+{
+	int count = element_count(array);
+	if (count < PARALLEL_MIN || parallel_threads() < 2 || !is_function(callback))
+		return (NULL);
+	obj_function_t *function = as_function(callback);
+	if (function->arity != arity || !parallel_safe(function->chunk))
+		return (NULL);
 
-    push(bool_val(result));
+	int blocks = (count + PARALLEL_BLOCK - 1) / PARALLEL_BLOCK;
+	value_t *results = malloc(sizeof(value_t) * (opcode == OP_ARRAY_REDUCE ? blocks : count));
+	if (results == NULL)
+		exit(1);
+	array_job_t job = {opcode, function, array, results, &vm, false};
+	run_parallel(blocks, array_task, &job);
+	if (atomic_load(&job.failed))
+	{
+		free(results);
+		return (NULL);
+	}
+	return (results);
 }
 
-static void handle_OP_LESS(void) {
-    value_t b = pop();
-    value_t a = pop();
+/**
+ * callback_arguments - Checks the array and callback of a builtin.
+ * @name: The builtin, for error messages.
+ * @argc: Number of its arguments; the array is the first, the callback
+ *        the second.
+ *
+ * A callback whose body was deferred is compiled here, so that it can run
+ * on the pool.
+ *
+ * Return: INTERPRET_OK, or a runtime error.
+ */
+static interpret_result_t callback_arguments(const char *name, int argc)
+{
+	value_t callback = peek(argc - 2);
+	if (!is_sequence(peek(argc - 1)))
+		return runtime_error("%s() needs an array.", name);
+	if (!is_function(callback) && !is_bound_method(callback) && !is_class(callback))
+		return runtime_error("%s() needs a function.", name);
+	if (is_function(callback) && as_function(callback)->source != NULL &&
+	    !compile_function(as_function(callback)))
+		return runtime_error("Can't compile %.*s().", string_length(&as_function(callback)->name),
+				     string_chars(&as_function(callback)->name));
+	return INTERPRET_OK;
+}
 
-    if (is_bool(a)) a = number_val(as_bool(a) ? 1 : 0);
-    if (is_bool(b)) b = number_val(as_bool(b) ? 1 : 0);
+static interpret_result_t handle_OP_ARRAY_MAP(void)
+{
+	interpret_result_t status = callback_arguments("map", 2);
+	if (status != INTERPRET_OK)
+		return status;
+	int count = element_count(peek(1));
+	if (count > ARRAY_MAX)
+		return runtime_error("Array too large.");
+	value_t *results = apply_on_pool(OP_ARRAY_MAP, peek(1), peek(0), 1);
+	if (results != NULL)
+	{
+		bool packed = true;
+		for (int i = 0; i < count; i++)
+			packed = packed && is_number(results[i]);
+		gc_add_roots(results, count);
+		value_t array = new_array(count, packed);
+		for (int i = 0; i < count; i++)
+			array_set(&array, i, &results[i]);
+		gc_remove_roots(results);
+		free(results);
+		vm.stack_top[-2] = array;
+		vm.stack_top--;
+		return INTERPRET_OK;
+	}
 
-    if (a.type != b.type) {
-        runtime_error("Operands must be of the same type.");
-        exit(EXIT_FAILURE);
-    }
+	push(new_array(count, true));
+	for (int i = 0; i < count; i++)
+	{
+		push(peek(1));
+		push(element_at(peek(3), i));
+		status = call_callback(1);
+		if (status != INTERPRET_OK)
+			return status;
+		array_set(vm.stack_top - 2, i, vm.stack_top - 1);
+		vm.stack_top--;
+	}
+	vm.stack_top[-3] = vm.stack_top[-1];
+	vm.stack_top -= 2;
+	return INTERPRET_OK;
+}
 
-    bool result = false;
-    switch (a.type) {
-        case VAL_NUMBER:
-            result = as_number(a) < as_number(b);
-            break;
-        default:
-            runtime_error("Operands must be numbers.");
-            exit(EXIT_FAILURE);
-    }
+static interpret_result_t handle_OP_ARRAY_FILTER(void)
+{
+	interpret_result_t status = callback_arguments("filter", 2);
+	if (status != INTERPRET_OK)
+		return status;
+	int count = element_count(peek(1));
+	if (count > ARRAY_MAX)
+		return runtime_error("Array too large.");
+	bool packed = is_mapped(peek(1)) || as_array(peek(1))->packed;
+	value_t *results = apply_on_pool(OP_ARRAY_FILTER, peek(1), peek(0), 1);
+	if (results != NULL)
+	{
+		int kept = 0;
+		for (int i = 0; i < count; i++)
+			kept += !is_falsey(results[i]);
+		value_t array = new_array(kept, packed);
+		for (int i = 0, k = 0; i < count; i++)
+		{
+			value_t element = element_at(peek(1), i);
+			if (!is_falsey(results[i]))
+				array_set(&array, k++, &element);
+		}
+		free(results);
+		vm.stack_top[-2] = array;
+		vm.stack_top--;
+		return INTERPRET_OK;
+	}
 
-    push(bool_val(result));
+	push(new_array(0, packed));
+	for (int i = 0; i < count; i++)
+	{
+		push(peek(1));
+		push(element_at(peek(3), i));
+		status = call_callback(1);
+		if (status != INTERPRET_OK)
+			return status;
+		if (!is_falsey(peek(0)))
+		{
+			vm.stack_top[-1] = element_at(peek(3), i);
+			array_push(vm.stack_top - 2, vm.stack_top - 1);
+		}
+		vm.stack_top--;
+	}
+	vm.stack_top[-3] = vm.stack_top[-1];
+	vm.stack_top -= 2;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_NEGATE(void)
+/**
+ * fold_elements - Folds elements of reduce()'s array into an accumulator.
+ * @base: Index in vm.stack of the array, which the callback follows; the
+ *        accumulator is on top of the stack.
+ * @start: The first element.
+ * @end: Past the last element.
+ *
+ * Return: INTERPRET_OK, or a runtime error.
+ */
+static interpret_result_t fold_elements(int base, int start, int end)
 {
-	if (!is_number(peek(0)))
+	for (int i = start; i < end; i++)
 	{
-		runtime_error("Operand must be a number.");
-		exit(EXIT_FAILURE);
+		push(vm.stack[base + 1]);
+		push(peek(1));
+		push(element_at(vm.stack[base], i));
+		interpret_result_t status = call_callback(2);
+		if (status != INTERPRET_OK)
+			return status;
+		vm.stack_top[-2] = vm.stack_top[-1];
+		vm.stack_top--;
 	}
-	(vm.stack_top - 1)->as.number = -(vm.stack_top - 1)->as.number;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_ADD(void)
+// Folds an array with reduce(array, fn, initial). Up to PARALLEL_BLOCK
+// elements are folded into the initial value left to right. A longer array
+// is cut into blocks, each folded from its first element, and the blocks'
+// results are folded into the initial value in order. For an associative
+// function both agree; the grouping only depends on the length, so the
+// result does not depend on the number of threads.
+static interpret_result_t handle_OP_ARRAY_REDUCE(void)
 {
-	double a, b;
-	if (!extract_binary_operands(&a, &b))
-		exit(EXIT_FAILURE);
+	interpret_result_t status = callback_arguments("reduce", 3);
+	if (status != INTERPRET_OK)
+		return status;
+	int base = (int)(vm.stack_top - vm.stack) - 3;
+	int count = element_count(peek(2));
+	if (count <= PARALLEL_BLOCK)
+	{
+		status = fold_elements(base, 0, count);
+		if (status != INTERPRET_OK)
+			return status;
+		vm.stack_top[-3] = vm.stack_top[-1];
+		vm.stack_top -= 2;
+		return INTERPRET_OK;
+	}
 
-	(vm.stack_top - 2)->as.number = a + b;
-	vm.stack_top--;
+	int blocks = (count + PARALLEL_BLOCK - 1) / PARALLEL_BLOCK;
+	value_t *results = apply_on_pool(OP_ARRAY_REDUCE, peek(2), peek(1), 2);
+	if (results != NULL)
+		gc_add_roots(results, blocks);
+	for (int block = 0; block < blocks; block++)
+	{
+		int start = block * PARALLEL_BLOCK;
+		if (results != NULL)
+		{
+			push(results[block]);
+		}
+		else
+		{
+			push(element_at(vm.stack[base], start));
+			int end = start + PARALLEL_BLOCK < count ? start + PARALLEL_BLOCK : count;
+			status = fold_elements(base, start + 1, end);
+		}
+		if (status == INTERPRET_OK)
+		{
+			push(vm.stack[base + 1]);
+			push(peek(2));
+			push(peek(2));
+			status = call_callback(2);
+		}
+		if (status != INTERPRET_OK)
+			break;
+		vm.stack_top[-3] = vm.stack_top[-1];
+		vm.stack_top -= 2;
+	}
+	if (results != NULL)
+	{
+		gc_remove_roots(results);
+		free(results);
+	}
+	if (status != INTERPRET_OK)
+		return status;
+	vm.stack_top[-3] = vm.stack_top[-1];
+	vm.stack_top -= 2;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_SUBTRACT(void)
+// Orders strings by their bytes, for sort().
+static int compare_strings(const void *a, const void *b)
 {
-	double a, b;
-	if (!extract_binary_operands(&a, &b))
-		exit(EXIT_FAILURE);
-
-	(vm.stack_top - 2)->as.number = a - b;
-	vm.stack_top--;
+	int a_length = string_length(a), b_length = string_length(b);
+	int order = memcmp(string_chars(a), string_chars(b), a_length < b_length ? a_length : b_length);
+	return (order != 0 ? order : (a_length > b_length) - (a_length < b_length));
 }
 
-static void handle_OP_MULTIPLY(void)
+static interpret_result_t handle_OP_ARRAY_SORT(void)
 {
-	double a, b;
-	if (!extract_binary_operands(&a, &b))
-		exit(EXIT_FAILURE);
+	if (!is_sequence(peek(0)))
+		return runtime_error("sort() needs an array of numbers or of strings.");
+	int count = element_count(peek(0));
+	if (is_mapped(peek(0)))
+	{
+		if (count > ARRAY_MAX)
+			return runtime_error("Array too large.");
+		value_t sorted = new_array(count, true);
+		double *numbers = array_numbers(as_array(sorted));
+		const double *elements = mapped_numbers(as_mapped(peek(0)), 0, count, numbers);
+		if (elements != numbers)
+			memcpy(numbers, elements, sizeof(double) * count);
+		sort_numbers(numbers, count);
+		vm.stack_top[-1] = sorted;
+		return INTERPRET_OK;
+	}
+	if (array_pack(vm.stack_top - 1))
+	{
+		value_t sorted = new_array(count, true);
+		memcpy(array_numbers(as_array(sorted)), array_numbers(as_array(peek(0))), sizeof(double) * count);
+		sort_numbers(array_numbers(as_array(sorted)), count);
+		vm.stack_top[-1] = sorted;
+		return INTERPRET_OK;
+	}
 
-	(vm.stack_top - 2)->as.number = a * b;
-	vm.stack_top--;
+	for (int i = 0; i < count; i++)
+		if (!is_string(array_values(as_array(peek(0)))[i]))
+			return runtime_error("sort() needs an array of numbers or of strings.");
+	value_t sorted = new_array(count, false);
+	memcpy(array_values(as_array(sorted)), array_values(as_array(peek(0))), sizeof(value_t) * count);
+	qsort(array_values(as_array(sorted)), count, sizeof(value_t), compare_strings);
+	vm.stack_top[-1] = sorted;
+	return INTERPRET_OK;
 }
 
-static void handle_OP_DIVIDE(void)
+static interpret_result_t handle_OP_MMAP(void)
 {
-	double a, b;
-	if (!extract_binary_operands(&a, &b))
-		exit(EXIT_FAILURE);
+	value_t path = peek(1);
+	int length = is_string(path) ? string_length(&path) : 0;
+	if (length == 0 || memchr(string_chars(&path), '\0', length) != NULL)
+		return runtime_error("mmap() needs a path.");
 
-	(vm.stack_top - 2)->as.number = a / b;
+	char *file = malloc(length + 1);
+	if (file == NULL)
+		exit(1);
+	memcpy(file, string_chars(&path), length);
+	file[length] = '\0';
+	value_t mapped;
+	const char *why = open_mapped(file, peek(0), &mapped);
+	interpret_result_t status = INTERPRET_OK;
+	if (why != NULL)
+		status = runtime_error("Can't map '%s': %s.", file, why);
+	free(file);
+	if (status != INTERPRET_OK)
+		return status;
+	vm.stack_top[-2] = mapped;
 	vm.stack_top--;
+	return INTERPRET_OK;
 }
 
-static interpret_result_t handle_OP_RETURN(void)
+// Returns the length of each dimension of an array; a plain array has one.
+static interpret_result_t handle_OP_SHAPE(void)
 {
-	print_value(pop());
-	printf("\n");
+	if (!is_sequence(peek(0)))
+		return runtime_error("shape() needs an array.");
+	int rank = is_mapped(peek(0)) ? as_mapped(peek(0))->rank : 1;
+	value_t shape = new_array(rank, true);
+	double *lengths = array_numbers(as_array(shape));
+	for (int i = 0; i < rank; i++)
+		lengths[i] = is_mapped(peek(0)) ? as_mapped(peek(0))->shape[i] : as_array(peek(0))->count;
+	vm.stack_top[-1] = shape;
 	return INTERPRET_OK;
 }
 
 // Jump table for opcode handlers
 static instruction_handler_t jump_table[] = {
 	[OP_CONSTANT] = handle_OP_CONSTANT,
+	[OP_INPUT] = handle_OP_INPUT,
+	[OP_POP] = handle_OP_POP,
+	[OP_POPN] = handle_OP_POPN,
+	[OP_GET_LOCAL] = handle_OP_GET_LOCAL,
+	[OP_SET_LOCAL] = handle_OP_SET_LOCAL,
+	[OP_GET_GLOBAL] = handle_OP_GET_GLOBAL,
+	[OP_SET_GLOBAL] = handle_OP_SET_GLOBAL,
+	[OP_DEFINE_GLOBAL] = handle_OP_DEFINE_GLOBAL,
 	[OP_NULL] = handle_OP_NULL,
 	[OP_TRUE] = handle_OP_TRUE,
 	[OP_FALSE] = handle_OP_FALSE,
 	[OP_NOT] = handle_OP_NOT,
 	[OP_EQUAL] = handle_OP_EQUAL,
 	[OP_GREATER] = handle_OP_GREATER,
-    [OP_LESS] = handle_OP_LESS,
+	[OP_LESS] = handle_OP_LESS,
 	[OP_NEGATE] = handle_OP_NEGATE,
 	[OP_ADD] = handle_OP_ADD,
 	[OP_SUBTRACT] = handle_OP_SUBTRACT,
 	[OP_MULTIPLY] = handle_OP_MULTIPLY,
 	[OP_DIVIDE] = handle_OP_DIVIDE,
-	[OP_RETURN] = (instruction_handler_t)handle_OP_RETURN,
+	[OP_RETURN] = handle_OP_RETURN,
+	[OP_CALL] = handle_OP_CALL,
+	[OP_TAIL_CALL] = handle_OP_TAIL_CALL,
+	[OP_GET_PROPERTY] = handle_OP_GET_PROPERTY,
+	[OP_SET_PROPERTY] = handle_OP_SET_PROPERTY,
+	[OP_INVOKE] = handle_OP_INVOKE,
+	[OP_SUPER_INVOKE] = handle_OP_SUPER_INVOKE,
+	[OP_ARRAY] = handle_OP_ARRAY,
+	[OP_GET_INDEX] = handle_OP_GET_INDEX,
+	[OP_SET_INDEX] = handle_OP_SET_INDEX,
+	[OP_LEN] = handle_OP_LEN,
+	[OP_SUM] = handle_OP_SUM,
+	[OP_ARRAY_MIN] = handle_OP_ARRAY_MIN,
+	[OP_ARRAY_MAX] = handle_OP_ARRAY_MAX,
+	[OP_DOT] = handle_OP_DOT,
+	[OP_PUSH] = handle_OP_PUSH,
+	[OP_RANGE] = handle_OP_RANGE,
+	[OP_FILL] = handle_OP_FILL,
+	[OP_MAP] = handle_OP_MAP,
+	[OP_MAP_HAS] = handle_OP_MAP_HAS,
+	[OP_MAP_DELETE] = handle_OP_MAP_DELETE,
+	[OP_MAP_KEYS] = handle_OP_MAP_KEYS,
+	[OP_ARRAY_MAP] = handle_OP_ARRAY_MAP,
+	[OP_ARRAY_FILTER] = handle_OP_ARRAY_FILTER,
+	[OP_ARRAY_REDUCE] = handle_OP_ARRAY_REDUCE,
+	[OP_ARRAY_SORT] = handle_OP_ARRAY_SORT,
+	[OP_MMAP] = handle_OP_MMAP,
+	[OP_SHAPE] = handle_OP_SHAPE,
+	[OP_SQRT] = handle_OP_SQRT,
+	[OP_ABS] = handle_OP_ABS,
+	[OP_FLOOR] = handle_OP_FLOOR,
+	[OP_CEIL] = handle_OP_CEIL,
+	[OP_ROUND] = handle_OP_ROUND,
+	[OP_EXP] = handle_OP_EXP,
+	[OP_LOG] = handle_OP_LOG,
+	[OP_SIN] = handle_OP_SIN,
+	[OP_COS] = handle_OP_COS,
+	[OP_TAN] = handle_OP_TAN,
+	[OP_ASIN] = handle_OP_ASIN,
+	[OP_ACOS] = handle_OP_ACOS,
+	[OP_ATAN] = handle_OP_ATAN,
+	[OP_MIN] = handle_OP_MIN,
+	[OP_MAX] = handle_OP_MAX,
+	[OP_POW] = handle_OP_POW,
+	[OP_ATAN2] = handle_OP_ATAN2,
+	[OP_JUMP] = handle_OP_JUMP,
+	[OP_JUMP_SHORT] = handle_OP_JUMP_SHORT,
+	[OP_JUMP_IF_FALSE] = handle_OP_JUMP_IF_FALSE,
+	[OP_JUMP_IF_FALSE_SHORT] = handle_OP_JUMP_IF_FALSE_SHORT,
+	[OP_JUMP_IF_LESS] = handle_OP_JUMP_IF_LESS,
+	[OP_JUMP_IF_LESS_SHORT] = handle_OP_JUMP_IF_LESS_SHORT,
+	[OP_JUMP_IF_NOT_LESS] = handle_OP_JUMP_IF_NOT_LESS,
+	[OP_JUMP_IF_NOT_LESS_SHORT] = handle_OP_JUMP_IF_NOT_LESS_SHORT,
+	[OP_JUMP_IF_GREATER] = handle_OP_JUMP_IF_GREATER,
+	[OP_JUMP_IF_GREATER_SHORT] = handle_OP_JUMP_IF_GREATER_SHORT,
+	[OP_JUMP_IF_NOT_GREATER] = handle_OP_JUMP_IF_NOT_GREATER,
+	[OP_JUMP_IF_NOT_GREATER_SHORT] = handle_OP_JUMP_IF_NOT_GREATER_SHORT,
+	[OP_JUMP_IF_EQUAL] = handle_OP_JUMP_IF_EQUAL,
+	[OP_JUMP_IF_EQUAL_SHORT] = handle_OP_JUMP_IF_EQUAL_SHORT,
+	[OP_JUMP_IF_NOT_EQUAL] = handle_OP_JUMP_IF_NOT_EQUAL,
+	[OP_JUMP_IF_NOT_EQUAL_SHORT] = handle_OP_JUMP_IF_NOT_EQUAL_SHORT,
+	[OP_JUMP_IF_TRUE] = handle_OP_JUMP_IF_TRUE,
+	[OP_JUMP_IF_TRUE_SHORT] = handle_OP_JUMP_IF_TRUE_SHORT,
+	[OP_JUMP_IF_FALSE_OR_POP] = handle_OP_JUMP_IF_FALSE_OR_POP,
+	[OP_JUMP_IF_FALSE_OR_POP_SHORT] = handle_OP_JUMP_IF_FALSE_OR_POP_SHORT,
+	[OP_JUMP_IF_TRUE_OR_POP] = handle_OP_JUMP_IF_TRUE_OR_POP,
+	[OP_JUMP_IF_TRUE_OR_POP_SHORT] = handle_OP_JUMP_IF_TRUE_OR_POP_SHORT,
+	[OP_LOOP] = handle_OP_LOOP,
+	[OP_LOOP_SHORT] = handle_OP_LOOP_SHORT,
 };
 
-static interpret_result_t run(void)
+/**
+ * run_loop - The dispatch loop, specialised at compile time on instrumentation.
+ * @traced: Whether to record every instruction into the trace ring.
+ * @profiled: Whether to count every instruction into the attached profile.
+ *
+ * Always inlined into run_untraced(), run_traced(), run_profiled() and
+ * run_traced_profiled() with constant arguments, so the plain instance
+ * carries no instrumentation.
+ *
+ * Return: The result of the interpretation.
+ */
+static inline __attribute__((always_inline)) interpret_result_t run_loop(bool traced, bool profiled)
 {
+	uint8_t previous = PROFILE_NO_OPCODE;
+
 	while (true)
 	{
-#ifdef DEBUG_TRACE_EXECUTION
-		printf("          ");
-		for (value_t *slot = vm.stack; slot < vm.stack_top; slot++)
+		if (traced)
+		{
+			trace_record(vm.trace_ring, vm.chunk, (uint32_t)(vm.ip - vm.chunk->code), *vm.ip,
+				     vm.stack, vm.stack_top);
+			if (vm.trace_dump_requested)
+			{
+				vm.trace_dump_requested = 0;
+				dump_trace(stderr);
+			}
+		}
+
+		if (profiled)
 		{
-			printf("[ ");
-			print_value(*slot);
-			printf(" ]");
+			if (vm.chunk != vm.profile->chunk || vm.frame_count != vm.profile->depth)
+				profile_enter(vm.profile, vm.frames, vm.frame_count);
+			profile_count(vm.profile, previous, *vm.ip, (size_t)(vm.ip - vm.chunk->code));
+			previous = *vm.ip;
 		}
-		printf("\n");
-		disassemble_instruction(vm.chunk, (int)(vm.ip - vm.chunk->code));
-#endif
 
 		uint8_t instruction = *vm.ip++;
 		instruction_handler_t handler = jump_table[instruction];
-		if (instruction == OP_RETURN)
+		if (instruction == OP_RETURN && vm.frame_count == vm.base_frames)
 		{
-			return handle_OP_RETURN();
+			vm.result = pop();
+			return INTERPRET_OK;
 		}
-		handler();
+		interpret_result_t result = handler();
+		if (result != INTERPRET_OK)
+			return result;
 	}
 }
 
+static interpret_result_t run_untraced(void) { return run_loop(false, false); }
+
+static interpret_result_t run_traced(void) { return run_loop(true, false); }
+
+static interpret_result_t run_profiled(void) { return run_loop(false, true); }
+
+static interpret_result_t run_traced_profiled(void) { return run_loop(true, true); }
+
+static interpret_result_t run(void)
+{
+	if (vm.profile != NULL && vm.profile->mode == PROFILE_COUNT)
+		return vm.trace ? run_traced_profiled() : run_profiled();
+	return vm.trace ? run_traced() : run_untraced();
+}
+
 void reset_stack(void)
 {
 	free(vm.stack);
 	vm.stack = NULL;
 	vm.stack_top = NULL;
 	vm.stack_capacity = 0;
+	free(vm.frames);
+	vm.frames = NULL;
+	vm.frame_capacity = 0;
+	vm.frame_count = 0;
 	grow_stack();
+	grow_frames();
 	vm.stack_top = vm.stack;
 	vm.ip = NULL;
 	vm.chunk = NULL;
@@ -290,6 +2016,7 @@ void reset_stack(void)
 static void grow_stack(void)
 {
 	size_t new_capacity = vm.stack_capacity == 0 ? 256 : vm.stack_capacity * 2;
+	size_t depth = vm.stack_top - vm.stack;
 	value_t *new_stack = realloc(vm.stack, new_capacity * sizeof(value_t));
 	if (!new_stack)
 	{
@@ -297,8 +2024,39 @@ static void grow_stack(void)
 		exit(INTERPRET_RUNTIME_ERROR);
 	}
 	vm.stack = new_stack;
-	vm.stack_top = vm.stack + (vm.stack_top - vm.stack);
+	vm.stack_top = vm.stack + depth;
 	vm.stack_capacity = new_capacity;
+	vm.slots = vm.stack + (vm.frame_count > 0 ? vm.frames[vm.frame_count - 1].base : 0);
+}
+
+/**
+ * grow_frames - Doubles the room for call frames, up to FRAMES_MAX.
+ *
+ * Frames are only ever reached through vm.frames and an index, never kept
+ * by address across a call, so they may move.
+ *
+ * Return: false if there are FRAMES_MAX frames already.
+ */
+static bool grow_frames(void)
+{
+	if (vm.frame_capacity == FRAMES_MAX)
+		return (false);
+	int new_capacity = vm.frame_capacity == 0 ? FRAMES_INITIAL : vm.frame_capacity * 2;
+	call_frame_t *old_frames = vm.frames;
+	call_frame_t *new_frames = malloc(new_capacity * sizeof(call_frame_t));
+	if (new_frames == NULL)
+	{
+		fprintf(stderr, "Error: Failed to grow call frames\n");
+		exit(INTERPRET_RUNTIME_ERROR);
+	}
+	if (vm.frame_count > 0)
+		memcpy(new_frames, old_frames, vm.frame_count * sizeof(call_frame_t));
+	// Move rather than realloc, so the sampler never walks freed frames.
+	vm.frames = new_frames;
+	atomic_signal_fence(memory_order_release);
+	free(old_frames);
+	vm.frame_capacity = new_capacity;
+	return (true);
 }
 
 void push(value_t value)
@@ -1,21 +1,100 @@
 #pragma once
 
+#include <setjmp.h>
+#include <signal.h>
 #include "common.h"
 #include "chunk.h"
 #include "compiler.h"
 #include "debug.h"
+#include "format.h"
+#include "function.h"
+#include "gc.h"
+#include "object.h"
+#include "profile.h"
+#include "table.h"
+#include "timings.h"
+#include "trace.h"
 #include "value.h"
 
 #define STACK_MAX 256
+#define FRAMES_MAX (1 << 14) // Deepest call nesting; tail calls do not nest.
+#define FRAMES_INITIAL 64    // Frames a context starts with; doubled as calls nest.
 
-typedef struct {
+/**
+ * struct call_frame_s - A function call in progress.
+ * @function: The function, or NULL for the script itself.
+ * @chunk: The code it runs.
+ * @ip: Where it resumes once the call it is making returns.
+ * @base: Index in vm.stack of its first local; a function's arguments are
+ *        its first locals, left where the caller pushed them, with the
+ *        function itself in the slot below.
+ *
+ * Description: Frames index into the shared value stack rather than point
+ * into it, since the stack is reallocated as it grows.
+ */
+typedef struct call_frame_s
+{
+	obj_function_t *function;
+	chunk_t *chunk;
+	uint8_t *ip;
+	int base;
+} call_frame_t;
+
+/**
+ * struct global_s - What the compiler knows about a global variable.
+ * @name: The variable's name, a string value.
+ * @is_const: Whether assignments to it are rejected.
+ * @is_folded: Whether its value was known at compile time, in which case
+ *             every use is compiled to that value instead of a load.
+ * @forward_line: Line of a call made before the global was declared, which
+ *                a later function declaration must resolve, or 0.
+ *
+ * Description: Globals live in vm.globals and are addressed by index;
+ * names are only consulted while compiling, never at run time.
+ */
+typedef struct global_s
+{
+	value_t name;
+	bool is_const;
+	bool is_folded;
+	int forward_line;
+} global_t;
+
+typedef struct vm_s {
     value_t *stack;
     value_t *stack_top;
     size_t stack_capacity;
     uint8_t *ip;
     chunk_t *chunk;
+    value_t *slots;
+    call_frame_t *frames; // Grown like the stack, so an idle context stays small.
+    int frame_capacity;
+    int frame_count;
+    int base_frames; // Frame count at which OP_RETURN leaves the dispatch loop.
+    value_t result;
+    const value_t *inputs;
+    int input_count;
+    jmp_buf *bail; // Where a worker goes when it has to give up, or NULL.
+
+    string_table_t strings;
+    value_array_t globals;
+    global_t *global_info;
+    int global_info_capacity;
+    bool eager;
+
+    number_format_t number_format;
+
+    bool trace;
+    trace_ring_t *trace_ring;
+    volatile sig_atomic_t trace_dump_requested;
+    profile_t *profile;
+    timings_t *timings;
 } vm_t;
 
+// Each thread has a context of its own; pool workers run builtins'
+// callbacks on theirs (see parallel.h).
+extern _Thread_local vm_t vm;
+
 
 typedef enum interpret_result_s
 {
@@ -24,15 +103,27 @@ typedef enum interpret_result_s
 	INTERPRET_RUNTIME_ERROR
 } interpret_result_t;
 
-typedef void (*instruction_handler_t)(void);
+typedef interpret_result_t (*instruction_handler_t)(void);
 
 void init_vm(void);
 void free_vm(void);
+void free_context(void);
+void set_trace(bool enabled);
+void dump_trace(FILE *out);
+void request_trace_dump(void);
+void set_profile(profile_t *profile);
+void set_timings(timings_t *timings);
+void init_worker(void);
+void free_worker(void);
+void abandon_worker(void) __attribute__((noreturn));
 
 
 interpret_result_t interpret(const char *source);
+interpret_result_t interpret_file(const char *source, const char *path);
+interpret_result_t interpret_chunk(chunk_t *chunk);
 static interpret_result_t run(void);
 void reset_stack(void);
 static void grow_stack(void);
+static bool grow_frames(void);
 void push(value_t value);
 value_t pop(void);
\ No newline at end of file